@@ -0,0 +1,39 @@
+using System;
+
+/*
+ * Register pressure in a hot loop: more live integer locals than there are
+ * callee saved registers on amd64, with a few long lived values which are
+ * only used outside the loop.
+ */
+class T {
+
+	static int Run (int n, int seed) {
+		int before = seed * 3;
+		int after = seed * 5;
+		int a = seed, b = seed + 1, c = seed + 2, d = seed + 3;
+		int e = seed + 4, f = seed + 5, g = seed + 6, h = seed + 7;
+
+		for (int i = 0; i < n; ++i) {
+			a += b ^ i;
+			b += c & i;
+			c += d | i;
+			d += e ^ a;
+			e += f & b;
+			f += g | c;
+			g += h ^ d;
+			h += a & e;
+		}
+
+		return before + (a ^ b ^ c ^ d ^ e ^ f ^ g ^ h) + after;
+	}
+
+	static int Main () {
+		int res = 0;
+
+		for (int i = 0; i < 20; ++i)
+			res ^= Run (10000000, i);
+
+		Console.WriteLine (res);
+		return 0;
+	}
+}
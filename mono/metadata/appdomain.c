@@ -318,6 +318,8 @@ mono_runtime_init_checked (MonoDomain *domain, MonoThreadStartCB start_cb, MonoT
 
 	mono_locks_tracer_init ();
 
+	mono_class_preload_init ();
+
 	/* mscorlib is loaded before we install the load hook */
 	mono_domain_fire_assembly_load (mono_defaults.corlib->assembly, NULL);
 
@@ -419,6 +421,8 @@ mono_context_init_checked (MonoDomain *domain, MonoError *error)
 void
 mono_runtime_cleanup (MonoDomain *domain)
 {
+	mono_class_preload_cleanup ();
+
 	mono_attach_cleanup ();
 
 	/* This ends up calling any pending pending (for at most 2 seconds) */
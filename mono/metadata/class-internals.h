@@ -1525,6 +1525,15 @@ mono_class_set_declsec_flags (MonoClass *class, guint32 value);
 void
 mono_class_set_is_com_object (MonoClass *klass);
 
+void
+mono_class_preload_init (void);
+
+void
+mono_class_preload_record (MonoClass *klass);
+
+void
+mono_class_preload_cleanup (void);
+
 /*Now that everything has been defined, let's include the inline functions */
 #include <mono/metadata/class-inlines.h>
 
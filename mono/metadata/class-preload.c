@@ -0,0 +1,248 @@
+/**
+ * \file
+ * Recording and replaying the classes initialized during startup.
+ *
+ * If the MONO_CLASS_PRELOAD_LIST environment variable names a file which doesn't
+ * exist, the runtime records the classes initialized by mono_class_init () and
+ * writes them to the file at shutdown. If the file exists, its classes are
+ * initialized on a background thread as soon as their assembly is loaded, so the
+ * main thread finds them already initialized instead of computing them on the
+ * startup path.
+ *
+ * Licensed under the MIT license. See LICENSE file in the project root for full license information.
+ */
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <mono/metadata/class-internals.h>
+#include <mono/metadata/assembly.h>
+#include <mono/metadata/domain-internals.h>
+#include <mono/metadata/object-internals.h>
+#include <mono/metadata/threads-types.h>
+#include <mono/utils/atomic.h>
+#include <mono/utils/mono-coop-mutex.h>
+#include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-logger-internals.h>
+#include <mono/utils/w32api.h>
+
+typedef struct {
+	MonoImage *image;
+	/* Type tokens, in the order their classes were initialized */
+	GArray *tokens;
+} PreloadItem;
+
+static MonoCoopMutex preload_mutex;
+
+/* The file the class list is read from or written to */
+static char *list_file;
+
+/* Recording mode, guid string -> GArray of type tokens */
+static gboolean recording;
+static GHashTable *recorded;
+
+/* Replay mode, guid string -> GArray of type tokens not yet queued */
+static GHashTable *pending;
+/* PreloadItems waiting for the preload thread */
+static GSList *queue;
+static gboolean thread_running;
+
+static gint32 classes_preloaded;
+
+static void
+load_list (FILE *f)
+{
+	char guid [64];
+	guint32 token;
+
+	pending = g_hash_table_new (g_str_hash, g_str_equal);
+	while (fscanf (f, "%63s %x", guid, &token) == 2) {
+		GArray *tokens = (GArray *)g_hash_table_lookup (pending, guid);
+
+		if (!tokens) {
+			tokens = g_array_new (FALSE, FALSE, sizeof (guint32));
+			g_hash_table_insert (pending, g_strdup (guid), tokens);
+		}
+		g_array_append_val (tokens, token);
+	}
+}
+
+static gsize WINAPI
+preload_thread (void *arg)
+{
+	MonoError error;
+	MonoInternalThread *internal = mono_thread_internal_current ();
+	MonoString *name;
+
+	name = mono_string_new_checked (mono_get_root_domain (), "Class preload", &error);
+	mono_error_assert_ok (&error);
+	mono_thread_set_name_internal (internal, name, TRUE, FALSE, &error);
+	mono_error_assert_ok (&error);
+	/* Ask the runtime to not wait for this thread */
+	internal->state |= ThreadState_Background;
+
+	while (TRUE) {
+		PreloadItem *item;
+		int i;
+
+		mono_coop_mutex_lock (&preload_mutex);
+		if (!queue) {
+			thread_running = FALSE;
+			mono_coop_mutex_unlock (&preload_mutex);
+			break;
+		}
+		item = (PreloadItem *)queue->data;
+		queue = g_slist_delete_link (queue, queue);
+		mono_coop_mutex_unlock (&preload_mutex);
+
+		for (i = 0; i < item->tokens->len; ++i) {
+			MonoClass *klass;
+
+			klass = mono_class_get_checked (item->image, g_array_index (item->tokens, guint32, i), &error);
+			if (!klass) {
+				/* The list is only a hint, the main thread will report the error if it needs the class */
+				mono_error_cleanup (&error);
+				continue;
+			}
+			mono_class_init (klass);
+			InterlockedIncrement (&classes_preloaded);
+		}
+		g_array_free (item->tokens, TRUE);
+		g_free (item);
+	}
+	return 0;
+}
+
+static void
+preload_assembly (MonoAssembly *assembly, gpointer user_data)
+{
+	MonoError error;
+	PreloadItem *item;
+	GArray *tokens;
+	gpointer orig_key;
+	gboolean start_thread = FALSE;
+
+	if (image_is_dynamic (assembly->image) || assembly->ref_only || mono_domain_get () != mono_get_root_domain ())
+		return;
+
+	mono_coop_mutex_lock (&preload_mutex);
+	if (!g_hash_table_lookup_extended (pending, assembly->image->guid, &orig_key, (gpointer *)&tokens)) {
+		mono_coop_mutex_unlock (&preload_mutex);
+		return;
+	}
+	g_hash_table_remove (pending, assembly->image->guid);
+	g_free (orig_key);
+
+	item = g_new0 (PreloadItem, 1);
+	item->image = assembly->image;
+	item->tokens = tokens;
+	queue = g_slist_append (queue, item);
+	if (!thread_running)
+		start_thread = thread_running = TRUE;
+	mono_coop_mutex_unlock (&preload_mutex);
+
+	mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_ASSEMBLY, "Preloading %d classes of '%s'.", tokens->len, assembly->image->name);
+
+	if (start_thread) {
+		if (!mono_thread_create_internal (mono_get_root_domain (), preload_thread, NULL, MONO_THREAD_CREATE_FLAGS_NONE, &error)) {
+			mono_trace (G_LOG_LEVEL_WARNING, MONO_TRACE_ASSEMBLY, "Unable to start the class preload thread: %s", mono_error_get_message (&error));
+			mono_error_cleanup (&error);
+			mono_coop_mutex_lock (&preload_mutex);
+			thread_running = FALSE;
+			mono_coop_mutex_unlock (&preload_mutex);
+		}
+	}
+}
+
+/*
+ * mono_class_preload_init:
+ *
+ *   Start recording or replaying the class list named by MONO_CLASS_PRELOAD_LIST.
+ * This should be called after the threading subsystem is initialized.
+ */
+void
+mono_class_preload_init (void)
+{
+	FILE *f;
+
+	list_file = g_getenv ("MONO_CLASS_PRELOAD_LIST");
+	if (!list_file)
+		return;
+
+	mono_coop_mutex_init (&preload_mutex);
+	mono_counters_register ("Classes preloaded", MONO_COUNTER_METADATA | MONO_COUNTER_INT, &classes_preloaded);
+
+	f = fopen (list_file, "r");
+	if (!f) {
+		recorded = g_hash_table_new (g_str_hash, g_str_equal);
+		recording = TRUE;
+		return;
+	}
+	load_list (f);
+	fclose (f);
+
+	mono_install_assembly_load_hook (preload_assembly, NULL);
+	/* mscorlib is loaded before the hook is installed */
+	preload_assembly (mono_defaults.corlib->assembly, NULL);
+}
+
+/*
+ * mono_class_preload_record:
+ *
+ *   Called by mono_class_init () after KLASS has been successfully initialized.
+ */
+void
+mono_class_preload_record (MonoClass *klass)
+{
+	GArray *tokens;
+
+	if (!recording)
+		return;
+	if (!klass->type_token || mono_class_is_ginst (klass) || klass->rank || image_is_dynamic (klass->image) || !klass->image->assembly)
+		return;
+
+	mono_coop_mutex_lock (&preload_mutex);
+	tokens = (GArray *)g_hash_table_lookup (recorded, klass->image->guid);
+	if (!tokens) {
+		tokens = g_array_new (FALSE, FALSE, sizeof (guint32));
+		g_hash_table_insert (recorded, g_strdup (klass->image->guid), tokens);
+	}
+	g_array_append_val (tokens, klass->type_token);
+	mono_coop_mutex_unlock (&preload_mutex);
+}
+
+static void
+write_tokens (gpointer key, gpointer value, gpointer user_data)
+{
+	GArray *tokens = (GArray *)value;
+	FILE *f = (FILE *)user_data;
+	int i;
+
+	for (i = 0; i < tokens->len; ++i)
+		fprintf (f, "%s %x\n", (char *)key, g_array_index (tokens, guint32, i));
+}
+
+/*
+ * mono_class_preload_cleanup:
+ *
+ *   Write out the recorded class list.
+ */
+void
+mono_class_preload_cleanup (void)
+{
+	FILE *f;
+
+	if (!recording)
+		return;
+
+	mono_coop_mutex_lock (&preload_mutex);
+	recording = FALSE;
+	f = fopen (list_file, "w");
+	if (f) {
+		g_hash_table_foreach (recorded, write_tokens, f);
+		fclose (f);
+	} else {
+		mono_trace (G_LOG_LEVEL_WARNING, MONO_TRACE_ASSEMBLY, "Unable to write the class preload list '%s'.", list_file);
+	}
+	mono_coop_mutex_unlock (&preload_mutex);
+}
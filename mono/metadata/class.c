@@ -5090,6 +5090,9 @@ mono_class_init (MonoClass *klass)
 	klass->inited = 1;
 	mono_loader_unlock ();
 
+	if (!mono_class_has_failure (klass))
+		mono_class_preload_record (klass);
+
 	return !mono_class_has_failure (klass);
 }
 
@@ -613,6 +613,11 @@ typedef struct {
 	GSList *apps;
 	GSList *assemblies;
 	char *aot_options;
+	/*
+	 * Record the generic instances the JIT compiles, and AOT them into the
+	 * cached images the next time they are compiled.
+	 */
+	gboolean profile_instances;
 } MonoAotCacheConfig;
 
 #define MONO_SIZEOF_METHOD_SIGNATURE (sizeof (struct _MonoMethodSignature) - MONO_ZERO_LEN_ARRAY * SIZEOF_VOID_P)
@@ -435,6 +435,8 @@ aot_cache_start (gpointer user_data,
 			g_strfreev (parts);
 		} else if (!strcmp (attribute_names [i], "options")) {
 			config->aot_options = g_strdup (attribute_values [i]);
+		} else if (!strcmp (attribute_names [i], "profile-instances")) {
+			config->profile_instances = !strcmp (attribute_values [i], "true");
 		}
 	}
 }
@@ -224,7 +224,7 @@ mono_profiler_get_coverage_data (MonoProfilerHandle handle, MonoMethod *method,
 	guint32 size;
 
 	const unsigned char *start = mono_method_header_get_code (header, &size, NULL);
-	const unsigned char *end = start - size;
+	const unsigned char *end = start + size;
 	MonoDebugMethodInfo *minfo = mono_debug_lookup_method (method);
 
 	for (guint32 i = 0; i < info->entries; i++) {
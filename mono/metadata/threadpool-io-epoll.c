@@ -13,13 +13,17 @@
 
 #define EPOLL_NEVENTS 128
 
-static gint epoll_fd;
-static struct epoll_event *epoll_events;
+typedef struct {
+	gint epoll_fd;
+	struct epoll_event *epoll_events;
+} EpollData;
 
-static gboolean
+static gpointer
 epoll_init (gint wakeup_pipe_fd)
 {
 	struct epoll_event event;
+	EpollData *data;
+	gint epoll_fd;
 
 #ifdef EPOOL_CLOEXEC
 	epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
@@ -34,7 +38,7 @@ epoll_init (gint wakeup_pipe_fd)
 #else
 		g_error ("epoll_init: epoll (256) failed, error (%d) %s\n", errno, g_strerror (errno));
 #endif
-		return FALSE;
+		return NULL;
 	}
 
 	event.events = EPOLLIN;
@@ -42,17 +46,20 @@ epoll_init (gint wakeup_pipe_fd)
 	if (epoll_ctl (epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event) == -1) {
 		g_error ("epoll_init: epoll_ctl () failed, error (%d) %s", errno, g_strerror (errno));
 		close (epoll_fd);
-		return FALSE;
+		return NULL;
 	}
 
-	epoll_events = g_new0 (struct epoll_event, EPOLL_NEVENTS);
+	data = g_new0 (EpollData, 1);
+	data->epoll_fd = epoll_fd;
+	data->epoll_events = g_new0 (struct epoll_event, EPOLL_NEVENTS);
 
-	return TRUE;
+	return data;
 }
 
 static void
-epoll_register_fd (gint fd, gint events, gboolean is_new)
+epoll_register_fd (gpointer backend_data, gint fd, gint events, gboolean is_new)
 {
+	EpollData *data = (EpollData *)backend_data;
 	struct epoll_event event;
 
 #ifndef EPOLLONESHOT
@@ -67,20 +74,24 @@ epoll_register_fd (gint fd, gint events, gboolean is_new)
 	if ((events & EVENT_OUT) != 0)
 		event.events |= EPOLLOUT;
 
-	if (epoll_ctl (epoll_fd, is_new ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, event.data.fd, &event) == -1)
+	if (epoll_ctl (data->epoll_fd, is_new ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, event.data.fd, &event) == -1)
 		g_error ("epoll_register_fd: epoll_ctl(%s) failed, error (%d) %s", is_new ? "EPOLL_CTL_ADD" : "EPOLL_CTL_MOD", errno, g_strerror (errno));
 }
 
 static void
-epoll_remove_fd (gint fd)
+epoll_remove_fd (gpointer backend_data, gint fd)
 {
-	if (epoll_ctl (epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1)
+	EpollData *data = (EpollData *)backend_data;
+
+	if (epoll_ctl (data->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1)
 			g_error ("epoll_remove_fd: epoll_ctl (EPOLL_CTL_DEL) failed, error (%d) %s", errno, g_strerror (errno));
 }
 
 static gint
-epoll_event_wait (void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data)
+epoll_event_wait (gpointer backend_data, void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data)
 {
+	EpollData *data = (EpollData *)backend_data;
+	struct epoll_event *epoll_events = data->epoll_events;
 	gint i, ready;
 
 	memset (epoll_events, 0, sizeof (struct epoll_event) * EPOLL_NEVENTS);
@@ -88,7 +99,7 @@ epoll_event_wait (void (*callback) (gint fd, gint events, gpointer user_data), g
 	mono_gc_set_skip_thread (TRUE);
 
 	MONO_ENTER_GC_SAFE;
-	ready = epoll_wait (epoll_fd, epoll_events, EPOLL_NEVENTS, -1);
+	ready = epoll_wait (data->epoll_fd, epoll_events, EPOLL_NEVENTS, -1);
 	MONO_EXIT_GC_SAFE;
 
 	mono_gc_set_skip_thread (FALSE);
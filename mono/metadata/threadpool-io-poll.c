@@ -4,9 +4,11 @@
 
 #include "utils/mono-poll.h"
 
-static mono_pollfd *poll_fds;
-static guint poll_fds_capacity;
-static guint poll_fds_size;
+typedef struct {
+	mono_pollfd *poll_fds;
+	guint poll_fds_capacity;
+	guint poll_fds_size;
+} PollData;
 
 static inline void
 POLL_INIT_FD (mono_pollfd *poll_fd, gint fd, gint events)
@@ -16,29 +18,33 @@ POLL_INIT_FD (mono_pollfd *poll_fd, gint fd, gint events)
 	poll_fd->revents = 0;
 }
 
-static gboolean
+static gpointer
 poll_init (gint wakeup_pipe_fd)
 {
+	PollData *data;
+
 	g_assert (wakeup_pipe_fd >= 0);
 
-	poll_fds_size = 1;
-	poll_fds_capacity = 64;
+	data = g_new0 (PollData, 1);
+	data->poll_fds_size = 1;
+	data->poll_fds_capacity = 64;
 
-	poll_fds = g_new0 (mono_pollfd, poll_fds_capacity);
+	data->poll_fds = g_new0 (mono_pollfd, data->poll_fds_capacity);
 
-	POLL_INIT_FD (&poll_fds [0], wakeup_pipe_fd, MONO_POLLIN);
+	POLL_INIT_FD (&data->poll_fds [0], wakeup_pipe_fd, MONO_POLLIN);
 
-	return TRUE;
+	return data;
 }
 
 static void
-poll_register_fd (gint fd, gint events, gboolean is_new)
+poll_register_fd (gpointer backend_data, gint fd, gint events, gboolean is_new)
 {
+	PollData *data = (PollData *)backend_data;
 	gint i;
 	gint poll_event;
 
 	g_assert (fd >= 0);
-	g_assert (poll_fds_size <= poll_fds_capacity);
+	g_assert (data->poll_fds_size <= data->poll_fds_capacity);
 
 	g_assert ((events & ~(EVENT_IN | EVENT_OUT)) == 0);
 
@@ -48,62 +54,63 @@ poll_register_fd (gint fd, gint events, gboolean is_new)
 	if (events & EVENT_OUT)
 		poll_event |= MONO_POLLOUT;
 
-	for (i = 0; i < poll_fds_size; ++i) {
-		if (poll_fds [i].fd == fd) {
+	for (i = 0; i < data->poll_fds_size; ++i) {
+		if (data->poll_fds [i].fd == fd) {
 			g_assert (!is_new);
-			POLL_INIT_FD (&poll_fds [i], fd, poll_event);
+			POLL_INIT_FD (&data->poll_fds [i], fd, poll_event);
 			return;
 		}
 	}
 
 	g_assert (is_new);
 
-	for (i = 0; i < poll_fds_size; ++i) {
-		if (poll_fds [i].fd == -1) {
-			POLL_INIT_FD (&poll_fds [i], fd, poll_event);
+	for (i = 0; i < data->poll_fds_size; ++i) {
+		if (data->poll_fds [i].fd == -1) {
+			POLL_INIT_FD (&data->poll_fds [i], fd, poll_event);
 			return;
 		}
 	}
 
-	poll_fds_size += 1;
+	data->poll_fds_size += 1;
 
-	if (poll_fds_size > poll_fds_capacity) {
-		poll_fds_capacity *= 2;
-		g_assert (poll_fds_size <= poll_fds_capacity);
+	if (data->poll_fds_size > data->poll_fds_capacity) {
+		data->poll_fds_capacity *= 2;
+		g_assert (data->poll_fds_size <= data->poll_fds_capacity);
 
-		poll_fds = (mono_pollfd *)g_renew (mono_pollfd, poll_fds, poll_fds_capacity);
+		data->poll_fds = (mono_pollfd *)g_renew (mono_pollfd, data->poll_fds, data->poll_fds_capacity);
 	}
 
-	POLL_INIT_FD (&poll_fds [poll_fds_size - 1], fd, poll_event);
+	POLL_INIT_FD (&data->poll_fds [data->poll_fds_size - 1], fd, poll_event);
 }
 
 static void
-poll_remove_fd (gint fd)
+poll_remove_fd (gpointer backend_data, gint fd)
 {
+	PollData *data = (PollData *)backend_data;
 	gint i;
 
 	g_assert (fd >= 0);
 
-	for (i = 0; i < poll_fds_size; ++i) {
-		if (poll_fds [i].fd == fd) {
-			POLL_INIT_FD (&poll_fds [i], -1, 0);
+	for (i = 0; i < data->poll_fds_size; ++i) {
+		if (data->poll_fds [i].fd == fd) {
+			POLL_INIT_FD (&data->poll_fds [i], -1, 0);
 			break;
 		}
 	}
 
 	/* if we don't find the fd in poll_fds,
 	 * it means we try to delete it twice */
-	g_assert (i < poll_fds_size);
+	g_assert (i < data->poll_fds_size);
 
 	/* if we find it again, it means we added
 	 * it twice */
-	for (; i < poll_fds_size; ++i)
-		g_assert (poll_fds [i].fd != fd);
+	for (; i < data->poll_fds_size; ++i)
+		g_assert (data->poll_fds [i].fd != fd);
 
 	/* reduce the value of poll_fds_size so we
 	 * do not keep it too big */
-	while (poll_fds_size > 1 && poll_fds [poll_fds_size - 1].fd == -1)
-		poll_fds_size -= 1;
+	while (data->poll_fds_size > 1 && data->poll_fds [data->poll_fds_size - 1].fd == -1)
+		data->poll_fds_size -= 1;
 }
 
 static inline gint
@@ -133,17 +140,18 @@ poll_mark_bad_fds (mono_pollfd *poll_fds, gint poll_fds_size)
 }
 
 static gint
-poll_event_wait (void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data)
+poll_event_wait (gpointer backend_data, void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data)
 {
+	PollData *data = (PollData *)backend_data;
 	gint i, ready;
 
-	for (i = 0; i < poll_fds_size; ++i)
-		poll_fds [i].revents = 0;
+	for (i = 0; i < data->poll_fds_size; ++i)
+		data->poll_fds [i].revents = 0;
 
 	mono_gc_set_skip_thread (TRUE);
 
 	MONO_ENTER_GC_SAFE;
-	ready = mono_poll (poll_fds, poll_fds_size, -1);
+	ready = mono_poll (data->poll_fds, data->poll_fds_size, -1);
 	MONO_EXIT_GC_SAFE;
 
 	mono_gc_set_skip_thread (FALSE);
@@ -171,7 +179,7 @@ poll_event_wait (void (*callback) (gint fd, gint events, gpointer user_data), gp
 		}
 		case EBADF:
 		{
-			ready = poll_mark_bad_fds (poll_fds, poll_fds_size);
+			ready = poll_mark_bad_fds (data->poll_fds, data->poll_fds_size);
 			break;
 		}
 		default:
@@ -187,20 +195,20 @@ poll_event_wait (void (*callback) (gint fd, gint events, gpointer user_data), gp
 
 	g_assert (ready > 0);
 
-	for (i = 0; i < poll_fds_size; ++i) {
+	for (i = 0; i < data->poll_fds_size; ++i) {
 		gint fd, events = 0;
 
-		if (poll_fds [i].fd == -1)
+		if (data->poll_fds [i].fd == -1)
 			continue;
-		if (poll_fds [i].revents == 0)
+		if (data->poll_fds [i].revents == 0)
 			continue;
 
-		fd = poll_fds [i].fd;
-		if (poll_fds [i].revents & (MONO_POLLIN | MONO_POLLERR | MONO_POLLHUP | MONO_POLLNVAL))
+		fd = data->poll_fds [i].fd;
+		if (data->poll_fds [i].revents & (MONO_POLLIN | MONO_POLLERR | MONO_POLLHUP | MONO_POLLNVAL))
 			events |= EVENT_IN;
-		if (poll_fds [i].revents & (MONO_POLLOUT | MONO_POLLERR | MONO_POLLHUP | MONO_POLLNVAL))
+		if (data->poll_fds [i].revents & (MONO_POLLOUT | MONO_POLLERR | MONO_POLLHUP | MONO_POLLNVAL))
 			events |= EVENT_OUT;
-		if (poll_fds [i].revents & (MONO_POLLERR | MONO_POLLHUP | MONO_POLLNVAL))
+		if (data->poll_fds [i].revents & (MONO_POLLERR | MONO_POLLHUP | MONO_POLLNVAL))
 			events |= EVENT_ERR;
 
 		callback (fd, events, user_data);
@@ -0,0 +1,335 @@
+/**
+ * \file
+ * io_uring backend of the I/O selector: the readiness of the fds is awaited
+ * with one-shot IORING_OP_POLL_ADD requests, which are submitted and reaped in
+ * batches with a single io_uring_enter () per wait.
+ *
+ * Only the readiness polling goes through the ring. Like with the other
+ * backends, the reads and writes themselves are still done by the socket and
+ * file icalls once the fd is ready.
+ */
+
+#if defined(HAVE_IO_URING)
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include <mono/utils/mono-memory-model.h>
+
+#if defined(HOST_WIN32)
+/* We assume that io_uring is not available on windows */
+#error
+#endif
+
+#define URING_ENTRIES 1024
+
+typedef struct {
+	gint ring_fd;
+	gint wakeup_pipe_fd;
+
+	/* Submission ring */
+	volatile guint32 *sq_head;
+	volatile guint32 *sq_tail;
+	guint32 sq_mask;
+	guint32 sq_entries;
+	guint32 *sq_array;
+	struct io_uring_sqe *sqes;
+	/* Entries queued since the last io_uring_enter () */
+	guint32 sq_pending;
+
+	/* Completion ring */
+	volatile guint32 *cq_head;
+	volatile guint32 *cq_tail;
+	guint32 cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/*
+	 * fd -> sequence number of its armed poll request. The user_data of a request
+	 * is (seq << 32) | fd, completions of requests which were since removed or
+	 * replaced don't match and are dropped. seq 0 is used for POLL_REMOVE.
+	 */
+	GHashTable *armed;
+	guint32 next_seq;
+} UringData;
+
+static gint
+uring_enter (UringData *data, guint32 to_submit, guint32 min_complete, guint32 flags)
+{
+	return syscall (__NR_io_uring_enter, data->ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void
+uring_flush (UringData *data)
+{
+	while (data->sq_pending > 0) {
+		gint submitted = uring_enter (data, data->sq_pending, 0, 0);
+		if (submitted == -1) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+				continue;
+			g_error ("uring_flush: io_uring_enter () failed, error (%d) %s", errno, g_strerror (errno));
+		}
+		data->sq_pending -= submitted;
+	}
+}
+
+static struct io_uring_sqe*
+uring_get_sqe (UringData *data)
+{
+	struct io_uring_sqe *sqe;
+	guint32 tail = *data->sq_tail;
+	guint32 index;
+
+	if (tail - *data->sq_head == data->sq_entries) {
+		/* the ring is full, make room by submitting what is queued */
+		uring_flush (data);
+		mono_memory_read_barrier ();
+	}
+
+	index = tail & data->sq_mask;
+	sqe = &data->sqes [index];
+	memset (sqe, 0, sizeof (struct io_uring_sqe));
+	data->sq_array [index] = index;
+	return sqe;
+}
+
+static void
+uring_queue_sqe (UringData *data)
+{
+	/* the sqe must be visible to the kernel before the tail */
+	mono_memory_write_barrier ();
+	*data->sq_tail = *data->sq_tail + 1;
+	data->sq_pending ++;
+}
+
+static void
+uring_poll_remove (UringData *data, gint fd)
+{
+	struct io_uring_sqe *sqe;
+	guint32 seq;
+
+	seq = GPOINTER_TO_UINT (g_hash_table_lookup (data->armed, GINT_TO_POINTER (fd)));
+	if (!seq)
+		return;
+	g_hash_table_remove (data->armed, GINT_TO_POINTER (fd));
+
+	sqe = uring_get_sqe (data);
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = ((guint64) seq << 32) | (guint32) fd;
+	sqe->user_data = (guint32) fd;
+	uring_queue_sqe (data);
+}
+
+static void
+uring_poll_add (UringData *data, gint fd, gint poll_events)
+{
+	struct io_uring_sqe *sqe;
+	guint32 seq;
+
+	/* replaces the request armed for fd, if any */
+	uring_poll_remove (data, fd);
+
+	seq = ++data->next_seq;
+	if (!seq)
+		seq = ++data->next_seq;
+	g_hash_table_insert (data->armed, GINT_TO_POINTER (fd), GUINT_TO_POINTER (seq));
+
+	sqe = uring_get_sqe (data);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll_events = poll_events;
+	sqe->user_data = ((guint64) seq << 32) | (guint32) fd;
+	uring_queue_sqe (data);
+}
+
+/*
+ * uring_is_supported:
+ *
+ *   Return whenever a ring can be set up, io_uring_setup () fails with ENOSYS on older
+ * kernels, or when io_uring is forbidden by seccomp.
+ */
+static gboolean
+uring_is_supported (void)
+{
+	struct io_uring_params params;
+	gint ring_fd;
+
+	memset (&params, 0, sizeof (params));
+	ring_fd = syscall (__NR_io_uring_setup, 1, &params);
+	if (ring_fd == -1) {
+		mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_IO_THREADPOOL, "io threadpool: io_uring_setup () failed, error (%d) %s", errno, g_strerror (errno));
+		return FALSE;
+	}
+	close (ring_fd);
+	return TRUE;
+}
+
+static gpointer
+uring_init (gint wakeup_pipe_fd)
+{
+	struct io_uring_params params;
+	UringData *data;
+	gint ring_fd;
+	gsize sq_ring_size, cq_ring_size;
+	guint8 *sq_ring, *cq_ring;
+	gpointer sqes;
+
+	memset (&params, 0, sizeof (params));
+	ring_fd = syscall (__NR_io_uring_setup, URING_ENTRIES, &params);
+	if (ring_fd == -1) {
+		g_error ("uring_init: io_uring_setup () failed, error (%d) %s", errno, g_strerror (errno));
+		return NULL;
+	}
+	fcntl (ring_fd, F_SETFD, FD_CLOEXEC);
+
+	sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (guint32);
+	cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		sq_ring_size = cq_ring_size = MAX (sq_ring_size, cq_ring_size);
+
+	sq_ring = mmap (NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED)
+		g_error ("uring_init: mmap (IORING_OFF_SQ_RING) failed, error (%d) %s", errno, g_strerror (errno));
+
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		cq_ring = sq_ring;
+	} else {
+		cq_ring = mmap (NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED)
+			g_error ("uring_init: mmap (IORING_OFF_CQ_RING) failed, error (%d) %s", errno, g_strerror (errno));
+	}
+
+	sqes = mmap (NULL, params.sq_entries * sizeof (struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+		g_error ("uring_init: mmap (IORING_OFF_SQES) failed, error (%d) %s", errno, g_strerror (errno));
+
+	data = g_new0 (UringData, 1);
+	data->ring_fd = ring_fd;
+	data->wakeup_pipe_fd = wakeup_pipe_fd;
+
+	data->sq_head = (volatile guint32 *)(sq_ring + params.sq_off.head);
+	data->sq_tail = (volatile guint32 *)(sq_ring + params.sq_off.tail);
+	data->sq_mask = *(guint32 *)(sq_ring + params.sq_off.ring_mask);
+	data->sq_entries = *(guint32 *)(sq_ring + params.sq_off.ring_entries);
+	data->sq_array = (guint32 *)(sq_ring + params.sq_off.array);
+	data->sqes = (struct io_uring_sqe *)sqes;
+
+	data->cq_head = (volatile guint32 *)(cq_ring + params.cq_off.head);
+	data->cq_tail = (volatile guint32 *)(cq_ring + params.cq_off.tail);
+	data->cq_mask = *(guint32 *)(cq_ring + params.cq_off.ring_mask);
+	data->cqes = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+
+	data->armed = g_hash_table_new (g_direct_hash, NULL);
+
+	uring_poll_add (data, wakeup_pipe_fd, POLLIN);
+	uring_flush (data);
+
+	return data;
+}
+
+static void
+uring_register_fd (gpointer backend_data, gint fd, gint events, gboolean is_new)
+{
+	UringData *data = (UringData *)backend_data;
+	gint poll_events = 0;
+
+	if ((events & EVENT_IN) != 0)
+		poll_events |= POLLIN;
+	if ((events & EVENT_OUT) != 0)
+		poll_events |= POLLOUT;
+
+	if (poll_events)
+		uring_poll_add (data, fd, poll_events);
+	else
+		uring_poll_remove (data, fd);
+}
+
+static void
+uring_remove_fd (gpointer backend_data, gint fd)
+{
+	uring_poll_remove ((UringData *)backend_data, fd);
+}
+
+static gint
+uring_event_wait (gpointer backend_data, void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data)
+{
+	UringData *data = (UringData *)backend_data;
+	guint32 head, tail;
+	gint res;
+
+	mono_gc_set_skip_thread (TRUE);
+
+	/* submit the queued requests and wait for the first completion in one syscall */
+	MONO_ENTER_GC_SAFE;
+	res = uring_enter (data, data->sq_pending, 1, IORING_ENTER_GETEVENTS);
+	MONO_EXIT_GC_SAFE;
+
+	mono_gc_set_skip_thread (FALSE);
+
+	if (res == -1) {
+		switch (errno) {
+		case EINTR:
+		case EAGAIN:
+		case EBUSY:
+			break;
+		default:
+			g_error ("uring_event_wait: io_uring_enter () failed, error (%d) %s", errno, g_strerror (errno));
+			return -1;
+		}
+	} else {
+		data->sq_pending -= res;
+	}
+
+	head = *data->cq_head;
+	for (;;) {
+		tail = *data->cq_tail;
+		mono_memory_read_barrier ();
+		if (head == tail)
+			break;
+
+		for (; head != tail; ++head) {
+			struct io_uring_cqe *cqe = &data->cqes [head & data->cq_mask];
+			guint32 seq = (guint32) (cqe->user_data >> 32);
+			gint fd = (gint) (guint32) cqe->user_data;
+			gint result = cqe->res;
+			gint events = 0;
+
+			/* completion of a POLL_REMOVE, or of a poll request which was removed or replaced */
+			if (!seq || GPOINTER_TO_UINT (g_hash_table_lookup (data->armed, GINT_TO_POINTER (fd))) != seq)
+				continue;
+			/* poll requests are one-shot */
+			g_hash_table_remove (data->armed, GINT_TO_POINTER (fd));
+
+			if (result < 0) {
+				events = EVENT_IN | EVENT_OUT | EVENT_ERR;
+			} else {
+				if (result & (POLLIN | POLLERR | POLLHUP))
+					events |= EVENT_IN;
+				if (result & (POLLOUT | POLLERR | POLLHUP))
+					events |= EVENT_OUT;
+			}
+
+			callback (fd, events, user_data);
+
+			if (fd == data->wakeup_pipe_fd)
+				uring_poll_add (data, fd, POLLIN);
+		}
+
+		/* the entries must be read before the kernel can reuse them */
+		mono_memory_barrier ();
+		*data->cq_head = head;
+	}
+
+	return 0;
+}
+
+static ThreadPoolIOBackend backend_uring = {
+	.init = uring_init,
+	.register_fd = uring_register_fd,
+	.remove_fd = uring_remove_fd,
+	.event_wait = uring_event_wait,
+};
+
+#endif
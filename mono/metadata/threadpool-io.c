@@ -23,20 +23,21 @@
 #endif
 
 #include <mono/metadata/gc-internals.h>
-#include <mono/metadata/mono-mlist.h>
 #include <mono/metadata/threadpool.h>
 #include <mono/metadata/threadpool-io.h>
 #include <mono/utils/atomic.h>
 #include <mono/utils/mono-threads.h>
 #include <mono/utils/mono-lazy-init.h>
 #include <mono/utils/mono-logger-internals.h>
+#include <mono/utils/mono-proclib.h>
 #include <mono/utils/w32api.h>
 
+/* Every selector thread has its own backend state, returned by init () */
 typedef struct {
-	gboolean (*init) (gint wakeup_pipe_fd);
-	void     (*register_fd) (gint fd, gint events, gboolean is_new);
-	void     (*remove_fd) (gint fd);
-	gint     (*event_wait) (void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data);
+	gpointer (*init) (gint wakeup_pipe_fd);
+	void     (*register_fd) (gpointer backend_data, gint fd, gint events, gboolean is_new);
+	void     (*remove_fd) (gpointer backend_data, gint fd);
+	gint     (*event_wait) (gpointer backend_data, void (*callback) (gint fd, gint events, gpointer user_data), gpointer user_data);
 } ThreadPoolIOBackend;
 
 /* Keep in sync with System.IOOperation in mcs/class/System/System/IOSelector.cs */
@@ -49,9 +50,13 @@ enum MonoIOOperation {
 #include "threadpool-io-epoll.c"
 #include "threadpool-io-kqueue.c"
 #include "threadpool-io-poll.c"
+#include "threadpool-io-uring.c"
 
 #define UPDATES_CAPACITY 128
 
+/* Upper bound of the default number of selector threads */
+#define SELECTORS_DEFAULT_MAX 4
+
 /* Keep in sync with System.IOSelectorJob in mcs/class/System/System/IOSelector.cs */
 struct _MonoIOSelectorJob {
 	MonoObject object;
@@ -89,39 +94,104 @@ typedef struct {
 	} data;
 } ThreadPoolIOUpdate;
 
+/* A job waiting for an event on a fd */
 typedef struct {
-	ThreadPoolIOBackend backend;
+	/* Keeps the MonoIOSelectorJob alive until it's queued */
+	guint32 gchandle;
+	gint32 operation;
+	MonoDomain *domain;
+} ThreadPoolIOJob;
+
+/* The jobs waiting on a fd, in the order they were added */
+typedef struct {
+	GSList *jobs;
+} ThreadPoolIOFdJobs;
+
+/*
+ * A selector thread, waiting for the events of the fds sharded to it
+ * with its own backend state and updates queue.
+ */
+typedef struct {
+	gpointer backend_data;
+
+	/* fd -> ThreadPoolIOFdJobs, only accessed by the selector thread */
+	GHashTable *states;
 
 	ThreadPoolIOUpdate updates [UPDATES_CAPACITY];
 	gint updates_size;
 	MonoCoopMutex updates_lock;
 	MonoCoopCond updates_cond;
 
+	/* Protected by updates_lock */
+	gboolean running;
+
 #if !defined(HOST_WIN32)
 	gint wakeup_pipes [2];
 #else
 	SOCKET wakeup_pipes [2];
 #endif
+} ThreadPoolIOSelector;
+
+typedef struct {
+	ThreadPoolIOBackend backend;
+
+	ThreadPoolIOSelector *selectors;
+	gint selectors_count;
 } ThreadPoolIO;
 
 static mono_lazy_init_t io_status = MONO_LAZY_INIT_STATUS_NOT_INITIALIZED;
 
-static gboolean io_selector_running = FALSE;
-
 static ThreadPoolIO* threadpool_io;
 
-static MonoIOSelectorJob*
-get_job_for_event (MonoMList **list, gint32 event)
+static ThreadPoolIOSelector*
+get_selector_for_fd (gint fd)
 {
-	MonoMList *current;
+	return &threadpool_io->selectors [(guint) fd % threadpool_io->selectors_count];
+}
 
-	g_assert (list);
+static ThreadPoolIOJob*
+job_new (MonoIOSelectorJob *job)
+{
+	ThreadPoolIOJob *io_job = g_new0 (ThreadPoolIOJob, 1);
 
-	for (current = *list; current; current = mono_mlist_next (current)) {
-		MonoIOSelectorJob *job = (MonoIOSelectorJob*) mono_mlist_get_data (current);
-		if (job->operation == event) {
-			*list = mono_mlist_remove_item (*list, current);
-			return job;
+	io_job->gchandle = mono_gchandle_new ((MonoObject*) job, FALSE);
+	io_job->operation = job->operation;
+	io_job->domain = mono_object_domain (job);
+	return io_job;
+}
+
+static void
+job_free (ThreadPoolIOJob *io_job)
+{
+	mono_gchandle_free (io_job->gchandle);
+	g_free (io_job);
+}
+
+/* Queue the job to the thread pool and free IO_JOB */
+static void
+job_enqueue (ThreadPoolIOJob *io_job)
+{
+	MonoError error;
+	MonoObject *job = mono_gchandle_get_target (io_job->gchandle);
+
+	mono_threadpool_enqueue_work_item (io_job->domain, job, &error);
+	mono_error_assert_ok (&error);
+
+	job_free (io_job);
+}
+
+static ThreadPoolIOJob*
+get_job_for_event (ThreadPoolIOFdJobs *fd_jobs, gint32 event)
+{
+	GSList *current;
+
+	g_assert (fd_jobs);
+
+	for (current = fd_jobs->jobs; current; current = current->next) {
+		ThreadPoolIOJob *io_job = (ThreadPoolIOJob*) current->data;
+		if (io_job->operation == event) {
+			fd_jobs->jobs = g_slist_delete_link (fd_jobs->jobs, current);
+			return io_job;
 		}
 	}
 
@@ -129,26 +199,37 @@ get_job_for_event (MonoMList **list, gint32 event)
 }
 
 static gint
-get_operations_for_jobs (MonoMList *list)
+get_operations_for_jobs (ThreadPoolIOFdJobs *fd_jobs)
 {
-	MonoMList *current;
+	GSList *current;
 	gint operations = 0;
 
-	for (current = list; current; current = mono_mlist_next (current))
-		operations |= ((MonoIOSelectorJob*) mono_mlist_get_data (current))->operation;
+	for (current = fd_jobs->jobs; current; current = current->next)
+		operations |= ((ThreadPoolIOJob*) current->data)->operation;
 
 	return operations;
 }
 
 static void
-selector_thread_wakeup (void)
+fd_jobs_free (ThreadPoolIOFdJobs *fd_jobs)
+{
+	GSList *current;
+
+	for (current = fd_jobs->jobs; current; current = current->next)
+		job_free ((ThreadPoolIOJob*) current->data);
+	g_slist_free (fd_jobs->jobs);
+	g_free (fd_jobs);
+}
+
+static void
+selector_thread_wakeup (ThreadPoolIOSelector *selector)
 {
 	gchar msg = 'c';
 	gint written;
 
 	for (;;) {
 #if !defined(HOST_WIN32)
-		written = write (threadpool_io->wakeup_pipes [1], &msg, 1);
+		written = write (selector->wakeup_pipes [1], &msg, 1);
 		if (written == 1)
 			break;
 		if (written == -1) {
@@ -156,7 +237,7 @@ selector_thread_wakeup (void)
 			break;
 		}
 #else
-		written = send (threadpool_io->wakeup_pipes [1], &msg, 1, 0);
+		written = send (selector->wakeup_pipes [1], &msg, 1, 0);
 		if (written == 1)
 			break;
 		if (written == SOCKET_ERROR) {
@@ -168,14 +249,14 @@ selector_thread_wakeup (void)
 }
 
 static void
-selector_thread_wakeup_drain_pipes (void)
+selector_thread_wakeup_drain_pipes (ThreadPoolIOSelector *selector)
 {
 	gchar buffer [128];
 	gint received;
 
 	for (;;) {
 #if !defined(HOST_WIN32)
-		received = read (threadpool_io->wakeup_pipes [0], buffer, sizeof (buffer));
+		received = read (selector->wakeup_pipes [0], buffer, sizeof (buffer));
 		if (received == 0)
 			break;
 		if (received == -1) {
@@ -184,7 +265,7 @@ selector_thread_wakeup_drain_pipes (void)
 			break;
 		}
 #else
-		received = recv (threadpool_io->wakeup_pipes [0], buffer, sizeof (buffer), 0);
+		received = recv (selector->wakeup_pipes [0], buffer, sizeof (buffer), 0);
 		if (received == 0)
 			break;
 		if (received == SOCKET_ERROR) {
@@ -196,135 +277,108 @@ selector_thread_wakeup_drain_pipes (void)
 	}
 }
 
-typedef struct {
-	MonoDomain *domain;
-	MonoGHashTable *states;
-} FilterSockaresForDomainData;
-
 static void
 filter_jobs_for_domain (gpointer key, gpointer value, gpointer user_data)
 {
-	FilterSockaresForDomainData *data;
-	MonoMList *list = (MonoMList *)value, *element;
-	MonoDomain *domain;
-	MonoGHashTable *states;
+	ThreadPoolIOFdJobs *fd_jobs = (ThreadPoolIOFdJobs *)value;
+	MonoDomain *domain = (MonoDomain *)user_data;
+	GSList *current, *next;
 
-	g_assert (user_data);
-	data = (FilterSockaresForDomainData *)user_data;
-	domain = data->domain;
-	states = data->states;
-
-	for (element = list; element; element = mono_mlist_next (element)) {
-		MonoIOSelectorJob *job = (MonoIOSelectorJob*) mono_mlist_get_data (element);
-		if (mono_object_domain (job) == domain)
-			mono_mlist_set_data (element, NULL);
-	}
+	g_assert (domain);
 
-	/* we skip all the first elements which are NULL */
-	for (; list; list = mono_mlist_next (list)) {
-		if (mono_mlist_get_data (list))
-			break;
-	}
-
-	if (list) {
-		g_assert (mono_mlist_get_data (list));
+	for (current = fd_jobs->jobs; current; current = next) {
+		ThreadPoolIOJob *io_job = (ThreadPoolIOJob*) current->data;
 
-		/* we delete all the NULL elements after the first one */
-		for (element = list; element;) {
-			MonoMList *next;
-			if (!(next = mono_mlist_next (element)))
-				break;
-			if (mono_mlist_get_data (next))
-				element = next;
-			else
-				mono_mlist_set_next (element, mono_mlist_next (next));
+		next = current->next;
+		if (io_job->domain == domain) {
+			fd_jobs->jobs = g_slist_delete_link (fd_jobs->jobs, current);
+			job_free (io_job);
 		}
 	}
-
-	mono_g_hash_table_replace (states, key, list);
 }
 
 static void
 wait_callback (gint fd, gint events, gpointer user_data)
 {
-	MonoError error;
+	ThreadPoolIOSelector *selector;
 
 	if (mono_runtime_is_shutting_down ())
 		return;
 
-	if (fd == threadpool_io->wakeup_pipes [0]) {
+	g_assert (user_data);
+	selector = (ThreadPoolIOSelector *)user_data;
+
+	if (fd == selector->wakeup_pipes [0]) {
 		mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: wke");
-		selector_thread_wakeup_drain_pipes ();
+		selector_thread_wakeup_drain_pipes (selector);
 	} else {
-		MonoGHashTable *states;
-		MonoMList *list = NULL;
-		gpointer k;
+		ThreadPoolIOFdJobs *fd_jobs;
 		gboolean remove_fd = FALSE;
 		gint operations;
 
-		g_assert (user_data);
-		states = (MonoGHashTable *)user_data;
-
 		mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: cal fd %3d, events = %2s | %2s | %3s",
 			fd, (events & EVENT_IN) ? "RD" : "..", (events & EVENT_OUT) ? "WR" : "..", (events & EVENT_ERR) ? "ERR" : "...");
 
-		if (!mono_g_hash_table_lookup_extended (states, GINT_TO_POINTER (fd), &k, (gpointer*) &list))
+		fd_jobs = (ThreadPoolIOFdJobs *)g_hash_table_lookup (selector->states, GINT_TO_POINTER (fd));
+		if (!fd_jobs)
 			g_error ("wait_callback: fd %d not found in states table", fd);
 
-		if (list && (events & EVENT_IN) != 0) {
-			MonoIOSelectorJob *job = get_job_for_event (&list, EVENT_IN);
-			if (job) {
-				mono_threadpool_enqueue_work_item (((MonoObject*) job)->vtable->domain, (MonoObject*) job, &error);
-				mono_error_assert_ok (&error);
-			}
-
+		if (fd_jobs->jobs && (events & EVENT_IN) != 0) {
+			ThreadPoolIOJob *io_job = get_job_for_event (fd_jobs, EVENT_IN);
+			if (io_job)
+				job_enqueue (io_job);
 		}
-		if (list && (events & EVENT_OUT) != 0) {
-			MonoIOSelectorJob *job = get_job_for_event (&list, EVENT_OUT);
-			if (job) {
-				mono_threadpool_enqueue_work_item (((MonoObject*) job)->vtable->domain, (MonoObject*) job, &error);
-				mono_error_assert_ok (&error);
-			}
+		if (fd_jobs->jobs && (events & EVENT_OUT) != 0) {
+			ThreadPoolIOJob *io_job = get_job_for_event (fd_jobs, EVENT_OUT);
+			if (io_job)
+				job_enqueue (io_job);
 		}
 
 		remove_fd = (events & EVENT_ERR) == EVENT_ERR;
 		if (!remove_fd) {
-			mono_g_hash_table_replace (states, GINT_TO_POINTER (fd), list);
-
-			operations = get_operations_for_jobs (list);
+			operations = get_operations_for_jobs (fd_jobs);
 
 			mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: res fd %3d, events = %2s | %2s | %3s",
 				fd, (operations & EVENT_IN) ? "RD" : "..", (operations & EVENT_OUT) ? "WR" : "..", (operations & EVENT_ERR) ? "ERR" : "...");
 
-			threadpool_io->backend.register_fd (fd, operations, FALSE);
+			threadpool_io->backend.register_fd (selector->backend_data, fd, operations, FALSE);
 		} else {
 			mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: err fd %d", fd);
 
-			mono_g_hash_table_remove (states, GINT_TO_POINTER (fd));
+			g_hash_table_remove (selector->states, GINT_TO_POINTER (fd));
+			fd_jobs_free (fd_jobs);
 
-			threadpool_io->backend.remove_fd (fd);
+			threadpool_io->backend.remove_fd (selector->backend_data, fd);
 		}
 	}
 }
 
 static void
-selector_thread_interrupt (gpointer unused)
+selector_thread_interrupt (gpointer data)
+{
+	selector_thread_wakeup ((ThreadPoolIOSelector *)data);
+}
+
+static gboolean
+free_fd_jobs (gpointer key, gpointer value, gpointer user_data)
 {
-	selector_thread_wakeup ();
+	fd_jobs_free ((ThreadPoolIOFdJobs *)value);
+	return TRUE;
 }
 
 static gsize WINAPI
 selector_thread (gpointer data)
 {
-	MonoError error;
-	MonoGHashTable *states;
+	ThreadPoolIOSelector *selector = (ThreadPoolIOSelector *)data;
 
 	if (mono_runtime_is_shutting_down ()) {
-		io_selector_running = FALSE;
+		mono_coop_mutex_lock (&selector->updates_lock);
+		selector->running = FALSE;
+		mono_coop_mutex_unlock (&selector->updates_lock);
 		return 0;
 	}
 
-	states = mono_g_hash_table_new_type (g_direct_hash, NULL, MONO_HASH_VALUE_GC, MONO_ROOT_SOURCE_THREAD_POOL, "i/o thread pool states table");
+	selector->states = g_hash_table_new (g_direct_hash, NULL);
 
 	while (!mono_runtime_is_shutting_down ()) {
 		gint i, j;
@@ -334,10 +388,10 @@ selector_thread (gpointer data)
 		if (mono_thread_interruption_checkpoint ())
 			continue;
 
-		mono_coop_mutex_lock (&threadpool_io->updates_lock);
+		mono_coop_mutex_lock (&selector->updates_lock);
 
-		for (i = 0; i < threadpool_io->updates_size; ++i) {
-			ThreadPoolIOUpdate *update = &threadpool_io->updates [i];
+		for (i = 0; i < selector->updates_size; ++i) {
+			ThreadPoolIOUpdate *update = &selector->updates [i];
 
 			switch (update->type) {
 			case UPDATE_EMPTY:
@@ -345,9 +399,8 @@ selector_thread (gpointer data)
 			case UPDATE_ADD: {
 				gint fd;
 				gint operations;
-				gpointer k;
 				gboolean exists;
-				MonoMList *list = NULL;
+				ThreadPoolIOFdJobs *fd_jobs;
 				MonoIOSelectorJob *job;
 
 				fd = update->data.add.fd;
@@ -356,44 +409,49 @@ selector_thread (gpointer data)
 				job = update->data.add.job;
 				g_assert (job);
 
-				exists = mono_g_hash_table_lookup_extended (states, GINT_TO_POINTER (fd), &k, (gpointer*) &list);
-				list = mono_mlist_append_checked (list, (MonoObject*) job, &error);
-				mono_error_assert_ok (&error);
-				mono_g_hash_table_replace (states, GINT_TO_POINTER (fd), list);
+				fd_jobs = (ThreadPoolIOFdJobs *)g_hash_table_lookup (selector->states, GINT_TO_POINTER (fd));
+				exists = fd_jobs != NULL;
+				if (!exists) {
+					fd_jobs = g_new0 (ThreadPoolIOFdJobs, 1);
+					g_hash_table_insert (selector->states, GINT_TO_POINTER (fd), fd_jobs);
+				}
+				fd_jobs->jobs = g_slist_append (fd_jobs->jobs, job_new (job));
 
-				operations = get_operations_for_jobs (list);
+				operations = get_operations_for_jobs (fd_jobs);
 
 				mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: %3s fd %3d, operations = %2s | %2s | %3s",
 					exists ? "mod" : "add", fd, (operations & EVENT_IN) ? "RD" : "..", (operations & EVENT_OUT) ? "WR" : "..", (operations & EVENT_ERR) ? "ERR" : "...");
 
-				threadpool_io->backend.register_fd (fd, operations, !exists);
+				threadpool_io->backend.register_fd (selector->backend_data, fd, operations, !exists);
 
 				break;
 			}
 			case UPDATE_REMOVE_SOCKET: {
 				gint fd;
-				gpointer k;
-				MonoMList *list = NULL;
+				ThreadPoolIOFdJobs *fd_jobs;
 
 				fd = update->data.remove_socket.fd;
 				g_assert (fd >= 0);
 
-				if (mono_g_hash_table_lookup_extended (states, GINT_TO_POINTER (fd), &k, (gpointer*) &list)) {
-					mono_g_hash_table_remove (states, GINT_TO_POINTER (fd));
+				fd_jobs = (ThreadPoolIOFdJobs *)g_hash_table_lookup (selector->states, GINT_TO_POINTER (fd));
+				if (fd_jobs) {
+					g_hash_table_remove (selector->states, GINT_TO_POINTER (fd));
 
-					for (j = i + 1; j < threadpool_io->updates_size; ++j) {
-						ThreadPoolIOUpdate *update = &threadpool_io->updates [j];
+					for (j = i + 1; j < selector->updates_size; ++j) {
+						ThreadPoolIOUpdate *update = &selector->updates [j];
 						if (update->type == UPDATE_ADD && update->data.add.fd == fd)
 							memset (update, 0, sizeof (ThreadPoolIOUpdate));
 					}
 
-					for (; list; list = mono_mlist_remove_item (list, list)) {
-						mono_threadpool_enqueue_work_item (mono_object_domain (mono_mlist_get_data (list)), mono_mlist_get_data (list), &error);
-						mono_error_assert_ok (&error);
+					while (fd_jobs->jobs) {
+						ThreadPoolIOJob *io_job = (ThreadPoolIOJob*) fd_jobs->jobs->data;
+						fd_jobs->jobs = g_slist_delete_link (fd_jobs->jobs, fd_jobs->jobs);
+						job_enqueue (io_job);
 					}
+					g_free (fd_jobs);
 
 					mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: del fd %3d", fd);
-					threadpool_io->backend.remove_fd (fd);
+					threadpool_io->backend.remove_fd (selector->backend_data, fd);
 				}
 
 				break;
@@ -404,11 +462,10 @@ selector_thread (gpointer data)
 				domain = update->data.remove_domain.domain;
 				g_assert (domain);
 
-				FilterSockaresForDomainData user_data = { .domain = domain, .states = states };
-				mono_g_hash_table_foreach (states, filter_jobs_for_domain, &user_data);
+				g_hash_table_foreach (selector->states, filter_jobs_for_domain, domain);
 
-				for (j = i + 1; j < threadpool_io->updates_size; ++j) {
-					ThreadPoolIOUpdate *update = &threadpool_io->updates [j];
+				for (j = i + 1; j < selector->updates_size; ++j) {
+					ThreadPoolIOUpdate *update = &selector->updates [j];
 					if (update->type == UPDATE_ADD && mono_object_domain (update->data.add.job) == domain)
 						memset (update, 0, sizeof (ThreadPoolIOUpdate));
 				}
@@ -420,68 +477,70 @@ selector_thread (gpointer data)
 			}
 		}
 
-		mono_coop_cond_broadcast (&threadpool_io->updates_cond);
+		mono_coop_cond_broadcast (&selector->updates_cond);
 
-		if (threadpool_io->updates_size > 0) {
-			threadpool_io->updates_size = 0;
-			memset (&threadpool_io->updates, 0, UPDATES_CAPACITY * sizeof (ThreadPoolIOUpdate));
+		if (selector->updates_size > 0) {
+			selector->updates_size = 0;
+			memset (&selector->updates, 0, UPDATES_CAPACITY * sizeof (ThreadPoolIOUpdate));
 		}
 
-		mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+		mono_coop_mutex_unlock (&selector->updates_lock);
 
 		mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_IO_THREADPOOL, "io threadpool: wai");
 
-		mono_thread_info_install_interrupt (selector_thread_interrupt, NULL, &interrupted);
+		mono_thread_info_install_interrupt (selector_thread_interrupt, selector, &interrupted);
 		if (interrupted)
 			continue;
 
-		res = threadpool_io->backend.event_wait (wait_callback, states);
+		res = threadpool_io->backend.event_wait (selector->backend_data, wait_callback, selector);
 		if (res == -1)
 			break;
 
 		mono_thread_info_uninstall_interrupt (&interrupted);
 	}
 
-	mono_g_hash_table_destroy (states);
+	g_hash_table_foreach_remove (selector->states, free_fd_jobs, NULL);
+	g_hash_table_destroy (selector->states);
+	selector->states = NULL;
 
-	mono_coop_mutex_lock (&threadpool_io->updates_lock);
+	mono_coop_mutex_lock (&selector->updates_lock);
 
-	io_selector_running = FALSE;
-	mono_coop_cond_broadcast (&threadpool_io->updates_cond);
+	selector->running = FALSE;
+	mono_coop_cond_broadcast (&selector->updates_cond);
 
-	mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+	mono_coop_mutex_unlock (&selector->updates_lock);
 
 	return 0;
 }
 
-/* Locking: threadpool_io->updates_lock must be held */
+/* Locking: selector->updates_lock must be held */
 static ThreadPoolIOUpdate*
-update_get_new (void)
+update_get_new (ThreadPoolIOSelector *selector)
 {
 	ThreadPoolIOUpdate *update = NULL;
-	g_assert (threadpool_io->updates_size <= UPDATES_CAPACITY);
+	g_assert (selector->updates_size <= UPDATES_CAPACITY);
 
-	while (threadpool_io->updates_size == UPDATES_CAPACITY) {
+	while (selector->updates_size == UPDATES_CAPACITY) {
 		/* we wait for updates to be applied in the selector_thread and we loop
 		 * as long as none are available. if it happends too much, then we need
 		 * to increase UPDATES_CAPACITY */
-		mono_coop_cond_wait (&threadpool_io->updates_cond, &threadpool_io->updates_lock);
+		mono_coop_cond_wait (&selector->updates_cond, &selector->updates_lock);
 	}
 
-	g_assert (threadpool_io->updates_size < UPDATES_CAPACITY);
+	g_assert (selector->updates_size < UPDATES_CAPACITY);
 
-	update = &threadpool_io->updates [threadpool_io->updates_size ++];
+	update = &selector->updates [selector->updates_size ++];
 
 	return update;
 }
 
 static void
-wakeup_pipes_init (void)
+wakeup_pipes_init (ThreadPoolIOSelector *selector)
 {
 #if !defined(HOST_WIN32)
-	if (pipe (threadpool_io->wakeup_pipes) == -1)
+	if (pipe (selector->wakeup_pipes) == -1)
 		g_error ("wakeup_pipes_init: pipe () failed, error (%d) %s\n", errno, g_strerror (errno));
-	if (fcntl (threadpool_io->wakeup_pipes [0], F_SETFL, O_NONBLOCK) == -1)
+	if (fcntl (selector->wakeup_pipes [0], F_SETFL, O_NONBLOCK) == -1)
 		g_error ("wakeup_pipes_init: fcntl () failed, error (%d) %s\n", errno, g_strerror (errno));
 #else
 	struct sockaddr_in client;
@@ -492,8 +551,8 @@ wakeup_pipes_init (void)
 
 	server_sock = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	g_assert (server_sock != INVALID_SOCKET);
-	threadpool_io->wakeup_pipes [1] = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	g_assert (threadpool_io->wakeup_pipes [1] != INVALID_SOCKET);
+	selector->wakeup_pipes [1] = socket (AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	g_assert (selector->wakeup_pipes [1] != INVALID_SOCKET);
 
 	server.sin_family = AF_INET;
 	server.sin_addr.s_addr = inet_addr ("127.0.0.1");
@@ -512,18 +571,18 @@ wakeup_pipes_init (void)
 		closesocket (server_sock);
 		g_error ("wakeup_pipes_init: listen () failed, error (%d)\n", WSAGetLastError ());
 	}
-	if (connect ((SOCKET) threadpool_io->wakeup_pipes [1], (SOCKADDR*) &server, sizeof (server)) == SOCKET_ERROR) {
+	if (connect ((SOCKET) selector->wakeup_pipes [1], (SOCKADDR*) &server, sizeof (server)) == SOCKET_ERROR) {
 		closesocket (server_sock);
 		g_error ("wakeup_pipes_init: connect () failed, error (%d)\n", WSAGetLastError ());
 	}
 
 	size = sizeof (client);
-	threadpool_io->wakeup_pipes [0] = accept (server_sock, (SOCKADDR *) &client, &size);
-	g_assert (threadpool_io->wakeup_pipes [0] != INVALID_SOCKET);
+	selector->wakeup_pipes [0] = accept (server_sock, (SOCKADDR *) &client, &size);
+	g_assert (selector->wakeup_pipes [0] != INVALID_SOCKET);
 
 	arg = 1;
-	if (ioctlsocket (threadpool_io->wakeup_pipes [0], FIONBIO, &arg) == SOCKET_ERROR) {
-		closesocket (threadpool_io->wakeup_pipes [0]);
+	if (ioctlsocket (selector->wakeup_pipes [0], FIONBIO, &arg) == SOCKET_ERROR) {
+		closesocket (selector->wakeup_pipes [0]);
 		closesocket (server_sock);
 		g_error ("wakeup_pipes_init: ioctlsocket () failed, error (%d)\n", WSAGetLastError ());
 	}
@@ -535,39 +594,72 @@ wakeup_pipes_init (void)
 static void
 initialize (void)
 {
+	const char *selectors_env;
+	gboolean aio = FALSE;
+	gint i;
+
 	g_assert (!threadpool_io);
 	threadpool_io = g_new0 (ThreadPoolIO, 1);
 	g_assert (threadpool_io);
 
-	mono_coop_mutex_init (&threadpool_io->updates_lock);
-	mono_coop_cond_init (&threadpool_io->updates_cond);
-	mono_gc_register_root ((char *)&threadpool_io->updates [0], sizeof (threadpool_io->updates), MONO_GC_DESCRIPTOR_NULL, MONO_ROOT_SOURCE_THREAD_POOL, "i/o thread pool updates list");
-
-	threadpool_io->updates_size = 0;
-
 	threadpool_io->backend = backend_poll;
 	if (g_hasenv ("MONO_ENABLE_AIO")) {
 #if defined(HAVE_EPOLL)
 		threadpool_io->backend = backend_epoll;
+		aio = TRUE;
 #elif defined(HAVE_KQUEUE)
 		threadpool_io->backend = backend_kqueue;
+		aio = TRUE;
+#endif
+	}
+#if defined(HAVE_IO_URING)
+	/* Probe once, so all the selectors use the same backend; otherwise keep the one chosen above */
+	if (g_hasenv ("MONO_ENABLE_IO_URING")) {
+		if (uring_is_supported ()) {
+			threadpool_io->backend = backend_uring;
+			aio = TRUE;
+		} else {
+#if defined(HAVE_EPOLL)
+			threadpool_io->backend = backend_epoll;
+			aio = TRUE;
 #endif
+		}
 	}
+#endif
 
-	wakeup_pipes_init ();
+	/* With poll, a single thread scanning all the fds is cheaper than several ones */
+	if ((selectors_env = g_getenv ("MONO_THREADPOOL_IO_SELECTORS")))
+		threadpool_io->selectors_count = CLAMP (atoi (selectors_env), 1, 64);
+	else
+		threadpool_io->selectors_count = aio ? CLAMP (mono_cpu_count (), 1, SELECTORS_DEFAULT_MAX) : 1;
 
-	if (!threadpool_io->backend.init (threadpool_io->wakeup_pipes [0]))
-		g_error ("initialize: backend->init () failed");
+	threadpool_io->selectors = g_new0 (ThreadPoolIOSelector, threadpool_io->selectors_count);
 
-	mono_coop_mutex_lock (&threadpool_io->updates_lock);
+	for (i = 0; i < threadpool_io->selectors_count; ++i) {
+		ThreadPoolIOSelector *selector = &threadpool_io->selectors [i];
 
-	io_selector_running = TRUE;
+		mono_coop_mutex_init (&selector->updates_lock);
+		mono_coop_cond_init (&selector->updates_cond);
+		mono_gc_register_root ((char *)&selector->updates [0], sizeof (selector->updates), MONO_GC_DESCRIPTOR_NULL, MONO_ROOT_SOURCE_THREAD_POOL, "i/o thread pool updates list");
 
-	MonoError error;
-	if (!mono_thread_create_internal (mono_get_root_domain (), selector_thread, NULL, MONO_THREAD_CREATE_FLAGS_THREADPOOL | MONO_THREAD_CREATE_FLAGS_SMALL_STACK, &error))
-		g_error ("initialize: mono_thread_create_internal () failed due to %s", mono_error_get_message (&error));
+		selector->updates_size = 0;
+
+		wakeup_pipes_init (selector);
+
+		selector->backend_data = threadpool_io->backend.init (selector->wakeup_pipes [0]);
+		if (!selector->backend_data)
+			g_error ("initialize: backend->init () failed");
+
+		mono_coop_mutex_lock (&selector->updates_lock);
+
+		selector->running = TRUE;
+
+		MonoError error;
+		if (!mono_thread_create_internal (mono_get_root_domain (), selector_thread, selector, MONO_THREAD_CREATE_FLAGS_THREADPOOL | MONO_THREAD_CREATE_FLAGS_SMALL_STACK, &error))
+			g_error ("initialize: mono_thread_create_internal () failed due to %s", mono_error_get_message (&error));
 
-	mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+		mono_coop_mutex_unlock (&selector->updates_lock);
+	}
 }
 
 static void
@@ -585,6 +677,7 @@ mono_threadpool_io_cleanup (void)
 void
 ves_icall_System_IOSelector_Add (gpointer handle, MonoIOSelectorJob *job)
 {
+	ThreadPoolIOSelector *selector;
 	ThreadPoolIOUpdate *update;
 
 	g_assert (handle);
@@ -599,22 +692,24 @@ ves_icall_System_IOSelector_Add (gpointer handle, MonoIOSelectorJob *job)
 
 	mono_lazy_initialize (&io_status, initialize);
 
-	mono_coop_mutex_lock (&threadpool_io->updates_lock);
+	selector = get_selector_for_fd (GPOINTER_TO_INT (handle));
+
+	mono_coop_mutex_lock (&selector->updates_lock);
 
-	if (!io_selector_running) {
-		mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+	if (!selector->running) {
+		mono_coop_mutex_unlock (&selector->updates_lock);
 		return;
 	}
 
-	update = update_get_new ();
+	update = update_get_new (selector);
 	update->type = UPDATE_ADD;
 	update->data.add.fd = GPOINTER_TO_INT (handle);
 	update->data.add.job = job;
 	mono_memory_barrier (); /* Ensure this is safely published before we wake up the selector */
 
-	selector_thread_wakeup ();
+	selector_thread_wakeup (selector);
 
-	mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+	mono_coop_mutex_unlock (&selector->updates_lock);
 }
 
 void
@@ -626,55 +721,64 @@ ves_icall_System_IOSelector_Remove (gpointer handle)
 void
 mono_threadpool_io_remove_socket (int fd)
 {
+	ThreadPoolIOSelector *selector;
 	ThreadPoolIOUpdate *update;
 
 	if (!mono_lazy_is_initialized (&io_status))
 		return;
 
-	mono_coop_mutex_lock (&threadpool_io->updates_lock);
+	selector = get_selector_for_fd (fd);
+
+	mono_coop_mutex_lock (&selector->updates_lock);
 
-	if (!io_selector_running) {
-		mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+	if (!selector->running) {
+		mono_coop_mutex_unlock (&selector->updates_lock);
 		return;
 	}
 
-	update = update_get_new ();
+	update = update_get_new (selector);
 	update->type = UPDATE_REMOVE_SOCKET;
-	update->data.add.fd = fd;
+	update->data.remove_socket.fd = fd;
 	mono_memory_barrier (); /* Ensure this is safely published before we wake up the selector */
 
-	selector_thread_wakeup ();
+	selector_thread_wakeup (selector);
 
-	mono_coop_cond_wait (&threadpool_io->updates_cond, &threadpool_io->updates_lock);
+	mono_coop_cond_wait (&selector->updates_cond, &selector->updates_lock);
 
-	mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+	mono_coop_mutex_unlock (&selector->updates_lock);
 }
 
 void
 mono_threadpool_io_remove_domain_jobs (MonoDomain *domain)
 {
-	ThreadPoolIOUpdate *update;
+	gint i;
 
 	if (!mono_lazy_is_initialized (&io_status))
 		return;
 
-	mono_coop_mutex_lock (&threadpool_io->updates_lock);
+	/* The jobs of the domain can be waiting on any of the selectors */
+	for (i = 0; i < threadpool_io->selectors_count; ++i) {
+		ThreadPoolIOSelector *selector = &threadpool_io->selectors [i];
+		ThreadPoolIOUpdate *update;
 
-	if (!io_selector_running) {
-		mono_coop_mutex_unlock (&threadpool_io->updates_lock);
-		return;
-	}
+		mono_coop_mutex_lock (&selector->updates_lock);
 
-	update = update_get_new ();
-	update->type = UPDATE_REMOVE_DOMAIN;
-	update->data.remove_domain.domain = domain;
-	mono_memory_barrier (); /* Ensure this is safely published before we wake up the selector */
+		if (!selector->running) {
+			mono_coop_mutex_unlock (&selector->updates_lock);
+			continue;
+		}
 
-	selector_thread_wakeup ();
+		update = update_get_new (selector);
+		update->type = UPDATE_REMOVE_DOMAIN;
+		update->data.remove_domain.domain = domain;
+		mono_memory_barrier (); /* Ensure this is safely published before we wake up the selector */
 
-	mono_coop_cond_wait (&threadpool_io->updates_cond, &threadpool_io->updates_lock);
+		selector_thread_wakeup (selector);
 
-	mono_coop_mutex_unlock (&threadpool_io->updates_lock);
+		mono_coop_cond_wait (&selector->updates_cond, &selector->updates_lock);
+
+		mono_coop_mutex_unlock (&selector->updates_lock);
+	}
 }
 
 #else
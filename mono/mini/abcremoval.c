@@ -10,6 +10,7 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <mono/metadata/abi-details.h>
 #include <mono/metadata/debug-helpers.h>
 #include <mono/metadata/mempool.h>
 #include <mono/metadata/opcodes.h>
@@ -21,6 +22,7 @@
 #ifndef DISABLE_JIT
 
 #include "abcremoval.h"
+#include "ir-emit.h"
 
 #if SIZEOF_VOID_P == 8
 #define OP_PCONST OP_I8CONST
@@ -1241,6 +1243,22 @@ type_to_value_kind (MonoType *type)
 	}
 }
 
+static int
+count_bounds_checks (MonoCompile *cfg)
+{
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+	int count = 0;
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			if (ins->opcode == OP_BOUNDS_CHECK)
+				count ++;
+		}
+	}
+	return count;
+}
+
 /**
  * mono_perform_abc_removal:
  * \param cfg Control Flow Graph
@@ -1262,7 +1280,7 @@ mono_perform_abc_removal (MonoCompile *cfg)
 {
 	MonoVariableRelationsEvaluationArea area;
 	MonoBasicBlock *bb;
-	int i;
+	int i, num_checks, remaining;
 	
 	verbose_level = cfg->verbose_level;
 	
@@ -1391,7 +1409,579 @@ mono_perform_abc_removal (MonoCompile *cfg)
 		}
 	}
 
+	num_checks = count_bounds_checks (cfg);
+
 	process_block (cfg, cfg->bblocks [0], &area);
+
+	remaining = count_bounds_checks (cfg);
+	mono_jit_stats.abc_checks_removed += num_checks - remaining;
+	mono_jit_stats.abc_checks_remaining += remaining;
+	if (verbose_level > 0 && num_checks)
+		printf ("ABCREM: %s: removed %d of %d bounds checks, %d remaining\n", mono_method_full_name (cfg->method, TRUE), num_checks - remaining, num_checks, remaining);
+}
+
+/*
+ * Loop versioning
+ *
+ * The relational analysis above can only remove the bounds checks in a loop if the
+ * loop condition relates the index to the length of the array, like in
+ * for (i = 0; i < a.Length; ++i). If the limit is something else, like a local
+ * variable, a constant or the length of another array, we create two versions of the
+ * loop: a guard emitted in front of the loop checks that the iteration space is inside
+ * the bounds of every array accessed by the loop, branching to a copy of the loop if
+ * it is, and to the original loop otherwise. The relations implied by the guard
+ * branches make the checks in the copy redundant, so mono_perform_abc_removal ()
+ * will remove them later.
+ * This runs before the SSA form is computed, so no phi nodes need to be updated.
+ * Only loops whose induction variable counts up are versioned, loops counting down
+ * like for (i = n - 1; i >= 0; --i) are left alone.
+ */
+
+#define MAX_VERSIONED_ARRAYS 4
+#define MAX_VERSIONED_LOOP_SIZE 256
+
+typedef struct {
+	MonoBasicBlock *header, *preheader;
+	/* The induction variable */
+	int iv;
+	/* The loop limit, either a variable or a constant */
+	int limit;
+	int limit_imm;
+	gboolean limit_is_imm;
+	/* The array whose length is the loop limit, or -1 */
+	int limit_array;
+	/* Whenever the loop continues while iv <= limit instead of iv < limit */
+	gboolean inclusive;
+	int arrays [MAX_VERSIONED_ARRAYS];
+	int num_arrays;
+} VersionedLoop;
+
+static gboolean
+is_loop_header (MonoBasicBlock *bb)
+{
+	return bb->loop_blocks && bb->loop_blocks->data == bb;
+}
+
+static gboolean
+can_clone_ins (MonoInst *ins)
+{
+	if (MONO_IS_CALL (ins))
+		return FALSE;
+
+	switch (ins->opcode) {
+	case OP_SWITCH:
+	case OP_BR_REG:
+	case OP_JUMP_TABLE:
+	case OP_LABEL:
+	case OP_LOCALLOC:
+	case OP_LOCALLOC_IMM:
+	case OP_ENDFINALLY:
+	case OP_ENDFILTER:
+	case OP_THROW:
+	case OP_RETHROW:
+	case OP_JMP:
+	case OP_SEQ_POINT:
+	case OP_OUTARG_VT:
+	case OP_ARGLIST:
+	case OP_DYN_CALL:
+	case OP_GC_LIVENESS_DEF:
+	case OP_GC_LIVENESS_USE:
+	case OP_GC_SPILL_SLOT_LIVENESS_DEF:
+	case OP_GC_PARAM_SLOT_LIVENESS_DEF:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+static gboolean
+defines_vreg (MonoInst *ins, int vreg)
+{
+	const char *spec = INS_INFO (ins->opcode);
+
+	return spec [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && ins->dreg == vreg;
+}
+
+/*
+ * Return the instruction defining VREG before INS in the same bblock.
+ */
+static MonoInst*
+find_local_def (MonoInst *ins, int vreg)
+{
+	for (ins = ins->prev; ins; ins = ins->prev) {
+		if (defines_vreg (ins, vreg))
+			return ins;
+	}
+	return NULL;
+}
+
+/*
+ * Return whenever VREG is a variable which is not modified inside the loop headed
+ * by HEADER.
+ */
+static gboolean
+is_loop_invariant_var (MonoCompile *cfg, MonoBasicBlock *header, int vreg)
+{
+	MonoInst *var = get_vreg_to_inst (cfg, vreg);
+	GList *l;
+	MonoInst *ins;
+
+	if (!var || (var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)))
+		return FALSE;
+
+	for (l = header->loop_blocks; l; l = l->next) {
+		MONO_BB_FOR_EACH_INS ((MonoBasicBlock*)l->data, ins) {
+			if (defines_vreg (ins, vreg))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/*
+ * Return whenever every assignment to the variable IV inside the loop headed by HEADER
+ * increments it by a positive constant.
+ */
+static gboolean
+is_counting_up (MonoCompile *cfg, MonoBasicBlock *header, int iv)
+{
+	MonoInst *var = get_vreg_to_inst (cfg, iv);
+	GList *l;
+	MonoInst *ins, *def;
+	int ndefs = 0;
+
+	if (!var || (var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)) || var->type != STACK_I4)
+		return FALSE;
+
+	for (l = header->loop_blocks; l; l = l->next) {
+		MONO_BB_FOR_EACH_INS ((MonoBasicBlock*)l->data, ins) {
+			if (!defines_vreg (ins, iv))
+				continue;
+			def = ins;
+			if (def->opcode == OP_MOVE && !get_vreg_to_inst (cfg, def->sreg1))
+				def = find_local_def (ins, ins->sreg1);
+			if (!def || def->opcode != OP_IADD_IMM || def->sreg1 != iv || def->inst_imm <= 0)
+				return FALSE;
+			ndefs ++;
+		}
+	}
+	return ndefs > 0;
+}
+
+static void
+add_versioned_array (VersionedLoop *loop, int array)
+{
+	int i;
+
+	if (array == loop->limit_array || loop->num_arrays == MAX_VERSIONED_ARRAYS)
+		return;
+	for (i = 0; i < loop->num_arrays; ++i)
+		if (loop->arrays [i] == array)
+			return;
+	loop->arrays [loop->num_arrays ++] = array;
+}
+
+/*
+ * Check whenever the loop headed by HEADER is a candidate for versioning, filling out
+ * LOOP if it is.
+ */
+static gboolean
+analyze_loop (MonoCompile *cfg, MonoBasicBlock *header, VersionedLoop *loop)
+{
+	MonoBasicBlock *preheader = header->idom;
+	MonoInst *ins, *compare, *branch, *def;
+	GList *l;
+	gboolean true_in_loop, false_in_loop;
+	int size = 0, rel;
+
+	memset (loop, 0, sizeof (VersionedLoop));
+	loop->limit_array = -1;
+
+	if (!preheader || !preheader->last_ins || preheader->last_ins->opcode != OP_BR || preheader->last_ins->inst_target_bb != header)
+		return FALSE;
+	if (preheader->region != -1 || g_list_find (header->loop_blocks, preheader))
+		return FALSE;
+
+	for (l = header->loop_blocks; l; l = l->next) {
+		MonoBasicBlock *bb = (MonoBasicBlock *)l->data;
+
+		/* Only innermost loops */
+		if (bb != header && is_loop_header (bb))
+			return FALSE;
+		if (bb->region != -1 || bb == cfg->bb_exit)
+			return FALSE;
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			if (!can_clone_ins (ins))
+				return FALSE;
+			size ++;
+		}
+		ins = bb->last_ins;
+		if (ins && MONO_IS_COND_BRANCH_OP (ins) && !ins->inst_false_bb)
+			return FALSE;
+		if ((!ins || !MONO_IS_BRANCH_OP (ins)) && bb->out_count != 1)
+			return FALSE;
+	}
+	if (size > MAX_VERSIONED_LOOP_SIZE)
+		return FALSE;
+
+	/* The loop condition */
+	branch = header->last_ins;
+	if (!branch || !MONO_IS_COND_BRANCH_OP (branch) || branch == header->code)
+		return FALSE;
+	compare = branch->prev;
+	true_in_loop = g_list_find (header->loop_blocks, branch->inst_true_bb) != NULL;
+	false_in_loop = g_list_find (header->loop_blocks, branch->inst_false_bb) != NULL;
+	if (true_in_loop == false_in_loop)
+		return FALSE;
+	switch (branch->opcode) {
+	case OP_IBLT:
+		rel = true_in_loop ? MONO_LT_RELATION : MONO_GE_RELATION;
+		break;
+	case OP_IBLE:
+		rel = true_in_loop ? MONO_LE_RELATION : MONO_GT_RELATION;
+		break;
+	case OP_IBGE:
+		rel = true_in_loop ? MONO_GE_RELATION : MONO_LT_RELATION;
+		break;
+	case OP_IBGT:
+		rel = true_in_loop ? MONO_GT_RELATION : MONO_LE_RELATION;
+		break;
+	default:
+		return FALSE;
+	}
+	if (rel != MONO_LT_RELATION && rel != MONO_LE_RELATION)
+		return FALSE;
+	loop->inclusive = rel == MONO_LE_RELATION;
+
+	if (compare->opcode == OP_ICOMPARE) {
+		loop->limit = compare->sreg2;
+		if (!is_loop_invariant_var (cfg, header, loop->limit)) {
+			/* i < b.Length */
+			def = find_local_def (compare, loop->limit);
+			if (!def || def->opcode != OP_LDLEN || get_vreg_to_inst (cfg, loop->limit) || !is_loop_invariant_var (cfg, header, def->sreg1))
+				return FALSE;
+			loop->limit_array = def->sreg1;
+		}
+	} else if (compare->opcode == OP_ICOMPARE_IMM) {
+		loop->limit_is_imm = TRUE;
+		loop->limit_imm = compare->inst_imm;
+	} else {
+		return FALSE;
+	}
+	loop->iv = compare->sreg1;
+	if (!is_counting_up (cfg, header, loop->iv))
+		return FALSE;
+
+	/* The arrays accessed using the induction variable as the index */
+	for (l = header->loop_blocks; l; l = l->next) {
+		MONO_BB_FOR_EACH_INS ((MonoBasicBlock*)l->data, ins) {
+			if (ins->opcode != OP_BOUNDS_CHECK || ins->inst_imm != MONO_STRUCT_OFFSET (MonoArray, max_length))
+				continue;
+			if (ins->sreg2 != loop->iv) {
+				def = find_local_def (ins, ins->sreg2);
+				if (!def || (def->opcode != OP_SEXT_I4 && def->opcode != OP_MOVE) || def->sreg1 != loop->iv)
+					continue;
+			}
+			if (is_loop_invariant_var (cfg, header, ins->sreg1))
+				add_versioned_array (loop, ins->sreg1);
+		}
+	}
+	if (!loop->num_arrays)
+		return FALSE;
+
+	loop->header = header;
+	loop->preheader = preheader;
+	return TRUE;
+}
+
+static MonoBasicBlock*
+new_bblock (MonoCompile *cfg, MonoBasicBlock *template_bb)
+{
+	MonoBasicBlock *bb = (MonoBasicBlock *)mono_mempool_alloc0 (cfg->mempool, sizeof (MonoBasicBlock));
+
+	bb->block_num = cfg->max_block_num ++;
+	bb->cil_code = template_bb->cil_code;
+	bb->real_offset = template_bb->real_offset;
+	bb->region = template_bb->region;
+	return bb;
+}
+
+static void
+emit_br (MonoCompile *cfg, MonoBasicBlock *bb, MonoBasicBlock *target)
+{
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, OP_BR);
+	ins->inst_target_bb = target;
+	MONO_ADD_INS (bb, ins);
+	mono_link_bblock (cfg, bb, target);
+}
+
+/*
+ * Emit a branch to FAIL_BB if the preceeding compare satisfies the condition of OPCODE,
+ * and return the bblock executed otherwise.
+ */
+static MonoBasicBlock*
+emit_guard_branch (MonoCompile *cfg, MonoBasicBlock *bb, int opcode, MonoBasicBlock *fail_bb)
+{
+	MonoBasicBlock *next_bb = new_bblock (cfg, bb);
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, opcode);
+	ins->inst_true_bb = fail_bb;
+	ins->inst_false_bb = next_bb;
+	MONO_ADD_INS (bb, ins);
+	mono_link_bblock (cfg, bb, fail_bb);
+	mono_link_bblock (cfg, bb, next_bb);
+	bb->next_bb = next_bb;
+	return next_bb;
+}
+
+static void
+emit_compare (MonoCompile *cfg, MonoBasicBlock *bb, int opcode, int sreg1, int sreg2, int imm)
+{
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, opcode);
+	ins->sreg1 = sreg1;
+	ins->sreg2 = sreg2;
+	ins->inst_imm = imm;
+	MONO_ADD_INS (bb, ins);
+}
+
+/*
+ * Emit a null check of ARRAY branching to FAIL_BB, followed by a load of its length.
+ */
+static MonoBasicBlock*
+emit_array_length (MonoCompile *cfg, MonoBasicBlock *bb, int array, MonoBasicBlock *fail_bb, int *length_reg)
+{
+	MonoInst *ins;
+
+	emit_compare (cfg, bb, OP_COMPARE_IMM, array, -1, 0);
+	bb = emit_guard_branch (cfg, bb, OP_PBEQ, fail_bb);
+
+	MONO_INST_NEW (cfg, ins, OP_LDLEN);
+	ins->dreg = alloc_preg (cfg);
+	ins->sreg1 = array;
+	ins->type = STACK_I4;
+	ins->flags |= MONO_INST_FAULT;
+	MONO_ADD_INS (bb, ins);
+	cfg->flags |= MONO_CFG_HAS_ARRAY_ACCESS;
+	bb->has_array_access = TRUE;
+
+	*length_reg = ins->dreg;
+	return bb;
+}
+
+/*
+ * Give the vregs which are local to the bblocks of the cloned loop new numbers, so
+ * they have a single definition, which mono_perform_abc_removal () relies on. The
+ * vregs of variables are renamed later by the SSA construction.
+ */
+static void
+rename_local_vregs (MonoCompile *cfg, MonoBasicBlock *bb, GHashTable *vregs)
+{
+	MonoInst *ins;
+	int *reg;
+	int vreg, regindex;
+
+	MONO_BB_FOR_EACH_INS (bb, ins) {
+		const char *spec = INS_INFO (ins->opcode);
+
+		/* Uses first, an instruction can define a vreg it uses */
+		for (regindex = 0; regindex < 4; regindex ++) {
+			if (regindex == 0) {
+				if (spec [MONO_INST_DEST] == ' ' || !MONO_IS_STORE_MEMBASE (ins))
+					continue;
+				reg = &ins->dreg;
+			} else if (regindex == 1) {
+				if (spec [MONO_INST_SRC1] == ' ')
+					continue;
+				reg = &ins->sreg1;
+			} else if (regindex == 2) {
+				if (spec [MONO_INST_SRC2] == ' ')
+					continue;
+				reg = &ins->sreg2;
+			} else {
+				if (spec [MONO_INST_SRC3] == ' ')
+					continue;
+				reg = &ins->sreg3;
+			}
+			vreg = GPOINTER_TO_INT (g_hash_table_lookup (vregs, GINT_TO_POINTER (*reg)));
+			if (vreg)
+				*reg = vreg;
+		}
+
+		if (spec [MONO_INST_DEST] == ' ' || MONO_IS_STORE_MEMBASE (ins))
+			continue;
+		if (ins->dreg < MAX (MONO_MAX_IREGS, MONO_MAX_FREGS) || get_vreg_to_inst (cfg, ins->dreg))
+			continue;
+
+		switch (spec [MONO_INST_DEST]) {
+		case 'f':
+			vreg = alloc_freg (cfg);
+			break;
+		case 'l':
+			vreg = alloc_lreg (cfg);
+			break;
+		case 'x':
+			vreg = alloc_xreg (cfg);
+			break;
+		default:
+			vreg = alloc_ireg (cfg);
+			break;
+		}
+		if (vreg_is_ref (cfg, ins->dreg))
+			mono_mark_vreg_as_ref (cfg, vreg);
+		if (vreg_is_mp (cfg, ins->dreg))
+			mono_mark_vreg_as_mp (cfg, vreg);
+		g_hash_table_insert (vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (vreg));
+		ins->dreg = vreg;
+	}
+}
+
+static void
+version_loop (MonoCompile *cfg, VersionedLoop *loop)
+{
+	MonoBasicBlock *header = loop->header, *preheader = loop->preheader;
+	MonoBasicBlock *guard_bb, *fast_bb, *slow_bb, *last_bb, *next_bb;
+	GHashTable *clones = g_hash_table_new (NULL, NULL);
+	GHashTable *vregs = g_hash_table_new (NULL, NULL);
+	GList *l;
+	MonoInst *ins;
+	int i, limit, length_reg;
+
+	slow_bb = new_bblock (cfg, preheader);
+	guard_bb = new_bblock (cfg, preheader);
+
+	mono_unlink_bblock (cfg, preheader, header);
+	preheader->last_ins->inst_target_bb = guard_bb;
+	mono_link_bblock (cfg, preheader, guard_bb);
+
+	/* iv >= 0 */
+	next_bb = guard_bb;
+	emit_compare (cfg, next_bb, OP_ICOMPARE_IMM, loop->iv, -1, 0);
+	next_bb = emit_guard_branch (cfg, next_bb, OP_IBLT, slow_bb);
+
+	limit = loop->limit;
+	if (loop->limit_array != -1)
+		next_bb = emit_array_length (cfg, next_bb, loop->limit_array, slow_bb, &limit);
+
+	/* limit <= a.Length or limit < a.Length */
+	for (i = 0; i < loop->num_arrays; ++i) {
+		next_bb = emit_array_length (cfg, next_bb, loop->arrays [i], slow_bb, &length_reg);
+		if (loop->limit_is_imm) {
+			emit_compare (cfg, next_bb, OP_ICOMPARE_IMM, length_reg, -1, loop->limit_imm);
+			next_bb = emit_guard_branch (cfg, next_bb, loop->inclusive ? OP_IBLE : OP_IBLT, slow_bb);
+		} else {
+			emit_compare (cfg, next_bb, OP_ICOMPARE, limit, length_reg, 0);
+			next_bb = emit_guard_branch (cfg, next_bb, loop->inclusive ? OP_IBGE : OP_IBGT, slow_bb);
+		}
+	}
+	fast_bb = next_bb;
+
+	/* Clone the loop */
+	for (l = header->loop_blocks; l; l = l->next) {
+		MonoBasicBlock *bb = (MonoBasicBlock *)l->data;
+		MonoBasicBlock *clone = new_bblock (cfg, bb);
+
+		clone->flags = bb->flags & ~BB_VISITED;
+		clone->has_array_access = bb->has_array_access;
+		clone->out_of_line = bb->out_of_line;
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			MonoInst *dup = (MonoInst *)mono_mempool_alloc (cfg->mempool, sizeof (MonoInst));
+
+			memcpy (dup, ins, sizeof (MonoInst));
+			dup->next = dup->prev = NULL;
+			MONO_ADD_INS (clone, dup);
+		}
+		rename_local_vregs (cfg, clone, vregs);
+		g_hash_table_insert (clones, bb, clone);
+	}
+
+#define CLONED_BB(bb) (g_hash_table_lookup (clones, (bb)) ? (MonoBasicBlock *)g_hash_table_lookup (clones, (bb)) : (bb))
+
+	last_bb = fast_bb;
+	emit_br (cfg, fast_bb, CLONED_BB (header));
+	for (l = header->loop_blocks; l; l = l->next) {
+		MonoBasicBlock *bb = (MonoBasicBlock *)l->data;
+		MonoBasicBlock *clone = CLONED_BB (bb);
+
+		ins = clone->last_ins;
+		if (ins && MONO_IS_COND_BRANCH_OP (ins)) {
+			ins->inst_true_bb = CLONED_BB (ins->inst_true_bb);
+			ins->inst_false_bb = CLONED_BB (ins->inst_false_bb);
+		} else if (ins && ins->opcode == OP_BR) {
+			ins->inst_target_bb = CLONED_BB (ins->inst_target_bb);
+		}
+		for (i = 0; i < bb->out_count; ++i)
+			mono_link_bblock (cfg, clone, CLONED_BB (bb->out_bb [i]));
+		if (!ins || !MONO_IS_BRANCH_OP (ins)) {
+			/* The original falls through to its next bblock */
+			MonoInst *br;
+
+			MONO_INST_NEW (cfg, br, OP_BR);
+			br->inst_target_bb = clone->out_bb [0];
+			MONO_ADD_INS (clone, br);
+		}
+
+		last_bb->next_bb = clone;
+		last_bb = clone;
+	}
+
+#undef CLONED_BB
+
+	emit_br (cfg, slow_bb, header);
+
+	/* Lay out the new bblocks after the preheader */
+	next_bb = preheader->next_bb;
+	preheader->next_bb = guard_bb;
+	for (last_bb = guard_bb; last_bb->next_bb; last_bb = last_bb->next_bb)
+		;
+	last_bb->next_bb = slow_bb;
+	slow_bb->next_bb = next_bb;
+
+	g_hash_table_destroy (clones);
+	g_hash_table_destroy (vregs);
+}
+
+/**
+ * mono_abc_loop_versioning:
+ * \param cfg Control Flow Graph
+ *
+ * Version the innermost loops whose bounds checks are not removable by
+ * mono_perform_abc_removal () alone. Requires the dominator and loop info to be
+ * computed. Returns whenever the CFG was changed, in which case the caller
+ * needs to recompute the bblock ordering, the dominators and the loop info.
+ */
+gboolean
+mono_abc_loop_versioning (MonoCompile *cfg)
+{
+	VersionedLoop *loops = NULL;
+	VersionedLoop loop;
+	MonoBasicBlock *bb;
+	int i, nloops = 0;
+
+	if (!(cfg->comp_done & MONO_COMP_LOOPS))
+		return FALSE;
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		if (!is_loop_header (bb) || !analyze_loop (cfg, bb, &loop))
+			continue;
+		loops = (VersionedLoop *)g_realloc (loops, sizeof (VersionedLoop) * (nloops + 1));
+		loops [nloops ++] = loop;
+	}
+
+	/* The loops are innermost loops, so they are disjoint */
+	for (i = 0; i < nloops; ++i) {
+		if (cfg->verbose_level > 1)
+			printf ("ABCREM: versioning loop BB%d (%d arrays) in %s\n", loops [i].header->block_num, loops [i].num_arrays, mono_method_full_name (cfg->method, TRUE));
+		version_loop (cfg, &loops [i]);
+		mono_jit_stats.abc_loops_versioned ++;
+	}
+
+	g_free (loops);
+	return nloops > 0;
 }
 
 #else /* !DISABLE_JIT */
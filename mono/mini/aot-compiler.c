@@ -54,6 +54,8 @@
 #include <mono/utils/mono-time.h>
 #include <mono/utils/mono-mmap.h>
 #include <mono/utils/mono-rand.h>
+#include <mono/utils/mono-digest.h>
+#include <mono/utils/mono-group-varint.h>
 #include <mono/utils/json.h>
 #include <mono/utils/mono-threads-coop.h>
 #include <mono/profiler/aot.h>
@@ -124,6 +126,10 @@ typedef struct {
 	char *signature;
 	GInstProfileData *inst;
 	MonoMethod *method;
+	/* The number of calls, only valid if IL_COUNTS is set */
+	int call_count;
+	/* IL offset + 1 -> execution count, for the IL offsets which were executed */
+	GHashTable *il_counts;
 } MethodProfileData;
 
 typedef struct {
@@ -191,6 +197,8 @@ typedef struct MonoAotOptions {
 	char *temp_path;
 	char *instances_logfile_path;
 	char *logfile;
+	char *cache_dir;
+	char *dedup_include;
 	gboolean dump_json;
 	gboolean profile_only;
 } MonoAotOptions;
@@ -265,6 +273,8 @@ typedef struct MonoAotCompile {
 	guint32 opts;
 	guint32 simd_opts;
 	MonoMemPool *mempool;
+	/* Mempools used by the compile threads, freed together with acfg */
+	GPtrArray *thread_mempools;
 	MonoAotStats stats;
 	int method_index;
 	char *static_linking_symbol;
@@ -316,11 +326,16 @@ typedef struct MonoAotCompile {
 	GHashTable *objc_selector_to_index;
 	GList *profile_data;
 	GHashTable *profile_methods;
+	/* MonoMethod -> MethodProfileData */
+	GHashTable *method_profiles;
 	FILE *logfile;
 	FILE *instances_logfile;
 	FILE *data_outfile;
 	int datafile_offset;
 	int gc_name_offset;
+	/* Set when compiling with 'dedup-include', see add_dedup_method () */
+	gboolean dedup_skip, dedup_container;
+	int dedup_container_index;
 } MonoAotCompile;
 
 typedef struct {
@@ -336,6 +351,9 @@ typedef struct {
 /* This points to the current acfg in LLVM mode */
 static MonoAotCompile *llvm_acfg;
 
+/* This points to the current acfg if it has profile data, used by the JIT */
+static MonoAotCompile *profile_acfg;
+
 #ifdef HAVE_ARRAY_ELEM_INIT
 #define MSGSTRFIELD(line) MSGSTRFIELD1(line)
 #define MSGSTRFIELD1(line) str##line
@@ -388,6 +406,9 @@ add_gsharedvt_wrappers (MonoAotCompile *acfg, MonoMethodSignature *sig, gboolean
 static void
 add_profile_instances (MonoAotCompile *acfg, ProfileData *data);
 
+static MethodProfileData*
+lookup_method_profile (MonoAotCompile *acfg, MonoMethod *method);
+
 static void
 aot_printf (MonoAotCompile *acfg, const gchar *format, ...)
 {
@@ -2728,33 +2749,36 @@ emit_aot_data (MonoAotCompile *acfg, MonoAotFileTable table, const char *symbol,
 static guint32
 emit_offset_table (MonoAotCompile *acfg, const char *symbol, MonoAotFileTable table, int noffsets, int group_size, gint32 *offsets)
 {
-	gint32 current_offset;
-	int i, buf_size, ngroups, index_entry_size;
+	int i, j, buf_size, ngroups, index_entry_size;
 	guint8 *p, *buf;
 	guint8 *data_p, *data_buf;
-	guint32 *index_offsets;
+	guint32 *index_offsets, *values;
 
 	ngroups = (noffsets + (group_size - 1)) / group_size;
 
 	index_offsets = g_new0 (guint32, ngroups);
+	values = g_new0 (guint32, group_size);
 
-	buf_size = noffsets * 4;
+	buf_size = noffsets * 5 + ngroups + 16;
 	p = buf = (guint8 *)g_malloc0 (buf_size);
 
-	current_offset = 0;
-	for (i = 0; i < noffsets; ++i) {
-		//printf ("D: %d -> %d\n", i, offsets [i]);
-		if ((i % group_size) == 0) {
-			index_offsets [i / group_size] = p - buf;
-			/* Emit the full value for these entries */
-			encode_value (offsets [i], p, &p);
-		} else {
-			/* The offsets are allowed to be non-increasing */
-			//g_assert (offsets [i] >= current_offset);
-			encode_value (offsets [i] - current_offset, p, &p);
-		}
-		current_offset = offsets [i];
+	/*
+	 * Each group is encoded using mono_group_varint_encode (), the first entry holds the
+	 * full value, the rest the difference from the previous entry.
+	 */
+	for (i = 0; i < ngroups; ++i) {
+		int n = MIN (group_size, noffsets - (i * group_size));
+		gint32 *group_offsets = offsets + (i * group_size);
+
+		index_offsets [i] = p - buf;
+		values [0] = group_offsets [0];
+		/* The offsets are allowed to be non-increasing */
+		for (j = 1; j < n; ++j)
+			values [j] = mono_zigzag_encode (group_offsets [j] - group_offsets [j - 1]);
+		mono_group_varint_encode (values, n, p, &p);
 	}
+	g_assert (p - buf <= buf_size);
+	g_free (values);
 	data_buf = buf;
 	data_p = p;
 
@@ -3632,6 +3656,44 @@ add_method (MonoAotCompile *acfg, MonoMethod *method)
 	return add_method_full (acfg, method, FALSE, 0);
 }
 
+/*
+ * With the 'dedup-include=<assembly name>' option, the images compiled in one
+ * invocation of the AOT compiler don't contain their own copies of generic
+ * instances like List<int>.Add (). They are added to this table instead, and compiled
+ * into the image of the named assembly, the generics container, which has to be
+ * compiled last. At runtime, find_aot_method () finds them in the container.
+ * The images are compiled one after the other, and methods are added under the
+ * acfg lock, so this doesn't need its own lock.
+ */
+static GPtrArray *dedup_methods;
+static GHashTable *dedup_methods_hash;
+
+static gboolean
+can_dedup (MonoMethod *method)
+{
+	/* Only instances without type variables, shared code is cheap to duplicate */
+	if (!method->is_inflated || method->wrapper_type)
+		return FALSE;
+	if (mono_method_is_generic_sharable_full (method, TRUE, FALSE, FALSE))
+		return FALSE;
+	if (mini_is_gsharedvt_klass (method->klass) || mini_is_gsharedvt_signature (mono_method_signature (method)))
+		return FALSE;
+	return TRUE;
+}
+
+static void
+add_dedup_method (MonoAotCompile *acfg, MonoMethod *method)
+{
+	if (!dedup_methods) {
+		dedup_methods = g_ptr_array_new ();
+		dedup_methods_hash = g_hash_table_new (NULL, NULL);
+	}
+	if (g_hash_table_lookup (dedup_methods_hash, method))
+		return;
+	g_hash_table_insert (dedup_methods_hash, method, method);
+	g_ptr_array_add (dedup_methods, method);
+}
+
 static void
 add_extra_method_with_depth (MonoAotCompile *acfg, MonoMethod *method, int depth)
 {
@@ -3641,6 +3703,13 @@ add_extra_method_with_depth (MonoAotCompile *acfg, MonoMethod *method, int depth
 		/* Use the gsharedvt version */
 		method = mini_get_shared_method_full (method, TRUE, TRUE);
 
+	if (acfg->dedup_skip && can_dedup (method)) {
+		if (acfg->aot_opts.log_generics)
+			aot_printf (acfg, "%*sLeaving method %s to the generics container.\n", depth, "", mono_method_get_full_name (method));
+		add_dedup_method (acfg, method);
+		return;
+	}
+
 	if (acfg->aot_opts.log_generics)
 		aot_printf (acfg, "%*sAdding method %s.\n", depth, "", mono_method_get_full_name (method));
 
@@ -5918,11 +5987,17 @@ static void
 encode_patch_list (MonoAotCompile *acfg, GPtrArray *patches, int n_patches, gboolean llvm, int first_got_offset, guint8 *buf, guint8 **endbuf)
 {
 	guint8 *p = buf;
-	guint32 pindex, offset;
+	guint32 pindex, offset, prev_offset;
+	guint32 *offsets;
+	int n;
 	MonoJumpInfo *patch_info;
 
 	encode_value (n_patches, p, &p);
 
+	/* The got offsets are encoded as differences from the previous offset, see load_patch_info () */
+	offsets = g_new0 (guint32, patches->len + 1);
+	prev_offset = 0;
+	n = 0;
 	for (pindex = 0; pindex < patches->len; ++pindex) {
 		patch_info = (MonoJumpInfo *)g_ptr_array_index (patches, pindex);
 
@@ -5931,8 +6006,12 @@ encode_patch_list (MonoAotCompile *acfg, GPtrArray *patches, int n_patches, gboo
 			continue;
 
 		offset = get_got_offset (acfg, llvm, patch_info);
-		encode_value (offset, p, &p);
+		offsets [n ++] = mono_zigzag_encode ((gint32)(offset - prev_offset));
+		prev_offset = offset;
 	}
+	g_assert (n == n_patches);
+	mono_group_varint_encode (offsets, n, p, &p);
+	g_free (offsets);
 
 	*endbuf = p;
 }
@@ -6076,12 +6155,10 @@ emit_exception_debug_info (MonoAotCompile *acfg, MonoCompile *cfg, gboolean stor
 	code = cfg->native_code;
 	header = cfg->header;
 
-	if (!acfg->aot_opts.nodebug) {
-		mono_debug_serialize_debug_info (cfg, &debug_info, &debug_info_size);
-	} else {
-		debug_info = NULL;
-		debug_info_size = 0;
-	}
+	/* Computed by compile_method () */
+	debug_info = cfg->aot_debug_info;
+	debug_info_size = cfg->aot_debug_info_size;
+	cfg->aot_debug_info = NULL;
 
 	seq_points = cfg->seq_point_info;
 	seq_points_size = (store_seq_points)? mono_seq_point_info_get_write_size (seq_points) : 0;
@@ -6101,7 +6178,11 @@ emit_exception_debug_info (MonoAotCompile *acfg, MonoCompile *cfg, gboolean stor
 		guint8 *encoded;
 		guint32 unwind_desc;
 
-		encoded = mono_unwind_ops_encode (cfg->unwind_ops, &encoded_len);
+		encoded = cfg->aot_unwind_info;
+		encoded_len = cfg->aot_unwind_info_len;
+		if (!encoded)
+			encoded = mono_unwind_ops_encode (cfg->unwind_ops, &encoded_len);
+		cfg->aot_unwind_info = NULL;
 
 		unwind_desc = get_unwind_info_offset (acfg, encoded, encoded_len);
 		encode_value (unwind_desc, p, &p);
@@ -6186,6 +6267,7 @@ emit_exception_debug_info (MonoAotCompile *acfg, MonoCompile *cfg, gboolean stor
 
 		for (k = 0; k < jinfo->num_clauses; ++k) {
 			MonoJitExceptionInfo *ei = &jinfo->clauses [k];
+			guint32 native_offsets [3];
 
 			encode_value (ei->flags, p, &p);
 #ifdef MONO_CONTEXT_SET_LLVM_EXC_REG
@@ -6217,20 +6299,25 @@ emit_exception_debug_info (MonoAotCompile *acfg, MonoCompile *cfg, gboolean stor
 				}
 			}
 
-			encode_value ((gint)((guint8*)ei->try_start - code), p, &p);
-			encode_value ((gint)((guint8*)ei->try_end - code), p, &p);
-			encode_value ((gint)((guint8*)ei->handler_start - code), p, &p);
+			native_offsets [0] = (guint8*)ei->try_start - code;
+			native_offsets [1] = (guint8*)ei->try_end - code;
+			native_offsets [2] = (guint8*)ei->handler_start - code;
+			mono_group_varint_encode (native_offsets, 3, p, &p);
 		}
 	}
 
 	if (jinfo->has_try_block_holes) {
 		MonoTryBlockHoleTableJitInfo *table = mono_jit_info_get_try_block_hole_table_info (jinfo);
+		guint32 *values = g_new (guint32, table->num_holes * 3);
+
 		for (i = 0; i < table->num_holes; ++i) {
 			MonoTryBlockHoleJitInfo *hole = &table->holes [i];
-			encode_value (hole->clause, p, &p);
-			encode_value (hole->length, p, &p);
-			encode_value (hole->offset, p, &p);
+			values [i * 3] = hole->clause;
+			values [i * 3 + 1] = hole->length;
+			values [i * 3 + 2] = hole->offset;
 		}
+		mono_group_varint_encode (values, table->num_holes * 3, p, &p);
+		g_free (values);
 	}
 
 	if (jinfo->has_arch_eh_info) {
@@ -7270,6 +7357,10 @@ mono_aot_parse_options (const char *aot_options, MonoAotOptions *opts)
 			opts->profile_files = g_list_append (opts->profile_files, g_strdup (arg + strlen ("profile=")));
 		} else if (!strcmp (arg, "profile-only")) {
 			opts->profile_only = TRUE;
+		} else if (str_begins_with (arg, "cache-dir=")) {
+			opts->cache_dir = g_strdup (arg + strlen ("cache-dir="));
+		} else if (str_begins_with (arg, "dedup-include=")) {
+			opts->dedup_include = g_strdup (arg + strlen ("dedup-include="));
 		} else if (!strcmp (arg, "verbose")) {
 			opts->verbose = TRUE;
 		} else if (str_begins_with (arg, "help") || str_begins_with (arg, "?")) {
@@ -7277,7 +7368,9 @@ mono_aot_parse_options (const char *aot_options, MonoAotOptions *opts)
 			printf ("    asmonly\n");
 			printf ("    bind-to-runtime-version\n");
 			printf ("    bitcode\n");
+			printf ("    cache-dir=\n");
 			printf ("    data-outfile=\n");
+			printf ("    dedup-include=\n");
 			printf ("    direct-icalls\n");
 			printf ("    direct-pinvoke\n");
 			printf ("    dwarfdebug\n");
@@ -7564,9 +7657,11 @@ add_gsharedvt_wrappers (MonoAotCompile *acfg, MonoMethodSignature *sig, gboolean
  *
  *   AOT compile a given method.
  * This function might be called by multiple threads, so it must be thread-safe.
+ * The data which needs to outlive the MonoCompile mempool is copied into MP, which
+ * is owned by the calling thread, so it can be done without holding the acfg lock.
  */
 static void
-compile_method (MonoAotCompile *acfg, MonoMethod *method)
+compile_method (MonoAotCompile *acfg, MonoMethod *method, MonoMemPool *mp)
 {
 	MonoCompile *cfg;
 	MonoJumpInfo *patch_info;
@@ -7848,6 +7943,8 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 		}
 	}
 
+	mono_acfg_unlock (acfg);
+
 	/* 
 	 * FIXME: Instead of this mess, allocate the patches from the aot mempool.
 	 */
@@ -7856,7 +7953,7 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 		MonoJumpInfo *patches = NULL, *patches_end = NULL;
 
 		for (patch_info = cfg->patch_info; patch_info; patch_info = patch_info->next) {
-			MonoJumpInfo *new_patch_info = mono_patch_info_dup_mp (acfg->mempool, patch_info);
+			MonoJumpInfo *new_patch_info = mono_patch_info_dup_mp (mp, patch_info);
 
 			if (!patches)
 				patches = new_patch_info;
@@ -7873,9 +7970,9 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 
 		unwind_ops = NULL;
 		for (l = cfg->unwind_ops; l; l = l->next) {
-			op = (MonoUnwindOp *)mono_mempool_alloc (acfg->mempool, sizeof (MonoUnwindOp));
+			op = (MonoUnwindOp *)mono_mempool_alloc (mp, sizeof (MonoUnwindOp));
 			memcpy (op, l->data, sizeof (MonoUnwindOp));
-			unwind_ops = g_slist_prepend_mempool (acfg->mempool, unwind_ops, op);
+			unwind_ops = g_slist_prepend_mempool (mp, unwind_ops, op);
 		}
 		cfg->unwind_ops = g_slist_reverse (unwind_ops);
 	}
@@ -7888,29 +7985,40 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 		int i;
 		
 		sig = mono_method_signature (method);
-		args = (MonoInst **)mono_mempool_alloc (acfg->mempool, sizeof (MonoInst*) * (sig->param_count + sig->hasthis));
+		args = (MonoInst **)mono_mempool_alloc (mp, sizeof (MonoInst*) * (sig->param_count + sig->hasthis));
 		for (i = 0; i < sig->param_count + sig->hasthis; ++i) {
-			args [i] = (MonoInst *)mono_mempool_alloc (acfg->mempool, sizeof (MonoInst));
+			args [i] = (MonoInst *)mono_mempool_alloc (mp, sizeof (MonoInst));
 			memcpy (args [i], cfg->args [i], sizeof (MonoInst));
 		}
 		cfg->args = args;
 
 		header = mono_method_get_header_checked (method, &error);
 		mono_error_assert_ok (&error); /* FIXME don't swallow the error */
-		locals = (MonoInst **)mono_mempool_alloc (acfg->mempool, sizeof (MonoInst*) * header->num_locals);
+		locals = (MonoInst **)mono_mempool_alloc (mp, sizeof (MonoInst*) * header->num_locals);
 		for (i = 0; i < header->num_locals; ++i) {
-			locals [i] = (MonoInst *)mono_mempool_alloc (acfg->mempool, sizeof (MonoInst));
+			locals [i] = (MonoInst *)mono_mempool_alloc (mp, sizeof (MonoInst));
 			memcpy (locals [i], cfg->locals [i], sizeof (MonoInst));
 		}
 		mono_metadata_free_mh (header);
 		cfg->locals = locals;
 	}
 
+	/*
+	 * Encode the per-method parts of the exception info here, since this runs in parallel
+	 * when using multiple threads, while emit_exception_info () runs serially.
+	 */
+	if (!acfg->aot_opts.nodebug)
+		mono_debug_serialize_debug_info (cfg, &cfg->aot_debug_info, &cfg->aot_debug_info_size);
+	if (cfg->unwind_ops)
+		cfg->aot_unwind_info = mono_unwind_ops_encode (cfg->unwind_ops, &cfg->aot_unwind_info_len);
+
 	/* Free some fields used by cfg to conserve memory */
 	mono_empty_compile (cfg);
 
 	//printf ("Compile:           %s\n", mono_method_full_name (method, TRUE));
 
+	mono_acfg_lock (acfg);
+
 	while (index >= acfg->cfgs_size) {
 		MonoCompile **new_cfgs;
 		int new_size;
@@ -7938,11 +8046,24 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 	InterlockedIncrement (&acfg->stats.ccount);
 }
  
+/*
+ * The methods compiled by a set of compile threads. Instead of partitioning them
+ * statically, each thread takes the next method from the queue, so threads which
+ * get cheap methods don't sit idle while the others are still compiling.
+ */
+typedef struct {
+	MonoMethod **methods;
+	int nmethods;
+	/* The index of the next method to compile */
+	volatile gint32 next;
+} CompileQueue;
+
 static mono_thread_start_return_t WINAPI
 compile_thread_main (gpointer user_data)
 {
 	MonoAotCompile *acfg = ((MonoAotCompile **)user_data) [0];
-	GPtrArray *methods = ((GPtrArray **)user_data) [1];
+	CompileQueue *queue = ((CompileQueue **)user_data) [1];
+	MonoMemPool *mp = ((MonoMemPool **)user_data) [2];
 	int i;
 
 	MonoError error;
@@ -7952,9 +8073,10 @@ compile_thread_main (gpointer user_data)
 	mono_thread_set_name_internal (internal, str, TRUE, FALSE, &error);
 	mono_error_assert_ok (&error);
 
-	for (i = 0; i < methods->len; ++i)
-		compile_method (acfg, (MonoMethod *)g_ptr_array_index (methods, i));
+	while ((i = InterlockedIncrement (&queue->next) - 1) < queue->nmethods)
+		compile_method (acfg, queue->methods [i], mp);
 
+	g_free (user_data);
 	return 0;
 }
  
@@ -7977,6 +8099,26 @@ mono_aot_is_shared_got_offset (int offset)
 	return offset < llvm_acfg->nshared_got_entries;
 }
 
+/*
+ * mono_aot_is_cold_il_offset:
+ *
+ *   Return whenever the code at IL_OFFSET in METHOD was never executed during profiling,
+ * according to the profile data of the assembly being compiled. The JIT moves such
+ * bblocks out of line.
+ */
+gboolean
+mono_aot_is_cold_il_offset (MonoMethod *method, guint32 il_offset)
+{
+	MethodProfileData *mdata;
+
+	if (!profile_acfg)
+		return FALSE;
+	mdata = lookup_method_profile (profile_acfg, method);
+	if (!mdata || !mdata->il_counts || !mdata->call_count)
+		return FALSE;
+	return !g_hash_table_lookup (mdata->il_counts, GUINT_TO_POINTER (il_offset + 1));
+}
+
 char*
 mono_aot_get_method_name (MonoCompile *cfg)
 {
@@ -8800,6 +8942,78 @@ emit_llvm_file (MonoAotCompile *acfg)
 }
 #endif
 
+static MethodProfileData*
+lookup_method_profile (MonoAotCompile *acfg, MonoMethod *method)
+{
+	MethodProfileData *mdata;
+
+	mdata = (MethodProfileData *)g_hash_table_lookup (acfg->method_profiles, method);
+	if (!mdata && method->is_inflated)
+		mdata = (MethodProfileData *)g_hash_table_lookup (acfg->method_profiles, ((MonoMethodInflated*)method)->declaring);
+	return mdata;
+}
+
+typedef struct {
+	int index;
+	int pos;
+	MethodProfileData *mdata;
+} MethodOrderEntry;
+
+static int
+compare_method_order (const void *a, const void *b)
+{
+	const MethodOrderEntry *e1 = (const MethodOrderEntry *)a;
+	const MethodOrderEntry *e2 = (const MethodOrderEntry *)b;
+
+	/* Methods executed during profiling come first */
+	if (!e1->mdata || !e2->mdata) {
+		if (e1->mdata != e2->mdata)
+			return e1->mdata ? -1 : 1;
+		return e1->pos - e2->pos;
+	}
+	/* Hottest first */
+	if (e1->mdata->call_count != e2->mdata->call_count)
+		return e1->mdata->call_count > e2->mdata->call_count ? -1 : 1;
+	/* Then in the order they were first executed */
+	if (e1->mdata->id != e2->mdata->id)
+		return e1->mdata->id - e2->mdata->id;
+	return e1->pos - e2->pos;
+}
+
+/*
+ * order_methods_by_profile:
+ *
+ *   Reorder acfg->method_order so the methods executed during profiling are emitted
+ * first, hottest first, and the rest are grouped together at the end of the text
+ * section. This reduces the number of pages and iTLB entries touched by the hot code.
+ * The runtime doesn't depend on the order of methods in the text section.
+ */
+static void
+order_methods_by_profile (MonoAotCompile *acfg)
+{
+	MethodOrderEntry *entries;
+	int oindex, i, len, nhot = 0;
+
+	len = acfg->method_order->len;
+	entries = g_new0 (MethodOrderEntry, len);
+	for (oindex = 0; oindex < len; ++oindex) {
+		i = GPOINTER_TO_UINT (g_ptr_array_index (acfg->method_order, oindex));
+
+		entries [oindex].index = i;
+		entries [oindex].pos = oindex;
+		if (acfg->cfgs [i])
+			entries [oindex].mdata = lookup_method_profile (acfg, acfg->cfgs [i]->orig_method);
+		if (entries [oindex].mdata)
+			nhot ++;
+	}
+	qsort (entries, len, sizeof (MethodOrderEntry), compare_method_order);
+	for (oindex = 0; oindex < len; ++oindex)
+		g_ptr_array_index (acfg->method_order, oindex) = GUINT_TO_POINTER (entries [oindex].index);
+	g_free (entries);
+
+	aot_printf (acfg, "Ordered %d profiled methods before %d other methods.\n", nhot, len - nhot);
+}
+
 static void
 emit_code (MonoAotCompile *acfg)
 {
@@ -8810,6 +9024,9 @@ emit_code (MonoAotCompile *acfg)
 	if (acfg->aot_opts.llvm_only)
 		return;
 
+	if (g_hash_table_size (acfg->method_profiles))
+		order_methods_by_profile (acfg);
+
 #if defined(TARGET_POWERPC64)
 	sprintf (symbol, ".Lgot_addr");
 	emit_section_change (acfg, ".text", 0);
@@ -9174,6 +9391,31 @@ mono_aot_method_hash (MonoMethod *method)
 #undef mix
 #undef final
 
+/*
+ * mono_aot_method_hash_slot:
+ *
+ *   Return the slot of the method with hash code HASH in the perfect hash table
+ * of extra methods of size SIZE, given the displacement DISP of its bucket.
+ * Displacements with the high bit set hold the slot directly.
+ */
+guint32
+mono_aot_method_hash_slot (guint32 hash, guint32 disp, guint32 size)
+{
+	guint32 h;
+
+	if (disp & 0x80000000)
+		return disp & 0x7fffffff;
+
+	/* Finalizer from MurmurHash3 */
+	h = hash ^ (disp * 0x9e3779b9);
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h % size;
+}
+
 /*
  * mono_aot_get_array_helper_from_wrapper;
  *
@@ -9222,10 +9464,19 @@ mono_aot_get_array_helper_from_wrapper (MonoMethod *method)
 #if !defined(DISABLE_AOT) && !defined(DISABLE_JIT)
 
 typedef struct HashEntry {
-    guint32 key, value, index;
+    guint32 key, value, index, hash;
 	struct HashEntry *next;
 } HashEntry;
 
+static int
+compare_bucket_sizes (const void *a, const void *b)
+{
+	GSList *l1 = *(GSList**)a;
+	GSList *l2 = *(GSList**)b;
+
+	return (int)g_slist_length (l2) - (int)g_slist_length (l1);
+}
+
 /*
  * emit_extra_methods:
  *
@@ -9234,14 +9485,15 @@ typedef struct HashEntry {
 static void
 emit_extra_methods (MonoAotCompile *acfg)
 {
-	int i, table_size, buf_size;
+	int i, table_size, nbuckets, nentries, buf_size;
 	guint8 *p, *buf;
 	guint32 *info_offsets;
-	guint32 hash;
-	GPtrArray *table;
+	guint32 *disps;
+	GHashTable *hash_to_entry;
+	GSList **buckets;
+	HashEntry **table;
 	HashEntry *entry, *new_entry;
-	int nmethods, max_chain_length;
-	int *chain_lengths;
+	int nmethods, free_slot;
 
 	info_offsets = g_new0 (guint32, acfg->extra_methods->len);
 
@@ -9270,72 +9522,122 @@ emit_extra_methods (MonoAotCompile *acfg)
 	}
 
 	/*
-	 * Construct a chained hash table for mapping indexes in extra_method_info to
-	 * method indexes.
+	 * Construct a minimal perfect hash table mapping the hash codes computed by
+	 * mono_aot_method_hash () to method indexes, using the hash-and-displace
+	 * scheme. Each slot holds the full hash code, which the runtime compares
+	 * before decoding the method ref, so lookups of methods not in this image
+	 * cost one probe and no decoding. Methods with the same hash code are
+	 * chained in entries emitted after the slots.
 	 */
-	table_size = g_spaced_primes_closest ((int)(nmethods * 1.5));
-	table = g_ptr_array_sized_new (table_size);
-	for (i = 0; i < table_size; ++i)
-		g_ptr_array_add (table, NULL);
-	chain_lengths = g_new0 (int, table_size);
-	max_chain_length = 0;
+	hash_to_entry = g_hash_table_new (NULL, NULL);
+	table_size = 0;
 	for (i = 0; i < acfg->extra_methods->len; ++i) {
 		MonoMethod *method = (MonoMethod *)g_ptr_array_index (acfg->extra_methods, i);
 		MonoCompile *cfg = (MonoCompile *)g_hash_table_lookup (acfg->method_to_cfg, method);
-		guint32 key, value;
 
 		if (!cfg)
 			continue;
 
-		key = info_offsets [i];
-		value = get_method_index (acfg, method);
-
-		hash = mono_aot_method_hash (method) % table_size;
-		//printf ("X: %s %x\n", mono_method_get_full_name (method), mono_aot_method_hash (method));
-
-		chain_lengths [hash] ++;
-		max_chain_length = MAX (max_chain_length, chain_lengths [hash]);
-
 		new_entry = (HashEntry *)mono_mempool_alloc0 (acfg->mempool, sizeof (HashEntry));
-		new_entry->key = key;
-		new_entry->value = value;
+		new_entry->key = info_offsets [i];
+		new_entry->value = get_method_index (acfg, method);
+		new_entry->hash = mono_aot_method_hash (method);
+		//printf ("X: %s %x\n", mono_method_get_full_name (method), new_entry->hash);
 
-		entry = (HashEntry *)g_ptr_array_index (table, hash);
-		if (entry == NULL) {
-			new_entry->index = hash;
-			g_ptr_array_index (table, hash) = new_entry;
-		} else {
+		entry = (HashEntry *)g_hash_table_lookup (hash_to_entry, GUINT_TO_POINTER (new_entry->hash));
+		if (entry) {
 			while (entry->next)
 				entry = entry->next;
-			
 			entry->next = new_entry;
-			new_entry->index = table->len;
-			g_ptr_array_add (table, new_entry);
+		} else {
+			g_hash_table_insert (hash_to_entry, GUINT_TO_POINTER (new_entry->hash), new_entry);
+			table_size ++;
 		}
 	}
-	g_free (chain_lengths);
 
-	//printf ("MAX: %d\n", max_chain_length);
+	nbuckets = table_size / 2 + 1;
+	buckets = g_new0 (GSList*, nbuckets);
+	disps = g_new0 (guint32, nbuckets);
+	table = g_new0 (HashEntry*, table_size);
 
-	buf_size = table->len * 12 + 4;
-	p = buf = (guint8 *)g_malloc (buf_size);
-	encode_int (table_size, p, &p);
+	{
+		GHashTableIter iter;
 
-	for (i = 0; i < table->len; ++i) {
-		HashEntry *entry = (HashEntry *)g_ptr_array_index (table, i);
+		g_hash_table_iter_init (&iter, hash_to_entry);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&entry))
+			buckets [entry->hash % nbuckets] = g_slist_prepend (buckets [entry->hash % nbuckets], entry);
+	}
 
-		if (entry == NULL) {
-			encode_int (0, p, &p);
-			encode_int (0, p, &p);
-			encode_int (0, p, &p);
-		} else {
-			//g_assert (entry->key > 0);
+	/* Place the largest buckets first while most of the slots are still free */
+	qsort (buckets, nbuckets, sizeof (GSList*), compare_bucket_sizes);
+
+	free_slot = 0;
+	for (i = 0; i < nbuckets; ++i) {
+		GSList *bucket = buckets [i];
+		guint32 bindex, disp;
+		GSList *l, *l2;
+
+		if (!bucket)
+			break;
+		bindex = ((HashEntry*)bucket->data)->hash % nbuckets;
+
+		if (!bucket->next) {
+			/* Singleton buckets store their slot directly */
+			while (table [free_slot])
+				free_slot ++;
+			table [free_slot] = (HashEntry*)bucket->data;
+			disps [bindex] = 0x80000000 | free_slot;
+			continue;
+		}
+
+		for (disp = 0; ; ++disp) {
+			g_assert (disp < 0x80000000);
+
+			for (l = bucket; l; l = l->next) {
+				guint32 slot = mono_aot_method_hash_slot (((HashEntry*)l->data)->hash, disp, table_size);
+
+				if (table [slot])
+					break;
+				/* Claim it for now so entries of the same bucket can't share it */
+				table [slot] = (HashEntry*)l->data;
+			}
+			if (!l)
+				break;
+			/* Release the slots claimed by this attempt */
+			for (l2 = bucket; l2 != l; l2 = l2->next)
+				table [mono_aot_method_hash_slot (((HashEntry*)l2->data)->hash, disp, table_size)] = NULL;
+		}
+		disps [bindex] = disp;
+	}
+
+	/* Number the entries of the chains, they come after the slots */
+	nentries = table_size;
+	for (i = 0; i < table_size; ++i) {
+		table [i]->index = i;
+		for (entry = table [i]->next; entry; entry = entry->next)
+			entry->index = nentries ++;
+	}
+
+	buf_size = nbuckets * 4 + nentries * 16 + 8;
+	p = buf = (guint8 *)g_malloc (buf_size);
+	encode_int (table_size, p, &p);
+	encode_int (nbuckets, p, &p);
+	for (i = 0; i < nbuckets; ++i)
+		encode_int (disps [i], p, &p);
+
+	for (i = 0; i < table_size; ++i) {
+		entry = table [i];
+		encode_int (entry->hash, p, &p);
+		encode_int (entry->key, p, &p);
+		encode_int (entry->value, p, &p);
+		encode_int (entry->next ? entry->next->index : 0, p, &p);
+	}
+	for (i = 0; i < table_size; ++i) {
+		for (entry = table [i]->next; entry; entry = entry->next) {
+			encode_int (entry->hash, p, &p);
 			encode_int (entry->key, p, &p);
 			encode_int (entry->value, p, &p);
-			if (entry->next)
-				encode_int (entry->next->index, p, &p);
-			else
-				encode_int (0, p, &p);
+			encode_int (entry->next ? entry->next->index : 0, p, &p);
 		}
 	}
 	g_assert (p - buf <= buf_size);
@@ -9362,7 +9664,12 @@ emit_extra_methods (MonoAotCompile *acfg)
 
 	g_free (buf);
 	g_free (info_offsets);
-	g_ptr_array_free (table, TRUE);
+	for (i = 0; i < nbuckets; ++i)
+		g_slist_free (buckets [i]);
+	g_free (buckets);
+	g_free (disps);
+	g_free (table);
+	g_hash_table_destroy (hash_to_entry);
 }	
 
 static void
@@ -9923,6 +10230,7 @@ init_aot_file_info (MonoAotCompile *acfg, MonoAotFileInfo *info)
 	info->simd_opts = acfg->simd_opts;
 	info->gc_name_index = acfg->gc_name_offset;
 	info->datafile_size = acfg->datafile_offset;
+	info->dedup_container_index = acfg->dedup_skip ? acfg->dedup_container_index : -1;
 	for (i = 0; i < MONO_AOT_TABLE_NUM; ++i)
 		info->table_offsets [i] = acfg->table_offsets [i];
 	for (i = 0; i < MONO_AOT_TRAMP_NUM; ++i)
@@ -10062,6 +10370,7 @@ emit_aot_file_info (MonoAotCompile *acfg, MonoAotFileInfo *info)
 	emit_int32 (acfg, info->tramp_page_size);
 	emit_int32 (acfg, info->nshared_got_entries);
 	emit_int32 (acfg, info->datafile_size);
+	emit_int32 (acfg, info->dedup_container_index);
 
 	for (i = 0; i < MONO_AOT_TABLE_NUM; ++i)
 		emit_int32 (acfg, info->table_offsets [i]);
@@ -10294,73 +10603,101 @@ collect_methods (MonoAotCompile *acfg)
 	return TRUE;
 }
 
-static void
-compile_methods (MonoAotCompile *acfg)
+/*
+ * compile_methods_parallel:
+ *
+ *   Compile the methods in acfg->methods starting at START using aot_opts.nthreads
+ * threads. Return the number of methods in acfg->methods before the compilation, the
+ * methods after it were added by compile_method ().
+ */
+static int
+compile_methods_parallel (MonoAotCompile *acfg, int start)
 {
+	CompileQueue queue;
+	GPtrArray *threads;
+	MonoThreadHandle *thread_handle;
+	gpointer *user_data;
 	int i, methods_len;
 
-	if (acfg->aot_opts.nthreads > 0) {
-		GPtrArray *frag;
-		int len, j;
-		GPtrArray *threads;
-		MonoThreadHandle *thread_handle;
-		gpointer *user_data;
-		MonoMethod **methods;
+	methods_len = acfg->methods->len;
 
-		methods_len = acfg->methods->len;
+	memset (&queue, 0, sizeof (queue));
+	/* Make a copy since acfg->methods is modified by compile_method () */
+	queue.nmethods = methods_len - start;
+	queue.methods = g_new0 (MonoMethod*, queue.nmethods);
+	for (i = start; i < methods_len; ++i)
+		queue.methods [i - start] = (MonoMethod *)g_ptr_array_index (acfg->methods, i);
 
-		len = acfg->methods->len / acfg->aot_opts.nthreads;
-		g_assert (len > 0);
-		/* 
-		 * Partition the list of methods into fragments, and hand it to threads to
-		 * process.
-		 */
-		threads = g_ptr_array_new ();
-		/* Make a copy since acfg->methods is modified by compile_method () */
-		methods = g_new0 (MonoMethod*, methods_len);
-		//memcpy (methods, g_ptr_array_index (acfg->methods, 0), sizeof (MonoMethod*) * methods_len);
-		for (i = 0; i < methods_len; ++i)
-			methods [i] = (MonoMethod *)g_ptr_array_index (acfg->methods, i);
-		i = 0;
-		while (i < methods_len) {
-			MonoError error;
-			MonoInternalThread *thread;
+	threads = g_ptr_array_new ();
+	for (i = 0; i < acfg->aot_opts.nthreads; ++i) {
+		MonoError error;
+		MonoInternalThread *thread;
+		MonoMemPool *mp;
 
-			frag = g_ptr_array_new ();
-			for (j = 0; j < len; ++j) {
-				if (i < methods_len) {
-					g_ptr_array_add (frag, methods [i]);
-					i ++;
-				}
-			}
+		mp = mono_mempool_new ();
+		g_ptr_array_add (acfg->thread_mempools, mp);
 
-			user_data = g_new0 (gpointer, 3);
-			user_data [0] = acfg;
-			user_data [1] = frag;
-			
-			thread = mono_thread_create_internal (mono_domain_get (), compile_thread_main, (gpointer) user_data, MONO_THREAD_CREATE_FLAGS_NONE, &error);
-			mono_error_assert_ok (&error);
+		user_data = g_new0 (gpointer, 3);
+		user_data [0] = acfg;
+		user_data [1] = &queue;
+		user_data [2] = mp;
 
-			thread_handle = mono_threads_open_thread_handle (thread->handle);
-			g_ptr_array_add (threads, thread_handle);
-		}
-		g_free (methods);
+		thread = mono_thread_create_internal (mono_domain_get (), compile_thread_main, (gpointer) user_data, MONO_THREAD_CREATE_FLAGS_NONE, &error);
+		mono_error_assert_ok (&error);
 
-		for (i = 0; i < threads->len; ++i) {
-			mono_thread_info_wait_one_handle (g_ptr_array_index (threads, i), MONO_INFINITE_WAIT, FALSE);
-			mono_threads_close_thread_handle (g_ptr_array_index (threads, i));
-		}
-	} else {
-		methods_len = 0;
+		thread_handle = mono_threads_open_thread_handle (thread->handle);
+		g_ptr_array_add (threads, thread_handle);
+	}
+
+	for (i = 0; i < threads->len; ++i) {
+		mono_thread_info_wait_one_handle (g_ptr_array_index (threads, i), MONO_INFINITE_WAIT, FALSE);
+		mono_threads_close_thread_handle (g_ptr_array_index (threads, i));
+	}
+	g_ptr_array_free (threads, TRUE);
+	g_free (queue.methods);
+
+	return methods_len;
+}
+
+/* Compile the methods added by compile_method () serially if there are fewer than this per thread */
+#define MIN_METHODS_PER_COMPILE_THREAD 16
+
+static void
+compile_methods (MonoAotCompile *acfg)
+{
+	int i, methods_len = 0;
+
+	if (acfg->aot_opts.nthreads > 0) {
+		/*
+		 * Compiling a method can add new methods like generic instances and wrappers,
+		 * compile those in parallel too as long as there are enough of them.
+		 */
+		do {
+			methods_len = compile_methods_parallel (acfg, methods_len);
+		} while (acfg->methods->len - methods_len >= acfg->aot_opts.nthreads * MIN_METHODS_PER_COMPILE_THREAD);
 	}
 
-	/* Compile methods added by compile_method () or all methods if nthreads == 0 */
+	/* Compile the remaining methods or all methods if nthreads == 0 */
 	for (i = methods_len; i < acfg->methods->len; ++i) {
 		/* This can add new methods to acfg->methods */
-		compile_method (acfg, (MonoMethod *)g_ptr_array_index (acfg->methods, i));
+		compile_method (acfg, (MonoMethod *)g_ptr_array_index (acfg->methods, i), acfg->mempool);
 	}
 }
 
+/*
+ * get_output_file_name:
+ *
+ *   Return the name of the shared library produced by compile_asm ().
+ */
+static char*
+get_output_file_name (MonoAotCompile *acfg)
+{
+	if (acfg->aot_opts.outfile)
+		return g_strdup_printf ("%s", acfg->aot_opts.outfile);
+	else
+		return g_strdup_printf ("%s%s", acfg->image->name, MONO_SOLIB_EXT);
+}
+
 static int
 compile_asm (MonoAotCompile *acfg)
 {
@@ -10479,10 +10816,7 @@ compile_asm (MonoAotCompile *acfg)
 		return 0;
 	}
 
-	if (acfg->aot_opts.outfile)
-		outfile_name = g_strdup_printf ("%s", acfg->aot_opts.outfile);
-	else
-		outfile_name = g_strdup_printf ("%s%s", acfg->image->name, MONO_SOLIB_EXT);
+	outfile_name = get_output_file_name (acfg);
 
 	tmp_outfile_name = g_strdup_printf ("%s.tmp", outfile_name);
 
@@ -10661,7 +10995,8 @@ load_profile_file (MonoAotCompile *acfg, char *filename)
 	}
 	guint32 expected_version = (AOT_PROFILER_MAJOR_VERSION << 16) | AOT_PROFILER_MINOR_VERSION;
 	version = profread_int (infile);
-	if (version != expected_version) {
+	/* Newer minor versions only add new record types */
+	if ((version >> 16) != AOT_PROFILER_MAJOR_VERSION || (version & 0xffff) > AOT_PROFILER_MINOR_VERSION) {
 		printf ("Profile file has wrong version 0x%4x, expected 0x%4x.\n", version, expected_version);
 		fclose (infile);
 		exit (1);
@@ -10773,6 +11108,24 @@ load_profile_file (MonoAotCompile *acfg, char *filename)
 			g_hash_table_insert (data->methods, GINT_TO_POINTER (id), mdata);
 			break;
 		}
+		case AOTPROF_RECORD_METHOD_COUNTS: {
+			int i;
+			int call_count = profread_int (infile);
+			int len = profread_int (infile);
+
+			MethodProfileData *mdata = g_hash_table_lookup (data->methods, GINT_TO_POINTER (id));
+			g_assert (mdata);
+
+			mdata->call_count = call_count;
+			mdata->il_counts = g_hash_table_new (NULL, NULL);
+			for (i = 0; i < len; ++i) {
+				int il_offset = profread_int (infile);
+				int count = profread_int (infile);
+
+				g_hash_table_insert (mdata->il_counts, GINT_TO_POINTER (il_offset + 1), GINT_TO_POINTER (count));
+			}
+			break;
+		}
 		default:
 			printf ("%d\n", type);
 			g_assert_not_reached ();
@@ -10937,6 +11290,15 @@ resolve_profile_data (MonoAotCompile *acfg, ProfileData *data)
 			mdata->method = m;
 			break;
 		}
+		if (mdata->method) {
+			MonoMethod *m = mdata->method;
+
+			if (!g_hash_table_lookup (acfg->method_profiles, m))
+				g_hash_table_insert (acfg->method_profiles, m, mdata);
+			/* Shared generic code is looked up using the generic method definition */
+			if (m->is_inflated && !g_hash_table_lookup (acfg->method_profiles, ((MonoMethodInflated*)m)->declaring))
+				g_hash_table_insert (acfg->method_profiles, ((MonoMethodInflated*)m)->declaring, mdata);
+		}
 		if (!mdata->method) {
 			if (acfg->aot_opts.verbose)
 				printf ("Unable to load method '%s' from class '%s', not found.\n", mdata->name, mono_class_full_name (klass));
@@ -11078,6 +11440,7 @@ acfg_create (MonoAssembly *ass, guint32 opts)
 	/* TODO: Write out set of SIMD instructions used, rather than just those available */
 	acfg->simd_opts = mono_arch_cpu_enumerate_simd_versions ();
 	acfg->mempool = mono_mempool_new ();
+	acfg->thread_mempools = g_ptr_array_new ();
 	acfg->extra_methods = g_ptr_array_new ();
 	acfg->unwind_info_offsets = g_hash_table_new (NULL, NULL);
 	acfg->unwind_ops = g_ptr_array_new ();
@@ -11090,6 +11453,7 @@ acfg_create (MonoAssembly *ass, guint32 opts)
 	acfg->gsharedvt_in_signatures = g_hash_table_new ((GHashFunc)mono_signature_hash, (GEqualFunc)mono_metadata_signature_equal);
 	acfg->gsharedvt_out_signatures = g_hash_table_new ((GHashFunc)mono_signature_hash, (GEqualFunc)mono_metadata_signature_equal);
 	acfg->profile_methods = g_hash_table_new (NULL, NULL);
+	acfg->method_profiles = g_hash_table_new (NULL, NULL);
 	mono_os_mutex_init_recursive (&acfg->mutex);
 
 	init_got_info (&acfg->got_info);
@@ -11115,7 +11479,9 @@ acfg_free (MonoAotCompile *acfg)
 {
 	int i;
 
-	mono_img_writer_destroy (acfg->w);
+	/* Not created yet if the output was found in the cache */
+	if (acfg->w)
+		mono_img_writer_destroy (acfg->w);
 	for (i = 0; i < acfg->nmethods; ++i)
 		if (acfg->cfgs [i])
 			mono_destroy_compile (acfg->cfgs [i]);
@@ -11149,8 +11515,14 @@ acfg_free (MonoAotCompile *acfg)
 	g_hash_table_destroy (acfg->plt_entry_debug_sym_cache);
 	g_hash_table_destroy (acfg->klass_blob_hash);
 	g_hash_table_destroy (acfg->method_blob_hash);
+	g_hash_table_destroy (acfg->method_profiles);
+	if (profile_acfg == acfg)
+		profile_acfg = NULL;
 	got_info_free (&acfg->got_info);
 	got_info_free (&acfg->llvm_got_info);
+	for (i = 0; i < acfg->thread_mempools->len; ++i)
+		mono_mempool_destroy ((MonoMemPool *)g_ptr_array_index (acfg->thread_mempools, i));
+	g_ptr_array_free (acfg->thread_mempools, TRUE);
 	mono_mempool_destroy (acfg->mempool);
 	g_free (acfg);
 }
@@ -11396,6 +11768,150 @@ add_preinit_got_slots (MonoAotCompile *acfg)
 	acfg->nshared_got_entries = acfg->got_offset;
 }
 
+static void
+sha1_update_str (MonoSHA1Context *ctx, const char *s)
+{
+	/* Include the terminating zero so adjacent strings can't run together */
+	mono_sha1_update (ctx, (const guchar*)s, strlen (s) + 1);
+}
+
+/* Options which don't change the generated image, these are left out of the output cache key */
+static const char *aot_cache_ignored_options [] = {
+	"outfile=", "llvm-outfile=", "temp-path=", "keep-temps", "threads=", "print-skipped", "stats",
+	"log-generics", "log-instances", "internal-logfile=", "verbose", "cache-dir=",
+	/* The contents of the profile files are hashed instead */
+	"profile="
+};
+
+static gboolean
+aot_option_affects_output (const char *arg)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (aot_cache_ignored_options); ++i)
+		if (str_begins_with (arg, aot_cache_ignored_options [i]))
+			return FALSE;
+	return TRUE;
+}
+
+/*
+ * get_output_cache_name:
+ *
+ *   Return the name of the file in the output cache which holds the AOT image
+ * of the current assembly, or NULL if the output of ACFG can't be cached.
+ * The name contains a hash of everything the image depends on: the assembly
+ * itself, the guids of the assemblies it references, the profile data, the
+ * compiler options and the runtime version.
+ */
+static char*
+get_output_cache_name (MonoAotCompile *acfg, const char *aot_options)
+{
+	MonoImage *image = acfg->image;
+	MonoSHA1Context ctx;
+	guint8 digest [20];
+	char digest_str [sizeof (digest) * 2 + 1];
+	char *build_info, *contents, *fname, *res;
+	gsize len;
+	GPtrArray *args;
+	GList *l;
+	int i;
+
+	/* Only plain shared libraries are cached, the other modes produce additional files */
+	if (acfg->aot_opts.asm_only || acfg->aot_opts.static_link || acfg->aot_opts.llvm_only || acfg->aot_opts.data_outfile ||
+		acfg->aot_opts.gen_msym_dir || acfg->aot_opts.save_temps || acfg->aot_opts.dump_json || acfg->aot_opts.instances_logfile_path)
+		return NULL;
+	/* The output depends on the other images compiled in the same invocation */
+	if (acfg->aot_opts.dedup_include)
+		return NULL;
+
+	mono_sha1_init (&ctx);
+
+	build_info = mono_get_runtime_build_info ();
+	sha1_update_str (&ctx, build_info);
+	g_free (build_info);
+	i = MONO_AOT_FILE_VERSION;
+	mono_sha1_update (&ctx, (guchar*)&i, sizeof (i));
+	mono_sha1_update (&ctx, (guchar*)&acfg->opts, sizeof (acfg->opts));
+	mono_sha1_update (&ctx, (guchar*)&acfg->flags, sizeof (acfg->flags));
+	/* The runtime rejects images compiled for other SIMD versions */
+	mono_sha1_update (&ctx, (guchar*)&acfg->simd_opts, sizeof (acfg->simd_opts));
+	i = mono_debug_enabled ();
+	mono_sha1_update (&ctx, (guchar*)&i, sizeof (i));
+	i = mono_do_vectorize;
+	mono_sha1_update (&ctx, (guchar*)&i, sizeof (i));
+	/* The output file name and the cache location shouldn't cause a miss */
+	args = mono_aot_split_options (aot_options ? aot_options : "");
+	for (i = 0; i < args->len; ++i) {
+		const char *arg = (const char*)g_ptr_array_index (args, i);
+
+		if (aot_option_affects_output (arg))
+			sha1_update_str (&ctx, arg);
+		g_free ((gpointer)arg);
+	}
+	g_ptr_array_free (args, TRUE);
+
+	mono_sha1_update (&ctx, (guchar*)image->raw_data, image->raw_data_len);
+
+	for (i = 0; i < image->tables [MONO_TABLE_ASSEMBLYREF].rows; ++i) {
+		MonoAssembly *ref;
+
+		mono_assembly_load_reference (image, i);
+		ref = image->references [i];
+		if (!ref || ref == REFERENCE_MISSING)
+			return NULL;
+		sha1_update_str (&ctx, ref->aname.name);
+		sha1_update_str (&ctx, ref->image->guid);
+	}
+
+	for (l = acfg->aot_opts.profile_files; l; l = l->next) {
+		if (!g_file_get_contents ((char*)l->data, &contents, &len, NULL))
+			return NULL;
+		mono_sha1_update (&ctx, (guchar*)contents, len);
+		g_free (contents);
+	}
+
+	mono_sha1_final (&ctx, digest);
+	for (i = 0; i < sizeof (digest); ++i)
+		sprintf (digest_str + (i * 2), "%02x", digest [i]);
+
+	fname = g_strdup_printf ("%s-%s%s", image->assembly->aname.name, digest_str, MONO_SOLIB_EXT);
+	res = g_build_filename (acfg->aot_opts.cache_dir, fname, NULL);
+	g_free (fname);
+	return res;
+}
+
+/*
+ * copy_file:
+ *
+ *   Copy SRC to DEST through a temporary file, so DEST is either complete or
+ * left untouched.
+ */
+static gboolean
+copy_file (const char *src, const char *dest)
+{
+	char *contents, *tmp_dest;
+	gsize len;
+	gboolean res;
+
+	if (!g_file_get_contents (src, &contents, &len, NULL))
+		return FALSE;
+	tmp_dest = g_strdup_printf ("%s.tmp", dest);
+	res = g_file_set_contents (tmp_dest, contents, len, NULL);
+	g_free (contents);
+	if (res && rename (tmp_dest, dest) != 0) {
+		if (G_FILE_ERROR_EXIST == g_file_error_from_errno (errno)) {
+			unlink (dest);
+			res = rename (tmp_dest, dest) == 0;
+		} else {
+			res = FALSE;
+		}
+	}
+	if (!res)
+		unlink (tmp_dest);
+	g_free (tmp_dest);
+	return res;
+}
+
 int
 mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 {
@@ -11404,6 +11920,7 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 	gint64 all_sizes;
 	MonoAotCompile *acfg;
 	char *outfile_name, *tmp_outfile_name, *p;
+	char *cache_name = NULL;
 	char llvm_stats_msg [256];
 	TV_DECLARE (atv);
 	TV_DECLARE (btv);
@@ -11526,6 +12043,21 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 	if (mono_threads_is_coop_enabled ())
 		acfg->flags = (MonoAotFileFlags)(acfg->flags | MONO_AOT_FILE_FLAG_SAFEPOINTS);
 
+	if (acfg->aot_opts.cache_dir)
+		cache_name = get_output_cache_name (acfg, aot_options);
+	if (cache_name && g_file_test (cache_name, G_FILE_TEST_EXISTS)) {
+		outfile_name = get_output_file_name (acfg);
+		res = copy_file (cache_name, outfile_name);
+		if (res) {
+			aot_printf (acfg, "Output file '%s' is up to date, copied from '%s'.\n", outfile_name, cache_name);
+			g_free (outfile_name);
+			g_free (cache_name);
+			acfg_free (acfg);
+			return 0;
+		}
+		g_free (outfile_name);
+	}
+
 	if (acfg->aot_opts.instances_logfile_path) {
 		acfg->instances_logfile = fopen (acfg->aot_opts.instances_logfile_path, "w");
 		if (!acfg->instances_logfile) {
@@ -11542,6 +12074,30 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 		}
 	}
 
+	if (acfg->aot_opts.dedup_include) {
+		if (!strcmp (acfg->image->assembly->aname.name, acfg->aot_opts.dedup_include)) {
+			acfg->dedup_container = TRUE;
+		} else {
+			MonoAssemblyName aname;
+			MonoAssembly *container;
+			MonoImageOpenStatus status;
+
+			if (!mono_assembly_name_parse (acfg->aot_opts.dedup_include, &aname)) {
+				aot_printerrf (acfg, "Invalid generics container name '%s'.\n", acfg->aot_opts.dedup_include);
+				return 1;
+			}
+			container = mono_assembly_load (&aname, acfg->image->assembly->basedir, &status);
+			mono_assembly_name_free (&aname);
+			if (!container) {
+				aot_printerrf (acfg, "Unable to load the generics container '%s'.\n", acfg->aot_opts.dedup_include);
+				return 1;
+			}
+			/* The runtime loads the container through the image table */
+			acfg->dedup_container_index = get_image_index (acfg, container->image);
+			acfg->dedup_skip = TRUE;
+		}
+	}
+
 	if (!mono_aot_mode_is_interp (&acfg->aot_opts)) {
 		int method_index;
 
@@ -11619,6 +12175,17 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 			resolve_profile_data (acfg, (ProfileData*)l->data);
 		for (l = acfg->profile_data; l; l = l->next)
 			add_profile_instances (acfg, (ProfileData*)l->data);
+		if (g_hash_table_size (acfg->method_profiles))
+			profile_acfg = acfg;
+	}
+
+	if (acfg->dedup_container) {
+		int i;
+
+		if (!dedup_methods)
+			aot_printf (acfg, "No methods were left to the generics container, it should be compiled last.\n");
+		for (i = 0; dedup_methods && i < dedup_methods->len; ++i)
+			add_extra_method (acfg, (MonoMethod *)g_ptr_array_index (dedup_methods, i));
 	}
 
 	acfg->cfgs_size = acfg->methods->len + 32;
@@ -11876,7 +12443,15 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 			acfg_free (acfg);
 			return res;
 		}
+		if (cache_name) {
+			outfile_name = get_output_file_name (acfg);
+			g_mkdir_with_parents (acfg->aot_opts.cache_dir, 0777);
+			if (!copy_file (outfile_name, cache_name))
+				aot_printerrf (acfg, "Unable to store '%s' in the AOT cache.\n", outfile_name);
+			g_free (outfile_name);
+		}
 	}
+	g_free (cache_name);
 	TV_GETTIME (btv);
 	acfg->stats.link_time = TV_ELAPSED (atv, btv);
 
@@ -11926,4 +12501,10 @@ mono_aot_is_shared_got_offset (int offset)
 	return FALSE;
 }
 
+gboolean
+mono_aot_is_cold_il_offset (MonoMethod *method, guint32 il_offset)
+{
+	return FALSE;
+}
+
 #endif
@@ -9,6 +9,7 @@
 
 int mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options);
 void* mono_aot_readonly_field_override (MonoClassField *field);
+gboolean mono_aot_is_cold_il_offset (MonoMethod *method, guint32 il_offset);
 gboolean mono_aot_is_shared_got_offset (int offset) MONO_LLVM_INTERNAL;
 
 guint32  mono_aot_get_got_offset            (MonoJumpInfo *ji) MONO_LLVM_INTERNAL;
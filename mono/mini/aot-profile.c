@@ -0,0 +1,528 @@
+/**
+ * \file
+ * Writer for the AOT profile format described in mono/profiler/aot.h, shared
+ * by the AOT profiler and the AOT cache.
+ *
+ * Copyright 2008-2009 Novell, Inc (http://www.novell.com)
+ * Licensed under the MIT license. See LICENSE file in the project root for full license information.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <mono/metadata/debug-helpers.h>
+#include <mono/metadata/metadata-internals.h>
+#include <mono/utils/mono-error-internals.h>
+
+#include "aot-profile.h"
+
+/**
+ * mono_aot_profile_writer_init:
+ *
+ *   Initialize W to write records to OUTFILE, numbering them from FIRST_ID.
+ */
+void
+mono_aot_profile_writer_init (MonoAotProfileWriter *w, FILE *outfile, int first_id)
+{
+	memset (w, 0, sizeof (MonoAotProfileWriter));
+	w->outfile = outfile;
+	w->images = g_hash_table_new (NULL, NULL);
+	w->classes = g_hash_table_new (NULL, NULL);
+	w->id = first_id;
+}
+
+static void
+emit_byte (MonoAotProfileWriter *w, guint8 value)
+{
+	fwrite (&value, 1, 1, w->outfile);
+}
+
+void
+mono_aot_profile_writer_emit_int32 (MonoAotProfileWriter *w, int value)
+{
+	// FIXME: Endianness
+	fwrite (&value, 4, 1, w->outfile);
+}
+
+static void
+emit_string (MonoAotProfileWriter *w, const char *str)
+{
+	int len = strlen (str);
+
+	mono_aot_profile_writer_emit_int32 (w, len);
+	fwrite (str, len, 1, w->outfile);
+}
+
+void
+mono_aot_profile_writer_emit_record (MonoAotProfileWriter *w, AotProfRecordType type, int id)
+{
+	emit_byte (w, type);
+	mono_aot_profile_writer_emit_int32 (w, id);
+}
+
+/**
+ * mono_aot_profile_writer_emit_header:
+ *
+ *   Emit the magic and the version, which start the file.
+ */
+void
+mono_aot_profile_writer_emit_header (MonoAotProfileWriter *w)
+{
+	char magic [32];
+
+	sprintf (magic, AOT_PROFILER_MAGIC);
+	fwrite (magic, strlen (magic), 1, w->outfile);
+	mono_aot_profile_writer_emit_int32 (w, (AOT_PROFILER_MAJOR_VERSION << 16) | AOT_PROFILER_MINOR_VERSION);
+}
+
+static int
+add_image (MonoAotProfileWriter *w, MonoImage *image)
+{
+	int id = GPOINTER_TO_INT (g_hash_table_lookup (w->images, image));
+	if (id)
+		return id - 1;
+
+	id = w->id ++;
+	mono_aot_profile_writer_emit_record (w, AOTPROF_RECORD_IMAGE, id);
+	emit_string (w, image->assembly->aname.name);
+	emit_string (w, image->guid);
+	g_hash_table_insert (w->images, image, GINT_TO_POINTER (id + 1));
+	return id;
+}
+
+/*
+ * Return whenever TYPE can be represented in the format, as the class it maps to.
+ */
+static gboolean
+is_type_supported (MonoType *type)
+{
+	switch (type->type) {
+	case MONO_TYPE_BOOLEAN:
+	case MONO_TYPE_CHAR:
+	case MONO_TYPE_I1:
+	case MONO_TYPE_U1:
+	case MONO_TYPE_I2:
+	case MONO_TYPE_U2:
+	case MONO_TYPE_I4:
+	case MONO_TYPE_U4:
+	case MONO_TYPE_I8:
+	case MONO_TYPE_U8:
+	case MONO_TYPE_R4:
+	case MONO_TYPE_R8:
+	case MONO_TYPE_I:
+	case MONO_TYPE_U:
+	case MONO_TYPE_OBJECT:
+	case MONO_TYPE_STRING:
+	case MONO_TYPE_CLASS:
+	case MONO_TYPE_VALUETYPE:
+	case MONO_TYPE_GENERICINST:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static char*
+get_class_name (MonoClass *klass)
+{
+	if (klass->nested_in)
+		return g_strdup_printf ("%s.%s/%s", klass->nested_in->name_space, klass->nested_in->name, klass->name);
+	else
+		return g_strdup_printf ("%s.%s", klass->name_space, klass->name);
+}
+
+static int
+add_class (MonoAotProfileWriter *w, MonoClass *klass);
+
+static int
+add_type (MonoAotProfileWriter *w, MonoType *type)
+{
+	if (!is_type_supported (type))
+		return -1;
+	return add_class (w, mono_class_from_mono_type (type));
+}
+
+static int
+add_ginst (MonoAotProfileWriter *w, MonoGenericInst *inst)
+{
+	int i, id;
+	int *ids;
+
+	// FIXME: Cache
+	ids = g_malloc0 (inst->type_argc * sizeof (int));
+	for (i = 0; i < inst->type_argc; ++i) {
+		MonoType *t = inst->type_argv [i];
+		ids [i] = add_type (w, t);
+		if (ids [i] == -1) {
+			g_free (ids);
+			return -1;
+		}
+	}
+	id = w->id ++;
+	mono_aot_profile_writer_emit_record (w, AOTPROF_RECORD_GINST, id);
+	mono_aot_profile_writer_emit_int32 (w, inst->type_argc);
+	for (i = 0; i < inst->type_argc; ++i)
+		mono_aot_profile_writer_emit_int32 (w, ids [i]);
+	g_free (ids);
+
+	return id;
+}
+
+static int
+add_class (MonoAotProfileWriter *w, MonoClass *klass)
+{
+	int id, inst_id = -1, image_id;
+	char *name;
+
+	id = GPOINTER_TO_INT (g_hash_table_lookup (w->classes, klass));
+	if (id)
+		return id - 1;
+
+	if (!klass->image->assembly)
+		return -1;
+	image_id = add_image (w, klass->image);
+
+	if (mono_class_is_ginst (klass)) {
+		MonoGenericContext *ctx = mono_class_get_context (klass);
+		inst_id = add_ginst (w, ctx->class_inst);
+		if (inst_id == -1)
+			return -1;
+	}
+
+	name = get_class_name (klass);
+
+	id = w->id ++;
+	mono_aot_profile_writer_emit_record (w, AOTPROF_RECORD_TYPE, id);
+	emit_byte (w, MONO_TYPE_CLASS);
+	mono_aot_profile_writer_emit_int32 (w, image_id);
+	mono_aot_profile_writer_emit_int32 (w, inst_id);
+	emit_string (w, name);
+	g_free (name);
+	g_hash_table_insert (w->classes, klass, GINT_TO_POINTER (id + 1));
+	return id;
+}
+
+/**
+ * mono_aot_profile_writer_add_method:
+ *
+ *   Emit a method record for M, preceded by the records it references. Return the
+ * id of the record, or -1 if M can't be represented in the format.
+ */
+int
+mono_aot_profile_writer_add_method (MonoAotProfileWriter *w, MonoMethod *m)
+{
+	MonoError error;
+	MonoMethodSignature *sig;
+	int id, class_id, inst_id = -1;
+	char *s;
+
+	sig = mono_method_signature_checked (m, &error);
+	if (!is_ok (&error)) {
+		mono_error_cleanup (&error);
+		return -1;
+	}
+
+	class_id = add_class (w, m->klass);
+	if (class_id == -1)
+		return -1;
+
+	if (m->is_inflated) {
+		MonoGenericContext *ctx = mono_method_get_context (m);
+		if (ctx->method_inst) {
+			inst_id = add_ginst (w, ctx->method_inst);
+			if (inst_id == -1)
+				return -1;
+		}
+	}
+	id = w->id ++;
+	mono_aot_profile_writer_emit_record (w, AOTPROF_RECORD_METHOD, id);
+	mono_aot_profile_writer_emit_int32 (w, class_id);
+	mono_aot_profile_writer_emit_int32 (w, inst_id);
+	mono_aot_profile_writer_emit_int32 (w, sig->param_count);
+	emit_string (w, m->name);
+	s = mono_signature_full_name (sig);
+	emit_string (w, s);
+	g_free (s);
+	return id;
+}
+
+/**
+ * mono_aot_profile_writer_finish:
+ *
+ *   Emit the record ending the file and free the data of W. The file is not closed.
+ */
+void
+mono_aot_profile_writer_finish (MonoAotProfileWriter *w)
+{
+	mono_aot_profile_writer_emit_record (w, AOTPROF_RECORD_NONE, 0);
+	g_hash_table_destroy (w->images);
+	g_hash_table_destroy (w->classes);
+	w->images = w->classes = NULL;
+}
+
+/*
+ * Reading
+ *
+ * Methods are identified by a key built from the names in their records, which is
+ * computed the same way from a MonoMethod, so the contents of a file can be merged
+ * with new methods without loading the assemblies it references.
+ * The keys look like [<assembly>:<guid>]<namespace>.<name><<type arg keys>>::<method name><<method type arg keys>>(<signature>).
+ */
+
+static gboolean
+append_class_key (GString *s, MonoClass *klass);
+
+static gboolean
+append_ginst_key (GString *s, MonoGenericInst *inst)
+{
+	int i;
+
+	g_string_append_c (s, '<');
+	for (i = 0; i < inst->type_argc; ++i) {
+		MonoType *t = inst->type_argv [i];
+
+		if (i > 0)
+			g_string_append_c (s, ',');
+		if (!is_type_supported (t) || !append_class_key (s, mono_class_from_mono_type (t)))
+			return FALSE;
+	}
+	g_string_append_c (s, '>');
+	return TRUE;
+}
+
+static gboolean
+append_class_key (GString *s, MonoClass *klass)
+{
+	char *name;
+
+	if (!klass->image->assembly)
+		return FALSE;
+	g_string_append_printf (s, "[%s:%s]", klass->image->assembly->aname.name, klass->image->guid);
+	name = get_class_name (klass);
+	g_string_append (s, name);
+	g_free (name);
+	if (mono_class_is_ginst (klass))
+		return append_ginst_key (s, mono_class_get_context (klass)->class_inst);
+	return TRUE;
+}
+
+/**
+ * mono_aot_profile_get_image_key:
+ *
+ *   Return the key identifying IMAGE in the values of MonoAotProfileContents:methods.
+ */
+char*
+mono_aot_profile_get_image_key (MonoImage *image)
+{
+	return g_strdup_printf ("%s:%s", image->assembly->aname.name, image->guid);
+}
+
+/**
+ * mono_aot_profile_get_method_key:
+ *
+ *   Return the key of the record mono_aot_profile_writer_add_method () would emit for
+ * M, or NULL if M can't be represented in the format.
+ */
+char*
+mono_aot_profile_get_method_key (MonoMethod *m)
+{
+	MonoError error;
+	MonoMethodSignature *sig;
+	GString *s;
+	char *sig_name;
+
+	sig = mono_method_signature_checked (m, &error);
+	if (!is_ok (&error)) {
+		mono_error_cleanup (&error);
+		return NULL;
+	}
+
+	s = g_string_new ("");
+	if (!append_class_key (s, m->klass))
+		goto fail;
+	g_string_append_printf (s, "::%s", m->name);
+	if (m->is_inflated && mono_method_get_context (m)->method_inst) {
+		if (!append_ginst_key (s, mono_method_get_context (m)->method_inst))
+			goto fail;
+	}
+	sig_name = mono_signature_full_name (sig);
+	g_string_append_printf (s, "(%s)", sig_name);
+	g_free (sig_name);
+	return g_string_free (s, FALSE);
+
+fail:
+	g_string_free (s, TRUE);
+	return NULL;
+}
+
+static gboolean
+read_int32 (MonoAotProfileContents *c, gsize *pos, int *value)
+{
+	if (*pos + 4 > c->len)
+		return FALSE;
+	memcpy (value, c->data + *pos, 4);
+	*pos += 4;
+	return TRUE;
+}
+
+static char*
+read_string (MonoAotProfileContents *c, gsize *pos)
+{
+	char *res;
+	int len;
+
+	if (!read_int32 (c, pos, &len) || len < 0 || *pos + len > c->len)
+		return NULL;
+	res = g_strndup ((char*)c->data + *pos, len);
+	*pos += len;
+	return res;
+}
+
+/*
+ * Read the record at *POS, adding the keys of images, types, ginsts and methods to KEYS,
+ * and the methods to C->methods. Return FALSE if the file is malformed.
+ */
+static gboolean
+read_record (MonoAotProfileContents *c, gsize *pos, GHashTable *keys, GHashTable *class_images, int type, int id)
+{
+	const char *image_key, *class_key, *inst_key;
+	char *name = NULL, *str = NULL;
+	int i, image_id, class_id, inst_id, count, value;
+	gboolean res = FALSE;
+
+	switch (type) {
+	case AOTPROF_RECORD_IMAGE:
+		name = read_string (c, pos);
+		str = read_string (c, pos);
+		if (!name || !str)
+			break;
+		g_hash_table_insert (keys, GINT_TO_POINTER (id), g_strdup_printf ("%s:%s", name, str));
+		res = TRUE;
+		break;
+	case AOTPROF_RECORD_TYPE:
+		if (*pos >= c->len || c->data [(*pos) ++] != MONO_TYPE_CLASS)
+			break;
+		if (!read_int32 (c, pos, &image_id) || !read_int32 (c, pos, &inst_id) || !(name = read_string (c, pos)))
+			break;
+		image_key = (const char *)g_hash_table_lookup (keys, GINT_TO_POINTER (image_id));
+		inst_key = inst_id == -1 ? "" : (const char *)g_hash_table_lookup (keys, GINT_TO_POINTER (inst_id));
+		if (!image_key || !inst_key)
+			break;
+		g_hash_table_insert (keys, GINT_TO_POINTER (id), g_strdup_printf ("[%s]%s%s", image_key, name, inst_key));
+		g_hash_table_insert (class_images, GINT_TO_POINTER (id), (gpointer)image_key);
+		res = TRUE;
+		break;
+	case AOTPROF_RECORD_GINST: {
+		GString *s;
+
+		if (!read_int32 (c, pos, &count) || count < 0)
+			break;
+		s = g_string_new ("<");
+		for (i = 0; i < count; ++i) {
+			if (!read_int32 (c, pos, &value) || !(class_key = (const char *)g_hash_table_lookup (keys, GINT_TO_POINTER (value))))
+				break;
+			if (i > 0)
+				g_string_append_c (s, ',');
+			g_string_append (s, class_key);
+		}
+		g_string_append_c (s, '>');
+		if (i == count) {
+			g_hash_table_insert (keys, GINT_TO_POINTER (id), g_string_free (s, FALSE));
+			res = TRUE;
+		} else {
+			g_string_free (s, TRUE);
+		}
+		break;
+	}
+	case AOTPROF_RECORD_METHOD:
+		if (!read_int32 (c, pos, &class_id) || !read_int32 (c, pos, &inst_id) || !read_int32 (c, pos, &count))
+			break;
+		name = read_string (c, pos);
+		str = read_string (c, pos);
+		if (!name || !str)
+			break;
+		class_key = (const char *)g_hash_table_lookup (keys, GINT_TO_POINTER (class_id));
+		image_key = (const char *)g_hash_table_lookup (class_images, GINT_TO_POINTER (class_id));
+		inst_key = inst_id == -1 ? "" : (const char *)g_hash_table_lookup (keys, GINT_TO_POINTER (inst_id));
+		if (!class_key || !image_key || !inst_key)
+			break;
+		g_hash_table_replace (c->methods, g_strdup_printf ("%s::%s%s(%s)", class_key, name, inst_key, str), g_strdup (image_key));
+		res = TRUE;
+		break;
+	case AOTPROF_RECORD_METHOD_COUNTS:
+		/* The number of calls, then IL offset/count pairs */
+		if (!read_int32 (c, pos, &value) || !read_int32 (c, pos, &count) || count < 0 || *pos + (gsize)count * 8 > c->len)
+			break;
+		*pos += (gsize)count * 8;
+		res = TRUE;
+		break;
+	default:
+		break;
+	}
+	g_free (name);
+	g_free (str);
+	return res;
+}
+
+/**
+ * mono_aot_profile_read:
+ *
+ *   Read the profile in FILENAME. Return NULL if it doesn't exist or is malformed.
+ */
+MonoAotProfileContents*
+mono_aot_profile_read (const char *filename)
+{
+	MonoAotProfileContents *c;
+	GHashTable *keys, *class_images;
+	gchar *data;
+	gsize len, pos, start;
+	int magic_len = strlen (AOT_PROFILER_MAGIC);
+	int version, type, id, max_id = -1;
+	gboolean ok = FALSE;
+
+	if (!g_file_get_contents (filename, &data, &len, NULL))
+		return NULL;
+
+	c = g_new0 (MonoAotProfileContents, 1);
+	c->data = (guint8*)data;
+	c->len = len;
+	c->methods = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	keys = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+	class_images = g_hash_table_new (NULL, NULL);
+
+	pos = magic_len;
+	if (len >= magic_len && !strncmp (data, AOT_PROFILER_MAGIC, magic_len) && read_int32 (c, &pos, &version) && (version >> 16) == AOT_PROFILER_MAJOR_VERSION) {
+		while (pos < len) {
+			start = pos;
+			type = c->data [pos ++];
+			if (!read_int32 (c, &pos, &id))
+				break;
+			if (type == AOTPROF_RECORD_NONE) {
+				c->end = start;
+				ok = TRUE;
+				break;
+			}
+			if (!read_record (c, &pos, keys, class_images, type, id))
+				break;
+			max_id = MAX (max_id, id);
+		}
+	}
+
+	g_hash_table_destroy (class_images);
+	g_hash_table_destroy (keys);
+
+	if (!ok) {
+		mono_aot_profile_contents_free (c);
+		return NULL;
+	}
+	c->next_id = max_id + 1;
+	return c;
+}
+
+void
+mono_aot_profile_contents_free (MonoAotProfileContents *c)
+{
+	g_hash_table_destroy (c->methods);
+	g_free (c->data);
+	g_free (c);
+}
@@ -0,0 +1,68 @@
+/**
+ * \file
+ * Writer for the AOT profile format described in mono/profiler/aot.h
+ *
+ * Licensed under the MIT license. See LICENSE file in the project root for full license information.
+ */
+
+#ifndef __MONO_AOT_PROFILE_H__
+#define __MONO_AOT_PROFILE_H__
+
+#include <stdio.h>
+#include <glib.h>
+#include <mono/metadata/class-internals.h>
+#include <mono/profiler/aot.h>
+#include <mono/utils/mono-compiler.h>
+
+typedef struct {
+	FILE *outfile;
+	/* MonoImage/MonoClass -> record id + 1 */
+	GHashTable *images;
+	GHashTable *classes;
+	/* The id of the next record */
+	int id;
+} MonoAotProfileWriter;
+
+MONO_PROFILER_API void
+mono_aot_profile_writer_init (MonoAotProfileWriter *w, FILE *outfile, int first_id);
+
+MONO_PROFILER_API void
+mono_aot_profile_writer_emit_header (MonoAotProfileWriter *w);
+
+MONO_PROFILER_API void
+mono_aot_profile_writer_emit_int32 (MonoAotProfileWriter *w, int value);
+
+MONO_PROFILER_API void
+mono_aot_profile_writer_emit_record (MonoAotProfileWriter *w, AotProfRecordType type, int id);
+
+MONO_PROFILER_API int
+mono_aot_profile_writer_add_method (MonoAotProfileWriter *w, MonoMethod *m);
+
+MONO_PROFILER_API void
+mono_aot_profile_writer_finish (MonoAotProfileWriter *w);
+
+/* The contents of a profile, as needed to append new methods to it */
+typedef struct {
+	guint8 *data;
+	gsize len;
+	/* The offset of the record ending the file */
+	gsize end;
+	/* The id to give to the next record */
+	int next_id;
+	/* Key of each method -> key of the image of its class */
+	GHashTable *methods;
+} MonoAotProfileContents;
+
+MonoAotProfileContents*
+mono_aot_profile_read (const char *filename);
+
+void
+mono_aot_profile_contents_free (MonoAotProfileContents *c);
+
+char*
+mono_aot_profile_get_method_key (MonoMethod *m);
+
+char*
+mono_aot_profile_get_image_key (MonoImage *image);
+
+#endif /* __MONO_AOT_PROFILE_H__ */
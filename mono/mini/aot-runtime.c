@@ -56,11 +56,15 @@
 #include <mono/utils/mono-mmap.h>
 #include <mono/utils/mono-compiler.h>
 #include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-time.h>
 #include <mono/utils/mono-digest.h>
+#include <mono/utils/mono-group-varint.h>
 #include <mono/utils/mono-threads-coop.h>
+#include <mono/utils/mono-proclib.h>
 
 #include "mini.h"
 #include "seq-points.h"
+#include "aot-profile.h"
 #include "version.h"
 #include "debugger-agent.h"
 #include "aot-compiler.h"
@@ -154,6 +158,11 @@ typedef struct MonoAotModule {
 
 	JitInfoMap *async_jit_info_table;
 	mono_mutex_t mutex;
+
+	/* Startup time breakdown, in 100ns ticks */
+	gint64 open_time;
+	gint64 references_time;
+	gint64 lazy_init_time;
 } MonoAotModule;
 
 typedef struct {
@@ -194,6 +203,17 @@ static gboolean make_unreadable = FALSE;
 static guint32 name_table_accesses = 0;
 static guint32 n_pagefaults = 0;
 
+/* Stats, the times are in 100ns ticks */
+static gint32 aot_modules_loaded;
+static gint64 aot_open_time;
+static gint64 aot_references_time;
+static gint64 aot_lazy_init_time;
+/* Trampolines handed out by kind, from the AOT image or from trampoline pages */
+static gint32 aot_trampolines_used [MONO_AOT_TRAMP_NUM];
+static gint32 aot_trampoline_pages;
+/* Trampolines created at runtime because the AOT image ran out of them */
+static gint32 aot_trampolines_created;
+
 /* Used to speed-up find_aot_module () */
 static gsize aot_code_low_addr = (gssize)-1;
 static gsize aot_code_high_addr = 0;
@@ -209,6 +229,14 @@ static GHashTable *aot_jit_icall_hash;
 #define USE_PAGE_TRAMPOLINES 0
 #endif
 
+/*
+ * Whenever trampolines can be created at runtime when the ones in the AOT image run
+ * out, instead of aborting. Not possible on platforms which can't generate code.
+ */
+#if !defined(MONOTOUCH) && !defined(DISABLE_JIT)
+#define CAN_CREATE_TRAMPOLINES 1
+#endif
+
 #define mono_aot_page_lock() mono_os_mutex_lock (&aot_page_mutex)
 #define mono_aot_page_unlock() mono_os_mutex_unlock (&aot_page_mutex)
 static mono_mutex_t aot_page_mutex;
@@ -325,8 +353,9 @@ decode_value (guint8 *ptr, guint8 **rptr)
 static guint32
 mono_aot_get_offset (guint32 *table, int index)
 {
-	int i, group, ngroups, index_entry_size;
-	int start_offset, offset, group_size;
+	int i, n, group, ngroups, index_entry_size;
+	int offset, group_size;
+	guint32 *values;
 	guint8 *data_start, *p;
 	guint32 *index32 = NULL;
 	guint16 *index16 = NULL;
@@ -347,13 +376,18 @@ mono_aot_get_offset (guint32 *table, int index)
 		p = data_start + index32 [group];
 	}
 
-	/* offset will contain the value of offsets [group * group_size] */
-	offset = start_offset = decode_value (p, &p);
-	for (i = group * group_size + 1; i <= index; ++i) {
-		offset += decode_value (p, &p);
-	}
+	/* Only decode the entries up to INDEX */
+	n = index - (group * group_size) + 1;
+	g_assert (n > 0);
+	values = g_newa (guint32, n);
+	mono_group_varint_decode (p, n, values);
 
-	//printf ("Offset lookup: %d -> %d, start=%d, p=%d\n", index, offset, start_offset, table [3 + group]);
+	/* values [0] is the value of offsets [group * group_size], the rest are differences */
+	offset = values [0];
+	for (i = 1; i < n; ++i)
+		offset += mono_zigzag_decode (values [i]);
+
+	//printf ("Offset lookup: %d -> %d, p=%d\n", index, offset, table [3 + group]);
 
 	return offset;
 }
@@ -1381,6 +1415,21 @@ static char *cache_dir;
 /* The number of assemblies AOTed in this run */
 static int cache_count;
 
+/*
+ * Generic instances of the cached assemblies which the JIT had to compile because
+ * they were not found in any AOT image. At shutdown, they are merged into the
+ * instance profile of the cache, which is passed to the AOT compiler when an
+ * assembly is (re)compiled into the cache.
+ */
+static GHashTable *jit_instances;
+
+/* The contents of the instance profile when the runtime started */
+static MonoAotProfileContents *instance_profile;
+static gboolean instance_profile_inited;
+
+/* Stop adding instances to the profile once it holds this many */
+#define MAX_PROFILE_INSTANCES 8192
+
 /* Whenever to AOT in-process */
 static gboolean in_process;
 
@@ -1395,6 +1444,124 @@ collect_assemblies (gpointer data, gpointer user_data)
 
 #define SHA1_DIGEST_LENGTH 20
 
+static const char*
+get_cache_dir (void)
+{
+	const char *home;
+
+	if (!cache_dir) {
+		home = g_get_home_dir ();
+		if (!home)
+			return NULL;
+		cache_dir = g_strdup_printf ("%s/Library/Caches/mono/aot-cache", home);
+		if (!g_file_test (cache_dir, G_FILE_TEST_EXISTS|G_FILE_TEST_IS_DIR))
+			g_mkdir_with_parents (cache_dir, 0777);
+	}
+	return cache_dir;
+}
+
+static char*
+get_instance_profile_name (void)
+{
+	return g_build_filename (cache_dir, "instances.aotprofile", NULL);
+}
+
+/*
+ * get_instance_profile:
+ *
+ *   Return the contents of the instance profile of the cache as of the start of the
+ * runtime, or NULL if there is none.
+ */
+static MonoAotProfileContents*
+get_instance_profile (void)
+{
+	char *fname;
+
+	mono_aot_lock ();
+	if (!instance_profile_inited && get_cache_dir ()) {
+		fname = get_instance_profile_name ();
+		instance_profile = mono_aot_profile_read (fname);
+		g_free (fname);
+		instance_profile_inited = TRUE;
+	}
+	mono_aot_unlock ();
+	return instance_profile;
+}
+
+static gint
+compare_strings (gconstpointer a, gconstpointer b)
+{
+	return strcmp (*(const char**)a, *(const char**)b);
+}
+
+/*
+ * get_instance_profile_hash:
+ *
+ *   Return a hash of the instances in the instance profile which belong to ASSEMBLY,
+ * or NULL if there are none. Instances of other assemblies don't change the image
+ * of ASSEMBLY, so they don't invalidate it.
+ */
+static char*
+get_instance_profile_hash (MonoAssembly *assembly)
+{
+	MonoAotProfileContents *profile = get_instance_profile ();
+	GHashTableIter iter;
+	GPtrArray *keys;
+	GString *s;
+	gpointer key, value;
+	char *image_key, *res;
+	guint8 digest [SHA1_DIGEST_LENGTH];
+	int i;
+
+	if (!profile)
+		return NULL;
+
+	image_key = mono_aot_profile_get_image_key (assembly->image);
+	keys = g_ptr_array_new ();
+	g_hash_table_iter_init (&iter, profile->methods);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (!strcmp ((char*)value, image_key))
+			g_ptr_array_add (keys, key);
+	}
+	g_free (image_key);
+
+	res = NULL;
+	if (keys->len) {
+		g_ptr_array_sort (keys, compare_strings);
+		s = g_string_new ("");
+		for (i = 0; i < keys->len; ++i) {
+			g_string_append (s, (char*)g_ptr_array_index (keys, i));
+			g_string_append_c (s, '\n');
+		}
+		mono_sha1_get_digest ((guint8*)s->str, s->len, digest);
+		g_string_free (s, TRUE);
+
+		res = g_malloc0 ((SHA1_DIGEST_LENGTH * 2) + 1);
+		for (i = 0; i < SHA1_DIGEST_LENGTH; ++i)
+			sprintf (res + (i * 2), "%02x", digest [i]);
+	}
+	g_ptr_array_free (keys, TRUE);
+	return res;
+}
+
+/*
+ * get_profile_options:
+ *
+ *   Return the AOT options which pass the instance profile to the AOT compiler.
+ */
+static char*
+get_profile_options (void)
+{
+	char *fname, *res;
+
+	if (!get_instance_profile ())
+		return g_strdup ("");
+	fname = get_instance_profile_name ();
+	res = g_strdup_printf (",profile=%s", fname);
+	g_free (fname);
+	return res;
+}
+
 /*
  * get_aot_config_hash:
  *
@@ -1408,12 +1575,20 @@ get_aot_config_hash (MonoAssembly *assembly)
 	GString *s;
 	int i;
 	guint8 digest [SHA1_DIGEST_LENGTH];
-	char *digest_str;
+	char *digest_str, *instances_hash;
 
 	build_info = mono_get_runtime_build_info ();
 
 	s = g_string_new (build_info);
 
+	/* New instances of the assembly change the image */
+	instances_hash = get_instance_profile_hash (assembly);
+	if (instances_hash) {
+		g_string_append (s, "_instances_");
+		g_string_append (s, instances_hash);
+		g_free (instances_hash);
+	}
+
 	mono_assembly_foreach (collect_assemblies, &assembly_list);
 
 	/*
@@ -1447,6 +1622,38 @@ get_aot_config_hash (MonoAssembly *assembly)
 	return digest_str;
 }
 
+/*
+ * is_cached_assembly:
+ *
+ *   Return whenever ASSEMBLY is in the list of assemblies enabled for aot caching.
+ */
+static gboolean
+is_cached_assembly (MonoAotCacheConfig *config, MonoAssembly *assembly)
+{
+	GSList *l;
+
+	if (config->apps) {
+		MonoDomain *domain = mono_domain_get ();
+		MonoAssembly *entry_assembly = domain->entry_assembly;
+
+		// FIXME: This cannot be used for mscorlib during startup, since entry_assembly is not set yet
+		for (l = config->apps; l; l = l->next) {
+			char *n = l->data;
+
+			if ((entry_assembly && !strcmp (entry_assembly->aname.name, n)) || (!entry_assembly && !strcmp (assembly->aname.name, n)))
+				return TRUE;
+		}
+	}
+
+	for (l = config->assemblies; l; l = l->next) {
+		char *n = l->data;
+
+		if (!strcmp (assembly->aname.name, n))
+			return TRUE;
+	}
+	return FALSE;
+}
+
 static void
 aot_cache_init (void)
 {
@@ -1466,14 +1673,12 @@ aot_cache_load_module (MonoAssembly *assembly, char **aot_name)
 {
 	MonoAotCacheConfig *config;
 	GSList *l;
-	char *fname, *tmp2, *aot_options, *failure_fname;
-	const char *home;
+	char *fname, *tmp2, *aot_options, *profile_options, *failure_fname;
 	MonoDl *module;
 	gboolean res;
 	gint exit_status;
 	char *hash;
 	int pid;
-	gboolean enabled;
 	FILE *failure_file;
 
 	*aot_name = NULL;
@@ -1481,46 +1686,13 @@ aot_cache_load_module (MonoAssembly *assembly, char **aot_name)
 	if (image_is_dynamic (assembly->image))
 		return NULL;
 
-	/* Check in the list of assemblies enabled for aot caching */
 	config = mono_get_aot_cache_config ();
 
-	enabled = FALSE;
-	if (config->apps) {
-		MonoDomain *domain = mono_domain_get ();
-		MonoAssembly *entry_assembly = domain->entry_assembly;
-
-		// FIXME: This cannot be used for mscorlib during startup, since entry_assembly is not set yet
-		for (l = config->apps; l; l = l->next) {
-			char *n = l->data;
-
-			if ((entry_assembly && !strcmp (entry_assembly->aname.name, n)) || (!entry_assembly && !strcmp (assembly->aname.name, n)))
-				break;
-		}
-		if (l)
-			enabled = TRUE;
-	}
-
-	if (!enabled) {
-		for (l = config->assemblies; l; l = l->next) {
-			char *n = l->data;
-
-			if (!strcmp (assembly->aname.name, n))
-				break;
-		}
-		if (l)
-			enabled = TRUE;
-	}
-	if (!enabled)
+	if (!is_cached_assembly (config, assembly))
 		return NULL;
 
-	if (!cache_dir) {
-		home = g_get_home_dir ();
-		if (!home)
-			return NULL;
-		cache_dir = g_strdup_printf ("%s/Library/Caches/mono/aot-cache", home);
-		if (!g_file_test (cache_dir, G_FILE_TEST_EXISTS|G_FILE_TEST_IS_DIR))
-			g_mkdir_with_parents (cache_dir, 0777);
-	}
+	if (!get_cache_dir ())
+		return NULL;
 
 	/*
 	 * The same assembly can be used in multiple configurations, i.e. multiple
@@ -1579,8 +1751,9 @@ aot_cache_load_module (MonoAssembly *assembly, char **aot_name)
 	 * the AOT compiler.
 	 * - fork a new process and do the work there.
 	 */
+	profile_options = get_profile_options ();
 	if (in_process) {
-		aot_options = g_strdup_printf ("outfile=%s,internal-logfile=%s.log%s%s", fname, fname, config->aot_options ? "," : "", config->aot_options ? config->aot_options : "");
+		aot_options = g_strdup_printf ("outfile=%s,internal-logfile=%s.log%s%s%s", fname, fname, profile_options, config->aot_options ? "," : "", config->aot_options ? config->aot_options : "");
 		/* Maybe due this in another thread ? */
 		res = mono_compile_assembly (assembly, mono_parse_default_optimizations (NULL), aot_options);
 		if (res) {
@@ -1611,7 +1784,7 @@ aot_cache_load_module (MonoAssembly *assembly, char **aot_name)
 			dup2 (fileno (logfile), 1);
 			dup2 (fileno (logfile), 2);
 
-			aot_options = g_strdup_printf ("outfile=%s", fname);
+			aot_options = g_strdup_printf ("outfile=%s%s", fname, profile_options);
 			res = mono_compile_assembly (assembly, mono_parse_default_optimizations (NULL), aot_options);
 			if (!res) {
 				exit (1);
@@ -1627,12 +1800,115 @@ aot_cache_load_module (MonoAssembly *assembly, char **aot_name)
 				mono_trace (G_LOG_LEVEL_MESSAGE, MONO_TRACE_AOT, "AOT: succeeded.");
 		}
 	}
+	g_free (profile_options);
 
 	module = mono_dl_open (fname, MONO_DL_LAZY, NULL);
 
 	return module;
 }
 
+/*
+ * aot_cache_record_instance:
+ *
+ *   Called when METHOD is not found in any AOT image and has to be JITted.
+ */
+static void
+aot_cache_record_instance (MonoMethod *method)
+{
+	MonoAotCacheConfig *config = mono_get_aot_cache_config ();
+
+	if (!config->profile_instances)
+		return;
+	if (!method->is_inflated || method->wrapper_type || !mono_method_get_token (method))
+		return;
+	/* Only the cached assemblies are compiled with the profile */
+	if (!method->klass->image->assembly || image_is_dynamic (method->klass->image) || !is_cached_assembly (config, method->klass->image->assembly))
+		return;
+
+	mono_aot_lock ();
+	if (!jit_instances)
+		jit_instances = g_hash_table_new (NULL, NULL);
+	g_hash_table_insert (jit_instances, method, method);
+	mono_aot_unlock ();
+}
+
+/*
+ * aot_cache_save_instances:
+ *
+ *   Merge the instances recorded by aot_cache_record_instance () into the instance
+ * profile of the cache, so the next compilation of the assemblies they belong to
+ * includes them. Instances already in the profile are not added again, so the
+ * profile, and the hash of the images, only change when there are new instances.
+ */
+static void
+aot_cache_save_instances (void)
+{
+	MonoAotProfileContents *profile;
+	MonoAotProfileWriter w;
+	GHashTableIter iter;
+	GPtrArray *methods;
+	gpointer key;
+	char *fname, *tmp_fname, *method_key;
+	FILE *outfile;
+	int i, nprofiled;
+
+	if (!jit_instances || !g_hash_table_size (jit_instances) || !get_cache_dir ())
+		return;
+
+	profile = get_instance_profile ();
+	nprofiled = profile ? g_hash_table_size (profile->methods) : 0;
+
+	methods = g_ptr_array_new ();
+	g_hash_table_iter_init (&iter, jit_instances);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		method_key = mono_aot_profile_get_method_key ((MonoMethod*)key);
+		if (method_key && !(profile && g_hash_table_lookup (profile->methods, method_key)) && nprofiled + methods->len < MAX_PROFILE_INSTANCES)
+			g_ptr_array_add (methods, key);
+		g_free (method_key);
+	}
+	if (!methods->len) {
+		g_ptr_array_free (methods, TRUE);
+		return;
+	}
+
+	/* Write to a temporary file, so other processes never read a partial profile */
+	fname = get_instance_profile_name ();
+	tmp_fname = g_strdup_printf ("%s.%d.tmp", fname, mono_process_current_pid ());
+	outfile = fopen (tmp_fname, "wb");
+	if (!outfile) {
+		mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_AOT, "AOT: unable to create '%s'.", tmp_fname);
+		g_free (tmp_fname);
+		g_free (fname);
+		g_ptr_array_free (methods, TRUE);
+		return;
+	}
+
+	/* Keep the existing records, and append the new ones */
+	if (profile) {
+		fwrite (profile->data, profile->end, 1, outfile);
+		mono_aot_profile_writer_init (&w, outfile, profile->next_id);
+	} else {
+		mono_aot_profile_writer_init (&w, outfile, 0);
+		mono_aot_profile_writer_emit_header (&w);
+	}
+	for (i = 0; i < methods->len; ++i)
+		mono_aot_profile_writer_add_method (&w, (MonoMethod*)g_ptr_array_index (methods, i));
+	mono_aot_profile_writer_finish (&w);
+	fclose (outfile);
+
+#ifdef HOST_WIN32
+	g_unlink (fname);
+#endif
+	if (g_rename (tmp_fname, fname) == 0)
+		mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_AOT, "AOT: added %d JITted instances to '%s'.", methods->len, fname);
+	else
+		g_unlink (tmp_fname);
+
+	g_free (tmp_fname);
+	g_free (fname);
+	g_ptr_array_free (methods, TRUE);
+}
+
 #else
 
 static void
@@ -1646,6 +1922,16 @@ aot_cache_load_module (MonoAssembly *assembly, char **aot_name)
 	return NULL;
 }
 
+static void
+aot_cache_record_instance (MonoMethod *method)
+{
+}
+
+static void
+aot_cache_save_instances (void)
+{
+}
+
 #endif
 
 static void
@@ -1868,6 +2154,7 @@ init_amodule_got (MonoAotModule *amodule)
 	guint32 got_offsets [128];
 	MonoError error;
 	int i, npatches;
+	gint64 start, elapsed;
 
 	/* These can't be initialized in load_aot_module () */
 	if (amodule->shared_got [0] || amodule->got_initializing)
@@ -1875,6 +2162,8 @@ init_amodule_got (MonoAotModule *amodule)
 
 	amodule->got_initializing = TRUE;
 
+	start = mono_100ns_ticks ();
+
 	mp = mono_mempool_new ();
 	npatches = amodule->info.nshared_got_entries;
 	for (i = 0; i < npatches; ++i)
@@ -1919,6 +2208,77 @@ init_amodule_got (MonoAotModule *amodule)
 	}
 
 	mono_mempool_destroy (mp);
+
+	elapsed = mono_100ns_ticks () - start;
+	InterlockedAdd64 (&amodule->lazy_init_time, elapsed);
+	InterlockedAdd64 (&aot_lazy_init_time, elapsed);
+}
+
+/*
+ * get_method_address:
+ *
+ *   Return the code address of the method with index I in AMODULE, or NULL if it
+ * was not compiled.
+ */
+static gpointer
+get_method_address (MonoAotModule *amodule, int i)
+{
+	void *addr = NULL;
+
+	if (amodule->info.llvm_get_method) {
+		gpointer (*get_method) (int) = (gpointer (*)(int))amodule->info.llvm_get_method;
+
+		addr = get_method (i);
+	}
+
+	/* method_addresses () contains a table of branches, since the ios linker can update those correctly */
+	if (!addr && amodule->info.method_addresses) {
+		addr = get_call_table_entry (amodule->info.method_addresses, i);
+		g_assert (addr);
+		if (addr == amodule->info.method_addresses)
+			addr = NULL;
+	}
+	return addr;
+}
+
+/*
+ * init_amodule_methods:
+ *
+ *   Compute the code addresses of the methods in AMODULE. This is done on the first
+ * lookup instead of in load_aot_module (), since it touches an entry for every method
+ * in the module, and most modules only have a few of their methods called.
+ */
+static void
+init_amodule_methods (MonoAotModule *amodule)
+{
+	gpointer *methods;
+	gint64 start, elapsed;
+	int i;
+
+	if (amodule->methods)
+		return;
+
+	start = mono_100ns_ticks ();
+
+	methods = (void **)g_malloc0 (amodule->info.nmethods * sizeof (gpointer));
+	for (i = 0; i < amodule->info.nmethods; ++i) {
+		void *addr = get_method_address (amodule, i);
+
+		if (addr == NULL)
+			methods [i] = GINT_TO_POINTER (-1);
+		else
+			methods [i] = addr;
+	}
+
+	if (InterlockedCompareExchangePointer ((gpointer*)&amodule->methods, methods, NULL) != NULL) {
+		/* Somebody got in before us */
+		g_free (methods);
+		return;
+	}
+
+	elapsed = mono_100ns_ticks () - start;
+	InterlockedAdd64 (&amodule->lazy_init_time, elapsed);
+	InterlockedAdd64 (&aot_lazy_init_time, elapsed);
 }
 
 static void
@@ -1936,10 +2296,14 @@ load_aot_module (MonoAssembly *assembly, gpointer user_data)
 	gboolean do_load_image = TRUE;
 	int align_double, align_int64;
 	guint8 *aot_data = NULL;
+	gint64 start;
+	char *counter_name;
 
 	if (mono_compile_aot)
 		return;
 
+	start = mono_100ns_ticks ();
+
 	if (assembly->image->aot_module)
 		/* 
 		 * Already loaded. This can happen because the assembly loading code might invoke
@@ -2189,29 +2553,7 @@ load_aot_module (MonoAssembly *assembly, gpointer user_data)
 	if (!strcmp (assembly->aname.name, "mscorlib"))
 		mscorlib_aot_module = amodule;
 
-	/* Compute method addresses */
-	amodule->methods = (void **)g_malloc0 (amodule->info.nmethods * sizeof (gpointer));
-	for (i = 0; i < amodule->info.nmethods; ++i) {
-		void *addr = NULL;
-
-		if (amodule->info.llvm_get_method) {
-			gpointer (*get_method) (int) = (gpointer (*)(int))amodule->info.llvm_get_method;
-
-			addr = get_method (i);
-		}
-
-		/* method_addresses () contains a table of branches, since the ios linker can update those correctly */
-		if (!addr && amodule->info.method_addresses) {
-			addr = get_call_table_entry (amodule->info.method_addresses, i);
-			g_assert (addr);
-			if (addr == amodule->info.method_addresses)
-				addr = NULL;
-		}
-		if (addr == NULL)
-			amodule->methods [i] = GINT_TO_POINTER (-1);
-		else
-			amodule->methods [i] = addr;
-	}
+	/* Method addresses and the GOT are computed lazily by init_amodule_methods ()/init_amodule_got () */
 
 	if (make_unreadable) {
 #ifndef TARGET_WIN32
@@ -2279,20 +2621,40 @@ load_aot_module (MonoAssembly *assembly, gpointer user_data)
 		NULL
 		);
 
+	amodule->open_time = mono_100ns_ticks () - start;
+	aot_open_time += amodule->open_time;
+
 	/*
 	 * Since we store methoddef and classdef tokens when referring to methods/classes in
 	 * referenced assemblies, we depend on the exact versions of the referenced assemblies.
 	 * MS calls this 'hard binding'. This means we have to load all referenced assemblies
 	 * non-lazily, since we can't handle out-of-date errors later.
 	 * The cached class info also depends on the exact assemblies.
+	 * For modules compiled with 'dedup-include', this also loads the container
+	 * image holding the generic instances left out of them, which is in the table.
 	 */
 	if (do_load_image) {
+		start = mono_100ns_ticks ();
 		for (i = 0; i < amodule->image_table_len; ++i) {
 			MonoError error;
 			load_image (amodule, i, &error);
 			mono_error_cleanup (&error); /* FIXME don't swallow the error */
 		}
-	}
+		/* This includes the time spent loading the AOT modules of the references */
+		amodule->references_time = mono_100ns_ticks () - start;
+		InterlockedAdd64 (&aot_references_time, amodule->references_time);
+	}
+
+	InterlockedIncrement (&aot_modules_loaded);
+	counter_name = g_strdup_printf ("AOT: %s open time", assembly->aname.name);
+	mono_counters_register (counter_name, MONO_COUNTER_JIT | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &amodule->open_time);
+	g_free (counter_name);
+	counter_name = g_strdup_printf ("AOT: %s references time", assembly->aname.name);
+	mono_counters_register (counter_name, MONO_COUNTER_JIT | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &amodule->references_time);
+	g_free (counter_name);
+	counter_name = g_strdup_printf ("AOT: %s lazy init time", assembly->aname.name);
+	mono_counters_register (counter_name, MONO_COUNTER_JIT | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &amodule->lazy_init_time);
+	g_free (counter_name);
 
 	if (amodule->out_of_date) {
 		mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_AOT, "AOT: Module %s is unusable because a dependency is out-of-date.", assembly->image->name);
@@ -2348,6 +2710,16 @@ mono_aot_init (void)
 
 	mono_install_assembly_load_hook (load_aot_module, NULL);
 	mono_counters_register ("Async JIT info size", MONO_COUNTER_INT|MONO_COUNTER_JIT, &async_jit_info_size);
+	mono_counters_register ("AOT: modules loaded", MONO_COUNTER_INT|MONO_COUNTER_JIT, &aot_modules_loaded);
+	mono_counters_register ("AOT: open time", MONO_COUNTER_JIT | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &aot_open_time);
+	mono_counters_register ("AOT: references time", MONO_COUNTER_JIT | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &aot_references_time);
+	mono_counters_register ("AOT: lazy init time", MONO_COUNTER_JIT | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &aot_lazy_init_time);
+	mono_counters_register ("AOT: specific trampolines", MONO_COUNTER_JIT | MONO_COUNTER_INT, &aot_trampolines_used [MONO_AOT_TRAMP_SPECIFIC]);
+	mono_counters_register ("AOT: static rgctx trampolines", MONO_COUNTER_JIT | MONO_COUNTER_INT, &aot_trampolines_used [MONO_AOT_TRAMP_STATIC_RGCTX]);
+	mono_counters_register ("AOT: imt trampolines", MONO_COUNTER_JIT | MONO_COUNTER_INT, &aot_trampolines_used [MONO_AOT_TRAMP_IMT]);
+	mono_counters_register ("AOT: gsharedvt arg trampolines", MONO_COUNTER_JIT | MONO_COUNTER_INT, &aot_trampolines_used [MONO_AOT_TRAMP_GSHAREDVT_ARG]);
+	mono_counters_register ("AOT: trampoline pages", MONO_COUNTER_JIT | MONO_COUNTER_INT, &aot_trampoline_pages);
+	mono_counters_register ("AOT: trampolines created at runtime", MONO_COUNTER_JIT | MONO_COUNTER_INT, &aot_trampolines_created);
 
 	char *lastaot = g_getenv ("MONO_LASTAOT");
 	if (lastaot) {
@@ -2357,6 +2729,18 @@ mono_aot_init (void)
 	aot_cache_init ();
 }
 
+/*
+ * mono_aot_shutdown:
+ *
+ *   Called during runtime shutdown, while metadata can still be accessed.
+ */
+void
+mono_aot_shutdown (void)
+{
+	if (enable_aot_cache)
+		aot_cache_save_instances ();
+}
+
 void
 mono_aot_cleanup (void)
 {
@@ -2625,9 +3009,10 @@ compute_llvm_code_range (MonoAotModule *amodule, guint8 **code_start, guint8 **c
 	p += 4;
 	table = (gint32*)p;
 
+	/* Only the first and the last method are needed, so don't build the full method table */
 	if (fde_count > 0) {
-		*code_start = (guint8 *)amodule->methods [table [0]];
-		*code_end = (guint8*)amodule->methods [table [(fde_count - 1) * 2]] + table [fde_count * 2];
+		*code_start = (guint8 *)get_method_address (amodule, table [0]);
+		*code_end = (guint8 *)get_method_address (amodule, table [(fde_count - 1) * 2]) + table [fde_count * 2];
 	} else {
 		*code_start = NULL;
 		*code_end = NULL;
@@ -2692,6 +3077,8 @@ decode_llvm_mono_eh_frame (MonoAotModule *amodule, MonoDomain *domain, MonoJitIn
 
 	g_assert (amodule->mono_eh_frame && code);
 
+	init_amodule_methods (amodule);
+
 	p = amodule->mono_eh_frame;
 
 	/* p points to data emitted by LLVM in DwarfMonoException::EmitMonoEHFrame () */
@@ -3012,6 +3399,7 @@ decode_exception_debug_info (MonoAotModule *amodule, MonoDomain *domain,
 
 		for (i = 0; i < jinfo->num_clauses; ++i) {
 			MonoJitExceptionInfo *ei = &jinfo->clauses [i];
+			guint32 native_offsets [3];
 
 			ei->flags = decode_value (p, &p);
 
@@ -3038,9 +3426,10 @@ decode_exception_debug_info (MonoAotModule *amodule, MonoDomain *domain,
 				}
 			}
 
-			ei->try_start = code + decode_value (p, &p);
-			ei->try_end = code + decode_value (p, &p);
-			ei->handler_start = code + decode_value (p, &p);
+			p = mono_group_varint_decode (p, 3, native_offsets);
+			ei->try_start = code + native_offsets [0];
+			ei->try_end = code + native_offsets [1];
+			ei->handler_start = code + native_offsets [2];
 		}
 
 		jinfo->unwind_info = unwind_info;
@@ -3057,11 +3446,18 @@ decode_exception_debug_info (MonoAotModule *amodule, MonoDomain *domain,
 		g_assert (table);
 
 		table->num_holes = (guint16)num_holes;
-		for (i = 0; i < num_holes; ++i) {
-			MonoTryBlockHoleJitInfo *hole = &table->holes [i];
-			hole->clause = decode_value (p, &p);
-			hole->length = decode_value (p, &p);
-			hole->offset = decode_value (p, &p);
+		/* Decode 4 holes, i.e. 3 groups at a time, this can run in async context */
+		for (i = 0; i < num_holes; i += 4) {
+			guint32 values [12];
+			int j, n = MIN (4, num_holes - i);
+
+			p = mono_group_varint_decode (p, n * 3, values);
+			for (j = 0; j < n; ++j) {
+				MonoTryBlockHoleJitInfo *hole = &table->holes [i + j];
+				hole->clause = values [j * 3];
+				hole->length = values [j * 3 + 1];
+				hole->offset = values [j * 3 + 2];
+			}
 		}
 	}
 
@@ -3313,6 +3709,17 @@ mono_aot_find_jit_info (MonoDomain *domain, MonoImage *image, gpointer addr)
 
 	async = mono_thread_info_is_async_context ();
 
+	if (async) {
+		/*
+		 * The method table can't be allocated in async context. It is built on the first
+		 * method lookup, so if it is missing, no code of this module can be running.
+		 */
+		if (!amodule->methods)
+			return NULL;
+	} else {
+		init_amodule_methods (amodule);
+	}
+
 	/* Compute a sorted table mapping code to method indexes. */
 	if (!amodule->sorted_methods) {
 		// FIXME: async
@@ -3845,10 +4252,11 @@ load_patch_info (MonoAotModule *amodule, MonoMemPool *mp, int n_patches,
 
 	p = buf;
 
+	/* The got offsets are encoded as differences from the previous offset */
 	*got_slots = (guint32 *)g_malloc (sizeof (guint32) * n_patches);
-	for (pindex = 0; pindex < n_patches; ++pindex) {
-		(*got_slots)[pindex] = decode_value (p, &p);
-	}
+	p = mono_group_varint_decode (p, n_patches, *got_slots);
+	for (pindex = 0; pindex < n_patches; ++pindex)
+		(*got_slots)[pindex] = (pindex ? (*got_slots)[pindex - 1] : 0) + mono_zigzag_decode ((*got_slots)[pindex]);
 
 	patches = decode_patches (amodule, mp, n_patches, llvm, *got_slots);
 	if (!patches) {
@@ -3900,6 +4308,7 @@ load_method (MonoDomain *domain, MonoAotModule *amodule, MonoImage *image, MonoM
 	error_init (error);
 
 	init_amodule_got (amodule);
+	init_amodule_methods (amodule);
 
 	if (domain != mono_get_root_domain ())
 		/* Non shared AOT code can't be used in other appdomains */
@@ -4042,28 +4451,34 @@ static guint32
 find_aot_method_in_amodule (MonoAotModule *amodule, MonoMethod *method, guint32 hash_full)
 {
 	MonoError error;
-	guint32 table_size, entry_size, hash;
-	guint32 *table, *entry;
+	guint32 table_size, nbuckets, entry_size, slot;
+	guint32 *disps, *table, *entry;
 	guint32 index;
 	static guint32 n_extra_decodes;
 
 	if (!amodule || amodule->out_of_date)
 		return 0xffffff;
 
+	/* See emit_extra_methods () in aot-compiler.c for the layout of the table */
 	table_size = amodule->extra_method_table [0];
-	hash = hash_full % table_size;
-	table = amodule->extra_method_table + 1;
-	entry_size = 3;
+	if (table_size == 0)
+		return 0xffffff;
+	nbuckets = amodule->extra_method_table [1];
+	disps = amodule->extra_method_table + 2;
+	table = disps + nbuckets;
+	entry_size = 4;
 
-	entry = &table [hash * entry_size];
+	slot = mono_aot_method_hash_slot (hash_full, disps [hash_full % nbuckets], table_size);
+	entry = &table [slot * entry_size];
 
-	if (entry [0] == 0)
+	/* The slot belongs to another method, no need to decode it */
+	if (entry [0] != hash_full)
 		return 0xffffff;
 
 	index = 0xffffff;
 	while (TRUE) {
-		guint32 key = entry [0];
-		guint32 value = entry [1];
+		guint32 key = entry [1];
+		guint32 value = entry [2];
 		guint32 next = entry [entry_size - 1];
 		MonoMethod *m;
 		guint8 *p, *orig_p;
@@ -4187,6 +4602,7 @@ init_method (MonoAotModule *amodule, guint32 method_index, MonoMethod *method, M
 
 	error_init (error);
 
+	init_amodule_methods (amodule);
 	code = (guint8 *)amodule->methods [method_index];
 	info = &amodule->blob [mono_aot_get_offset (amodule->method_info_offsets, method_index)];
 
@@ -4607,6 +5023,8 @@ mono_aot_get_method_checked (MonoDomain *domain, MonoMethod *method, MonoError *
 				mono_trace (G_LOG_LEVEL_DEBUG, MONO_TRACE_AOT, "AOT NOT FOUND: %s.", full_name);
 				g_free (full_name);
 			}
+			if (enable_aot_cache)
+				aot_cache_record_instance (orig_method);
 			return NULL;
 		}
 
@@ -5260,6 +5678,7 @@ get_new_trampoline_from_page (int tramp_type)
 	if (page && page->trampolines < page->trampolines_end) {
 		code = page->trampolines;
 		page->trampolines += specific_trampoline_size;
+		aot_trampolines_used [tramp_type] ++;
 		mono_aot_page_unlock ();
 		return code;
 	}
@@ -5321,6 +5740,7 @@ get_new_trampoline_from_page (int tramp_type)
 		if (page && page->trampolines < page->trampolines_end) {
 			code = page->trampolines;
 			page->trampolines += specific_trampoline_size;
+			aot_trampolines_used [tramp_type] ++;
 			mono_aot_page_unlock ();
 			vm_deallocate (mach_task_self (), addr, psize);
 			vm_deallocate (mach_task_self (), taddr, psize);
@@ -5333,6 +5753,8 @@ get_new_trampoline_from_page (int tramp_type)
 		page->trampolines_end = (void*)(taddr + psize - 64);
 		code = page->trampolines;
 		page->trampolines += specific_trampoline_size;
+		aot_trampolines_used [tramp_type] ++;
+		aot_trampoline_pages ++;
 		mono_aot_page_unlock ();
 
 		/* Register the generic part at the beggining of the trampoline page */
@@ -5429,7 +5851,11 @@ get_new_gsharedvt_arg_trampoline_from_page (gpointer tramp, gpointer arg)
 	return code;
 }
 
-/* Return a given kind of trampoline */
+/*
+ * Return a given kind of trampoline, or NULL if the AOT image ran out of them and
+ * CAN_CREATE_TRAMPOLINES is defined, in which case the caller creates one at runtime.
+ * Running out of gsharedvt arg trampolines is still fatal when the arch can't create them.
+ */
 /* FIXME set unwind info for these trampolines */
 static gpointer
 get_numerous_trampoline (MonoAotTrampoline tramp_type, int n_got_slots, MonoAotModule **out_amodule, guint32 *got_offset, guint32 *out_tramp_size)
@@ -5451,10 +5877,24 @@ get_numerous_trampoline (MonoAotTrampoline tramp_type, int n_got_slots, MonoAotM
 #define	MONOTOUCH_TRAMPOLINES_ERROR ""
 #endif
 	if (amodule->trampoline_index [tramp_type] == amodule->info.num_trampolines [tramp_type]) {
+#ifdef CAN_CREATE_TRAMPOLINES
+#ifndef MONO_ARCH_GSHAREDVT_SUPPORTED
+		/* There is no arch code to create these */
+		if (tramp_type != MONO_AOT_TRAMP_GSHAREDVT_ARG)
+#endif
+		{
+			if (!aot_trampolines_created)
+				mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_AOT, "AOT: ran out of trampolines of type %d in '%s' (limit %d), creating them at runtime.", tramp_type, image ? image->name : "mscorlib", amodule->info.num_trampolines [tramp_type]);
+			aot_trampolines_created ++;
+			mono_aot_unlock ();
+			return NULL;
+		}
+#endif
 		g_error ("Ran out of trampolines of type %d in '%s' (limit %d)%s\n", 
 				 tramp_type, image ? image->name : "mscorlib", amodule->info.num_trampolines [tramp_type], MONOTOUCH_TRAMPOLINES_ERROR);
 	}
 	index = amodule->trampoline_index [tramp_type] ++;
+	aot_trampolines_used [tramp_type] ++;
 
 	mono_aot_unlock ();
 
@@ -5521,6 +5961,10 @@ mono_aot_create_specific_trampoline (MonoImage *image, gpointer arg1, MonoTrampo
 		tramp_size = 8;
 	} else {
 		code = (guint8 *)get_numerous_trampoline (MONO_AOT_TRAMP_SPECIFIC, 2, &amodule, &got_offset, &tramp_size);
+#ifdef CAN_CREATE_TRAMPOLINES
+		if (!code)
+			return mono_arch_create_specific_trampoline (arg1, tramp_type, domain, code_len);
+#endif
 
 		amodule->got [got_offset] = tramp;
 		amodule->got [got_offset + 1] = arg1;
@@ -5543,6 +5987,10 @@ mono_aot_get_static_rgctx_trampoline (gpointer ctx, gpointer addr)
 		code = (guint8 *)get_new_rgctx_trampoline_from_page (addr, ctx);
 	} else {
 		code = (guint8 *)get_numerous_trampoline (MONO_AOT_TRAMP_STATIC_RGCTX, 2, &amodule, &got_offset, NULL);
+#ifdef CAN_CREATE_TRAMPOLINES
+		if (!code)
+			return mono_arch_get_static_rgctx_trampoline (ctx, addr);
+#endif
 
 		amodule->got [got_offset] = ctx;
 		amodule->got [got_offset + 1] = addr; 
@@ -5675,6 +6123,14 @@ mono_aot_get_imt_trampoline (MonoVTable *vtable, MonoDomain *domain, MonoIMTChec
 	if (mono_llvm_only)
 		return no_imt_trampoline;
 
+	if (!USE_PAGE_TRAMPOLINES) {
+		code = get_numerous_trampoline (MONO_AOT_TRAMP_IMT, 1, &amodule, &got_offset, NULL);
+#ifdef CAN_CREATE_TRAMPOLINES
+		if (!code)
+			return mono_arch_build_imt_trampoline (vtable, domain, imt_entries, count, fail_tramp);
+#endif
+	}
+
 	real_count = 0;
 	for (i = 0; i < count; ++i) {
 		MonoIMTCheckItem *item = imt_entries [i];
@@ -5707,13 +6163,10 @@ mono_aot_get_imt_trampoline (MonoVTable *vtable, MonoDomain *domain, MonoIMTChec
 	buf [(index * 2)] = NULL;
 	buf [(index * 2) + 1] = fail_tramp;
 	
-	if (USE_PAGE_TRAMPOLINES) {
+	if (USE_PAGE_TRAMPOLINES)
 		code = get_new_imt_trampoline_from_page (buf);
-	} else {
-		code = get_numerous_trampoline (MONO_AOT_TRAMP_IMT, 1, &amodule, &got_offset, NULL);
-
+	else
 		amodule->got [got_offset] = buf;
-	}
 
 	return code;
 }
@@ -5729,6 +6182,11 @@ mono_aot_get_gsharedvt_arg_trampoline (gpointer arg, gpointer addr)
 		code = (guint8 *)get_new_gsharedvt_arg_trampoline_from_page (addr, arg);
 	} else {
 		code = (guint8 *)get_numerous_trampoline (MONO_AOT_TRAMP_GSHAREDVT_ARG, 2, &amodule, &got_offset, NULL);
+#if defined(CAN_CREATE_TRAMPOLINES) && defined(MONO_ARCH_GSHAREDVT_SUPPORTED)
+		if (!code)
+			return mono_arch_get_gsharedvt_arg_trampoline (mono_domain_get (), arg, addr);
+#endif
+		g_assert (code);
 
 		amodule->got [got_offset] = arg;
 		amodule->got [got_offset + 1] = addr; 
@@ -5838,6 +6296,11 @@ mono_aot_init (void)
 {
 }
 
+void
+mono_aot_shutdown (void)
+{
+}
+
 void
 mono_aot_cleanup (void)
 {
@@ -806,6 +806,166 @@ class Tests
 			arr [i] = 1;
 		return llvm_ldlen_licm (arr);
 	}
+
+	class LicmList {
+		public int[] items;
+		public int size;
+	}
+
+	static int licm_list_sum (LicmList l, int k) {
+		int sum = 0;
+		// l.size, l.items and k * 3 are invariant
+		for (int i = 0; i < l.size; ++i)
+			sum += l.items [i] + k * 3;
+		return sum;
+	}
+
+	public static int test_0_licm_invariant_loads () {
+		LicmList l = new LicmList ();
+		l.items = new int [] { 1, 2, 3, 4 };
+		l.size = 3;
+		if (licm_list_sum (l, 2) != 6 + 18)
+			return 1;
+		l.size = 0;
+		if (licm_list_sum (l, 2) != 0)
+			return 2;
+		try {
+			licm_list_sum (null, 2);
+			return 3;
+		} catch (NullReferenceException) {
+		}
+		return 0;
+	}
+
+	public static int test_0_strength_reduce_iv () {
+		int[] arr = new int [20];
+		for (int i = 0; i < 10; ++i)
+			arr [i] = i * 7;
+		for (int i = 19; i >= 10; i -= 3)
+			arr [i] = i * 1000003;
+		int sum = 0;
+		for (int i = 0; i < 10; ++i)
+			sum += arr [i];
+		if (sum != 7 * 45)
+			return 1;
+		if (arr [19] != 19 * 1000003 || arr [10] != 10 * 1000003 || arr [18] != 0)
+			return 2;
+		return 0;
+	}
+
+	static int versioned_copy (int[] src, int[] dst, int n) {
+		int sum = 0;
+		for (int i = 0; i < n; ++i) {
+			dst [i] = src [i];
+			sum += src [i];
+		}
+		return sum;
+	}
+
+	public static int test_0_abc_loop_versioning () {
+		int[] a = new int [10];
+		int[] b = new int [10];
+		for (int i = 0; i < a.Length; ++i)
+			a [i] = i;
+		if (versioned_copy (a, b, 10) != 45 || b [9] != 9)
+			return 1;
+		/* The guard fails, the original loop throws */
+		try {
+			versioned_copy (a, new int [5], 10);
+			return 2;
+		} catch (IndexOutOfRangeException) {
+		}
+		try {
+			versioned_copy (null, b, 1);
+			return 3;
+		} catch (NullReferenceException) {
+		}
+		if (versioned_copy (null, null, 0) != 0)
+			return 4;
+		return 0;
+	}
+
+	static int vector_sum (int[] a, int[] b, int[] c, int k) {
+		int sum = 0;
+		for (int i = 0; i < a.Length; ++i) {
+			c [i] = (a [i] + b [i]) ^ k;
+			sum += a [i] - b [i];
+		}
+		return sum;
+	}
+
+	static void vector_scale (float[] a, float[] b, float f) {
+		for (int i = 0; i < a.Length; ++i)
+			b [i] = a [i] * f;
+	}
+
+	static float vector_fsum (float[] a) {
+		float sum = 0;
+		for (int i = 0; i < a.Length; ++i)
+			sum += a [i];
+		return sum;
+	}
+
+	static void vector_greater (int[] a, int[] b, bool[] r) {
+		for (int i = 0; i < a.Length; ++i)
+			r [i] = a [i] > b [i];
+	}
+
+	static void vector_less (float[] a, float f, bool[] r) {
+		for (int i = 0; i < a.Length; ++i)
+			r [i] = a [i] < f;
+	}
+
+	public static int test_0_simd_vectorize_loops () {
+		/* The length is not a multiple of the vector length */
+		int[] a = new int [11];
+		int[] b = new int [11];
+		int[] c = new int [11];
+		for (int i = 0; i < a.Length; ++i) {
+			a [i] = i * 3;
+			b [i] = i;
+		}
+		if (vector_sum (a, b, c, 5) != 110)
+			return 1;
+		for (int i = 0; i < c.Length; ++i)
+			if (c [i] != ((i * 4) ^ 5))
+				return 2;
+		/* Aliased arrays */
+		if (vector_sum (a, a, a, 0) != 0 || a [10] != 60)
+			return 3;
+		try {
+			vector_sum (a, b, new int [3], 0);
+			return 4;
+		} catch (IndexOutOfRangeException) {
+		}
+
+		float[] f = new float [7];
+		float[] g = new float [7];
+		for (int i = 0; i < f.Length; ++i)
+			f [i] = i + 0.5f;
+		vector_scale (f, g, 2.0f);
+		for (int i = 0; i < g.Length; ++i)
+			if (g [i] != 2 * i + 1)
+				return 5;
+		/* The elements and their partial sums are exact, so the order doesn't matter */
+		if (vector_fsum (f) != 24.5f)
+			return 6;
+
+		bool[] r = new bool [11];
+		vector_greater (b, c, r);
+		for (int i = 0; i < r.Length; ++i)
+			if (r [i] != (b [i] > c [i]))
+				return 7;
+		f [3] = float.NaN;
+		vector_less (f, 4.0f, r);
+		for (int i = 0; i < f.Length; ++i)
+			if (r [i] != (i < 4 && i != 3))
+				return 8;
+		/* Not written by vector_less () */
+		if (r [7] != (b [7] > c [7]))
+			return 9;
+		return 0;
+	}
 }
 
 
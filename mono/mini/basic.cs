@@ -1467,4 +1467,26 @@ class Tests
 
 		return k == -32768 ? 0 : 1;
 	}
+
+	public static int test_0_compare_branch_imm () {
+		int n = 0;
+
+		for (int i = -5; i < 100; i++) {
+			if (i == -1)
+				n += 1;
+			if (i != 7)
+				n += 2;
+			if (i >= 99)
+				n += 4;
+			if (i <= -5)
+				n += 8;
+		}
+		if (n != 1 + 104 * 2 + 4 + 8)
+			return 1;
+
+		int j = 10;
+		while (j > 0)
+			j--;
+		return j;
+	}
 }
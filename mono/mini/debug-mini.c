@@ -20,6 +20,7 @@
 #include <mono/metadata/debug-internals.h>
 
 #include <mono/utils/valgrind.h>
+#include <mono/utils/mono-group-varint.h>
 
 typedef struct {
 	guint32 index;
@@ -446,6 +447,7 @@ mono_debug_serialize_debug_info (MonoCompile *cfg, guint8 **out_buf, guint32 *bu
 {
 	MonoDebugMethodJitInfo *jit;
 	guint32 size, prev_offset, prev_native_offset;
+	guint32 *values;
 	guint8 *buf, *p;
 	int i;
 
@@ -484,16 +486,20 @@ mono_debug_serialize_debug_info (MonoCompile *cfg, guint8 **out_buf, guint32 *bu
 
 	encode_value (jit->num_line_numbers, p, &p);
 
+	/* Pairs of il/native offset differences, encoded as a group varint run */
+	values = g_new (guint32, jit->num_line_numbers * 2);
 	prev_offset = 0;
 	prev_native_offset = 0;
 	for (i = 0; i < jit->num_line_numbers; ++i) {
 		/* Sometimes, the offset values are not in increasing order */
 		MonoDebugLineNumberEntry *lne = &jit->line_numbers [i];
-		encode_value (lne->il_offset - prev_offset, p, &p);
-		encode_value (lne->native_offset - prev_native_offset, p, &p);
+		values [i * 2] = mono_zigzag_encode (lne->il_offset - prev_offset);
+		values [i * 2 + 1] = mono_zigzag_encode (lne->native_offset - prev_native_offset);
 		prev_offset = lne->il_offset;
 		prev_native_offset = lne->native_offset;
 	}
+	mono_group_varint_encode (values, jit->num_line_numbers * 2, p, &p);
+	g_free (values);
 
 	g_assert (p - buf < size);
 
@@ -534,6 +540,7 @@ deserialize_debug_info (MonoMethod *method, guint8 *code_start, guint8 *buf, gui
 	MonoMethodHeader *header;
 	gint32 offset, native_offset, prev_offset, prev_native_offset;
 	MonoDebugMethodJitInfo *jit;
+	guint32 *values;
 	guint8 *p;
 	int i;
 
@@ -577,13 +584,15 @@ deserialize_debug_info (MonoMethod *method, guint8 *code_start, guint8 *buf, gui
 	jit->num_line_numbers = decode_value (p, &p);
 	jit->line_numbers = g_new0 (MonoDebugLineNumberEntry, jit->num_line_numbers);
 
+	values = g_new (guint32, jit->num_line_numbers * 2);
+	p = mono_group_varint_decode (p, jit->num_line_numbers * 2, values);
 	prev_offset = 0;
 	prev_native_offset = 0;
 	for (i = 0; i < jit->num_line_numbers; ++i) {
 		MonoDebugLineNumberEntry *lne = &jit->line_numbers [i];
 
-		offset = prev_offset + decode_value (p, &p);
-		native_offset = prev_native_offset + decode_value (p, &p);
+		offset = prev_offset + mono_zigzag_decode (values [i * 2]);
+		native_offset = prev_native_offset + mono_zigzag_decode (values [i * 2 + 1]);
 
 		lne->native_offset = native_offset;
 		lne->il_offset = offset;
@@ -591,6 +600,7 @@ deserialize_debug_info (MonoMethod *method, guint8 *code_start, guint8 *buf, gui
 		prev_offset = offset;
 		prev_native_offset = native_offset;
 	}
+	g_free (values);
 
 	mono_metadata_free_mh (header);
 	return jit;
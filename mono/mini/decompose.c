@@ -1543,6 +1543,10 @@ mono_decompose_array_access_opts (MonoCompile *cfg)
 						dest->dreg = ins->dreg;
 					}
 					break;
+				case OP_NEWOBJ:
+					dest = mini_emit_alloc_vtable (cfg, (MonoVTable *)ins->inst_p0, FALSE);
+					dest->dreg = ins->dreg;
+					break;
 				case OP_STRLEN:
 					MONO_EMIT_NEW_LOAD_MEMBASE_OP_FLAGS (cfg, OP_LOADI4_MEMBASE, ins->dreg,
 														 ins->sreg1, MONO_STRUCT_OFFSET (MonoString, length), ins->flags | MONO_INST_INVARIANT_LOAD);
@@ -0,0 +1,599 @@
+/**
+ * \file
+ * Escape analysis and scalar replacement of objects.
+ *
+ * Objects allocated by newobj are represented by OP_NEWOBJ until the
+ * array access decomposition pass. While the method is in SSA form, this
+ * pass computes the set of vregs which can hold each allocated object. If
+ * the object is only used as the base of field loads/stores and by null
+ * checks, it doesn't escape the method, so its fields are replaced by
+ * local variables and the allocation is removed.
+ *
+ * Licensed under the MIT license. See LICENSE file in the project root for full license information.
+ */
+
+#include <config.h>
+#include <stdio.h>
+
+#include "mini.h"
+#include "ir-emit.h"
+#include "glib.h"
+#include <mono/metadata/profiler-private.h>
+#include <mono/utils/mono-compiler.h>
+
+#ifndef DISABLE_JIT
+
+/* Objects larger than this are never scalar replaced */
+#define MAX_REPLACED_OBJECT_SIZE (sizeof (MonoObject) + 8 * sizeof (gpointer))
+
+typedef struct {
+	MonoBasicBlock *bb;
+	MonoInst *alloc;
+	gboolean escapes;
+	/* The field loads/stores using the object as their base */
+	GSList *accesses;
+} EscapeCandidate;
+
+typedef struct {
+	MonoCompile *cfg;
+	EscapeCandidate *candidates;
+	int num_candidates;
+	/* Size of the arrays below, vregs created by the pass itself are not tracked */
+	int num_vregs;
+	/* Number of definitions of each vreg */
+	int *ndefs;
+	/* Candidate index + 1 of the object held by each vreg, 0 if none */
+	int *owner;
+	/* Candidate index + 1 of the object whose interior pointer is held by each vreg, 0 if none */
+	int *interior;
+} EscapeContext;
+
+static inline int
+get_owner (EscapeContext *ctx, int vreg)
+{
+	return (vreg >= 0 && vreg < ctx->num_vregs) ? ctx->owner [vreg] : 0;
+}
+
+static inline int
+get_interior (EscapeContext *ctx, int vreg)
+{
+	return (vreg >= 0 && vreg < ctx->num_vregs) ? ctx->interior [vreg] : 0;
+}
+
+/**
+ * mono_escape_analysis_is_candidate:
+ *
+ *   Return whenever allocations of KLASS can be represented as OP_NEWOBJ so
+ * mono_escape_analysis () can remove them.
+ */
+gboolean
+mono_escape_analysis_is_candidate (MonoCompile *cfg, MonoClass *klass)
+{
+	MonoClass *k;
+
+	if (klass->valuetype || klass->rank || klass->delegate || klass == mono_defaults.string_class)
+		return FALSE;
+	if (mono_class_is_marshalbyref (klass) || mono_class_is_contextbound (klass))
+		return FALSE;
+	if (mono_class_has_finalizer (klass))
+		return FALSE;
+	if (mono_class_instance_size (klass) > MAX_REPLACED_OBJECT_SIZE)
+		return FALSE;
+	/* Fields are replaced by offset, so overlapping fields would become independent variables */
+	for (k = klass; k; k = k->parent) {
+		if ((mono_class_get_flags (k) & TYPE_ATTRIBUTE_LAYOUT_MASK) == TYPE_ATTRIBUTE_EXPLICIT_LAYOUT)
+			return FALSE;
+	}
+	/* The profiler and the debugger need to see the objects */
+	if (mono_profiler_allocations_enabled () || cfg->gen_sdb_seq_points)
+		return FALSE;
+	return TRUE;
+}
+
+static void
+mark_escaped (EscapeContext *ctx, int index, MonoInst *ins)
+{
+	EscapeCandidate *cand = &ctx->candidates [index - 1];
+
+	if (cand->escapes)
+		return;
+	if (ctx->cfg->verbose_level > 2) {
+		printf ("R%d escapes at: ", cand->alloc->dreg);
+		mono_print_ins (ins);
+	}
+	cand->escapes = TRUE;
+}
+
+/*
+ * Return whenever VREG can become an alias of an allocated object.
+ */
+static gboolean
+is_alias_vreg (EscapeContext *ctx, int vreg)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoInst *var;
+
+	if (vreg < MONO_MAX_IREGS || vreg >= ctx->num_vregs || ctx->ndefs [vreg] != 1)
+		return FALSE;
+	var = get_vreg_to_inst (cfg, vreg);
+	if (!var)
+		return TRUE;
+	/* These have implicit uses not visible in the IR */
+	if (var == cfg->ret || var->opcode != OP_LOCAL || (var->flags & (MONO_INST_VOLATILE | MONO_INST_INDIRECT)))
+		return FALSE;
+	return TRUE;
+}
+
+/*
+ * Compute the vregs holding the allocated objects or pointers to their
+ * interior by following moves from the OP_NEWOBJ instructions.
+ */
+static void
+compute_aliases (EscapeContext *ctx)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+	gboolean changed = TRUE;
+
+	while (changed) {
+		changed = FALSE;
+		for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+			MONO_BB_FOR_EACH_INS (bb, ins) {
+				int index;
+
+				if (ins->opcode != OP_MOVE && ins->opcode != OP_PADD_IMM)
+					continue;
+				index = get_owner (ctx, ins->sreg1);
+				if (!index || get_owner (ctx, ins->dreg) || get_interior (ctx, ins->dreg))
+					continue;
+				if (!is_alias_vreg (ctx, ins->dreg)) {
+					mark_escaped (ctx, index, ins);
+					continue;
+				}
+				if (ins->opcode == OP_MOVE)
+					ctx->owner [ins->dreg] = index;
+				else
+					ctx->interior [ins->dreg] = index;
+				changed = TRUE;
+			}
+		}
+	}
+}
+
+static gboolean
+is_null_check_exc (MonoInst *ins)
+{
+	return ins && (ins->opcode == OP_COND_EXC_EQ || ins->opcode == OP_COND_EXC_IEQ);
+}
+
+/*
+ * Check the uses of an object alias. Field accesses are collected, every
+ * other use which is not a null check makes the object escape.
+ */
+static void
+check_use (EscapeContext *ctx, MonoInst *ins, int vreg, gboolean is_base)
+{
+	int index = get_owner (ctx, vreg);
+	int interior = get_interior (ctx, vreg);
+
+	if (interior) {
+		/* Interior pointers are only created for write barriers */
+		if (!(ins->opcode == OP_CARD_TABLE_WBARRIER && ins->sreg1 == vreg))
+			mark_escaped (ctx, interior, ins);
+		return;
+	}
+	if (!index)
+		return;
+
+	if (is_base) {
+		if (MONO_IS_STORE_MEMBASE (ins) && !(ins->opcode >= OP_ATOMIC_STORE_I1 && ins->opcode <= OP_ATOMIC_STORE_R8) && ins->inst_offset >= (int)sizeof (MonoObject)) {
+			EscapeCandidate *cand = &ctx->candidates [index - 1];
+
+			cand->accesses = g_slist_prepend (cand->accesses, ins);
+		} else {
+			mark_escaped (ctx, index, ins);
+		}
+		return;
+	}
+
+	switch (ins->opcode) {
+	case OP_MOVE:
+	case OP_PADD_IMM:
+		/* Handled by compute_aliases () */
+		if (!get_owner (ctx, ins->dreg) && !get_interior (ctx, ins->dreg))
+			mark_escaped (ctx, index, ins);
+		if (ins->opcode == OP_PADD_IMM && ins->inst_imm < (int)sizeof (MonoObject))
+			mark_escaped (ctx, index, ins);
+		break;
+	case OP_CHECK_THIS:
+	case OP_NOT_NULL:
+	case OP_DUMMY_USE:
+		break;
+	case OP_COMPARE_IMM:
+	case OP_ICOMPARE_IMM:
+	case OP_LCOMPARE_IMM:
+		/* Explicit null checks */
+		if (ins->inst_imm != 0 || !is_null_check_exc (ins->next))
+			mark_escaped (ctx, index, ins);
+		break;
+	default:
+		if (MONO_IS_LOAD_MEMBASE (ins) && !(ins->opcode >= OP_ATOMIC_LOAD_I1 && ins->opcode <= OP_ATOMIC_LOAD_R8) && ins->inst_offset >= (int)sizeof (MonoObject)) {
+			EscapeCandidate *cand = &ctx->candidates [index - 1];
+
+			cand->accesses = g_slist_prepend (cand->accesses, ins);
+		} else {
+			mark_escaped (ctx, index, ins);
+		}
+		break;
+	}
+}
+
+static void
+check_uses (EscapeContext *ctx)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			int sregs [MONO_MAX_SRC_REGS];
+			int i, num_sregs;
+
+			if (ins->opcode == OP_NEWOBJ || ins->opcode == OP_NOP)
+				continue;
+
+			if (MONO_IS_PHI (ins)) {
+				/* Merging the object with other values is not supported */
+				for (i = ins->inst_phi_args [0]; i > 0; i--) {
+					int index = get_owner (ctx, ins->inst_phi_args [i]);
+
+					if (!index)
+						index = get_interior (ctx, ins->inst_phi_args [i]);
+					if (index)
+						mark_escaped (ctx, index, ins);
+				}
+				continue;
+			}
+
+			num_sregs = mono_inst_get_src_registers (ins, sregs);
+			for (i = 0; i < num_sregs; ++i)
+				check_use (ctx, ins, sregs [i], FALSE);
+
+			/* The alias vregs have a single definition, anything else using them as dreg treats them as a base */
+			if (get_owner (ctx, ins->dreg) || get_interior (ctx, ins->dreg)) {
+				gboolean is_def = (ins->opcode == OP_MOVE || ins->opcode == OP_PADD_IMM) && get_owner (ctx, ins->sreg1);
+
+				if (!is_def)
+					check_use (ctx, ins, ins->dreg, TRUE);
+			}
+
+			/* Arguments passed in registers are hidden uses */
+			if (MONO_IS_CALL (ins)) {
+				MonoCallInst *call = (MonoCallInst*)ins;
+				GSList *l;
+
+				for (l = call->out_ireg_args; l; l = l->next) {
+					guint32 regpair = (guint32)(gssize)(l->data);
+					int index = get_owner (ctx, regpair & 0xffffff);
+
+					if (!index)
+						index = get_interior (ctx, regpair & 0xffffff);
+					if (index)
+						mark_escaped (ctx, index, ins);
+				}
+			}
+		}
+	}
+}
+
+static int
+store_imm_to_store_reg (int opcode)
+{
+	switch (opcode) {
+	case OP_STORE_MEMBASE_IMM:
+		return OP_STORE_MEMBASE_REG;
+	case OP_STOREI1_MEMBASE_IMM:
+		return OP_STOREI1_MEMBASE_REG;
+	case OP_STOREI2_MEMBASE_IMM:
+		return OP_STOREI2_MEMBASE_REG;
+	case OP_STOREI4_MEMBASE_IMM:
+		return OP_STOREI4_MEMBASE_REG;
+	case OP_STOREI8_MEMBASE_IMM:
+		return OP_STOREI8_MEMBASE_REG;
+	default:
+		return -1;
+	}
+}
+
+static MonoClassField*
+find_field (MonoClass *klass, int offset)
+{
+	for (; klass; klass = klass->parent) {
+		MonoClassField *field;
+		gpointer iter = NULL;
+
+		while ((field = mono_class_get_fields (klass, &iter))) {
+			if (field->type->attrs & FIELD_ATTRIBUTE_STATIC)
+				continue;
+			if (field->offset == offset)
+				return field;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Return the field accessed by INS if it can be replaced by a variable, NULL otherwise.
+ */
+static MonoClassField*
+get_replaceable_field (MonoCompile *cfg, MonoClass *klass, MonoInst *ins)
+{
+	MonoClassField *field = find_field (klass, ins->inst_offset);
+	MonoType *type;
+	int load_op, store_op;
+
+	if (!field)
+		return NULL;
+	type = mini_get_underlying_type (field->type);
+	if (mono_arch_is_soft_float () && (type->type == MONO_TYPE_R4 || type->type == MONO_TYPE_R8))
+		return NULL;
+
+	load_op = mono_type_to_load_membase (cfg, type);
+	store_op = mono_type_to_store_membase (cfg, type);
+	if (load_op == OP_LOADV_MEMBASE || load_op == OP_LOADX_MEMBASE)
+		return NULL;
+
+	if (MONO_IS_LOAD_MEMBASE (ins))
+		return ins->opcode == load_op ? field : NULL;
+	if (ins->opcode == store_op)
+		return field;
+	if (store_imm_to_store_reg (ins->opcode) == store_op)
+		return field;
+	return NULL;
+}
+
+/*
+ * Return the opcode used to read a field of type TYPE from its variable. Small
+ * integers and R4 values are normalized on load, like the memory store would do.
+ */
+static int
+field_load_opcode (MonoCompile *cfg, MonoType *type)
+{
+	type = mini_get_underlying_type (type);
+	switch (type->type) {
+	case MONO_TYPE_I1:
+		return OP_ICONV_TO_I1;
+	case MONO_TYPE_U1:
+	case MONO_TYPE_BOOLEAN:
+		return OP_ICONV_TO_U1;
+	case MONO_TYPE_I2:
+		return OP_ICONV_TO_I2;
+	case MONO_TYPE_U2:
+	case MONO_TYPE_CHAR:
+		return OP_ICONV_TO_U2;
+	case MONO_TYPE_R4:
+		if (!cfg->r4fp)
+			return OP_FCONV_TO_R4;
+		break;
+	default:
+		break;
+	}
+	return mono_type_to_regmove (cfg, type);
+}
+
+static void
+replace_access (MonoCompile *cfg, MonoInst *ins, MonoInst *var)
+{
+	if (cfg->verbose_level > 2) { printf ("scalar replacing: "); mono_print_ins (ins); }
+
+	if (MONO_IS_LOAD_MEMBASE (ins)) {
+		ins->opcode = field_load_opcode (cfg, var->inst_vtype);
+		ins->sreg1 = var->dreg;
+	} else if (store_imm_to_store_reg (ins->opcode) != -1) {
+		/* Store of an immediate */
+		gint64 imm = ins->inst_imm;
+
+#if SIZEOF_REGISTER == 8
+		if (var->type == STACK_I8 || var->type == STACK_PTR || var->type == STACK_OBJ || var->type == STACK_MP) {
+			ins->opcode = OP_I8CONST;
+			ins->inst_l = imm;
+		} else
+#endif
+		{
+			ins->opcode = OP_ICONST;
+			ins->inst_c0 = imm;
+		}
+		ins->dreg = var->dreg;
+	} else {
+		ins->opcode = mono_type_to_regmove (cfg, var->inst_vtype);
+		ins->dreg = var->dreg;
+	}
+	ins->inst_offset = 0;
+}
+
+/*
+ * Remove the instructions which only exist to check or write through the object.
+ */
+static void
+remove_object_uses (EscapeContext *ctx, int index)
+{
+	MonoCompile *cfg = ctx->cfg;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			switch (ins->opcode) {
+			case OP_MOVE:
+			case OP_PADD_IMM:
+				if (get_owner (ctx, ins->sreg1) == index)
+					NULLIFY_INS (ins);
+				break;
+			case OP_CHECK_THIS:
+			case OP_NOT_NULL:
+			case OP_DUMMY_USE:
+				if (get_owner (ctx, ins->sreg1) == index)
+					NULLIFY_INS (ins);
+				break;
+			case OP_CARD_TABLE_WBARRIER:
+				if (get_interior (ctx, ins->sreg1) == index)
+					NULLIFY_INS (ins);
+				break;
+			case OP_COMPARE_IMM:
+			case OP_ICOMPARE_IMM:
+			case OP_LCOMPARE_IMM:
+				if (get_owner (ctx, ins->sreg1) == index) {
+					NULLIFY_INS (ins->next);
+					NULLIFY_INS (ins);
+				}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+}
+
+static void
+scalar_replace (EscapeContext *ctx, int index)
+{
+	MonoCompile *cfg = ctx->cfg;
+	EscapeCandidate *cand = &ctx->candidates [index - 1];
+	MonoClass *klass = cand->alloc->klass;
+	GHashTable *field_vars = g_hash_table_new (NULL, NULL);
+	MonoBasicBlock *init_bb;
+	MonoInst *ins, *next, *prev;
+	GSList *l;
+	int nfields = 0;
+
+	for (l = cand->accesses; l; l = l->next) {
+		if (!get_replaceable_field (cfg, klass, (MonoInst *)l->data)) {
+			mark_escaped (ctx, index, (MonoInst *)l->data);
+			g_hash_table_destroy (field_vars);
+			return;
+		}
+	}
+
+	/* Zero initialize the fields where the object was allocated */
+	init_bb = (MonoBasicBlock *)mono_mempool_alloc0 (cfg->mempool, sizeof (MonoBasicBlock));
+	cfg->cbb = init_bb;
+	for (l = cand->accesses; l; l = l->next) {
+		MonoInst *access = (MonoInst *)l->data;
+		MonoClassField *field = get_replaceable_field (cfg, klass, access);
+		MonoInst *var = (MonoInst *)g_hash_table_lookup (field_vars, field);
+
+		if (!var) {
+			var = mono_compile_create_var (cfg, field->type, OP_LOCAL);
+			mini_emit_init_rvar (cfg, var->dreg, field->type);
+			g_hash_table_insert (field_vars, field, var);
+			nfields++;
+		}
+		replace_access (cfg, access, var);
+	}
+
+	prev = cand->alloc;
+	for (ins = init_bb->code; ins; ins = next) {
+		next = ins->next;
+		mono_bblock_insert_after_ins (cand->bb, prev, ins);
+		prev = ins;
+	}
+	NULLIFY_INS (cand->alloc);
+
+	remove_object_uses (ctx, index);
+
+	if (cfg->verbose_level > 2)
+		printf ("Scalar replaced %s.%s allocation with %d fields.\n", klass->name_space, klass->name, nfields);
+	mono_jit_stats.objects_scalar_replaced++;
+	mono_jit_stats.fields_scalar_replaced += nfields;
+
+	g_hash_table_destroy (field_vars);
+}
+
+/**
+ * mono_escape_analysis:
+ *
+ *   Remove the allocation of objects which don't escape the method, replacing
+ * their fields with variables. This needs to run while the method is in SSA form,
+ * since it depends on the variables holding the objects having a single definition.
+ */
+void
+mono_escape_analysis (MonoCompile *cfg)
+{
+	EscapeContext ctx;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+	GPtrArray *allocs;
+	int i;
+
+	if (!(cfg->flags & MONO_CFG_HAS_ARRAY_ACCESS))
+		return;
+
+	g_assert (cfg->comp_done & MONO_COMP_SSA);
+
+	memset (&ctx, 0, sizeof (ctx));
+	ctx.cfg = cfg;
+	ctx.num_vregs = cfg->next_vreg;
+	ctx.ndefs = g_new0 (int, cfg->next_vreg);
+	ctx.owner = g_new0 (int, cfg->next_vreg);
+	ctx.interior = g_new0 (int, cfg->next_vreg);
+
+	allocs = g_ptr_array_new ();
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			const char *spec = INS_INFO (ins->opcode);
+
+			if (ins->opcode == OP_NOP)
+				continue;
+			if (spec [MONO_INST_DEST] != ' ' && ins->dreg >= 0 && !MONO_IS_STORE_MEMBASE (ins) && !MONO_IS_STORE_MEMINDEX (ins))
+				ctx.ndefs [ins->dreg]++;
+			if (ins->opcode == OP_NEWOBJ) {
+				g_ptr_array_add (allocs, bb);
+				g_ptr_array_add (allocs, ins);
+			}
+		}
+	}
+
+	ctx.num_candidates = allocs->len / 2;
+	mono_jit_stats.escape_candidates += ctx.num_candidates;
+	if (!ctx.num_candidates)
+		goto done;
+
+	ctx.candidates = g_new0 (EscapeCandidate, ctx.num_candidates);
+	for (i = 0; i < ctx.num_candidates; ++i) {
+		EscapeCandidate *cand = &ctx.candidates [i];
+
+		cand->bb = (MonoBasicBlock *)g_ptr_array_index (allocs, i * 2);
+		cand->alloc = (MonoInst *)g_ptr_array_index (allocs, (i * 2) + 1);
+		if (ctx.ndefs [cand->alloc->dreg] == 1)
+			ctx.owner [cand->alloc->dreg] = i + 1;
+		else
+			cand->escapes = TRUE;
+	}
+
+	compute_aliases (&ctx);
+	check_uses (&ctx);
+
+	for (i = 0; i < ctx.num_candidates; ++i) {
+		if (!ctx.candidates [i].escapes)
+			scalar_replace (&ctx, i + 1);
+		g_slist_free (ctx.candidates [i].accesses);
+	}
+
+	if (cfg->verbose_level > 2)
+		mono_print_code (cfg, "AFTER ESCAPE ANALYSIS");
+
+	g_free (ctx.candidates);
+done:
+	g_ptr_array_free (allocs, TRUE);
+	g_free (ctx.ndefs);
+	g_free (ctx.owner);
+	g_free (ctx.interior);
+}
+
+#else /* !DISABLE_JIT */
+
+MONO_EMPTY_SOURCE_FILE (escape_analysis);
+
+#endif /* !DISABLE_JIT */
@@ -65,12 +65,7 @@ typedef void (*MonoPIFunc) (MonoFuncV callme, void *margs);
  */
 typedef struct _RuntimeMethod
 {
-	/* NOTE: These first two elements (method and
-	   next_jit_code_hash) must be in the same order and at the
-	   same offset as in MonoJitInfo, because of the jit_code_hash
-	   internal hash table in MonoDomain. */
 	MonoMethod *method;
-	struct _RuntimeMethod *next_jit_code_hash;
 	guint32 locals_size;
 	guint32 args_size;
 	guint32 stack_size;
@@ -92,12 +87,48 @@ typedef struct _RuntimeMethod
 	gpointer jit_addr;
 	MonoMethodSignature *jit_sig;
 	gpointer jit_entry;
+	/* Mixed mode state, see tier_up_count_call () */
+	gint32 tier_state;
+	gint32 call_count;
 	MonoType *rtype;
 	MonoType **param_types;
 	MonoJitInfo *jinfo;
 	MonoDomain *domain;
 } RuntimeMethod;
 
+#define INTERP_IC_SIZE 4
+
+/*
+ * Inline cache of a MINT_CALLVIRT/MINT_VCALLVIRT call site, mapping the vtables of the
+ * receivers seen at the call site to the target method. Entries are filled in order
+ * and never replaced, once it's full the call site is megamorphic.
+ */
+typedef struct {
+	MonoVTable *vtables [INTERP_IC_SIZE];
+	RuntimeMethod *targets [INTERP_IC_SIZE];
+} InterpInlineCache;
+
+/*
+ * A chunk of the interpreter stack, which holds the frames, args, evaluation stack
+ * and locals of the methods, instead of allocating them on the native stack.
+ */
+typedef struct _InterpStackChunk InterpStackChunk;
+struct _InterpStackChunk {
+	InterpStackChunk *prev;
+	/* Kept around after its frames returned, to be reused by the next calls */
+	InterpStackChunk *next;
+	guint8 *pos;
+	/* The memory between pos and dirty_end was used by popped frames and not cleared yet */
+	guint8 *dirty_end;
+	guint8 *end;
+	guint8 data [MONO_ZERO_LEN_ARRAY];
+};
+
+typedef struct {
+	InterpStackChunk *chunk;
+	guint8 *pos;
+} InterpStackMark;
+
 struct _MonoInvocation {
 	MonoInvocation *parent; /* parent */
 	RuntimeMethod  *runtime_method; /* parent */
@@ -113,8 +144,23 @@ struct _MonoInvocation {
 	const unsigned short  *ip;
 	MonoException     *ex;
 	MonoExceptionClause *ex_handler;
+	/* State of the caller saved while it's calling another method without recursing */
+	unsigned char  *vt_sp;
+	GSList         *finally_ips;
+	const unsigned short *endfinally_ip;
+	/* Start of the memory of a frame allocated on the interpreter stack */
+	InterpStackMark stack_mark;
 };
 
+/*
+ * The interpreter stack of a thread. The chunks are kept for the lifetime of the
+ * thread, the memory above the dirty_end of each chunk is kept cleared.
+ */
+typedef struct {
+	InterpStackChunk *first;
+	InterpStackChunk *current;
+} InterpStack;
+
 typedef struct {
 	MonoDomain *original_domain;
 	MonoInvocation *base_frame;
@@ -130,10 +176,18 @@ typedef struct {
 	MonoInvocation *handler_frame;
 	/* IP to resume execution at */
 	gpointer handler_ip;
+
+	/* Interpreter stack of the thread, reset when the context is */
+	InterpStack *stack;
+
+	/* Inline cache hits/misses not yet added to the global counters */
+	guint32 ic_hits;
+	guint32 ic_misses;
 } ThreadContext;
 
 extern int mono_interp_traceopt;
 extern GSList *jit_classes;
+extern int mono_interp_tier_threshold;
 
 MonoException *
 mono_interp_transform_method (RuntimeMethod *runtime_method, ThreadContext *context);
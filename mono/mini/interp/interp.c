@@ -55,9 +55,14 @@
 #include <mono/metadata/debug-helpers.h>
 #include <mono/metadata/mono-config.h>
 #include <mono/metadata/marshal.h>
+#include <mono/metadata/gc-internals.h>
 #include <mono/metadata/environment.h>
 #include <mono/metadata/mono-debug.h>
+#include <mono/metadata/threads-types.h>
 #include <mono/utils/atomic.h>
+#include <mono/utils/mono-coop-mutex.h>
+#include <mono/utils/mono-counters.h>
+#include <mono/utils/w32api.h>
 
 #include "interp.h"
 #include "interp-internals.h"
@@ -105,6 +110,11 @@ init_frame (MonoInvocation *frame, MonoInvocation *parent_frame, RuntimeMethod *
  * Used for testing.
  */
 GSList *jit_classes;
+/*
+ * Number of calls after which an interpreted method is compiled by the JIT in the
+ * background, 0 if methods are only interpreted.
+ */
+int mono_interp_tier_threshold;
 /* If TRUE, interpreted code will be interrupted at function entry/backward branches */
 static gboolean ss_enabled;
 
@@ -217,13 +227,170 @@ static void debug_enter (MonoInvocation *frame, int *tracing)
 		goto main_loop;													\
 	} while (0)
 
+#define INTERP_STACK_CHUNK_SIZE (64 * 1024)
+
+static void
+free_stack_chunks (InterpStackChunk *chunk)
+{
+	while (chunk) {
+		InterpStackChunk *next = chunk->next;
+
+		mono_gc_deregister_root ((char *)chunk->data);
+		g_free (chunk);
+		chunk = next;
+	}
+}
+
+static inline void
+interp_stack_mark (ThreadContext *context, InterpStackMark *mark)
+{
+	mark->chunk = context->stack->current;
+	mark->pos = mark->chunk ? mark->chunk->pos : NULL;
+}
+
+/*
+ * interp_stack_restore:
+ *
+ *   Pop everything allocated on the interpreter stack since MARK was taken. The
+ * popped memory is not cleared here, frames are popped on every return. The next
+ * allocations clear the part they reuse, and interp_stack_clear_popped () clears
+ * the rest.
+ */
+static inline void
+interp_stack_restore (ThreadContext *context, InterpStackMark *mark)
+{
+	InterpStack *stack = context->stack;
+	InterpStackChunk *chunk;
+
+	for (chunk = stack->current; chunk && chunk != mark->chunk; chunk = chunk->prev)
+		chunk->pos = chunk->data;
+	if (mark->chunk) {
+		mark->chunk->pos = mark->pos;
+		stack->current = mark->chunk;
+	} else {
+		stack->current = stack->first;
+	}
+}
+
+/*
+ * interp_stack_clear_popped:
+ *
+ *   Clear the memory left behind by popped frames. The chunks are scanned
+ * conservatively as a whole, so it would keep the objects they referenced alive.
+ * This is done when ves_exec_method_with_context () returns, instead of every time
+ * a frame is popped.
+ */
+static void
+interp_stack_clear_popped (InterpStack *stack)
+{
+	InterpStackChunk *chunk;
+
+	for (chunk = stack->first; chunk; chunk = chunk->next) {
+		if (chunk->dirty_end > chunk->pos) {
+			memset (chunk->pos, 0, chunk->dirty_end - chunk->pos);
+			chunk->dirty_end = chunk->pos;
+		}
+	}
+}
+
+static void
+interp_stack_reset (InterpStack *stack)
+{
+	InterpStackChunk *chunk;
+
+	/* Pop everything, including the frames skipped by a longjmp */
+	for (chunk = stack->first; chunk; chunk = chunk->next)
+		chunk->pos = chunk->data;
+	stack->current = stack->first;
+	interp_stack_clear_popped (stack);
+}
+
+static gpointer
+interp_stack_alloc0 (ThreadContext *context, int size)
+{
+	InterpStack *stack = context->stack;
+	InterpStackChunk *chunk = stack->current;
+	gpointer res;
+
+	size = (size + 7) & ~7;
+	if (!chunk || chunk->pos + size > chunk->end) {
+		InterpStackChunk *next = chunk ? chunk->next : stack->first;
+
+		if (next && next->data + size > next->end) {
+			free_stack_chunks (next);
+			next = NULL;
+		}
+		if (!next) {
+			int chunk_size = MAX (size, INTERP_STACK_CHUNK_SIZE);
+
+			next = (InterpStackChunk *)g_malloc0 (sizeof (InterpStackChunk) + chunk_size);
+			next->prev = chunk;
+			next->next = NULL;
+			next->dirty_end = next->data;
+			next->end = next->data + chunk_size;
+			/* The frames can hold the only references to objects */
+			mono_gc_register_root ((char *)next->data, chunk_size, MONO_GC_DESCRIPTOR_NULL, MONO_ROOT_SOURCE_STACK, "interpreter stack");
+			if (chunk)
+				chunk->next = next;
+			else
+				stack->first = next;
+		}
+		next->pos = next->data;
+		stack->current = chunk = next;
+	}
+	res = chunk->pos;
+	chunk->pos += size;
+	/* Only the memory used by popped frames needs to be cleared */
+	if (chunk->dirty_end > (guint8 *)res)
+		memset (res, 0, MIN (chunk->pos, chunk->dirty_end) - (guint8 *)res);
+	if (chunk->pos > chunk->dirty_end)
+		chunk->dirty_end = chunk->pos;
+	return res;
+}
+
+/*
+ * mono_interp_free_thread_stack:
+ *
+ *   Free the interpreter stack of a thread, called when its jit tls data is freed.
+ */
+void
+mono_interp_free_thread_stack (gpointer stack)
+{
+	InterpStack *s = (InterpStack *)stack;
+
+	if (!s)
+		return;
+	free_stack_chunks (s->first);
+	g_free (s);
+}
+
 static void
 set_context (ThreadContext *context)
 {
 	MonoJitTlsData *jit_tls;
 
-	mono_native_tls_set_value (thread_context_id, context);
 	jit_tls = mono_tls_get_jit_tls ();
+	if (!context) {
+		ThreadContext *old_context = mono_native_tls_get_value (thread_context_id);
+
+		if (old_context && old_context->stack) {
+			/* Keep the chunks of the thread, so the next entry doesn't need to allocate them again */
+			if (jit_tls && jit_tls->interp_stack == old_context->stack)
+				interp_stack_reset (old_context->stack);
+			else
+				mono_interp_free_thread_stack (old_context->stack);
+			old_context->stack = NULL;
+		}
+	} else if (!context->stack) {
+		if (jit_tls) {
+			if (!jit_tls->interp_stack)
+				jit_tls->interp_stack = g_new0 (InterpStack, 1);
+			context->stack = (InterpStack *)jit_tls->interp_stack;
+		} else {
+			context->stack = g_new0 (InterpStack, 1);
+		}
+	}
+	mono_native_tls_set_value (thread_context_id, context);
 	if (jit_tls)
 		jit_tls->interp_context = context;
 }
@@ -253,20 +420,16 @@ ves_real_abort (int line, MonoMethod *mh,
 static RuntimeMethod*
 lookup_runtime_method (MonoDomain *domain, MonoMethod *method)
 {
-	RuntimeMethod *rtm;
 	MonoJitDomainInfo *info;
 
 	info = domain_jit_info (domain);
-	mono_domain_jit_code_hash_lock (domain);
-	rtm = mono_internal_hash_table_lookup (&info->interp_code_hash, method);
-	mono_domain_jit_code_hash_unlock (domain);
-	return rtm;
+	return (RuntimeMethod *)mono_conc_hashtable_lookup (info->interp_code_hash, method);
 }
 
 RuntimeMethod*
 mono_interp_get_runtime_method (MonoDomain *domain, MonoMethod *method, MonoError *error)
 {
-	RuntimeMethod *rtm;
+	RuntimeMethod *rtm, *rtm2;
 	MonoJitDomainInfo *info;
 	MonoMethodSignature *sig;
 	int i;
@@ -274,9 +437,7 @@ mono_interp_get_runtime_method (MonoDomain *domain, MonoMethod *method, MonoErro
 	error_init (error);
 
 	info = domain_jit_info (domain);
-	mono_domain_jit_code_hash_lock (domain);
-	rtm = mono_internal_hash_table_lookup (&info->interp_code_hash, method);
-	mono_domain_jit_code_hash_unlock (domain);
+	rtm = (RuntimeMethod *)mono_conc_hashtable_lookup (info->interp_code_hash, method);
 	if (rtm)
 		return rtm;
 
@@ -292,12 +453,15 @@ mono_interp_get_runtime_method (MonoDomain *domain, MonoMethod *method, MonoErro
 	for (i = 0; i < sig->param_count; ++i)
 		rtm->param_types [i] = mini_get_underlying_type (sig->params [i]);
 
+	/* Inserts still need to be serialized */
 	mono_domain_jit_code_hash_lock (domain);
-	if (!mono_internal_hash_table_lookup (&info->interp_code_hash, method))
-		mono_internal_hash_table_insert (&info->interp_code_hash, method, rtm);
+	rtm2 = (RuntimeMethod *)mono_conc_hashtable_lookup (info->interp_code_hash, method);
+	if (!rtm2)
+		mono_conc_hashtable_insert (info->interp_code_hash, method, rtm);
 	mono_domain_jit_code_hash_unlock (domain);
 
-	return rtm;
+	/* Another thread won the race, its RuntimeMethod is the one which can get transformed */
+	return rtm2 ? rtm2 : rtm;
 }
 
 gpointer
@@ -391,6 +555,82 @@ get_virtual_method (RuntimeMethod *runtime_method, MonoObject *obj)
 	return virtual_runtime_method;
 }
 
+/*
+ * The inline cache counters are kept per thread and added to the global ones every
+ * INTERP_IC_COUNTER_BATCH events, so they don't add a shared store to every call.
+ */
+#define INTERP_IC_COUNTER_BATCH 1024
+
+static gint32 interp_ic_hits;
+static gint32 interp_ic_misses;
+
+static inline void
+count_ic_event (guint32 *count, gint32 *total)
+{
+	if (++*count == INTERP_IC_COUNTER_BATCH) {
+		InterlockedAdd (total, INTERP_IC_COUNTER_BATCH);
+		*count = 0;
+	}
+}
+
+static RuntimeMethod *
+get_virtual_method_ic_miss (RuntimeMethod *runtime_method, InterpInlineCache *ic, MonoObject *obj, ThreadContext *context)
+{
+	RuntimeMethod *ret = get_virtual_method (runtime_method, obj);
+	MonoDomain *domain = runtime_method->domain;
+	int i;
+
+	count_ic_event (&context->ic_misses, &interp_ic_misses);
+	/* Megamorphic call site, entries are never replaced so don't bother taking the lock */
+	if (ic->vtables [INTERP_IC_SIZE - 1])
+		return ret;
+#ifndef DISABLE_REMOTING
+	if (mono_object_is_transparent_proxy (obj))
+		return ret;
+#endif
+
+	mono_domain_jit_code_hash_lock (domain);
+	for (i = 0; i < INTERP_IC_SIZE; ++i) {
+		/* Added by another thread */
+		if (ic->vtables [i] == obj->vtable)
+			break;
+		if (!ic->vtables [i]) {
+			ic->targets [i] = ret;
+			/* Readers check the vtable without taking the lock */
+			mono_memory_barrier ();
+			ic->vtables [i] = obj->vtable;
+			break;
+		}
+	}
+	mono_domain_jit_code_hash_unlock (domain);
+	return ret;
+}
+
+/*
+ * get_virtual_method_cached:
+ *
+ *   Same as get_virtual_method (), looking up the receiver's vtable in the call site's
+ * inline cache IC first.
+ */
+static inline RuntimeMethod *
+get_virtual_method_cached (RuntimeMethod *runtime_method, InterpInlineCache *ic, MonoObject *obj, ThreadContext *context)
+{
+	MonoVTable *vtable = obj->vtable;
+	int i;
+
+	for (i = 0; i < INTERP_IC_SIZE; ++i) {
+		if (ic->vtables [i] == vtable) {
+			/* Pairs with the barrier in get_virtual_method_ic_miss (), the target is stored before the vtable */
+			mono_memory_read_barrier ();
+			count_ic_event (&context->ic_hits, &interp_ic_hits);
+			return ic->targets [i];
+		}
+		if (!ic->vtables [i])
+			break;
+	}
+	return get_virtual_method_ic_miss (runtime_method, ic, obj, context);
+}
+
 static void inline
 stackval_from_data (MonoType *type, stackval *result, char *data, gboolean pinvoke)
 {
@@ -785,87 +1025,50 @@ interp_walk_stack_with_ctx (MonoInternalStackWalk func, MonoContext *ctx, MonoUn
 
 static MonoPIFunc mono_interp_enter_icall_trampoline = NULL;
 
-static InterpMethodArguments* build_args_from_sig (MonoMethodSignature *sig, MonoInvocation *frame)
+enum {
+	INTERP_ARG_INT,
+	/* I8 passed in two int registers on 32 bit targets */
+	INTERP_ARG_INT_PAIR,
+	INTERP_ARG_R4,
+	INTERP_ARG_R8
+};
+
+/*
+ * How the arguments of a native call with a given signature are passed to
+ * mono_interp_enter_icall_trampoline, computed once per signature.
+ */
+typedef struct {
+	size_t ilen;
+	size_t flen;
+	gboolean hasthis;
+	int param_count;
+	gboolean has_retval;
+	size_t is_float_ret;
+	/* INTERP_ARG_ kind and iargs/fargs index of each parameter */
+	guint8 *arg_kinds;
+	guint8 *arg_slots;
+} InterpCallInfo;
+
+/* MonoMethodSignature -> InterpCallInfo */
+static InterpCallInfo*
+build_call_info (MonoDomain *domain, MonoMethodSignature *sig)
 {
-	InterpMethodArguments *margs = g_malloc0 (sizeof (InterpMethodArguments));
+	InterpCallInfo *cinfo = (InterpCallInfo *)mono_domain_alloc0 (domain, sizeof (InterpCallInfo) + 2 * sig->param_count);
+	size_t int_i = 0;
+	size_t int_f = 0;
+
+	cinfo->arg_kinds = (guint8 *)(cinfo + 1);
+	cinfo->arg_slots = cinfo->arg_kinds + sig->param_count;
+	cinfo->hasthis = sig->hasthis;
+	cinfo->param_count = sig->param_count;
 
 #ifdef TARGET_ARM
 	g_assert (mono_arm_eabi_supported ());
 	int i8_align = mono_arm_i8_align ();
 #endif
 
-	if (sig->hasthis)
-		margs->ilen++;
-
-	for (int i = 0; i < sig->param_count; i++) {
-		guint32 ptype = sig->params [i]->byref ? MONO_TYPE_PTR : sig->params [i]->type;
-		switch (ptype) {
-		case MONO_TYPE_BOOLEAN:
-		case MONO_TYPE_CHAR:
-		case MONO_TYPE_I1:
-		case MONO_TYPE_U1:
-		case MONO_TYPE_I2:
-		case MONO_TYPE_U2:
-		case MONO_TYPE_I4:
-		case MONO_TYPE_U4:
-		case MONO_TYPE_I:
-		case MONO_TYPE_U:
-		case MONO_TYPE_PTR:
-		case MONO_TYPE_SZARRAY:
-		case MONO_TYPE_CLASS:
-		case MONO_TYPE_OBJECT:
-		case MONO_TYPE_STRING:
-		case MONO_TYPE_VALUETYPE:
-		case MONO_TYPE_GENERICINST:
-#if SIZEOF_VOID_P == 8
-		case MONO_TYPE_I8:
-#endif
-			margs->ilen++;
-			break;
-#if SIZEOF_VOID_P == 4
-		case MONO_TYPE_I8:
-#ifdef TARGET_ARM
-			/* pairs begin at even registers */
-			if (i8_align == 8 && margs->ilen & 1)
-				margs->ilen++;
-#endif
-			margs->ilen += 2;
-			break;
-#endif
-		case MONO_TYPE_R4:
-#if SIZEOF_VOID_P == 8
-		case MONO_TYPE_R8:
-#endif
-			margs->flen++;
-			break;
-#if SIZEOF_VOID_P == 4
-		case MONO_TYPE_R8:
-			margs->flen += 2;
-			break;
-#endif
-		default:
-			g_error ("build_args_from_sig: not implemented yet (1): 0x%x\n", ptype);
-		}
-	}
-
-	if (margs->ilen > 0)
-		margs->iargs = g_malloc0 (sizeof (gpointer) * margs->ilen);
-
-	if (margs->flen > 0)
-		margs->fargs = g_malloc0 (sizeof (double) * margs->flen);
-
-	if (margs->ilen > INTERP_ICALL_TRAMP_IARGS)
-		g_error ("build_args_from_sig: TODO, allocate gregs: %d\n", margs->ilen);
-
-	if (margs->flen > INTERP_ICALL_TRAMP_FARGS)
-		g_error ("build_args_from_sig: TODO, allocate fregs: %d\n", margs->flen);
-
-
-	size_t int_i = 0;
-	size_t int_f = 0;
-
 	if (sig->hasthis) {
-		margs->iargs [0] = frame->stack_args->data.p;
+		cinfo->ilen++;
 		int_i++;
 	}
 
@@ -892,50 +1095,49 @@ static InterpMethodArguments* build_args_from_sig (MonoMethodSignature *sig, Mon
 #if SIZEOF_VOID_P == 8
 		case MONO_TYPE_I8:
 #endif
-			margs->iargs [int_i] = frame->stack_args [i].data.p;
-#if DEBUG_INTERP
-			g_print ("build_args_from_sig: margs->iargs [%d]: %p (frame @ %d)\n", int_i, margs->iargs [int_i], i);
-#endif
+			cinfo->arg_kinds [i] = INTERP_ARG_INT;
+			cinfo->arg_slots [i] = int_i;
+			cinfo->ilen++;
 			int_i++;
 			break;
 #if SIZEOF_VOID_P == 4
-		case MONO_TYPE_I8: {
-			stackval *sarg = &frame->stack_args [i];
+		case MONO_TYPE_I8:
 #ifdef TARGET_ARM
 			/* pairs begin at even registers */
-			if (i8_align == 8 && int_i & 1)
+			if (i8_align == 8 && int_i & 1) {
+				cinfo->ilen++;
 				int_i++;
+			}
 #endif
-			margs->iargs [int_i] = (gpointer) sarg->data.pair.lo;
-			int_i++;
-			margs->iargs [int_i] = (gpointer) sarg->data.pair.hi;
-#if DEBUG_INTERP
-			g_print ("build_args_from_sig: margs->iargs [%d/%d]: 0x%016llx, hi=0x%08x lo=0x%08x (frame @ %d)\n", int_i - 1, int_i, *((guint64 *) &margs->iargs [int_i - 1]), sarg->data.pair.hi, sarg->data.pair.lo, i);
-#endif
-			int_i++;
+			cinfo->arg_kinds [i] = INTERP_ARG_INT_PAIR;
+			cinfo->arg_slots [i] = int_i;
+			cinfo->ilen += 2;
+			int_i += 2;
 			break;
-		}
 #endif
 		case MONO_TYPE_R4:
 		case MONO_TYPE_R8:
-			if (ptype == MONO_TYPE_R4)
-				* (float *) &(margs->fargs [int_f]) = (float) frame->stack_args [i].data.f;
-			else
-				margs->fargs [int_f] = frame->stack_args [i].data.f;
-#if DEBUG_INTERP
-			g_print ("build_args_from_sig: margs->fargs [%d]: %p (%f) (frame @ %d)\n", int_f, margs->fargs [int_f], margs->fargs [int_f], i);
-#endif
+			cinfo->arg_kinds [i] = ptype == MONO_TYPE_R4 ? INTERP_ARG_R4 : INTERP_ARG_R8;
+			cinfo->arg_slots [i] = int_f;
 #if SIZEOF_VOID_P == 4
+			cinfo->flen += ptype == MONO_TYPE_R4 ? 1 : 2;
 			int_f += 2;
 #else
+			cinfo->flen++;
 			int_f++;
 #endif
 			break;
 		default:
-			g_error ("build_args_from_sig: not implemented yet (2): 0x%x\n", ptype);
+			g_error ("build_call_info: not implemented yet: 0x%x\n", ptype);
 		}
 	}
 
+	if (cinfo->ilen > INTERP_ICALL_TRAMP_IARGS)
+		g_error ("build_call_info: TODO, allocate gregs: %d\n", cinfo->ilen);
+
+	if (cinfo->flen > INTERP_ICALL_TRAMP_FARGS)
+		g_error ("build_call_info: TODO, allocate fregs: %d\n", cinfo->flen);
+
 	switch (sig->ret->type) {
 		case MONO_TYPE_BOOLEAN:
 		case MONO_TYPE_CHAR:
@@ -955,26 +1157,100 @@ static InterpMethodArguments* build_args_from_sig (MonoMethodSignature *sig, Mon
 		case MONO_TYPE_I8:
 		case MONO_TYPE_VALUETYPE:
 		case MONO_TYPE_GENERICINST:
-			margs->retval = &(frame->retval->data.p);
-			margs->is_float_ret = 0;
+			cinfo->has_retval = TRUE;
+			cinfo->is_float_ret = 0;
 			break;
 		case MONO_TYPE_R4:
 		case MONO_TYPE_R8:
-			margs->retval = &(frame->retval->data.p);
-			margs->is_float_ret = 1;
+			cinfo->has_retval = TRUE;
+			cinfo->is_float_ret = 1;
 			break;
 		case MONO_TYPE_VOID:
-			margs->retval = NULL;
 			break;
 		default:
-			g_error ("build_args_from_sig: ret type not implemented yet: 0x%x\n", sig->ret->type);
+			g_error ("build_call_info: ret type not implemented yet: 0x%x\n", sig->ret->type);
+	}
+
+	return cinfo;
+}
+
+/*
+ * get_call_info:
+ *
+ *   Return the InterpCallInfo of SIG, cached in the call site slot CACHE. The slot and
+ * the info are allocated from DOMAIN, so they live as long as the calling code.
+ */
+static InterpCallInfo*
+get_call_info (MonoDomain *domain, MonoMethodSignature *sig, gpointer *cache)
+{
+	InterpCallInfo *cinfo = (InterpCallInfo *)*cache;
+
+	if (cinfo) {
+		mono_memory_read_barrier ();
+		return cinfo;
 	}
 
-	return margs;
+	/* Racing threads build identical infos, the losers stay in the domain mempool */
+	cinfo = build_call_info (domain, sig);
+	mono_memory_write_barrier ();
+	*cache = cinfo;
+	return cinfo;
+}
+
+/*
+ * build_args_from_sig:
+ *
+ *   Fill MARGS, IARGS and FARGS with the arguments of FRAME, laid out as described by
+ * CINFO.
+ */
+static void
+build_args_from_sig (InterpCallInfo *cinfo, MonoInvocation *frame, InterpMethodArguments *margs, gpointer *iargs, double *fargs)
+{
+	stackval *args = frame->stack_args;
+
+	margs->ilen = cinfo->ilen;
+	margs->iargs = cinfo->ilen ? iargs : NULL;
+	margs->flen = cinfo->flen;
+	margs->fargs = cinfo->flen ? fargs : NULL;
+	margs->retval = cinfo->has_retval ? &(frame->retval->data.p) : NULL;
+	margs->is_float_ret = cinfo->is_float_ret;
+
+	/* Padding slots are not set otherwise */
+	memset (iargs, 0, cinfo->ilen * sizeof (gpointer));
+
+	if (cinfo->hasthis)
+		iargs [0] = args->data.p;
+
+	for (int i = 0; i < cinfo->param_count; i++) {
+		int slot = cinfo->arg_slots [i];
+
+		switch (cinfo->arg_kinds [i]) {
+		case INTERP_ARG_INT:
+			iargs [slot] = args [i].data.p;
+#if DEBUG_INTERP
+			g_print ("build_args_from_sig: margs->iargs [%d]: %p (frame @ %d)\n", slot, iargs [slot], i);
+#endif
+			break;
+#if SIZEOF_VOID_P == 4
+		case INTERP_ARG_INT_PAIR:
+			iargs [slot] = (gpointer) args [i].data.pair.lo;
+			iargs [slot + 1] = (gpointer) args [i].data.pair.hi;
+			break;
+#endif
+		case INTERP_ARG_R4:
+			* (float *) &(fargs [slot]) = (float) args [i].data.f;
+			break;
+		case INTERP_ARG_R8:
+			fargs [slot] = args [i].data.f;
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+	}
 }
 
 static void 
-ves_pinvoke_method (MonoInvocation *frame, MonoMethodSignature *sig, MonoFuncV addr, gboolean string_ctor, ThreadContext *context)
+ves_pinvoke_method (MonoInvocation *frame, MonoMethodSignature *sig, InterpCallInfo *cinfo, MonoFuncV addr, gboolean string_ctor, ThreadContext *context)
 {
 	jmp_buf env;
 	MonoInvocation *old_frame = context->current_frame;
@@ -1006,10 +1282,14 @@ ves_pinvoke_method (MonoInvocation *frame, MonoMethodSignature *sig, MonoFuncV a
 		}
 	}
 
-	InterpMethodArguments *margs = build_args_from_sig (sig, frame);
+	InterpMethodArguments margs;
+	gpointer iargs [INTERP_ICALL_TRAMP_IARGS];
+	double fargs [INTERP_ICALL_TRAMP_FARGS];
+
+	build_args_from_sig (cinfo, frame, &margs, iargs, fargs);
 #if DEBUG_INTERP
 	g_print ("ICALL: mono_interp_enter_icall_trampoline = %p, addr = %p\n", mono_interp_enter_icall_trampoline, addr);
-	g_print ("margs(out): ilen=%d, flen=%d\n", margs->ilen, margs->flen);
+	g_print ("margs(out): ilen=%d, flen=%d\n", margs.ilen, margs.flen);
 #endif
 
 	context->current_frame = frame;
@@ -1017,7 +1297,7 @@ ves_pinvoke_method (MonoInvocation *frame, MonoMethodSignature *sig, MonoFuncV a
 
 	interp_push_lmf (&ext, frame);
 
-	mono_interp_enter_icall_trampoline (addr, margs);
+	mono_interp_enter_icall_trampoline (addr, &margs);
 
 	interp_pop_lmf (&ext);
 
@@ -1037,10 +1317,6 @@ ves_pinvoke_method (MonoInvocation *frame, MonoMethodSignature *sig, MonoFuncV a
 	context->current_frame = old_frame;
 	context->env_frame = old_env_frame;
 	context->current_env = old_env;
-
-	g_free (margs->iargs);
-	g_free (margs->fargs);
-	g_free (margs);
 }
 
 void
@@ -1734,6 +2010,40 @@ do_icall (ThreadContext *context, int op, stackval *sp, gpointer ptr)
 	return sp;
 }
 
+/*
+ * interp_jit_compile:
+ *
+ *   Compile RMETHOD and the gsharedvt_out wrapper used to call it with the JIT,
+ * and publish them in RMETHOD. Return FALSE and set ERROR on failure.
+ */
+static gboolean
+interp_jit_compile (RuntimeMethod *rmethod, MonoError *error)
+{
+	MonoMethod *method = rmethod->method;
+	MonoMethodSignature *sig;
+
+	sig = mono_method_signature (method);
+	g_assert (sig);
+
+	MonoMethod *wrapper = mini_get_gsharedvt_out_sig_wrapper (sig);
+	//printf ("J: %s %s\n", mono_method_full_name (method, 1), mono_method_full_name (wrapper, 1));
+
+	gpointer jit_wrapper = mono_jit_compile_method_jit_only (wrapper, error);
+	if (!is_ok (error))
+		return FALSE;
+
+	gpointer addr = mono_jit_compile_method_jit_only (method, error);
+	if (!is_ok (error))
+		return FALSE;
+	g_assert (addr);
+
+	rmethod->jit_addr = addr;
+	rmethod->jit_sig = sig;
+	mono_memory_barrier ();
+	rmethod->jit_wrapper = jit_wrapper;
+	return TRUE;
+}
+
 static stackval *
 do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInvocation *frame, RuntimeMethod *rmethod)
 {
@@ -1750,30 +2060,12 @@ do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInv
 	 * by ref and return a return value using an explicit return value argument.
 	 */
 	if (!rmethod->jit_wrapper) {
-		MonoMethod *method = rmethod->method;
 		MonoError error;
 
-		sig = mono_method_signature (method);
-		g_assert (sig);
-
-		MonoMethod *wrapper = mini_get_gsharedvt_out_sig_wrapper (sig);
-		//printf ("J: %s %s\n", mono_method_full_name (method, 1), mono_method_full_name (wrapper, 1));
-
-		gpointer jit_wrapper = mono_jit_compile_method_jit_only (wrapper, &error);
-		mono_error_assert_ok (&error);
-
-		gpointer addr = mono_jit_compile_method_jit_only (method, &error);
-		g_assert (addr);
+		interp_jit_compile (rmethod, &error);
 		mono_error_assert_ok (&error);
-
-		rmethod->jit_addr = addr;
-		rmethod->jit_sig = sig;
-		mono_memory_barrier ();
-		rmethod->jit_wrapper = jit_wrapper;
-
-	} else {
-		sig = rmethod->jit_sig;
 	}
+	sig = rmethod->jit_sig;
 
 	sp -= sig->param_count;
 	if (sig->hasthis)
@@ -1809,6 +2101,8 @@ do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInv
 			args [pindex ++] = &sval->data.p;
 		} else {
 			switch (t->type) {
+			case MONO_TYPE_BOOLEAN:
+			case MONO_TYPE_CHAR:
 			case MONO_TYPE_I1:
 			case MONO_TYPE_U1:
 			case MONO_TYPE_I2:
@@ -1829,6 +2123,9 @@ do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInv
 			case MONO_TYPE_U8:
 				args [pindex ++] = &sval->data.l;
 				break;
+			case MONO_TYPE_R8:
+				args [pindex ++] = &sval->data.f;
+				break;
 			default:
 				printf ("%s\n", mono_type_full_name (t));
 				g_assert_not_reached ();
@@ -1904,17 +2201,21 @@ do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInv
 	case MONO_TYPE_SZARRAY:
 	case MONO_TYPE_I:
 	case MONO_TYPE_U:
+	case MONO_TYPE_PTR:
+	case MONO_TYPE_FNPTR:
 		sp->data.p = *(gpointer*)res_buf;
 		break;
 	case MONO_TYPE_I1:
 		sp->data.i = *(gint8*)res_buf;
 		break;
+	case MONO_TYPE_BOOLEAN:
 	case MONO_TYPE_U1:
 		sp->data.i = *(guint8*)res_buf;
 		break;
 	case MONO_TYPE_I2:
 		sp->data.i = *(gint16*)res_buf;
 		break;
+	case MONO_TYPE_CHAR:
 	case MONO_TYPE_U2:
 		sp->data.i = *(guint16*)res_buf;
 		break;
@@ -1924,6 +2225,16 @@ do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInv
 	case MONO_TYPE_U4:
 		sp->data.i = *(guint32*)res_buf;
 		break;
+	case MONO_TYPE_I8:
+	case MONO_TYPE_U8:
+		sp->data.l = *(gint64*)res_buf;
+		break;
+	case MONO_TYPE_R4:
+		sp->data.f = *(float*)res_buf;
+		break;
+	case MONO_TYPE_R8:
+		sp->data.f = *(double*)res_buf;
+		break;
 	case MONO_TYPE_VALUETYPE:
 		/* The result was written to vt_sp */
 		sp->data.p = vt_sp;
@@ -1932,17 +2243,202 @@ do_jit_call (stackval *sp, unsigned char *vt_sp, ThreadContext *context, MonoInv
 		if (MONO_TYPE_IS_REFERENCE (rtype)) {
 			sp->data.p = *(gpointer*)res_buf;
 		} else {
-			/* The result was written to vt_sp */
-			sp->data.p = vt_sp;
+			/* The result was written to vt_sp */
+			sp->data.p = vt_sp;
+		}
+		break;
+	default:
+		printf ("%s\n", mono_type_full_name (rtype));
+		g_assert_not_reached ();
+		break;
+	}
+
+	return sp;
+}
+
+/*
+ * Mixed mode execution: when mono_interp_tier_threshold is set, methods start out
+ * interpreted, and the ones called that many times are compiled by the JIT on a
+ * background thread. Interpreted callers then switch to the JITted code through
+ * do_jit_call () once it is ready.
+ */
+enum {
+	/* Not yet checked whether the method can be called through do_jit_call () */
+	TIER_STATE_UNCHECKED,
+	TIER_STATE_COUNTING,
+	/* Waiting for the tier up thread */
+	TIER_STATE_QUEUED,
+	/* jit_wrapper/jit_addr are set, calls go to the JITted code */
+	TIER_STATE_JIT,
+	/* Stays interpreted */
+	TIER_STATE_NEVER
+};
+
+static MonoCoopMutex tier_up_mutex;
+/* RuntimeMethods waiting to be compiled */
+static GSList *tier_up_queue;
+static gboolean tier_up_thread_running;
+
+static gint32 interp_tiered_methods;
+
+static gboolean
+tier_up_type_supported (MonoType *t)
+{
+	if (t->byref || MONO_TYPE_IS_REFERENCE (t))
+		return TRUE;
+	switch (t->type) {
+	case MONO_TYPE_BOOLEAN:
+	case MONO_TYPE_CHAR:
+	case MONO_TYPE_I1:
+	case MONO_TYPE_U1:
+	case MONO_TYPE_I2:
+	case MONO_TYPE_U2:
+	case MONO_TYPE_I4:
+	case MONO_TYPE_U4:
+	case MONO_TYPE_I8:
+	case MONO_TYPE_U8:
+	case MONO_TYPE_I:
+	case MONO_TYPE_U:
+	case MONO_TYPE_PTR:
+	case MONO_TYPE_FNPTR:
+	case MONO_TYPE_R8:
+	case MONO_TYPE_VALUETYPE:
+		return TRUE;
+	case MONO_TYPE_GENERICINST:
+		return MONO_TYPE_ISSTRUCT (t);
+	default:
+		/* R4 arguments would need to be narrowed from the stackval */
+		return FALSE;
+	}
+}
+
+/*
+ * tier_up_supported:
+ *
+ *   Return whenever RTM can be called through do_jit_call ().
+ */
+static gboolean
+tier_up_supported (RuntimeMethod *rtm)
+{
+	MonoMethod *method = rtm->method;
+	MonoMethodSignature *sig = mono_method_signature (method);
+	int i, nargs;
+
+	/* The queued methods are not tracked across domain unloads */
+	if (rtm->domain != mono_get_root_domain ())
+		return FALSE;
+	if (method->wrapper_type != MONO_WRAPPER_NONE)
+		return FALSE;
+	if (sig->pinvoke || sig->call_convention == MONO_CALL_VARARG)
+		return FALSE;
+	if (method->flags & METHOD_ATTRIBUTE_PINVOKE_IMPL)
+		return FALSE;
+	if (method->iflags & (METHOD_IMPL_ATTRIBUTE_INTERNAL_CALL | METHOD_IMPL_ATTRIBUTE_RUNTIME))
+		return FALSE;
+	if (method->is_inflated || method->string_ctor)
+		return FALSE;
+	/* Remoting invokes are dispatched by the interpreted call opcodes */
+	if (mono_class_is_marshalbyref (method->klass))
+		return FALSE;
+	/* Calls to the JITted code skip the seq points and the enter/leave events of the interpreter */
+	if (debug_options.gen_sdb_seq_points)
+		return FALSE;
+	if (mono_profiler_should_instrument_method (method, TRUE) || mono_profiler_should_instrument_method (method, FALSE))
+		return FALSE;
+
+	/* do_jit_call () passes at most 7 arguments to the wrapper */
+	nargs = sig->param_count + (sig->hasthis ? 1 : 0) + (rtm->rtype->type != MONO_TYPE_VOID ? 1 : 0);
+	if (nargs > 7)
+		return FALSE;
+	for (i = 0; i < sig->param_count; ++i) {
+		if (!tier_up_type_supported (rtm->param_types [i]))
+			return FALSE;
+	}
+	if (rtm->rtype->byref)
+		return FALSE;
+	/* Unlike arguments, R4 results are widened by do_jit_call () */
+	if (rtm->rtype->type != MONO_TYPE_VOID && rtm->rtype->type != MONO_TYPE_R4 && !tier_up_type_supported (rtm->rtype))
+		return FALSE;
+	return TRUE;
+}
+
+static gsize WINAPI
+tier_up_thread (void *arg)
+{
+	MonoError error;
+	MonoInternalThread *internal = mono_thread_internal_current ();
+	MonoString *name;
+
+	name = mono_string_new_checked (mono_get_root_domain (), "Interpreter tier up", &error);
+	mono_error_assert_ok (&error);
+	mono_thread_set_name_internal (internal, name, TRUE, FALSE, &error);
+	mono_error_assert_ok (&error);
+	/* Ask the runtime to not wait for this thread */
+	internal->state |= ThreadState_Background;
+
+	while (TRUE) {
+		RuntimeMethod *rtm;
+
+		mono_coop_mutex_lock (&tier_up_mutex);
+		if (!tier_up_queue) {
+			tier_up_thread_running = FALSE;
+			mono_coop_mutex_unlock (&tier_up_mutex);
+			break;
+		}
+		rtm = (RuntimeMethod *)tier_up_queue->data;
+		tier_up_queue = g_slist_delete_link (tier_up_queue, tier_up_queue);
+		mono_coop_mutex_unlock (&tier_up_mutex);
+
+		if (rtm->jit_wrapper || interp_jit_compile (rtm, &error)) {
+			mono_memory_barrier ();
+			rtm->tier_state = TIER_STATE_JIT;
+			InterlockedIncrement (&interp_tiered_methods);
+		} else {
+			/* The interpreter keeps running the method, the JIT error is not fatal */
+			mono_error_cleanup (&error);
+			rtm->tier_state = TIER_STATE_NEVER;
 		}
-		break;
-	default:
-		printf ("%s\n", mono_type_full_name (rtype));
-		g_assert_not_reached ();
-		break;
 	}
+	return 0;
+}
 
-	return sp;
+/*
+ * tier_up_count_call:
+ *
+ *   Called on entry to the interpreted method RTM. Queue it for JIT compilation once
+ * it reaches mono_interp_tier_threshold calls.
+ */
+static void
+tier_up_count_call (RuntimeMethod *rtm)
+{
+	MonoError error;
+	gboolean start_thread = FALSE;
+
+	if (rtm->tier_state == TIER_STATE_UNCHECKED)
+		rtm->tier_state = tier_up_supported (rtm) ? TIER_STATE_COUNTING : TIER_STATE_NEVER;
+	if (rtm->tier_state != TIER_STATE_COUNTING)
+		return;
+	/* Racy, losing a few counts doesn't matter */
+	if (++rtm->call_count < mono_interp_tier_threshold)
+		return;
+	if (InterlockedCompareExchange (&rtm->tier_state, TIER_STATE_QUEUED, TIER_STATE_COUNTING) != TIER_STATE_COUNTING)
+		return;
+
+	mono_coop_mutex_lock (&tier_up_mutex);
+	tier_up_queue = g_slist_append (tier_up_queue, rtm);
+	if (!tier_up_thread_running)
+		start_thread = tier_up_thread_running = TRUE;
+	mono_coop_mutex_unlock (&tier_up_mutex);
+
+	if (start_thread) {
+		if (!mono_thread_create_internal (mono_get_root_domain (), tier_up_thread, NULL, MONO_THREAD_CREATE_FLAGS_NONE, &error)) {
+			/* Keep interpreting, the queued methods are picked up if a later start succeeds */
+			mono_error_cleanup (&error);
+			mono_coop_mutex_lock (&tier_up_mutex);
+			tier_up_thread_running = FALSE;
+			mono_coop_mutex_unlock (&tier_up_mutex);
+		}
+	}
 }
 
 static void
@@ -2238,11 +2734,16 @@ static int opcode_counts[512];
 
 /*
  * If EXIT_AT_FINALLY is not -1, exit after exiting the finally clause with that index.
+ * Calls to other interpreted methods made by the call opcodes don't recurse, the frames
+ * of the callees are allocated on the interpreter stack and executed by this loop, until
+ * FRAME returns.
  */
 static void 
 ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, unsigned short *start_with_ip, MonoException *filter_exception, int exit_at_finally)
 {
+	MonoInvocation *entry_frame = frame;
 	MonoInvocation child_frame;
+	InterpStackMark stack_mark;
 	GSList *finally_ips = NULL;
 	const unsigned short *endfinally_ip = NULL;
 	const unsigned short *ip = NULL;
@@ -2272,6 +2773,7 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 	frame->ex_handler = NULL;
 	frame->ip = NULL;
 	context->current_frame = frame;
+	interp_stack_mark (context, &stack_mark);
 
 	debug_enter (frame, &tracing);
 
@@ -2293,8 +2795,9 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 
 	rtm = frame->runtime_method;
 	if (!start_with_ip ) {
-		frame->args = alloca (rtm->alloca_size);
-		memset (frame->args, 0, rtm->alloca_size);
+		if (G_UNLIKELY (mono_interp_tier_threshold) && rtm->tier_state < TIER_STATE_QUEUED)
+			tier_up_count_call (rtm);
+		frame->args = interp_stack_alloc0 (context, rtm->alloca_size);
 
 		ip = rtm->code;
 	} else {
@@ -2458,14 +2961,12 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 		}
 		MINT_IN_CASE(MINT_CALLI) {
 			MonoMethodSignature *csignature;
-			stackval *endsp = sp;
 
 			frame->ip = ip;
 			
 			csignature = rtm->data_items [* (guint16 *)(ip + 1)];
 			ip += 2;
 			--sp;
-			--endsp;
 			child_frame.runtime_method = sp->data.p;
 
 			sp->data.p = vt_sp;
@@ -2497,41 +2998,19 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 				}
 			}
 
-			ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
-
-			context->current_frame = frame;
-
-			if (context->has_resume_state) {
-				if (frame == context->handler_frame)
-					SET_RESUME_STATE (context);
-				else
-					goto exit_frame;
-			}
-
-			if (child_frame.ex) {
-				/*
-				 * An exception occurred, need to run finally, fault and catch handlers..
-				 */
-				frame->ex = child_frame.ex;
-				goto handle_finally;
-			}
-
-			/* need to handle typedbyref ... */
-			if (csignature->ret->type != MONO_TYPE_VOID) {
-				*sp = *endsp;
-				sp++;
-			}
-			MINT_IN_BREAK;
+			goto call_managed;
 		}
 		MINT_IN_CASE(MINT_CALLI_NAT) {
 			MonoMethodSignature *csignature;
+			InterpCallInfo *cinfo;
 			stackval *endsp = sp;
 			unsigned char *code = NULL;
 
 			frame->ip = ip;
 			
 			csignature = rtm->data_items [* (guint16 *)(ip + 1)];
-			ip += 2;
+			cinfo = get_call_info (rtm->domain, csignature, (gpointer *)rtm->data_items [* (guint16 *)(ip + 2)]);
+			ip += 3;
 			--sp;
 			--endsp;
 			code = sp->data.p;
@@ -2544,7 +3023,7 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			if (csignature->hasthis)
 				--sp;
 			child_frame.stack_args = sp;
-			ves_pinvoke_method (&child_frame, csignature, (MonoFuncV) code, FALSE, context);
+			ves_pinvoke_method (&child_frame, csignature, cinfo, (MonoFuncV) code, FALSE, context);
 
 			context->current_frame = frame;
 
@@ -2575,8 +3054,6 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			MINT_IN_BREAK;
 		}
 		MINT_IN_CASE(MINT_CALL) {
-			stackval *endsp = sp;
-
 			frame->ip = ip;
 			
 			child_frame.runtime_method = rtm->data_items [* (guint16 *)(ip + 1)];
@@ -2597,29 +3074,7 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			}
 #endif
 
-			ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
-
-			context->current_frame = frame;
-
-			if (context->has_resume_state) {
-				if (frame == context->handler_frame)
-					SET_RESUME_STATE (context);
-				else
-					goto exit_frame;
-			}
-
-			if (child_frame.ex) {
-				/*
-				 * An exception occurred, need to run finally, fault and catch handlers..
-				 */
-				frame->ex = child_frame.ex;
-				goto handle_exception;;
-			}
-
-			/* need to handle typedbyref ... */
-			*sp = *endsp;
-			sp++;
-			MINT_IN_BREAK;
+			goto call_managed;
 		}
 		MINT_IN_CASE(MINT_VCALL) {
 			frame->ip = ip;
@@ -2646,25 +3101,7 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			}
 #endif
 
-			ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
-
-			context->current_frame = frame;
-
-			if (context->has_resume_state) {
-				if (frame == context->handler_frame)
-					SET_RESUME_STATE (context);
-				else
-					goto exit_frame;
-			}
-
-			if (child_frame.ex) {
-				/*
-				 * An exception occurred, need to run finally, fault and catch handlers..
-				 */
-				frame->ex = child_frame.ex;
-				goto handle_finally;
-			}
-			MINT_IN_BREAK;
+			goto call_managed;
 		}
 
 		MINT_IN_CASE(MINT_JIT_CALL) {
@@ -2692,14 +3129,15 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 		}
 
 		MINT_IN_CASE(MINT_CALLVIRT) {
-			stackval *endsp = sp;
 			MonoObject *this_arg;
+			InterpInlineCache *ic;
 			guint32 token;
 
 			frame->ip = ip;
 			
 			token = * (unsigned short *)(ip + 1);
-			ip += 2;
+			ic = rtm->data_items [* (unsigned short *)(ip + 2)];
+			ip += 3;
 			child_frame.runtime_method = rtm->data_items [token];
 			sp->data.p = vt_sp;
 			child_frame.retval = sp;
@@ -2709,8 +3147,8 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			child_frame.stack_args = sp;
 			this_arg = sp->data.p;
 			if (!this_arg)
-				THROW_EX (mono_get_exception_null_reference(), ip - 2);
-			child_frame.runtime_method = get_virtual_method (child_frame.runtime_method, this_arg);
+				THROW_EX (mono_get_exception_null_reference(), ip - 3);
+			child_frame.runtime_method = get_virtual_method_cached (child_frame.runtime_method, ic, this_arg, context);
 
 			MonoClass *this_class = this_arg->vtable->klass;
 			if (this_class->valuetype && child_frame.runtime_method->method->klass->valuetype) {
@@ -2719,42 +3157,18 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 				sp [0].data.p = unboxed;
 			}
 
-			ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
-
-			context->current_frame = frame;
-
-			if (context->has_resume_state) {
-				if (frame == context->handler_frame)
-					SET_RESUME_STATE (context);
-				else
-					goto exit_frame;
-			}
-
-			if (child_frame.ex) {
-				/*
-				 * An exception occurred, need to run finally, fault and catch handlers..
-				 */
-				frame->ex = child_frame.ex;
-				if (context->search_for_handler) {
-					context->search_for_handler = 0;
-					goto handle_exception;
-				}
-				goto handle_finally;
-			}
-
-			/* need to handle typedbyref ... */
-			*sp = *endsp;
-			sp++;
-			MINT_IN_BREAK;
+			goto call_managed;
 		}
 		MINT_IN_CASE(MINT_VCALLVIRT) {
 			MonoObject *this_arg;
+			InterpInlineCache *ic;
 			guint32 token;
 
 			frame->ip = ip;
 			
 			token = * (unsigned short *)(ip + 1);
-			ip += 2;
+			ic = rtm->data_items [* (unsigned short *)(ip + 2)];
+			ip += 3;
 			child_frame.runtime_method = rtm->data_items [token];
 			sp->data.p = vt_sp;
 			child_frame.retval = sp;
@@ -2764,8 +3178,8 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			child_frame.stack_args = sp;
 			this_arg = sp->data.p;
 			if (!this_arg)
-				THROW_EX (mono_get_exception_null_reference(), ip - 2);
-			child_frame.runtime_method = get_virtual_method (child_frame.runtime_method, this_arg);
+				THROW_EX (mono_get_exception_null_reference(), ip - 3);
+			child_frame.runtime_method = get_virtual_method_cached (child_frame.runtime_method, ic, this_arg, context);
 
 			MonoClass *this_class = this_arg->vtable->klass;
 			if (this_class->valuetype && child_frame.runtime_method->method->klass->valuetype) {
@@ -2773,29 +3187,7 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 				sp [0].data.p = unboxed;
 			}
 
-			ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
-
-			context->current_frame = frame;
-
-			if (context->has_resume_state) {
-				if (frame == context->handler_frame)
-					SET_RESUME_STATE (context);
-				else
-					goto exit_frame;
-			}
-
-			if (child_frame.ex) {
-				/*
-				 * An exception occurred, need to run finally, fault and catch handlers..
-				 */
-				frame->ex = child_frame.ex;
-				if (context->search_for_handler) {
-					context->search_for_handler = 0;
-					goto handle_exception;
-				}
-				goto handle_finally;
-			}
-			MINT_IN_BREAK;
+			goto call_managed;
 		}
 		MINT_IN_CASE(MINT_CALLRUN)
 			ves_runtime_method (frame, context);
@@ -3091,6 +3483,53 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 		MINT_IN_CASE(MINT_BLT_UN_R8)
 			CONDBR(isunordered (sp [0].data.f, sp [1].data.f) || sp[0].data.f < sp[1].data.f)
 			MINT_IN_BREAK;
+#define BRELOP_IMM_S(op) \
+	--sp; \
+	if (sp[0].data.i op * (gint16 *)(ip + 2)) \
+		ip += * (gint16 *)(ip + 1); \
+	else \
+		ip += 3;
+#define BRELOP_IMM(op) \
+	--sp; \
+	if (sp[0].data.i op * (gint16 *)(ip + 3)) \
+		ip += READ32(ip + 1); \
+	else \
+		ip += 4;
+		MINT_IN_CASE(MINT_BEQ_I4_IMM_S) BRELOP_IMM_S(==); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGE_I4_IMM_S) BRELOP_IMM_S(>=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGT_I4_IMM_S) BRELOP_IMM_S(>); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLT_I4_IMM_S) BRELOP_IMM_S(<); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLE_I4_IMM_S) BRELOP_IMM_S(<=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BNE_UN_I4_IMM_S) BRELOP_IMM_S(!=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BEQ_I4_IMM) BRELOP_IMM(==); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGE_I4_IMM) BRELOP_IMM(>=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGT_I4_IMM) BRELOP_IMM(>); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLT_I4_IMM) BRELOP_IMM(<); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLE_I4_IMM) BRELOP_IMM(<=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BNE_UN_I4_IMM) BRELOP_IMM(!=); MINT_IN_BREAK;
+#define LOCAL_I4(n) (* (gint32 *)(locals + * (guint16 *)(ip + (n))))
+#define BRELOP_LOC_S(op) \
+	if (LOCAL_I4 (2) op LOCAL_I4 (3)) \
+		ip += * (gint16 *)(ip + 1); \
+	else \
+		ip += 4;
+#define BRELOP_LOC(op) \
+	if (LOCAL_I4 (3) op LOCAL_I4 (4)) \
+		ip += READ32(ip + 1); \
+	else \
+		ip += 5;
+		MINT_IN_CASE(MINT_BEQ_I4_LOC_S) BRELOP_LOC_S(==); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGE_I4_LOC_S) BRELOP_LOC_S(>=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGT_I4_LOC_S) BRELOP_LOC_S(>); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLT_I4_LOC_S) BRELOP_LOC_S(<); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLE_I4_LOC_S) BRELOP_LOC_S(<=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BNE_UN_I4_LOC_S) BRELOP_LOC_S(!=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BEQ_I4_LOC) BRELOP_LOC(==); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGE_I4_LOC) BRELOP_LOC(>=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BGT_I4_LOC) BRELOP_LOC(>); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLT_I4_LOC) BRELOP_LOC(<); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BLE_I4_LOC) BRELOP_LOC(<=); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_BNE_UN_I4_LOC) BRELOP_LOC(!=); MINT_IN_BREAK;
 		MINT_IN_CASE(MINT_SWITCH) {
 			guint32 n;
 			const unsigned short *st;
@@ -3215,6 +3654,35 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 			++sp [-1].data.i;
 			++ip;
 			MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_ADD1_LOC_I4)
+			++* (gint32 *)(locals + * (guint16 *)(ip + 1));
+			ip += 2;
+			MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_SUB1_LOC_I4)
+			--* (gint32 *)(locals + * (guint16 *)(ip + 1));
+			ip += 2;
+			MINT_IN_BREAK;
+#define BINOP_LOC(op) \
+	LOCAL_I4 (1) = LOCAL_I4 (2) op LOCAL_I4 (3); \
+	ip += 4;
+		MINT_IN_CASE(MINT_ADD_I4_LOC) BINOP_LOC(+); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_SUB_I4_LOC) BINOP_LOC(-); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_MUL_I4_LOC) BINOP_LOC(*); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_AND_I4_LOC) BINOP_LOC(&); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_OR_I4_LOC) BINOP_LOC(|); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_XOR_I4_LOC) BINOP_LOC(^); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_MOV_LOC_I4)
+			LOCAL_I4 (1) = LOCAL_I4 (2);
+			ip += 3;
+			MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_MOV_LOC_I8)
+			* (gint64 *)(locals + * (guint16 *)(ip + 1)) = * (gint64 *)(locals + * (guint16 *)(ip + 2));
+			ip += 3;
+			MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_MOV_LOC_P)
+			* (gpointer *)(locals + * (guint16 *)(ip + 1)) = * (gpointer *)(locals + * (guint16 *)(ip + 2));
+			ip += 3;
+			MINT_IN_BREAK;
 		MINT_IN_CASE(MINT_SUB_I4)
 			BINOP(i, -);
 			MINT_IN_BREAK;
@@ -3578,7 +4046,11 @@ ves_exec_method_with_context (MonoInvocation *frame, ThreadContext *context, uns
 
 			g_assert (csig->call_convention == MONO_CALL_DEFAULT);
 
-			ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
+			if (G_UNLIKELY (child_frame.runtime_method->tier_state == TIER_STATE_JIT))
+				/* The ctor returns void, do_jit_call () only overwrites the this arg */
+				do_jit_call (sp + 1 + csig->param_count, vt_sp, context, frame, child_frame.runtime_method);
+			else
+				ves_exec_method_with_context (&child_frame, context, NULL, NULL, -1);
 
 			context->current_frame = frame;
 
@@ -3698,6 +4170,17 @@ array_constructed:
 		MINT_IN_CASE(MINT_LDFLD_O) LDFLD(p, gpointer); MINT_IN_BREAK;
 		MINT_IN_CASE(MINT_LDFLD_P) LDFLD(p, gpointer); MINT_IN_BREAK;
 
+#define LDARGFLD(datamem, fieldtype) \
+	o = * (gpointer *)(frame->args + * (guint16 *)(ip + 1)); \
+	if (!o) \
+		THROW_EX (mono_get_exception_null_reference (), ip); \
+	sp->data.datamem = * (fieldtype *)((char *)o + * (guint16 *)(ip + 2)); \
+	ip += 3; \
+	++sp;
+
+		MINT_IN_CASE(MINT_LDARGFLD_I4) LDARGFLD(i, gint32); MINT_IN_BREAK;
+		MINT_IN_CASE(MINT_LDARGFLD_O) LDARGFLD(p, gpointer); MINT_IN_BREAK;
+
 		MINT_IN_CASE(MINT_LDFLD_VT)
 			o = sp [-1].data.p;
 			if (!o)
@@ -4416,7 +4899,7 @@ array_constructed:
 		MINT_IN_CASE(MINT_ENDFINALLY)
 			ip ++;
 			int clause_index = *ip;
-			if (clause_index == exit_at_finally)
+			if (clause_index == exit_at_finally && frame == entry_frame)
 				goto exit_frame;
 			while (sp > frame->stack) {
 				--sp;
@@ -4909,6 +5392,131 @@ array_constructed:
 	}
 
 	g_assert_not_reached ();
+
+	/*
+	 * Call the method in child_frame without recursing. The state of the caller is
+	 * saved in its frame, and restored when the callee exits.
+	 */
+	call_managed:
+	{
+		MonoInvocation *new_frame;
+		InterpStackMark mark;
+
+		if (G_UNLIKELY (child_frame.runtime_method->tier_state == TIER_STATE_JIT)) {
+			/* Compiled by tier_up_thread (), the args are already in place for do_jit_call () */
+			RuntimeMethod *rmethod = child_frame.runtime_method;
+
+			sp = do_jit_call (child_frame.retval, vt_sp, context, frame, rmethod);
+			if (context->has_resume_state) {
+				if (frame == context->handler_frame)
+					SET_RESUME_STATE (context);
+				else
+					goto exit_frame;
+			}
+			if (rmethod->rtype->type != MONO_TYPE_VOID)
+				sp++;
+			goto main_loop;
+		}
+
+		frame->vt_sp = vt_sp;
+		frame->finally_ips = finally_ips;
+		frame->endfinally_ip = endfinally_ip;
+		finally_ips = NULL;
+		endfinally_ip = NULL;
+
+		interp_stack_mark (context, &mark);
+		new_frame = interp_stack_alloc0 (context, sizeof (MonoInvocation));
+		new_frame->stack_mark = mark;
+		new_frame->parent = frame;
+		new_frame->runtime_method = child_frame.runtime_method;
+		new_frame->retval = child_frame.retval;
+		new_frame->stack_args = child_frame.stack_args;
+		frame = new_frame;
+		context->current_frame = frame;
+		child_frame.parent = frame;
+
+		debug_enter (frame, &tracing);
+
+		if (!frame->runtime_method->transformed) {
+			context->managed_code = 0;
+			do_transform_method (frame, context);
+			if (frame->ex)
+				goto exit_frame;
+		}
+
+		rtm = frame->runtime_method;
+		if (G_UNLIKELY (mono_interp_tier_threshold) && rtm->tier_state < TIER_STATE_QUEUED)
+			tier_up_count_call (rtm);
+		frame->args = interp_stack_alloc0 (context, rtm->alloca_size);
+		ip = rtm->code;
+		sp = frame->stack = (stackval *) ((char *) frame->args + rtm->args_size);
+		vt_sp = (unsigned char *) sp + rtm->stack_size;
+#if DEBUG_INTERP
+		vtalloc = vt_sp;
+#endif
+		locals = vt_sp + rtm->vt_stack_size;
+		frame->locals = locals;
+		goto main_loop;
+	}
+
+	/*
+	 * Return from a frame entered by call_managed to its caller, and finish the call
+	 * opcode at the caller's ip.
+	 */
+	return_to_caller:
+	{
+		MonoInvocation *callee = frame;
+		MonoException *ex = callee->ex;
+		stackval *retval = callee->retval;
+		int call_op;
+
+		sp = callee->stack_args;
+		frame = callee->parent;
+		interp_stack_restore (context, &callee->stack_mark);
+
+		context->current_frame = frame;
+		child_frame.parent = frame;
+		rtm = frame->runtime_method;
+		locals = frame->locals;
+		vt_sp = frame->vt_sp;
+#if DEBUG_INTERP
+		vtalloc = (unsigned char *) frame->stack + rtm->stack_size;
+#endif
+		finally_ips = frame->finally_ips;
+		endfinally_ip = frame->endfinally_ip;
+		call_op = *frame->ip;
+		ip = frame->ip + mono_interp_oplen [call_op];
+
+		if (context->has_resume_state) {
+			if (frame == context->handler_frame)
+				SET_RESUME_STATE (context);
+			else
+				goto exit_frame;
+		}
+
+		if (ex) {
+			/*
+			 * An exception occurred, need to run finally, fault and catch handlers..
+			 */
+			frame->ex = ex;
+			if (call_op == MINT_CALL)
+				goto handle_exception;
+			if ((call_op == MINT_CALLVIRT || call_op == MINT_VCALLVIRT) && context->search_for_handler) {
+				context->search_for_handler = 0;
+				goto handle_exception;
+			}
+			goto handle_finally;
+		}
+
+		/* need to handle typedbyref ... */
+		if (call_op == MINT_CALL || call_op == MINT_CALLVIRT ||
+			(call_op == MINT_CALLI && ((MonoMethodSignature *)rtm->data_items [frame->ip [1]])->ret->type != MONO_TYPE_VOID)) {
+			*sp = *retval;
+			sp++;
+		}
+		goto main_loop;
+	}
+
 	/*
 	 * Exception handling code.
 	 * The exception object is stored in frame->ex.
@@ -5110,6 +5718,10 @@ die_on_ex:
 	}
 exit_frame:
 	DEBUG_LEAVE ();
+	if (frame != entry_frame)
+		goto return_to_caller;
+	interp_stack_restore (context, &stack_mark);
+	interp_stack_clear_popped (context->stack);
 }
 
 void
@@ -5129,6 +5741,7 @@ ves_exec_method (MonoInvocation *frame)
 	}
 	if (context == NULL) {
 		context = &context_struct;
+		memset (context, 0, sizeof (ThreadContext));
 		context_struct.base_frame = frame;
 		context_struct.current_frame = NULL;
 		context_struct.env_frame = frame;
@@ -5169,6 +5782,8 @@ mono_interp_parse_options (const char *options)
 
 		if (strncmp (arg, "jit=", 4) == 0)
 			jit_classes = g_slist_prepend (jit_classes, arg + 4);
+		else if (strncmp (arg, "tier=", 5) == 0)
+			mono_interp_tier_threshold = atoi (arg + 5);
 	}
 }
 
@@ -5178,6 +5793,11 @@ mono_interp_init ()
 	mono_native_tls_alloc (&thread_context_id, NULL);
 	set_context (NULL);
 
+	mono_coop_mutex_init (&tier_up_mutex);
+	mono_counters_register ("Interp: methods tiered up", MONO_COUNTER_JIT | MONO_COUNTER_INT, &interp_tiered_methods);
+	mono_counters_register ("Interp: virtual call IC hits", MONO_COUNTER_JIT | MONO_COUNTER_INT, &interp_ic_hits);
+	mono_counters_register ("Interp: virtual call IC misses", MONO_COUNTER_JIT | MONO_COUNTER_INT, &interp_ic_misses);
+
 	mono_interp_transform_init ();
 }
 
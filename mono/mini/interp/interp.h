@@ -51,6 +51,9 @@ mono_interp_create_trampoline (MonoDomain *domain, MonoMethod *method, MonoError
 void
 mono_interp_parse_options (const char *options);
 
+void
+mono_interp_free_thread_stack (gpointer stack);
+
 void
 interp_walk_stack_with_ctx (MonoInternalStackWalk func, MonoContext *ctx, MonoUnwindOptions options, void *user_data);
 
@@ -59,6 +59,12 @@ mono_interp_dis_mintop(const guint16 *base, const guint16 *ip)
 	case MintOpTwoShorts:
 		g_print (" %u,%u", * (guint16 *)(ip + 1), * (guint16 *)(ip + 2));
 		break;
+	case MintOpThreeShorts:
+		g_print (" %u,%u,%u", * (guint16 *)(ip + 1), * (guint16 *)(ip + 2), * (guint16 *)(ip + 3));
+		break;
+	case MintOpMethodTokenAndCache:
+		g_print (" %u,ic%u", * (guint16 *)(ip + 1), * (guint16 *)(ip + 2));
+		break;
 	case MintOpShortAndInt:
 		g_print (" %u,%u", * (guint16 *)(ip + 1), (guint32)READ32(ip + 2));
 		break;
@@ -95,6 +101,22 @@ mono_interp_dis_mintop(const guint16 *base, const guint16 *ip)
 		target = ip + (gint32)READ32 (ip + 1) - base;
 		g_print (" IL_%04x", target);
 		break;
+	case MintOpShortBranchImm:
+		target = ip + * (short *)(ip + 1) - base;
+		g_print (" %d,IL_%04x", * (short *)(ip + 2), target);
+		break;
+	case MintOpBranchImm:
+		target = ip + (gint32)READ32 (ip + 1) - base;
+		g_print (" %d,IL_%04x", * (short *)(ip + 3), target);
+		break;
+	case MintOpShortBranchTwoShorts:
+		target = ip + * (short *)(ip + 1) - base;
+		g_print (" %u,%u,IL_%04x", * (guint16 *)(ip + 2), * (guint16 *)(ip + 3), target);
+		break;
+	case MintOpBranchTwoShorts:
+		target = ip + (gint32)READ32 (ip + 1) - base;
+		g_print (" %u,%u,IL_%04x", * (guint16 *)(ip + 3), * (guint16 *)(ip + 4), target);
+		break;
 	case MintOpSwitch: {
 		const guint16 *p = ip + 1;
 		int sval = (gint32)READ32 (p);
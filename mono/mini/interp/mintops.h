@@ -20,10 +20,16 @@ typedef enum
 	MintOpShortBranch,
 	MintOpSwitch,
 	MintOpMethodToken,
+	MintOpMethodTokenAndCache,
 	MintOpFieldToken,
 	MintOpClassToken,
 	MintOpTwoShorts,
-	MintOpShortAndInt
+	MintOpShortAndInt,
+	MintOpShortBranchImm,
+	MintOpBranchImm,
+	MintOpThreeShorts,
+	MintOpShortBranchTwoShorts,
+	MintOpBranchTwoShorts
 } MintOpArgType;
 
 #define OPDEF(a,b,c,d) \
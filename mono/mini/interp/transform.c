@@ -16,6 +16,7 @@
 #include <mono/metadata/profiler-private.h>
 #include <mono/metadata/tabledefs.h>
 #include <mono/metadata/seq-points-data.h>
+#include <mono/utils/mono-counters.h>
 
 #include <mono/mini/mini.h>
 
@@ -60,6 +61,8 @@ typedef struct {
 	int target;
 } Reloc;
 
+#define INS_HISTORY_SIZE 3
+
 typedef struct
 {
 	MonoMethod *method;
@@ -78,7 +81,12 @@ typedef struct
 	unsigned short *new_code;
 	unsigned short *new_code_end;
 	unsigned short *new_ip;
-	unsigned short *last_new_ip;
+	/* Offset of the code emitted for the current IL instruction */
+	int new_in_start_offset;
+	/* Code offsets and IL of the last instructions which emitted code, oldest first */
+	int ins_history [INS_HISTORY_SIZE];
+	const unsigned char *ins_history_il [INS_HISTORY_SIZE];
+	int n_ins_history;
 	unsigned int max_code_size;
 	StackInfo *stack;
 	StackInfo *sp;
@@ -146,12 +154,10 @@ static void
 grow_code (TransformData *td)
 {
 	unsigned int old_ip_offset = td->new_ip - td->new_code;
-	unsigned int old_last_ip_offset = td->last_new_ip - td->new_code;
 	g_assert (old_ip_offset <= td->max_code_size);
 	td->new_code = g_realloc (td->new_code, (td->max_code_size *= 2) * sizeof (td->new_code [0]));
 	td->new_code_end = td->new_code + td->max_code_size;
 	td->new_ip = td->new_code + old_ip_offset;
-	td->last_new_ip = td->new_code + old_last_ip_offset;
 }
 
 #define ENSURE_CODE(td, n) \
@@ -237,6 +243,118 @@ one_arg_branch(TransformData *td, int mint_op, int offset)
 	handle_branch (td, short_op, long_op, offset);
 }
 
+static void
+push_ins_history (TransformData *td)
+{
+	/* Drop the instructions replaced by a fused one */
+	while (td->n_ins_history > 0 && td->ins_history [td->n_ins_history - 1] >= td->new_in_start_offset)
+		td->n_ins_history--;
+	if (td->n_ins_history == INS_HISTORY_SIZE) {
+		memmove (td->ins_history, td->ins_history + 1, (INS_HISTORY_SIZE - 1) * sizeof (int));
+		memmove (td->ins_history_il, td->ins_history_il + 1, (INS_HISTORY_SIZE - 1) * sizeof (gpointer));
+		td->n_ins_history--;
+	}
+	td->ins_history [td->n_ins_history] = td->new_in_start_offset;
+	td->ins_history_il [td->n_ins_history] = td->in_start;
+	td->n_ins_history++;
+}
+
+/*
+ * match_ins_history:
+ *
+ *   Check whether the code emitted for the current basic block ends with the N
+ * instructions OPS, and return the code of the first one, or NULL.
+ */
+static unsigned short *
+match_ins_history (TransformData *td, const int *ops, int n)
+{
+	int i, end = td->new_ip - td->new_code;
+
+	if (td->gen_sdb_seq_points || td->is_bb_start [td->in_start - td->il_code] || td->n_ins_history < n)
+		return NULL;
+	for (i = 1; i <= n; ++i) {
+		int offset = td->ins_history [td->n_ins_history - i];
+		int op = ops [n - i];
+
+		if (td->new_code [offset] != op || offset + mono_interp_oplen [op] != end)
+			return NULL;
+		/* The first instruction can start a basic block */
+		if (i < n && td->is_bb_start [td->ins_history_il [td->n_ins_history - i] - td->il_code])
+			return NULL;
+		end = offset;
+	}
+	return td->new_code + end;
+}
+
+/*
+ * get_last_ins:
+ *
+ *   Return the code of the last instruction emitted for the current basic block if
+ * nothing was emitted after it, or NULL.
+ */
+static unsigned short *
+get_last_ins (TransformData *td)
+{
+	unsigned short *last;
+
+	if (td->gen_sdb_seq_points || td->is_bb_start [td->in_start - td->il_code] || td->n_ins_history == 0)
+		return NULL;
+	last = td->new_code + td->ins_history [td->n_ins_history - 1];
+	if (last + mono_interp_oplen [*last] != td->new_ip)
+		return NULL;
+	return last;
+}
+
+/*
+ * get_fused_branch_op:
+ *
+ *   Return the opcode for the int32 branch MINT_OP among the fused branches starting
+ * with FIRST, which follow the order beq, bge, bgt, blt, ble, bne.un. Return -1 if
+ * there is none.
+ */
+static int
+get_fused_branch_op (int mint_op, int first)
+{
+	switch (mint_op) {
+	case MINT_BEQ_I4: return first;
+	case MINT_BGE_I4: return first + 1;
+	case MINT_BGT_I4: return first + 2;
+	case MINT_BLT_I4: return first + 3;
+	case MINT_BLE_I4: return first + 4;
+	case MINT_BNE_UN_I4: return first + 5;
+	default: return -1;
+	}
+}
+
+/*
+ * get_imm_branch_op:
+ *
+ *   If the second operand of the int32 branch MINT_OP was pushed by the constant load
+ * emitted just before it, return the opcode of the branch comparing against an
+ * immediate, and the constant in IMM. Return -1 otherwise.
+ */
+static int
+get_imm_branch_op (TransformData *td, int mint_op, gint16 *imm)
+{
+	int imm_op;
+	unsigned short *last;
+
+	imm_op = get_fused_branch_op (mint_op, MINT_BEQ_I4_IMM);
+	if (imm_op == -1)
+		return -1;
+
+	last = get_last_ins (td);
+	if (!last)
+		return -1;
+	if (last [0] >= MINT_LDC_I4_M1 && last [0] <= MINT_LDC_I4_8)
+		*imm = last [0] - MINT_LDC_I4_0;
+	else if (last [0] == MINT_LDC_I4_S)
+		*imm = (gint16) last [1];
+	else
+		return -1;
+	return imm_op;
+}
+
 static void 
 two_arg_branch(TransformData *td, int mint_op, int offset) 
 {
@@ -244,7 +362,32 @@ two_arg_branch(TransformData *td, int mint_op, int offset)
 	int type2 = td->sp [-2].type == STACK_TYPE_O || td->sp [-2].type == STACK_TYPE_MP ? STACK_TYPE_I : td->sp [-2].type;
 	int long_op = mint_op + type1 - STACK_TYPE_I4;
 	int short_op = long_op + MINT_BEQ_I4_S - MINT_BEQ_I4;
+	static const int ldloc_ops [] = { MINT_LDLOC_I4, MINT_LDLOC_I4 };
+	int imm_op, loc_op;
+	gint16 imm;
+	unsigned short *start;
 	CHECK_STACK(td, 2);
+	if (type1 == STACK_TYPE_I4 && type2 == STACK_TYPE_I4 && (loc_op = get_fused_branch_op (mint_op, MINT_BEQ_I4_LOC)) != -1 &&
+		(start = match_ins_history (td, ldloc_ops, 2))) {
+		/* Compare the two locals directly */
+		guint16 loc1 = start [1], loc2 = start [3];
+		td->new_ip = start;
+		td->new_in_start_offset = td->new_ip - td->new_code;
+		td->sp -= 2;
+		handle_branch (td, loc_op + MINT_BEQ_I4_LOC_S - MINT_BEQ_I4_LOC, loc_op, offset);
+		ADD_CODE(td, loc1);
+		ADD_CODE(td, loc2);
+		return;
+	}
+	if (type1 == STACK_TYPE_I4 && type2 == STACK_TYPE_I4 && (imm_op = get_imm_branch_op (td, mint_op, &imm)) != -1) {
+		/* Replace the constant load with an operand of the branch */
+		td->new_ip = get_last_ins (td);
+		td->new_in_start_offset = td->new_ip - td->new_code;
+		td->sp -= 2;
+		handle_branch (td, imm_op + MINT_BEQ_I4_IMM_S - MINT_BEQ_I4_IMM, imm_op, offset);
+		ADD_CODE(td, imm);
+		return;
+	}
 	if (type1 == STACK_TYPE_I4 && type2 == STACK_TYPE_I8) {
 		ADD_CODE(td, MINT_CONV_I8_I4);
 		td->in_offsets [td->ip - td->il_code]++;
@@ -586,6 +729,7 @@ load_local(TransformData *td, int n)
 	int mt = mint_type (type);
 	int offset = td->rtm->local_offsets [n];
 	MonoClass *klass = NULL;
+	unsigned short *last;
 	if (mt == MINT_TYPE_VT) {
 		klass = mono_class_from_mono_type (type);
 		gint32 size = mono_class_value_size (klass, NULL);
@@ -595,14 +739,11 @@ load_local(TransformData *td, int n)
 		WRITE32(td, &size);
 	} else {
 		g_assert (mt < MINT_TYPE_VT);
-		if (!td->gen_sdb_seq_points &&
-			mt == MINT_TYPE_I4 && !td->is_bb_start [td->in_start - td->il_code] && td->last_new_ip != NULL &&
-			td->last_new_ip [0] == MINT_STLOC_I4 && td->last_new_ip [1] == offset) {
-			td->last_new_ip [0] = MINT_STLOC_NP_I4;
-		} else if (!td->gen_sdb_seq_points &&
-				   mt == MINT_TYPE_O && !td->is_bb_start [td->in_start - td->il_code] && td->last_new_ip != NULL &&
-				   td->last_new_ip [0] == MINT_STLOC_O && td->last_new_ip [1] == offset) {
-			td->last_new_ip [0] = MINT_STLOC_NP_O;
+		last = get_last_ins (td);
+		if (mt == MINT_TYPE_I4 && last && last [0] == MINT_STLOC_I4 && last [1] == offset) {
+			last [0] = MINT_STLOC_NP_I4;
+		} else if (mt == MINT_TYPE_O && last && last [0] == MINT_STLOC_O && last [1] == offset) {
+			last [0] = MINT_STLOC_NP_O;
 		} else {
 			ADD_CODE(td, MINT_LDLOC_I1 + (mt - MINT_TYPE_I1));
 			ADD_CODE(td, offset); /*FIX for large offset */
@@ -613,6 +754,72 @@ load_local(TransformData *td, int n)
 	PUSH_TYPE(td, stack_type[mt], klass);
 }
 
+/*
+ * emit_local_op:
+ *
+ *   Peephole pass for stores to the local at OFFSET. If the value stored was loaded
+ * from another local, or computed from two locals by a simple i4 operation, replace
+ * the loads, the operation and the store with a single superinstruction addressing
+ * the local slots directly. This is done on the stack based code as it is emitted,
+ * there is no separate register IR.
+ */
+static gboolean
+emit_local_op (TransformData *td, int mt, int offset)
+{
+	int ops [3];
+	int op = -1;
+	unsigned short *start;
+	guint16 loc1, loc2;
+
+	if (mt == MINT_TYPE_I4 && td->n_ins_history > 0) {
+		switch (td->new_code [td->ins_history [td->n_ins_history - 1]]) {
+		case MINT_ADD_I4: op = MINT_ADD_I4_LOC; break;
+		case MINT_SUB_I4: op = MINT_SUB_I4_LOC; break;
+		case MINT_MUL_I4: op = MINT_MUL_I4_LOC; break;
+		case MINT_AND_I4: op = MINT_AND_I4_LOC; break;
+		case MINT_OR_I4: op = MINT_OR_I4_LOC; break;
+		case MINT_XOR_I4: op = MINT_XOR_I4_LOC; break;
+		}
+	}
+	if (op != -1) {
+		ops [0] = MINT_LDLOC_I4;
+		ops [1] = MINT_LDLOC_I4;
+		ops [2] = td->new_code [td->ins_history [td->n_ins_history - 1]];
+		start = match_ins_history (td, ops, 3);
+		if (!start)
+			return FALSE;
+		loc1 = start [1];
+		loc2 = start [3];
+		td->new_ip = start;
+		td->new_in_start_offset = td->new_ip - td->new_code;
+		ADD_CODE(td, op);
+		ADD_CODE(td, offset);
+		ADD_CODE(td, loc1);
+		ADD_CODE(td, loc2);
+		return TRUE;
+	}
+
+	switch (mt) {
+	case MINT_TYPE_I4: op = MINT_MOV_LOC_I4; break;
+	case MINT_TYPE_I8:
+	case MINT_TYPE_R8: op = MINT_MOV_LOC_I8; break;
+	case MINT_TYPE_O:
+	case MINT_TYPE_P: op = MINT_MOV_LOC_P; break;
+	default: return FALSE;
+	}
+	ops [0] = MINT_LDLOC_I1 + (mt - MINT_TYPE_I1);
+	start = match_ins_history (td, ops, 1);
+	if (!start)
+		return FALSE;
+	loc1 = start [1];
+	td->new_ip = start;
+	td->new_in_start_offset = td->new_ip - td->new_code;
+	ADD_CODE(td, op);
+	ADD_CODE(td, offset);
+	ADD_CODE(td, loc1);
+	return TRUE;
+}
+
 static void 
 store_local(TransformData *td, int n)
 {
@@ -641,8 +848,10 @@ store_local(TransformData *td, int n)
 			POP_VT(td, size);
 	} else {
 		g_assert (mt < MINT_TYPE_VT);
-		ADD_CODE(td, MINT_STLOC_I1 + (mt - MINT_TYPE_I1));
-		ADD_CODE(td, offset); /*FIX for large offset */
+		if (!emit_local_op (td, mt, offset)) {
+			ADD_CODE(td, MINT_STLOC_I1 + (mt - MINT_TYPE_I1));
+			ADD_CODE(td, offset); /*FIX for large offset */
+		}
 	}
 	--td->sp;
 }
@@ -700,6 +909,210 @@ jit_call_supported (MonoMethod *method, MonoMethodSignature *sig)
 	return FALSE;
 }
 
+static MonoClassField *
+interp_field_from_token (MonoMethod *method, guint32 token, MonoClass **klass, MonoGenericContext *generic_context);
+
+/* Callees with more IL bytes than this are only inlined if marked AggressiveInlining */
+#define INLINE_LENGTH_LIMIT 20
+#define INLINE_AGGRESSIVE_LENGTH_LIMIT 64
+
+static gint32 interp_inlined_methods;
+
+/*
+ * interp_inline_method:
+ *
+ *   Try to emit the body of TARGET_METHOD in place of a call to it. Only straight
+ * line bodies are handled, which load all their args in order or none of them, and
+ * then only load and store instance fields, load constants and return, like
+ * property accessors. Return whenever the call was inlined.
+ */
+static gboolean
+interp_inline_method (TransformData *td, MonoMethod *target_method, MonoMethodHeader *header, MonoMethodSignature *csignature, gboolean virtual)
+{
+	MonoGenericContext *context = target_method->is_inflated ? mono_method_get_context (target_method) : NULL;
+	const unsigned char *ip = header->code;
+	const unsigned char *end = header->code + header->code_size;
+	MonoClassField *fields [INLINE_AGGRESSIVE_LENGTH_LIMIT / 5 + 1];
+	const unsigned char *body;
+	int nargs = csignature->param_count + csignature->hasthis;
+	int i, depth, max_depth, nfields = 0;
+	gboolean this_checked = FALSE;
+
+	if (td->gen_sdb_seq_points || target_method->wrapper_type != MONO_WRAPPER_NONE || header->num_clauses ||
+		(target_method->iflags & METHOD_IMPL_ATTRIBUTE_SYNCHRONIZED) || target_method->klass->marshalbyref)
+		return FALSE;
+	if (header->code_size > ((target_method->iflags & METHOD_IMPL_ATTRIBUTE_AGGRESSIVE_INLINING) ? INLINE_AGGRESSIVE_LENGTH_LIMIT : INLINE_LENGTH_LIMIT))
+		return FALSE;
+
+	/* The args are already on the stack in order, so loading all of them is a nop */
+	for (i = 0; i < nargs && ip < end; ++i, ++ip) {
+		if (i < 4 ? *ip != CEE_LDARG_0 + i : (*ip != CEE_LDARG_S || ip + 1 >= end || ip [1] != i))
+			break;
+		if (i >= 4)
+			++ip;
+	}
+	if (i == 0) {
+		/* Args which are not loaded are popped */
+		for (i = 0; i < csignature->param_count; ++i) {
+			if (mint_type (csignature->params [i]) == MINT_TYPE_VT)
+				return FALSE;
+		}
+		depth = 0;
+	} else if (i == nargs) {
+		/* Valuetypes loaded by the body would need their vt stack space managed */
+		for (i = 0; i < nargs; ++i) {
+			if (td->sp [i - nargs].type == STACK_TYPE_VT)
+				return FALSE;
+		}
+		depth = nargs;
+	} else {
+		return FALSE;
+	}
+	body = ip;
+	max_depth = depth;
+
+	/* Check the rest of the body before emitting anything */
+	while (ip < end) {
+		MonoClassField *field;
+		MonoClass *klass;
+
+		switch (*ip) {
+		case CEE_LDNULL:
+		case CEE_LDC_I4_M1:
+		case CEE_LDC_I4_0:
+		case CEE_LDC_I4_1:
+		case CEE_LDC_I4_2:
+		case CEE_LDC_I4_3:
+		case CEE_LDC_I4_4:
+		case CEE_LDC_I4_5:
+		case CEE_LDC_I4_6:
+		case CEE_LDC_I4_7:
+		case CEE_LDC_I4_8:
+			++depth;
+			++ip;
+			break;
+		case CEE_LDC_I4_S:
+			++depth;
+			ip += 2;
+			break;
+		case CEE_LDC_I4:
+			++depth;
+			ip += 5;
+			break;
+		case CEE_LDFLD:
+		case CEE_STFLD:
+			if (ip + 5 > end || depth < (*ip == CEE_LDFLD ? 1 : 2))
+				return FALSE;
+			field = interp_field_from_token (target_method, read32 (ip + 1), &klass, context);
+			if (!field || (field->type->attrs & FIELD_ATTRIBUTE_STATIC) || klass->marshalbyref || mint_type (field->type) == MINT_TYPE_VT)
+				return FALSE;
+			mono_class_init (klass);
+			fields [nfields++] = field;
+			/* Whenever the object is the bottom of the stack, which is the this arg until then */
+			if (depth == (*ip == CEE_LDFLD ? 1 : 2))
+				this_checked = TRUE;
+			depth -= *ip == CEE_LDFLD ? 0 : 2;
+			ip += 5;
+			break;
+		case CEE_RET:
+			if (ip + 1 != end || depth != (csignature->ret->type == MONO_TYPE_VOID ? 0 : 1))
+				return FALSE;
+			++ip;
+			break;
+		default:
+			return FALSE;
+		}
+		max_depth = MAX (max_depth, depth);
+	}
+	/* The stack of the caller is sized by its own max_stack */
+	if ((td->sp - td->stack) - nargs + max_depth > td->header->max_stack)
+		return FALSE;
+
+	/* A callvirt needs to throw on a null this even if the body does not dereference it */
+	if (virtual && csignature->hasthis && body != header->code && !this_checked && nargs != 1)
+		return FALSE;
+
+	if (td->verbose_level)
+		g_print ("Inline call of %s.%s\n", target_method->klass->name, target_method->name);
+
+	if (body == header->code) {
+		for (i = 0; i < csignature->param_count; i++) {
+			ADD_CODE (td, MINT_POP);
+			ADD_CODE (td, 0);
+		}
+		if (csignature->hasthis) {
+			if (virtual)
+				ADD_CODE (td, MINT_CKNULL);
+			ADD_CODE (td, MINT_POP);
+			ADD_CODE (td, 0);
+		}
+		td->sp -= nargs;
+	} else if (virtual && csignature->hasthis && !this_checked) {
+		/* The this arg is the only one, so it is on the top of the stack */
+		ADD_CODE (td, MINT_CKNULL);
+	}
+
+	ip = body;
+	nfields = 0;
+	while (ip < end) {
+		MonoClassField *field;
+		int mt;
+
+		switch (*ip) {
+		case CEE_LDNULL:
+			ADD_CODE (td, MINT_LDNULL);
+			PUSH_TYPE (td, STACK_TYPE_O, NULL);
+			++ip;
+			break;
+		case CEE_LDC_I4_S:
+			ADD_CODE (td, MINT_LDC_I4_S);
+			ADD_CODE (td, ((gint8 *) ip) [1]);
+			PUSH_SIMPLE_TYPE (td, STACK_TYPE_I4);
+			ip += 2;
+			break;
+		case CEE_LDC_I4: {
+			guint32 val = read32 (ip + 1);
+			ADD_CODE (td, MINT_LDC_I4);
+			WRITE32 (td, &val);
+			PUSH_SIMPLE_TYPE (td, STACK_TYPE_I4);
+			ip += 5;
+			break;
+		}
+		case CEE_LDFLD:
+			field = fields [nfields++];
+			mt = mint_type (field->type);
+			ADD_CODE (td, MINT_LDFLD_I1 + mt - MINT_TYPE_I1);
+			ADD_CODE (td, field->parent->valuetype ? field->offset - sizeof (MonoObject) : field->offset);
+			SET_TYPE (td->sp - 1, stack_type [mt], mono_class_from_mono_type (field->type));
+			ip += 5;
+			break;
+		case CEE_STFLD:
+			field = fields [nfields++];
+			mt = mint_type (field->type);
+			ADD_CODE (td, MINT_STFLD_I1 + mt - MINT_TYPE_I1);
+			ADD_CODE (td, field->parent->valuetype ? field->offset - sizeof (MonoObject) : field->offset);
+			td->sp -= 2;
+			ip += 5;
+			break;
+		case CEE_RET:
+			++ip;
+			break;
+		default:
+			/* ldc.i4.<n> */
+			ADD_CODE (td, MINT_LDC_I4_M1 + (*ip - CEE_LDC_I4_M1));
+			PUSH_SIMPLE_TYPE (td, STACK_TYPE_I4);
+			++ip;
+			break;
+		}
+	}
+	if (csignature->ret->type != MONO_TYPE_VOID) {
+		int mt = mint_type (csignature->ret);
+		SET_TYPE (td->sp - 1, stack_type [mt], mono_class_from_mono_type (csignature->ret));
+	}
+	InterlockedIncrement (&interp_inlined_methods);
+	return TRUE;
+}
+
 static void
 interp_transform_call (TransformData *td, MonoMethod *method, MonoMethod *target_method, MonoDomain *domain, MonoGenericContext *generic_context, unsigned char *is_bb_start, int body_start_offset, MonoClass *constrained_class, gboolean readonly)
 {
@@ -882,6 +1295,7 @@ interp_transform_call (TransformData *td, MonoMethod *method, MonoMethod *target
 		} else {
 			/* mheader might not exist if this is a delegate invoc, etc */
 			if (mheader && *mheader->code == CEE_RET && called_inited) {
+				InterlockedIncrement (&interp_inlined_methods);
 				if (td->verbose_level)
 					g_print ("Inline (empty) call of %s.%s\n", target_method->klass->name, target_method->name);
 				for (i = 0; i < csignature->param_count; i++) {
@@ -898,6 +1312,10 @@ interp_transform_call (TransformData *td, MonoMethod *method, MonoMethod *target
 				td->ip += 5;
 				return;
 			}
+			if (mheader && called_inited && interp_inline_method (td, target_method, mheader, csignature, virtual)) {
+				td->ip += 5;
+				return;
+			}
 		}
 	}
 	if (method->wrapper_type == MONO_WRAPPER_NONE && target_method != NULL) {
@@ -960,9 +1378,13 @@ interp_transform_call (TransformData *td, MonoMethod *method, MonoMethod *target
 
 		if (calli) {
 			ADD_CODE(td, get_data_item_index (td, (void *)csignature));
+			if (native)
+				ADD_CODE(td, get_data_item_index (td, mono_domain_alloc0 (domain, sizeof (gpointer))));
 		} else {
 			ADD_CODE(td, get_data_item_index (td, (void *)mono_interp_get_runtime_method (domain, target_method, &error)));
 			mono_error_cleanup (&error); /* FIXME: don't swallow the error */
+			if (virtual)
+				ADD_CODE(td, get_data_item_index (td, mono_domain_alloc0 (domain, sizeof (InterpInlineCache))));
 		}
 	}
 	td->ip += 5;
@@ -1352,11 +1774,11 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 	MonoClass *klass;
 	MonoClassField *field;
 	const unsigned char *end;
-	int new_in_start_offset;
 	int body_start_offset;
 	int target;
 	guint32 token;
 	TransformData td;
+	unsigned short *last_ins;
 	int generating_code = 1;
 	GArray *line_numbers;
 	MonoDebugMethodInfo *minfo;
@@ -1448,7 +1870,6 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 	}
 
 	td.new_ip = td.new_code;
-	td.last_new_ip = NULL;
 
 	td.stack = g_malloc0 ((header->max_stack + 1) * sizeof (td.stack [0]));
 	td.sp = td.stack;
@@ -1524,7 +1945,7 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 		g_assert (td.vt_sp < 0x10000000);
 		in_offset = td.ip - header->code;
 		td.in_offsets [in_offset] = td.new_ip - td.new_code;
-		new_in_start_offset = td.new_ip - td.new_code;
+		td.new_in_start_offset = td.new_ip - td.new_code;
 		td.in_start = td.ip;
 
 		MonoDebugLineNumberEntry lne;
@@ -1656,8 +2077,27 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 				PUSH_SIMPLE_TYPE(&td, STACK_TYPE_I4);
 			}
 			break;
-		case CEE_LDC_I4_1:
-			if (!td.is_bb_start[td.ip + 1 - td.il_code] && 
+		case CEE_LDC_I4_1: {
+			int stloc_len = 0;
+			int n = -1;
+
+			if (td.ip + 2 < end && !td.is_bb_start [td.ip + 2 - td.il_code]) {
+				if (td.ip [2] >= CEE_STLOC_0 && td.ip [2] <= CEE_STLOC_3) {
+					n = td.ip [2] - CEE_STLOC_0;
+					stloc_len = 1;
+				} else if (td.ip [2] == CEE_STLOC_S && td.ip + 3 < end) {
+					n = td.ip [3];
+					stloc_len = 2;
+				}
+			}
+			if (n != -1 && !td.is_bb_start [td.ip + 1 - td.il_code] && (td.ip [1] == CEE_ADD || td.ip [1] == CEE_SUB) &&
+				(last_ins = get_last_ins (&td)) && last_ins [0] == MINT_LDLOC_I4 && last_ins [1] == td.rtm->local_offsets [n]) {
+				/* ldloc.x, ldc.i4.1, add/sub, stloc.x */
+				last_ins [0] = td.ip [1] == CEE_ADD ? MINT_ADD1_LOC_I4 : MINT_SUB1_LOC_I4;
+				td.new_in_start_offset = last_ins - td.new_code;
+				--td.sp;
+				td.ip += 2 + stloc_len;
+			} else if (!td.is_bb_start[td.ip + 1 - td.il_code] && 
 				(td.ip [1] == CEE_ADD || td.ip [1] == CEE_SUB) && td.sp [-1].type == STACK_TYPE_I4) {
 				ADD_CODE(&td, td.ip [1] == CEE_ADD ? MINT_ADD1_I4 : MINT_SUB1_I4);
 				td.ip += 2;
@@ -1666,6 +2106,7 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 				PUSH_SIMPLE_TYPE(&td, STACK_TYPE_I4);
 			}
 			break;
+		}
 		case CEE_LDC_I4_2:
 		case CEE_LDC_I4_3:
 		case CEE_LDC_I4_4:
@@ -2613,6 +3054,12 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 					ADD_CODE (&td, 0);
 					ADD_CODE (&td, mt == MINT_TYPE_VT ? MINT_LDSFLD_VT : MINT_LDSFLD);
 					ADD_CODE (&td, get_data_item_index (&td, field));
+				} else if ((mt == MINT_TYPE_I4 || mt == MINT_TYPE_O) &&
+						   (last_ins = get_last_ins (&td)) && (last_ins [0] == MINT_LDARG_O || last_ins [0] == MINT_LDARG_P)) {
+					/* ldarg + ldfld */
+					last_ins [0] = mt == MINT_TYPE_I4 ? MINT_LDARGFLD_I4 : MINT_LDARGFLD_O;
+					ADD_CODE (&td, klass->valuetype ? field->offset - sizeof(MonoObject) : field->offset);
+					td.new_in_start_offset = last_ins - td.new_code;
 				} else {
 					ADD_CODE (&td, MINT_LDFLD_I1 + mt - MINT_TYPE_I1);
 					ADD_CODE (&td, klass->valuetype ? field->offset - sizeof(MonoObject) : field->offset);
@@ -3840,8 +4287,8 @@ generate (MonoMethod *method, RuntimeMethod *rtm, unsigned char *is_bb_start, Mo
 			g_error ("transform.c: Unimplemented opcode: %02x at 0x%x\n", *td.ip, td.ip-header->code);
 		}
 
-		if (td.new_ip - td.new_code != new_in_start_offset) 
-			td.last_new_ip = td.new_code + new_in_start_offset;
+		if (td.new_ip - td.new_code != td.new_in_start_offset)
+			push_ins_history (&td);
 		else if (td.is_bb_start [td.in_start - td.il_code])
 			td.is_bb_start [td.ip - td.il_code] = 1;
 			
@@ -3965,6 +4412,8 @@ void
 mono_interp_transform_init (void)
 {
 	mono_os_mutex_init_recursive(&calc_section);
+
+	mono_counters_register ("Interp: inlined methods", MONO_COUNTER_JIT | MONO_COUNTER_INT, &interp_inlined_methods);
 }
 
 MonoException *
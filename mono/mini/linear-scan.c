@@ -281,6 +281,71 @@ regalloc_cost (MonoCompile *cfg, MonoMethodVar *vmv)
 	return (ins->opcode == OP_ARG) ? 1 : 0;
 }
 
+/*
+ * assign_regvars:
+ *
+ *   Turn the variables in VARS which were allocated to a register, and whose
+ * register has a positive gain, into OP_REGVAR variables. During allocation,
+ * vmv->reg is an index into the REGS list.
+ */
+static void
+assign_regvars (MonoCompile *cfg, GList *vars, GList *regs, gint32 *gains, int n_regs, regmask_t *used_mask)
+{
+	GList *l;
+	MonoMethodVar *vmv;
+	regmask_t used_regs = 0;
+	int n_regvars, i;
+
+	/* Decrease the gains by the cost of saving+restoring the register */
+	for (i = 0; i < n_regs; ++i) {
+		if (gains [i]) {
+			/* FIXME: This is x86 only */
+			gains [i] -= cfg->method->save_lmf ? 1 : 2;
+			if (gains [i] < 0)
+				gains [i] = 0;
+		}
+	}
+
+	/* Do the actual register assignment */
+	n_regvars = 0;
+	for (l = vars; l; l = l->next) {
+		vmv = (MonoMethodVar *)l->data;
+
+		if (vmv->reg >= 0) {
+			int reg_index = vmv->reg;
+
+			/* During allocation, vmv->reg is an index into the regs list */
+			vmv->reg = GPOINTER_TO_INT (g_list_nth_data (regs, vmv->reg));
+
+			if ((gains [reg_index] > regalloc_cost (cfg, vmv)) && (cfg->varinfo [vmv->idx]->opcode != OP_REGVAR)) {
+				if (cfg->verbose_level > 2)
+					printf ("REGVAR R%d G%d C%d %s\n", cfg->varinfo [vmv->idx]->dreg, gains [reg_index], regalloc_cost (cfg, vmv), mono_arch_regname (vmv->reg));
+				cfg->varinfo [vmv->idx]->opcode = OP_REGVAR;
+				cfg->varinfo [vmv->idx]->dreg = vmv->reg;
+				n_regvars ++;
+			}
+			else {
+				if (cfg->verbose_level > 2)
+					printf ("COSTLY: %s R%d G%d C%d %s\n", mono_method_full_name (cfg->method, TRUE), cfg->varinfo [vmv->idx]->dreg, gains [reg_index], regalloc_cost (cfg, vmv), mono_arch_regname (vmv->reg));
+				vmv->reg = -1;
+			}
+		}
+	}
+
+	cfg->stat_n_regvars = n_regvars;
+
+	/* Compute used regs */
+	used_regs = 0;
+	for (l = vars; l; l = l->next) {
+		vmv = (MonoMethodVar *)l->data;
+		
+		if (vmv->reg >= 0)
+			used_regs |= 1LL << vmv->reg;
+	}
+
+	*used_mask |= used_regs;
+}
+
 void
 mono_linear_scan2 (MonoCompile *cfg, GList *vars, GList *regs, regmask_t *used_mask)
 {
@@ -288,8 +353,7 @@ mono_linear_scan2 (MonoCompile *cfg, GList *vars, GList *regs, regmask_t *used_m
 	MonoMethodVar *vmv;
 	gint32 free_pos [sizeof (regmask_t) * 8];
 	gint32 gains [sizeof (regmask_t) * 8];
-	regmask_t used_regs = 0;
-	int n_regs, n_regvars, i;
+	int n_regs, i;
 
 	for (l = vars; l; l = l->next) {
 		vmv = (MonoMethodVar *)l->data;
@@ -461,57 +525,176 @@ mono_linear_scan2 (MonoCompile *cfg, GList *vars, GList *regs, regmask_t *used_m
 		}
 	}
 
-	/* Decrease the gains by the cost of saving+restoring the register */
-	for (i = 0; i < n_regs; ++i) {
-		if (gains [i]) {
-			/* FIXME: This is x86 only */
-			gains [i] -= cfg->method->save_lmf ? 1 : 2;
-			if (gains [i] < 0)
-				gains [i] = 0;
-		}
+	assign_regvars (cfg, vars, regs, gains, n_regs, used_mask);
+
+	g_list_free (active);
+	g_list_free (inactive);
+}
+
+/* Methods with more variables than this are allocated using linear scan */
+#define MAX_COLORING_VARS 1024
+
+static inline gboolean
+intervals_interfere (MonoLiveInterval *i1, MonoLiveInterval *i2)
+{
+	if (i1->last_range->to <= i2->range->from || i2->last_range->to <= i1->range->from)
+		return FALSE;
+	return mono_linterval_get_intersect_pos (i1, i2) != -1;
+}
+
+/**
+ * mono_graph_coloring:
+ *
+ *   Allocate the global int registers in REGS to the variables in VARS by coloring
+ * their interference graph (Chaitin-Briggs). Two variables interfere only if their
+ * live intervals intersect, so a variable whose interval has a hole can share a
+ * register with the variables living inside the hole. When the graph is not
+ * colorable, the variable with the lowest spill cost per interference is picked
+ * for spilling, optimistically, since it may still receive a color. The spill costs
+ * are scaled by the loop nesting level, so the variables used in hot loops keep
+ * their registers, instead of the ones which happen to start first, like in
+ * mono_linear_scan2 ().
+ * Frees VARS and REGS.
+ */
+void
+mono_graph_coloring (MonoCompile *cfg, GList *vars, GList *regs, regmask_t *used_mask)
+{
+	MonoMethodVar **nodes;
+	MonoBitSet **adj;
+	GList *l;
+	gint32 gains [sizeof (regmask_t) * 8];
+	int *degree, *stack, *color;
+	gboolean *removed;
+	regmask_t used_colors = 0;
+	int n, n_regs, i, j, sp;
+
+	n = g_list_length (vars);
+	if (!vars || !regs || !((MonoMethodVar*)vars->data)->interval || cfg->disable_reuse_registers || n > MAX_COLORING_VARS) {
+		mono_linear_scan (cfg, vars, regs, used_mask);
+		return;
 	}
 
-	/* Do the actual register assignment */
-	n_regvars = 0;
-	for (l = vars; l; l = l->next) {
-		vmv = (MonoMethodVar *)l->data;
+	n_regs = g_list_length (regs);
+	g_assert (n_regs <= G_N_ELEMENTS (gains));
+	memset (gains, 0, sizeof (gains));
 
-		if (vmv->reg >= 0) {
-			int reg_index = vmv->reg;
+	nodes = g_new0 (MonoMethodVar*, n);
+	i = 0;
+	for (l = vars; l; l = l->next) {
+		MonoMethodVar *vmv = (MonoMethodVar *)l->data;
 
-			/* During allocation, vmv->reg is an index into the regs list */
-			vmv->reg = GPOINTER_TO_INT (g_list_nth_data (regs, vmv->reg));
+		vmv->reg = -1;
+		if (vmv->interval->range)
+			nodes [i ++] = vmv;
+	}
+	n = i;
+
+	/* Build the interference graph */
+	adj = g_new0 (MonoBitSet*, n);
+	degree = g_new0 (int, n);
+	for (i = 0; i < n; ++i)
+		adj [i] = mono_bitset_new (n, 0);
+	for (i = 0; i < n; ++i) {
+		for (j = 0; j < i; ++j) {
+			if (intervals_interfere (nodes [i]->interval, nodes [j]->interval)) {
+				mono_bitset_set_fast (adj [i], j);
+				mono_bitset_set_fast (adj [j], i);
+				degree [i] ++;
+				degree [j] ++;
+			}
+		}
+	}
 
-			if ((gains [reg_index] > regalloc_cost (cfg, vmv)) && (cfg->varinfo [vmv->idx]->opcode != OP_REGVAR)) {
-				if (cfg->verbose_level > 2)
-					printf ("REGVAR R%d G%d C%d %s\n", cfg->varinfo [vmv->idx]->dreg, gains [reg_index], regalloc_cost (cfg, vmv), mono_arch_regname (vmv->reg));
-				cfg->varinfo [vmv->idx]->opcode = OP_REGVAR;
-				cfg->varinfo [vmv->idx]->dreg = vmv->reg;
-				n_regvars ++;
+	/* Simplify */
+	removed = g_new0 (gboolean, n);
+	stack = g_new0 (int, n);
+	sp = 0;
+	while (sp < n) {
+		int best = -1;
+		double best_metric = 0;
+
+		for (i = 0; i < n; ++i) {
+			if (!removed [i] && degree [i] < n_regs) {
+				best = i;
+				break;
 			}
-			else {
-				if (cfg->verbose_level > 2)
-					printf ("COSTLY: %s R%d G%d C%d %s\n", mono_method_full_name (cfg->method, TRUE), cfg->varinfo [vmv->idx]->dreg, gains [reg_index], regalloc_cost (cfg, vmv), mono_arch_regname (vmv->reg));
-				vmv->reg = -1;
+		}
+		if (best == -1) {
+			/* Potential spill */
+			for (i = 0; i < n; ++i) {
+				double metric;
+
+				if (removed [i])
+					continue;
+				metric = (double)nodes [i]->spill_costs / degree [i];
+				if (best == -1 || metric < best_metric) {
+					best = i;
+					best_metric = metric;
+				}
 			}
+			if (cfg->verbose_level > 2)
+				printf ("GCOLOR: spill candidate R%d C%d D%d\n", cfg->varinfo [nodes [best]->idx]->dreg, nodes [best]->spill_costs, degree [best]);
+		}
+
+		removed [best] = TRUE;
+		stack [sp ++] = best;
+		for (j = 0; j < n; ++j) {
+			if (!removed [j] && mono_bitset_test_fast (adj [best], j))
+				degree [j] --;
 		}
 	}
 
-	cfg->stat_n_regvars = n_regvars;
+	/* Select */
+	color = g_new (int, n);
+	for (i = 0; i < n; ++i)
+		color [i] = -1;
+	while (sp > 0) {
+		regmask_t busy = 0;
+		int c = -1;
+
+		i = stack [-- sp];
+		for (j = 0; j < n; ++j) {
+			if (color [j] >= 0 && mono_bitset_test_fast (adj [i], j))
+				busy |= (regmask_t)1 << color [j];
+		}
+		/* Prefer registers already in use, to avoid saving another callee saved register */
+		for (j = 0; j < n_regs; ++j) {
+			if (!(busy & ((regmask_t)1 << j)) && (used_colors & ((regmask_t)1 << j))) {
+				c = j;
+				break;
+			}
+		}
+		if (c == -1) {
+			for (j = 0; j < n_regs; ++j) {
+				if (!(busy & ((regmask_t)1 << j))) {
+					c = j;
+					break;
+				}
+			}
+		}
 
-	/* Compute used regs */
-	used_regs = 0;
-	for (l = vars; l; l = l->next) {
-		vmv = (MonoMethodVar *)l->data;
-		
-		if (vmv->reg >= 0)
-			used_regs |= 1LL << vmv->reg;
+		color [i] = c;
+		if (c >= 0) {
+			used_colors |= (regmask_t)1 << c;
+			nodes [i]->reg = c;
+			gains [c] += nodes [i]->spill_costs;
+		} else if (cfg->verbose_level > 2) {
+			printf ("GCOLOR: spilled R%d C%d\n", cfg->varinfo [nodes [i]->idx]->dreg, nodes [i]->spill_costs);
+		}
 	}
 
-	*used_mask |= used_regs;
+	assign_regvars (cfg, vars, regs, gains, n_regs, used_mask);
 
-	g_list_free (active);
-	g_list_free (inactive);
+	for (i = 0; i < n; ++i)
+		mono_bitset_free (adj [i]);
+	g_free (adj);
+	g_free (degree);
+	g_free (removed);
+	g_free (stack);
+	g_free (color);
+	g_free (nodes);
+	g_list_free (regs);
+	g_list_free (vars);
 }
 
 #else /* !DISABLE_JIT */
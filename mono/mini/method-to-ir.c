@@ -3722,8 +3722,6 @@ handle_alloc (MonoCompile *cfg, MonoClass *klass, gboolean for_box, int context_
 		return mono_emit_jit_icall (cfg, mono_helper_newobj_mscorlib, iargs);
 	} else {
 		MonoVTable *vtable = mono_class_vtable (cfg->domain, klass);
-		MonoMethod *managed_alloc = NULL;
-		gboolean pass_lw;
 
 		if (!vtable) {
 			mono_cfg_set_exception (cfg, MONO_EXCEPTION_TYPE_LOAD);
@@ -3731,27 +3729,65 @@ handle_alloc (MonoCompile *cfg, MonoClass *klass, gboolean for_box, int context_
 			return NULL;
 		}
 
-		managed_alloc = mono_gc_get_managed_allocator (klass, for_box, TRUE);
+		if ((cfg->opt & MONO_OPT_ESCAPE) && !for_box && !cfg->cbb->out_of_line && mono_escape_analysis_is_candidate (cfg, klass)) {
+			MonoInst *ins;
 
-		if (managed_alloc) {
-			int size = mono_class_instance_size (klass);
-			if (size < sizeof (MonoObject))
-				g_error ("Invalid size %d for class %s", size, mono_type_get_full_name (klass));
+			/* Decompose later since it is needed by escape analysis */
+			MONO_INST_NEW (cfg, ins, OP_NEWOBJ);
+			ins->dreg = alloc_ireg_ref (cfg);
+			ins->inst_p0 = vtable;
+			ins->type = STACK_OBJ;
+			ins->klass = klass;
+			MONO_ADD_INS (cfg->cbb, ins);
+			cfg->flags |= MONO_CFG_HAS_ARRAY_ACCESS;
+			cfg->cbb->has_array_access = TRUE;
 
-			EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
-			EMIT_NEW_ICONST (cfg, iargs [1], size);
-			return mono_emit_method_call (cfg, managed_alloc, iargs, NULL);
-		}
-		alloc_ftn = mono_class_get_allocation_ftn (vtable, for_box, &pass_lw);
-		if (pass_lw) {
-			guint32 lw = vtable->klass->instance_size;
-			lw = ((lw + (sizeof (gpointer) - 1)) & ~(sizeof (gpointer) - 1)) / sizeof (gpointer);
-			EMIT_NEW_ICONST (cfg, iargs [0], lw);
-			EMIT_NEW_VTABLECONST (cfg, iargs [1], vtable);
-		}
-		else {
-			EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
+			/* Needed so mono_emit_load_get_addr () gets called */
+			mono_get_got_var (cfg);
+			return ins;
 		}
+
+		return mini_emit_alloc_vtable (cfg, vtable, for_box);
+	}
+
+	return mono_emit_jit_icall (cfg, alloc_ftn, iargs);
+}
+
+/*
+ * mini_emit_alloc_vtable:
+ *
+ *   Emit a call which allocates an instance of VTABLE->klass, using the managed
+ * allocator if the GC provides one.
+ */
+MonoInst*
+mini_emit_alloc_vtable (MonoCompile *cfg, MonoVTable *vtable, gboolean for_box)
+{
+	MonoClass *klass = vtable->klass;
+	MonoInst *iargs [2];
+	MonoMethod *managed_alloc;
+	void *alloc_ftn;
+	gboolean pass_lw;
+
+	managed_alloc = mono_gc_get_managed_allocator (klass, for_box, TRUE);
+
+	if (managed_alloc) {
+		int size = mono_class_instance_size (klass);
+		if (size < sizeof (MonoObject))
+			g_error ("Invalid size %d for class %s", size, mono_type_get_full_name (klass));
+
+		EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
+		EMIT_NEW_ICONST (cfg, iargs [1], size);
+		return mono_emit_method_call (cfg, managed_alloc, iargs, NULL);
+	}
+	alloc_ftn = mono_class_get_allocation_ftn (vtable, for_box, &pass_lw);
+	if (pass_lw) {
+		guint32 lw = vtable->klass->instance_size;
+		lw = ((lw + (sizeof (gpointer) - 1)) & ~(sizeof (gpointer) - 1)) / sizeof (gpointer);
+		EMIT_NEW_ICONST (cfg, iargs [0], lw);
+		EMIT_NEW_VTABLECONST (cfg, iargs [1], vtable);
+	}
+	else {
+		EMIT_NEW_VTABLECONST (cfg, iargs [0], vtable);
 	}
 
 	return mono_emit_jit_icall (cfg, alloc_ftn, iargs);
@@ -5975,8 +6011,8 @@ check_inline_caller_method_name_limit (MonoMethod *caller_method)
 }
 #endif
 
-static void
-emit_init_rvar (MonoCompile *cfg, int dreg, MonoType *rtype)
+void
+mini_emit_init_rvar (MonoCompile *cfg, int dreg, MonoType *rtype)
 {
 	static double r8_0 = 0.0;
 	static float r4_0 = 0.0;
@@ -6038,7 +6074,7 @@ emit_dummy_init_rvar (MonoCompile *cfg, int dreg, MonoType *rtype)
 	} else if (((t == MONO_TYPE_VAR) || (t == MONO_TYPE_MVAR)) && mini_type_var_is_vt (rtype)) {
 		MONO_EMIT_NEW_DUMMY_INIT (cfg, dreg, OP_DUMMY_VZERO);
 	} else {
-		emit_init_rvar (cfg, dreg, rtype);
+		mini_emit_init_rvar (cfg, dreg, rtype);
 	}
 }
 
@@ -6050,11 +6086,11 @@ emit_init_local (MonoCompile *cfg, int local, MonoType *type, gboolean init)
 	if (COMPILE_SOFT_FLOAT (cfg)) {
 		MonoInst *store;
 		int reg = alloc_dreg (cfg, (MonoStackType)var->type);
-		emit_init_rvar (cfg, reg, type);
+		mini_emit_init_rvar (cfg, reg, type);
 		EMIT_NEW_LOCSTORE (cfg, store, local, cfg->cbb->last_ins);
 	} else {
 		if (init)
-			emit_init_rvar (cfg, var->dreg, type);
+			mini_emit_init_rvar (cfg, var->dreg, type);
 		else
 			emit_dummy_init_rvar (cfg, var->dreg, type);
 	}
@@ -6245,7 +6281,7 @@ inline_method (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig,
 					if (bb->last_ins && bb->last_ins->opcode == OP_NOT_REACHED) {
 						cfg->cbb = bb;
 
-						emit_init_rvar (cfg, rvar->dreg, fsig->ret);
+						mini_emit_init_rvar (cfg, rvar->dreg, fsig->ret);
 					}
 				}
 			}
@@ -6259,7 +6295,7 @@ inline_method (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig,
 			 * set, so set it to a dummy value.
 			 */
 			if (!ret_var_set)
-				emit_init_rvar (cfg, rvar->dreg, fsig->ret);
+				mini_emit_init_rvar (cfg, rvar->dreg, fsig->ret);
 
 			EMIT_NEW_TEMPLOAD (cfg, ins, rvar->inst_c0);
 			*sp++ = ins;
@@ -6321,6 +6357,28 @@ ip_in_bb (MonoCompile *cfg, MonoBasicBlock *bb, const guint8* ip)
 	return b == NULL || b == bb;
 }
 
+/*
+ * mark_cold_bblocks:
+ *
+ *   Mark the bblocks which were never executed according to the AOT profile data as
+ * out of line, so they are moved to the end of the method like throw blocks.
+ */
+static void
+mark_cold_bblocks (MonoCompile *cfg, MonoMethodHeader *header)
+{
+	MonoBasicBlock *bb;
+	guint32 i;
+
+	for (i = 0; i < header->code_size; ++i) {
+		bb = cfg->cil_offset_to_bb [i];
+		if (bb && bb->cil_code == header->code + i && !bb->out_of_line && mono_aot_is_cold_il_offset (cfg->method, i)) {
+			if (cfg->verbose_level > 2)
+				printf ("BB%d at IL_%04x is cold.\n", bb->block_num, i);
+			bb->out_of_line = 1;
+		}
+	}
+}
+
 static int
 get_basic_blocks (MonoCompile *cfg, MonoMethodHeader* header, guint real_offset, unsigned char *start, unsigned char *end, unsigned char **pos)
 {
@@ -7556,6 +7614,9 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 		UNVERIFIED;
 	}
 
+	if (cfg->compile_aot && cfg->method == method && !cfg->disable_out_of_line_bblocks)
+		mark_cold_bblocks (cfg, header);
+
 	if (cfg->method == method)
 		mono_debug_init_method (cfg, cfg->cbb, breakpoint_id);
 
@@ -9919,7 +9980,7 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 			} else {
 				if (cmethod->klass->valuetype) {
 					iargs [0] = mono_compile_create_var (cfg, &cmethod->klass->byval_arg, OP_LOCAL);
-					emit_init_rvar (cfg, iargs [0]->dreg, &cmethod->klass->byval_arg);
+					mini_emit_init_rvar (cfg, iargs [0]->dreg, &cmethod->klass->byval_arg);
 					EMIT_NEW_TEMPLOADA (cfg, *sp, iargs [0]->inst_c0);
 
 					alloc = NULL;
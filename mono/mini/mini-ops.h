@@ -705,6 +705,8 @@ MINI_OP(OP_ROUND,   "round", FREG, FREG, NONE)
 /* to optimize strings */
 MINI_OP(OP_STRLEN, "strlen", IREG, IREG, NONE)
 MINI_OP(OP_NEWARR, "newarr", IREG, IREG, NONE)
+/* object allocation, decomposed late so escape analysis can remove it */
+MINI_OP(OP_NEWOBJ, "newobj", IREG, NONE, NONE)
 MINI_OP(OP_LDLEN, "ldlen", IREG, IREG, NONE)
 MINI_OP(OP_BOUNDS_CHECK, "bounds_check", NONE, IREG, IREG)
 /* type checks */
@@ -117,6 +117,12 @@ gboolean mono_use_llvm = FALSE;
 
 gboolean mono_use_interpreter = FALSE;
 
+/*
+ * This flag controls whenever loops over arrays are vectorized when the simd
+ * optimization is enabled, see simd-vectorize.c.
+ */
+gboolean mono_do_vectorize = FALSE;
+
 #define mono_jit_lock() mono_os_mutex_lock (&jit_mutex)
 #define mono_jit_unlock() mono_os_mutex_unlock (&jit_mutex)
 static mono_mutex_t jit_mutex;
@@ -941,6 +947,10 @@ free_jit_tls_data (MonoJitTlsData *jit_tls)
 	mono_arch_free_jit_tls_data (jit_tls);
 	mono_free_altstack (jit_tls);
 
+#ifdef ENABLE_INTERPRETER
+	mono_interp_free_thread_stack (jit_tls->interp_stack);
+#endif
+
 	g_free (jit_tls->first_lmf);
 	g_free (jit_tls);
 }
@@ -3550,7 +3560,12 @@ register_jit_stats (void)
 	mono_counters_register ("JIT/ssa_compute (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_ssa_compute);
 	mono_counters_register ("JIT/ssa_cprop (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_ssa_cprop);
 	mono_counters_register ("JIT/ssa_deadce(sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_ssa_deadce);
+	mono_counters_register ("JIT/simd_vectorize_loops (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_simd_vectorize_loops);
+	mono_counters_register ("JIT/abc_loop_versioning (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_abc_loop_versioning);
 	mono_counters_register ("JIT/perform_abc_removal (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_perform_abc_removal);
+	mono_counters_register ("JIT/escape_analysis (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_escape_analysis);
+	mono_counters_register ("JIT/ssa_strength_reduction (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_ssa_strength_reduction);
+	mono_counters_register ("JIT/ssa_licm (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_ssa_licm);
 	mono_counters_register ("JIT/ssa_remove (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_ssa_remove);
 	mono_counters_register ("JIT/local_cprop2 (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_local_cprop2);
 	mono_counters_register ("JIT/handle_global_vregs2 (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_handle_global_vregs2);
@@ -3588,6 +3603,15 @@ register_jit_stats (void)
 	mono_counters_register ("Aliased loads eliminated", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.loads_eliminated);
 	mono_counters_register ("Aliased stores eliminated", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.stores_eliminated);
 	mono_counters_register ("Optimized immediate divisions", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.optimized_divisions);
+	mono_counters_register ("Escape analysis candidates", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.escape_candidates);
+	mono_counters_register ("Objects scalar replaced", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.objects_scalar_replaced);
+	mono_counters_register ("Fields scalar replaced", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.fields_scalar_replaced);
+	mono_counters_register ("Loop invariant instructions hoisted", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.licm_hoisted);
+	mono_counters_register ("Induction variables strength reduced", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.ivs_strength_reduced);
+	mono_counters_register ("Bounds checks removed", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.abc_checks_removed);
+	mono_counters_register ("Bounds checks remaining", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.abc_checks_remaining);
+	mono_counters_register ("Loops versioned for bounds checks", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.abc_loops_versioned);
+	mono_counters_register ("Loops vectorized", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.loops_vectorized);
 }
 
 static void runtime_invoke_info_free (gpointer value);
@@ -3622,7 +3646,7 @@ mini_create_jit_domain_info (MonoDomain *domain)
 	info->seq_points = g_hash_table_new_full (mono_aligned_addr_hash, NULL, NULL, mono_seq_point_info_free);
 	info->arch_seq_points = g_hash_table_new (mono_aligned_addr_hash, NULL);
 	info->jump_target_hash = g_hash_table_new (NULL, NULL);
-	mono_jit_code_hash_init (&info->interp_code_hash);
+	info->interp_code_hash = mono_conc_hashtable_new (mono_aligned_addr_hash, NULL);
 
 	domain->runtime_info = info;
 }
@@ -3701,7 +3725,7 @@ mini_free_jit_domain_info (MonoDomain *domain)
 		g_hash_table_foreach (info->llvm_jit_callees, free_jit_callee_list, NULL);
 		g_hash_table_destroy (info->llvm_jit_callees);
 	}
-	mono_internal_hash_table_destroy (&info->interp_code_hash);
+	mono_conc_hashtable_destroy (info->interp_code_hash);
 #ifdef ENABLE_LLVM
 	mono_llvm_free_domain_info (domain);
 #endif
@@ -4374,6 +4398,8 @@ mini_cleanup (MonoDomain *domain)
 	/* This accesses metadata so needs to be called before runtime shutdown */
 	print_jit_stats ();
 
+	mono_aot_shutdown ();
+
 #ifndef MONO_CROSS_COMPILE
 	mono_runtime_cleanup (domain);
 #endif
@@ -1950,6 +1950,8 @@ mono_destroy_compile (MonoCompile *cfg)
 	g_free (cfg->varinfo);
 	g_free (cfg->vars);
 	g_free (cfg->exception_message);
+	g_free (cfg->aot_debug_info);
+	g_free (cfg->aot_unwind_info);
 	g_free (cfg);
 }
 
@@ -2433,6 +2435,31 @@ static void mono_bb_ordering (MonoCompile *cfg)
 	}
 }
 
+/*
+ * recompute_loop_info:
+ *
+ *   Recompute the bblock ordering, the dominators and the loop info after the CFG
+ * has been changed by loop versioning.
+ */
+static void
+recompute_loop_info (MonoCompile *cfg)
+{
+	MonoBasicBlock *bb;
+
+	mono_free_loop_info (cfg);
+	cfg->comp_done &= ~MONO_COMP_DOM;
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		bb->dfn = 0;
+		bb->df_parent = NULL;
+		bb->loop_body_start = 0;
+	}
+	/* New bblocks are numbered from max_block_num */
+	cfg->num_bblocks = cfg->max_block_num;
+	mono_bb_ordering (cfg);
+	mono_compile_dominator_info (cfg, MONO_COMP_DOM | MONO_COMP_IDOM);
+	mono_compute_natural_loops (cfg);
+}
+
 static void
 mono_handle_out_of_line_bblock (MonoCompile *cfg)
 {
@@ -3184,6 +3211,9 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 	/* coop requires loop detection to happen */
 	if (mono_threads_is_coop_enabled ())
 		cfg->opt |= MONO_OPT_LOOP;
+	/* licm needs the loop structure */
+	if (cfg->opt & MONO_OPT_LICM)
+		cfg->opt |= MONO_OPT_LOOP;
 	cfg->explicit_null_checks = debug_options.explicit_null_checks || (flags & JIT_FLAG_EXPLICIT_NULL_CHECKS);
 	cfg->soft_breakpoints = debug_options.soft_breakpoints;
 	cfg->check_pinvoke_callconv = debug_options.check_pinvoke_callconv;
@@ -3398,7 +3428,7 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 		g_free (method_name);
 	}
 
-	if (cfg->opt & MONO_OPT_ABCREM)
+	if (cfg->opt & (MONO_OPT_ABCREM | MONO_OPT_ESCAPE | MONO_OPT_LICM))
 		cfg->opt |= MONO_OPT_SSA;
 
 	cfg->rs = mono_regstate_new ();
@@ -3584,6 +3614,28 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 		MONO_TIME_TRACK (mono_jit_stats.jit_compute_natural_loops, mono_compute_natural_loops (cfg));
 	}
 
+#ifdef MONO_ARCH_SIMD_INTRINSICS
+	if (mono_do_vectorize && (cfg->opt & MONO_OPT_SIMD) && (cfg->comp_done & MONO_COMP_LOOPS) && (cfg->flags & MONO_CFG_HAS_LDELEMA) && !COMPILE_LLVM (cfg) && !cfg->gen_sdb_seq_points) {
+		gboolean vectorized;
+
+		MONO_TIME_TRACK (mono_jit_stats.jit_simd_vectorize_loops, vectorized = mono_simd_vectorize_loops (cfg));
+		if (vectorized) {
+			recompute_loop_info (cfg);
+			mono_cfg_dump_ir (cfg, "simd_vectorize_loops");
+		}
+	}
+#endif
+
+	if ((cfg->opt & MONO_OPT_ABCREM) && (cfg->comp_done & MONO_COMP_LOOPS) && (cfg->flags & MONO_CFG_HAS_LDELEMA) && !cfg->disable_ssa && !COMPILE_LLVM (cfg) && !cfg->gen_sdb_seq_points) {
+		gboolean versioned;
+
+		MONO_TIME_TRACK (mono_jit_stats.jit_abc_loop_versioning, versioned = mono_abc_loop_versioning (cfg));
+		if (versioned) {
+			recompute_loop_info (cfg);
+			mono_cfg_dump_ir (cfg, "abc_loop_versioning");
+		}
+	}
+
 	MONO_TIME_TRACK (mono_jit_stats.jit_insert_safepoints, mono_insert_safepoints (cfg));
 	mono_cfg_dump_ir (cfg, "insert_safepoints");
 
@@ -3643,8 +3695,6 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 
 #ifndef DISABLE_SSA
 	if (cfg->comp_done & MONO_COMP_SSA && !COMPILE_LLVM (cfg)) {
-		//mono_ssa_strength_reduction (cfg);
-
 		if (cfg->opt & MONO_OPT_DEADCE) {
 			MONO_TIME_TRACK (mono_jit_stats.jit_ssa_deadce, mono_ssa_deadce (cfg));
 			mono_cfg_dump_ir (cfg, "ssa_deadce");
@@ -3655,6 +3705,18 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 			mono_cfg_dump_ir (cfg, "perform_abc_removal");
 		}
 
+		if (cfg->opt & MONO_OPT_ESCAPE) {
+			MONO_TIME_TRACK (mono_jit_stats.jit_escape_analysis, mono_escape_analysis (cfg));
+			mono_cfg_dump_ir (cfg, "escape_analysis");
+		}
+
+		if (cfg->opt & MONO_OPT_LICM) {
+			MONO_TIME_TRACK (mono_jit_stats.jit_ssa_strength_reduction, mono_ssa_strength_reduction (cfg));
+			mono_cfg_dump_ir (cfg, "ssa_strength_reduction");
+			MONO_TIME_TRACK (mono_jit_stats.jit_ssa_licm, mono_ssa_licm (cfg));
+			mono_cfg_dump_ir (cfg, "ssa_licm");
+		}
+
 		MONO_TIME_TRACK (mono_jit_stats.jit_ssa_remove, mono_ssa_remove (cfg));
 		mono_cfg_dump_ir (cfg, "ssa_remove");
 		MONO_TIME_TRACK (mono_jit_stats.jit_local_cprop2, mono_local_cprop (cfg));
@@ -3755,7 +3817,11 @@ mini_method_compile (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFl
 					}
 				}
 			}
-			MONO_TIME_TRACK (mono_jit_stats.jit_linear_scan, mono_linear_scan (cfg, vars, regs, &cfg->used_int_regs));
+			if (cfg->opt & MONO_OPT_GCOLOR) {
+				MONO_TIME_TRACK (mono_jit_stats.jit_linear_scan, mono_graph_coloring (cfg, vars, regs, &cfg->used_int_regs));
+			} else {
+				MONO_TIME_TRACK (mono_jit_stats.jit_linear_scan, mono_linear_scan (cfg, vars, regs, &cfg->used_int_regs));
+			}
 			mono_cfg_dump_ir (cfg, "linear_scan");
 		}
 	}
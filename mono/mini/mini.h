@@ -117,7 +117,7 @@
 #endif
 
 /* Version number of the AOT file format */
-#define MONO_AOT_FILE_VERSION 140
+#define MONO_AOT_FILE_VERSION 144
 
 //TODO: This is x86/amd64 specific.
 #define mono_simd_shuffle_mask(a,b,c,d) ((a) | ((b) << 2) | ((c) << 4) | ((d) << 6))
@@ -294,6 +294,8 @@ typedef struct MonoAotFileInfo
 	guint32 nshared_got_entries;
 	/* The size of the data file, if MONO_AOT_FILE_FLAG_SEPARATE_DATA is set */
 	guint32 datafile_size;
+	/* The index in the image table of the generics container, see 'dedup-include', or -1 */
+	gint32 dedup_container_index;
 
 	/* Arrays */
 	/* Offsets for tables inside the data file if MONO_AOT_FILE_FLAG_SEPARATE_DATA is set */
@@ -361,8 +363,8 @@ typedef struct
 	gpointer llvm_module;
 	/* Maps MonoMethod -> GSlist of addresses */
 	GHashTable *llvm_jit_callees;
-	/* Maps MonoMethod -> RuntimeMethod */
-	MonoInternalHashTable interp_code_hash;
+	/* Maps MonoMethod -> RuntimeMethod, lookups don't need a lock */
+	MonoConcurrentHashTable *interp_code_hash;
 } MonoJitDomainInfo;
 
 typedef struct {
@@ -557,6 +559,7 @@ extern gboolean mono_do_signal_chaining;
 extern gboolean mono_do_crash_chaining;
 extern MONO_API gboolean mono_use_llvm;
 extern MONO_API gboolean mono_use_interpreter;
+extern gboolean mono_do_vectorize;
 extern gboolean mono_do_single_method_regression;
 extern guint32 mono_single_method_regression_opt;
 extern MonoMethod *mono_current_single_method;
@@ -1218,6 +1221,8 @@ typedef struct {
 	int active_jit_methods;
 
 	gpointer interp_context;
+	/* The InterpStack of the thread */
+	gpointer interp_stack;
 } MonoJitTlsData;
 
 /*
@@ -1500,7 +1505,7 @@ typedef enum {
 	((t) == MONO_TRAMPOLINE_HANDLER_BLOCK_GUARD)
 
 /* optimization flags */
-#define OPTFLAG(id,shift,name,descr) MONO_OPT_ ## id = 1 << shift,
+#define OPTFLAG(id,shift,name,descr) MONO_OPT_ ## id = 1U << shift,
 enum {
 #include "optflags-def.h"
 	MONO_OPT_LAST
@@ -1852,6 +1857,9 @@ typedef struct {
 
 	/* Used by AOT */
 	guint32 got_offset, ex_info_offset, method_info_offset, method_index;
+	/* Serialized debug info and encoded unwind info, computed by the AOT compile threads */
+	guint8 *aot_debug_info, *aot_unwind_info;
+	guint32 aot_debug_info_size, aot_unwind_info_len;
 	/* Symbol used to refer to this method in generated assembly */
 	char *asm_symbol;
 	char *asm_debug_symbol;
@@ -1949,6 +1957,15 @@ typedef struct {
 	gint32 loads_eliminated;
 	gint32 stores_eliminated;
 	gint32 optimized_divisions;
+	gint32 escape_candidates;
+	gint32 objects_scalar_replaced;
+	gint32 fields_scalar_replaced;
+	gint32 licm_hoisted;
+	gint32 ivs_strength_reduced;
+	gint32 abc_checks_removed;
+	gint32 abc_checks_remaining;
+	gint32 abc_loops_versioned;
+	gint32 loops_vectorized;
 	int methods_with_llvm;
 	int methods_without_llvm;
 	char *max_ratio_method;
@@ -1972,7 +1989,12 @@ typedef struct {
 	double jit_ssa_compute;
 	double jit_ssa_cprop;
 	double jit_ssa_deadce;
+	double jit_simd_vectorize_loops;
+	double jit_abc_loop_versioning;
 	double jit_perform_abc_removal;
+	double jit_escape_analysis;
+	double jit_ssa_strength_reduction;
+	double jit_ssa_licm;
 	double jit_ssa_remove;
 	double jit_local_cprop2;
 	double jit_handle_global_vregs2;
@@ -2453,6 +2475,7 @@ GList    *mono_varlist_sort                 (MonoCompile *cfg, GList *list, int
 void      mono_analyze_liveness             (MonoCompile *cfg);
 void      mono_analyze_liveness_gc          (MonoCompile *cfg);
 void      mono_linear_scan                  (MonoCompile *cfg, GList *vars, GList *regs, regmask_t *used_mask);
+void      mono_graph_coloring               (MonoCompile *cfg, GList *vars, GList *regs, regmask_t *used_mask);
 void      mono_global_regalloc              (MonoCompile *cfg);
 void      mono_create_jump_table            (MonoCompile *cfg, MonoInst *label, MonoBasicBlock **bbs, int num_blocks);
 MonoCompile *mini_method_compile            (MonoMethod *method, guint32 opts, MonoDomain *domain, JitFlags flags, int parts, int aot_method_index);
@@ -2499,6 +2522,7 @@ jinfo_get_method (MonoJitInfo *ji)
 
 /* AOT */
 void      mono_aot_init                     (void);
+void      mono_aot_shutdown                 (void);
 void      mono_aot_cleanup                  (void);
 gpointer  mono_aot_get_method_checked       (MonoDomain *domain,
 											 MonoMethod *method, MonoError *error);
@@ -2522,6 +2546,7 @@ gpointer mono_aot_get_imt_trampoline        (MonoVTable *vtable, MonoDomain *dom
 gpointer mono_aot_get_gsharedvt_arg_trampoline(gpointer arg, gpointer addr);
 guint8*  mono_aot_get_unwind_info           (MonoJitInfo *ji, guint32 *unwind_info_len);
 guint32  mono_aot_method_hash               (MonoMethod *method);
+guint32  mono_aot_method_hash_slot          (guint32 hash, guint32 disp, guint32 size);
 MonoMethod* mono_aot_get_array_helper_from_wrapper (MonoMethod *method);
 void     mono_aot_set_make_unreadable       (gboolean unreadable);
 gboolean mono_aot_is_pagefault              (void *ptr);
@@ -2637,6 +2662,8 @@ MonoInst*         mini_emit_get_gsharedvt_info_klass (MonoCompile *cfg, MonoClas
 MonoInst*         mini_emit_calli (MonoCompile *cfg, MonoMethodSignature *sig, MonoInst **args, MonoInst *addr, MonoInst *imt_arg, MonoInst *rgctx_arg);
 MonoInst*         mini_emit_memory_barrier (MonoCompile *cfg, int kind);
 void              mini_emit_write_barrier (MonoCompile *cfg, MonoInst *ptr, MonoInst *value);
+MonoInst*         mini_emit_alloc_vtable (MonoCompile *cfg, MonoVTable *vtable, gboolean for_box);
+void              mini_emit_init_rvar (MonoCompile *cfg, int dreg, MonoType *rtype);
 MonoInst*         mini_emit_memory_load (MonoCompile *cfg, MonoType *type, MonoInst *src, int offset, int ins_flag);
 void              mini_emit_memory_store (MonoCompile *cfg, MonoType *type, MonoInst *dest, MonoInst *value, int ins_flag);
 void              mini_emit_memory_copy_bytes (MonoCompile *cfg, MonoInst *dest, MonoInst *src, MonoInst *size, int ins_flag);
@@ -2942,6 +2969,7 @@ void        mono_ssa_remove_gsharedvt           (MonoCompile *cfg);
 void        mono_ssa_cprop                      (MonoCompile *cfg);
 void        mono_ssa_deadce                     (MonoCompile *cfg);
 void        mono_ssa_strength_reduction         (MonoCompile *cfg);
+void        mono_ssa_licm                       (MonoCompile *cfg);
 void        mono_free_loop_info                 (MonoCompile *cfg);
 void        mono_ssa_loop_invariant_code_motion (MonoCompile *cfg);
 
@@ -2976,6 +3004,8 @@ extern void
 mono_perform_abc_removal (MonoCompile *cfg);
 extern void
 mono_perform_abc_removal (MonoCompile *cfg);
+extern gboolean
+mono_abc_loop_versioning (MonoCompile *cfg);
 extern void
 mono_perform_ssapre (MonoCompile *cfg);
 extern void
@@ -2986,6 +3016,10 @@ extern void
 mono_local_deadce (MonoCompile *cfg);
 void
 mono_local_alias_analysis (MonoCompile *cfg);
+gboolean
+mono_escape_analysis_is_candidate (MonoCompile *cfg, MonoClass *klass);
+void
+mono_escape_analysis (MonoCompile *cfg);
 
 /* Generic sharing */
 
@@ -3183,6 +3217,7 @@ MonoInst*   mono_emit_simd_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, Mo
 MonoInst*   mono_emit_simd_field_load (MonoCompile *cfg, MonoClassField *field, MonoInst *addr);
 guint32     mono_arch_cpu_enumerate_simd_versions (void);
 void        mono_simd_intrinsics_init (void);
+gboolean    mono_simd_vectorize_loops (MonoCompile *cfg);
 
 MonoInst*   mono_emit_native_types_intrinsics (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **args);
 MonoType*   mini_native_type_replace_type (MonoType *type) MONO_LLVM_INTERNAL;
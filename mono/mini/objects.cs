@@ -86,6 +86,48 @@ class Sample {
 	}
 }
 
+class Accessors {
+	int count;
+	object tag;
+
+	public int Count {
+		get { return count; }
+		set { count = value; }
+	}
+
+	public object Tag {
+		get { return tag; }
+		set { tag = value; }
+	}
+
+	public bool IsAccessors {
+		get { return true; }
+	}
+}
+
+struct StructAccessors {
+	int val;
+
+	public int Value {
+		get { return val; }
+		set { val = value; }
+	}
+}
+
+interface IShape {
+	int Id ();
+}
+
+class Shape : IShape {
+	public virtual int Id () { return 0; }
+}
+
+class Shape1 : Shape { public override int Id () { return 1; } }
+class Shape2 : Shape { public override int Id () { return 2; } }
+class Shape3 : Shape { public override int Id () { return 3; } }
+class Shape4 : Shape { public override int Id () { return 4; } }
+class Shape5 : Shape { public override int Id () { return 5; } }
+
 [StructLayout ( LayoutKind.Explicit )]
 struct StructWithBigOffsets {
 		[ FieldOffset(10000) ] public byte b;
@@ -1828,6 +1870,86 @@ ncells ) {
 
 		return 0;
 	}
+
+	class Point2 {
+		public int x;
+		public byte b;
+		public long l;
+	}
+
+	public static int test_0_escape_scalar_replace () {
+		int sum = 0;
+		for (int i = 0; i < 10; ++i) {
+			Point2 p = new Point2 ();
+			if (p.x != 0 || p.b != 0 || p.l != 0)
+				return 1;
+			p.x = i;
+			p.b = (byte)(i + 250);
+			p.l = (long)i << 33;
+			sum += p.x + p.b + (int)(p.l >> 33);
+		}
+		return sum == 45 + (250 * 6 + 15) + (0 + 1 + 2 + 3) + 45 ? 0 : 2;
+	}
+
+	static Point2 escaped_point;
+
+	public static int test_0_escape_stored_object () {
+		Point2 p = new Point2 ();
+		p.x = 5;
+		escaped_point = p;
+		p.x = 6;
+		return escaped_point.x == 6 ? 0 : 1;
+	}
+
+	public static int test_0_inline_accessors () {
+		Accessors a = new Accessors ();
+		a.Count = 5;
+		a.Tag = a;
+		if (a.Count != 5 || a.Tag != a || !a.IsAccessors)
+			return 1;
+
+		StructAccessors s = new StructAccessors ();
+		s.Value = 7;
+		if (s.Value != 7)
+			return 2;
+
+		a = null;
+		try {
+			int i = a.Count;
+			return 3;
+		} catch (NullReferenceException) {
+		}
+		try {
+			bool b = a.IsAccessors;
+			return 4;
+		} catch (NullReferenceException) {
+		}
+		return 0;
+	}
+
+	static int call_shape_id (Shape s) {
+		return s.Id ();
+	}
+
+	static int call_ishape_id (IShape s) {
+		return s.Id ();
+	}
+
+	/* Call sites going from monomorphic to megamorphic */
+	public static int test_0_virtual_call_receivers () {
+		Shape[] shapes = new Shape [] { new Shape1 (), new Shape2 (), new Shape3 (), new Shape4 (), new Shape5 (), new Shape () };
+
+		for (int iter = 0; iter < 3; ++iter) {
+			for (int i = 0; i < shapes.Length; ++i) {
+				int expected = (i + 1) % shapes.Length;
+				if (call_shape_id (shapes [i]) != expected)
+					return 1;
+				if (call_ishape_id (shapes [i]) != expected)
+					return 2;
+			}
+		}
+		return 0;
+	}
 }
 
 #if __MOBILE__
@@ -27,3 +27,6 @@ OPTFLAG (GSHARED, 25, "gshared",     "Generic Sharing")
 OPTFLAG(SIMD	 ,26, "simd",	    "Simd intrinsics")
 OPTFLAG(UNSAFE	 ,27, "unsafe",	    "Remove bound checks and perform other dangerous changes")
 OPTFLAG(ALIAS_ANALYSIS	 ,28, "alias-analysis",      "Alias analysis of locals")
+OPTFLAG(ESCAPE	 ,29, "escape",      "Escape analysis and scalar replacement of objects")
+OPTFLAG(LICM	 ,30, "licm",        "Loop invariant code motion and strength reduction")
+OPTFLAG(GCOLOR	 ,31, "gcolor",      "Graph coloring global register allocator")
@@ -0,0 +1,1215 @@
+/**
+ * \file
+ * Vectorization of simple array loops using the SIMD opcodes
+ */
+
+#include <config.h>
+#include <stdio.h>
+
+#include "mini.h"
+#include "ir-emit.h"
+#include <mono/metadata/abi-details.h>
+#include <mono/metadata/debug-helpers.h>
+#include <mono/utils/mono-compiler.h>
+
+#if defined(MONO_ARCH_SIMD_INTRINSICS) && !defined(DISABLE_JIT)
+
+/*
+ * This pass vectorizes counted loops of the form:
+ *
+ *   for (i = start; i < limit; ++i) {
+ *       c [i] = a [i] + b [i];
+ *       d [i] = a [i] * k;
+ *       r [i] = a [i] > b [i];
+ *       sum += a [i] ^ b [i];
+ *   }
+ *
+ * where every array access uses the induction variable as the index, the arrays
+ * have int or float elements, or byte/bool elements for storing the results of
+ * compares, and the only loop carried values are the induction variable and a sum.
+ * Since every iteration only touches element i of each array, executing four
+ * iterations at once lane by lane gives the same result even if the arrays alias.
+ * The vector loop is emitted in front of the original loop:
+ *
+ *   guards: start >= 0, arrays != null, limit <= a.Length, else goto H
+ *   VH:     if (i >= limit - 3) goto H
+ *   VB:     <the body, using 128 bit loads, stores and operations>
+ *           sum += horizontal sum of the vector
+ *           i += 4; goto VH
+ *   H:      <the original loop, which also serves as the scalar epilogue>
+ *
+ * Integer operations wrap around the same way in vectors, so integer expressions
+ * can be arbitrarily nested. Float expressions are computed in double precision
+ * unless cfg->r4fp is set, and rounding a single add/sub/mul/div of two floats
+ * computed in double precision gives the same result as computing it in single
+ * precision, so without r4fp, only a single operation is allowed. Compares are
+ * computed as 0/1 integer vectors.
+ * Without r4fp, float and double variables hold double precision values, so a sum
+ * of float array elements is vectorized by adding the elements converted to double
+ * in pairs. This reassociates the additions, so the rounding of the result can
+ * differ from the scalar loop, which is why the pass needs to be enabled explicitly
+ * with --vectorize. Float sums are not vectorized with r4fp.
+ * This runs on the non-SSA IR after the loop info has been computed, the caller
+ * needs to recompute the bblock ordering, the dominators and the loop info if the
+ * CFG was changed.
+ */
+
+#define MAX_VECTOR_ARRAYS 8
+#define MAX_VECTOR_LOOP_SIZE 128
+
+#define VECTOR_LENGTH 4
+
+typedef enum {
+	VAL_NONE,
+	/* The induction variable, possibly extended */
+	VAL_IV,
+	/* The induction variable incremented by one */
+	VAL_IV_NEXT,
+	/* The address of arr [iv] */
+	VAL_ADDR,
+	/* A loop invariant scalar, either a constant or a variable */
+	VAL_INV,
+	/* arr [iv] or an expression computed from it */
+	VAL_VECTOR,
+	/* sum + <vector expression> */
+	VAL_SUM
+} ValueKind;
+
+typedef struct {
+	ValueKind kind;
+	gboolean is_float;
+	/* Whenever the value is a load or an invariant, i.e. an operand of a float op */
+	gboolean is_leaf;
+	/* Whenever the value is the 0/1 result of a compare */
+	gboolean is_bool;
+	/* VAL_ADDR: the array, VAL_SUM: the sum variable */
+	int var;
+	/* VAL_ADDR: the size of the array elements */
+	int elem_size;
+	/* VAL_SUM: the vreg of the vector expression */
+	int vector;
+} VectorValue;
+
+typedef struct {
+	MonoCompile *cfg;
+	MonoBasicBlock *header, *body, *preheader;
+	/* The induction variable */
+	int iv;
+	/* The loop limit */
+	int limit, limit_imm, limit_array;
+	gboolean limit_is_imm, inclusive;
+	int arrays [MAX_VECTOR_ARRAYS];
+	int num_arrays;
+	/* The sum variable, or -1 */
+	int sum;
+	/* Whenever the sum is a float or double variable holding a double value */
+	gboolean sum_is_float;
+	/* Whenever the induction variable was incremented */
+	gboolean iv_updated;
+	VectorValue iv_value;
+	/* vreg -> VectorValue */
+	GHashTable *values;
+	/* vreg -> vreg of the vectorized value */
+	GHashTable *vregs;
+} VectorLoop;
+
+static gboolean
+is_loop_header (MonoBasicBlock *bb)
+{
+	return bb->loop_blocks && bb->loop_blocks->data == bb;
+}
+
+static gboolean
+is_loop_var (MonoCompile *cfg, int vreg)
+{
+	MonoInst *var = get_vreg_to_inst (cfg, vreg);
+
+	return var && !(var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT));
+}
+
+static gboolean
+is_i4_var (MonoCompile *cfg, int vreg)
+{
+	MonoInst *var = get_vreg_to_inst (cfg, vreg);
+
+	return is_loop_var (cfg, vreg) && var->type == STACK_I4;
+}
+
+static gboolean
+defines_vreg (MonoInst *ins, int vreg)
+{
+	const char *spec = INS_INFO (ins->opcode);
+
+	return spec [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && ins->dreg == vreg;
+}
+
+static int
+count_defs (VectorLoop *loop, int vreg)
+{
+	MonoInst *ins;
+	int ndefs = 0;
+
+	MONO_BB_FOR_EACH_INS (loop->header, ins) {
+		if (defines_vreg (ins, vreg))
+			ndefs ++;
+	}
+	MONO_BB_FOR_EACH_INS (loop->body, ins) {
+		if (defines_vreg (ins, vreg))
+			ndefs ++;
+	}
+	return ndefs;
+}
+
+static gboolean
+is_invariant_var (VectorLoop *loop, int vreg)
+{
+	return is_loop_var (loop->cfg, vreg) && count_defs (loop, vreg) == 0;
+}
+
+static void
+add_array (VectorLoop *loop, int array, gboolean *failed)
+{
+	int i;
+
+	for (i = 0; i < loop->num_arrays; ++i)
+		if (loop->arrays [i] == array)
+			return;
+	if (loop->num_arrays == MAX_VECTOR_ARRAYS) {
+		*failed = TRUE;
+		return;
+	}
+	loop->arrays [loop->num_arrays ++] = array;
+}
+
+static VectorValue*
+new_value (VectorLoop *loop, int vreg, ValueKind kind)
+{
+	VectorValue *value = (VectorValue *)mono_mempool_alloc0 (loop->cfg->mempool, sizeof (VectorValue));
+
+	value->kind = kind;
+	g_hash_table_insert (loop->values, GINT_TO_POINTER (vreg), value);
+	return value;
+}
+
+/*
+ * Return the value of the scalar vreg VREG at this point of the loop body.
+ */
+static VectorValue*
+get_value (VectorLoop *loop, int vreg)
+{
+	MonoCompile *cfg = loop->cfg;
+	VectorValue *value;
+
+	if (vreg != loop->iv) {
+		value = (VectorValue *)g_hash_table_lookup (loop->values, GINT_TO_POINTER (vreg));
+		if (value)
+			return value;
+	}
+
+	if (vreg == loop->iv) {
+		/* Uses after the increment would see i + 1 */
+		if (loop->iv_updated)
+			return NULL;
+		loop->iv_value.kind = VAL_IV;
+		return &loop->iv_value;
+	} else if (is_invariant_var (loop, vreg)) {
+		MonoInst *var = get_vreg_to_inst (cfg, vreg);
+		MonoType *t = mini_get_underlying_type (var->inst_vtype);
+
+		if (var->type == STACK_I4) {
+			value = new_value (loop, vreg, VAL_INV);
+		} else if (t->type == MONO_TYPE_R4 && !t->byref) {
+			value = new_value (loop, vreg, VAL_INV);
+			value->is_float = TRUE;
+		} else if (var->type == STACK_OBJ) {
+			/* Arrays */
+			value = new_value (loop, vreg, VAL_INV);
+			value->var = vreg;
+		} else {
+			return NULL;
+		}
+		value->is_leaf = TRUE;
+	}
+	return value;
+}
+
+static gboolean
+is_vector_operand (VectorLoop *loop, VectorValue *value, gboolean is_float)
+{
+	if (!value || (value->kind != VAL_VECTOR && value->kind != VAL_INV) || value->is_float != is_float)
+		return FALSE;
+	if (value->kind == VAL_INV && value->var)
+		/* An array reference */
+		return FALSE;
+	/* Float ops are computed in double precision, see above */
+	if (is_float && !loop->cfg->r4fp && !value->is_leaf)
+		return FALSE;
+	return TRUE;
+}
+
+static int
+int_op_to_simd (int opcode)
+{
+	switch (opcode) {
+	case OP_IADD:
+	case OP_IADD_IMM:
+		return OP_PADDD;
+	case OP_ISUB:
+	case OP_ISUB_IMM:
+		return OP_PSUBD;
+	case OP_IAND:
+	case OP_IAND_IMM:
+		return OP_PAND;
+	case OP_IOR:
+	case OP_IOR_IMM:
+		return OP_POR;
+	case OP_IXOR:
+	case OP_IXOR_IMM:
+		return OP_PXOR;
+	default:
+		return -1;
+	}
+}
+
+static int
+float_op_to_simd (MonoCompile *cfg, int opcode)
+{
+	if (cfg->r4fp) {
+		switch (opcode) {
+		case OP_RADD:
+			return OP_ADDPS;
+		case OP_RSUB:
+			return OP_SUBPS;
+		case OP_RMUL:
+			return OP_MULPS;
+		case OP_RDIV:
+			return OP_DIVPS;
+		default:
+			return -1;
+		}
+	} else {
+		switch (opcode) {
+		case OP_FADD:
+			return OP_ADDPS;
+		case OP_FSUB:
+			return OP_SUBPS;
+		case OP_FMUL:
+			return OP_MULPS;
+		case OP_FDIV:
+			return OP_DIVPS;
+		default:
+			return -1;
+		}
+	}
+}
+
+static gboolean
+is_element_address (VectorLoop *loop, int vreg, int offset, int elem_size)
+{
+	VectorValue *value = get_value (loop, vreg);
+
+	return value && value->kind == VAL_ADDR && offset == 0 && value->elem_size == elem_size;
+}
+
+/*
+ * Return whenever INS adds a value to the sum variable, setting OTHER to the vreg of
+ * the value.
+ */
+static gboolean
+is_sum_add (VectorLoop *loop, MonoInst *ins, int *other)
+{
+	if (loop->sum == -1 || (ins->sreg1 != loop->sum && ins->sreg2 != loop->sum))
+		return FALSE;
+	if (ins->opcode != (loop->sum_is_float ? OP_FADD : OP_IADD))
+		return FALSE;
+	*other = ins->sreg1 == loop->sum ? ins->sreg2 : ins->sreg1;
+	return TRUE;
+}
+
+static int
+int_compare_to_simd (int opcode)
+{
+	switch (opcode) {
+	case OP_ICEQ:
+		return OP_PCMPEQD;
+	case OP_ICGT:
+	case OP_ICLT:
+		return OP_PCMPGTD;
+	default:
+		return -1;
+	}
+}
+
+static gboolean
+is_float_compare (MonoCompile *cfg, int opcode)
+{
+	if (cfg->r4fp)
+		return opcode == OP_RCEQ || opcode == OP_RCGT || opcode == OP_RCLT;
+	else
+		return opcode == OP_FCEQ || opcode == OP_FCGT || opcode == OP_FCLT;
+}
+
+/*
+ * Check whenever the loop body can be vectorized, computing the value of every
+ * vreg defined in it.
+ */
+static gboolean
+analyze_body (VectorLoop *loop)
+{
+	MonoCompile *cfg = loop->cfg;
+	MonoInst *ins;
+	VectorValue *value, *v1, *v2;
+	gboolean failed = FALSE;
+	int increments = 0, sums = 0, size = 0, other;
+
+	MONO_BB_FOR_EACH_INS (loop->body, ins) {
+		const char *spec = INS_INFO (ins->opcode);
+		gboolean dreg_is_var = spec [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && get_vreg_to_inst (cfg, ins->dreg);
+
+		if (++ size > MAX_VECTOR_LOOP_SIZE)
+			return FALSE;
+
+		/* Only the induction variable and the sum can be assigned in the loop */
+		if (dreg_is_var && ins->dreg != loop->iv && ins->dreg != loop->sum)
+			return FALSE;
+
+		if (is_sum_add (loop, ins, &other)) {
+			/* sum + <vector expression> */
+			v1 = get_value (loop, other);
+			if (other == loop->sum || !v1 || v1->kind != VAL_VECTOR || v1->is_float != loop->sum_is_float)
+				return FALSE;
+			/* Float elements are summed in double precision, so they can't be rounded to float first */
+			if (loop->sum_is_float && !v1->is_leaf)
+				return FALSE;
+			if (ins->dreg == loop->sum) {
+				sums ++;
+			} else {
+				value = new_value (loop, ins->dreg, VAL_SUM);
+				value->var = loop->sum;
+				value->vector = other;
+			}
+			continue;
+		}
+
+		switch (ins->opcode) {
+		case OP_NOP:
+		case OP_IL_SEQ_POINT:
+			break;
+		case OP_BR:
+			if (ins != loop->body->last_ins || ins->inst_target_bb != loop->header)
+				return FALSE;
+			break;
+		case OP_ICONST:
+			value = new_value (loop, ins->dreg, VAL_INV);
+			value->is_leaf = TRUE;
+			break;
+		case OP_R4CONST:
+			value = new_value (loop, ins->dreg, VAL_INV);
+			value->is_float = TRUE;
+			value->is_leaf = TRUE;
+			break;
+		case OP_SEXT_I4:
+		case OP_MOVE:
+		case OP_FMOVE:
+		case OP_RMOVE:
+			v1 = get_value (loop, ins->sreg1);
+			if (!v1)
+				return FALSE;
+			if (ins->dreg == loop->iv) {
+				/* i = i + 1 */
+				if (v1->kind != VAL_IV_NEXT)
+					return FALSE;
+				increments ++;
+				loop->iv_updated = TRUE;
+			} else if (ins->dreg == loop->sum) {
+				if (v1->kind != VAL_SUM || v1->var != loop->sum)
+					return FALSE;
+				sums ++;
+			} else if (ins->opcode == OP_SEXT_I4 && v1->kind != VAL_IV) {
+				return FALSE;
+			} else {
+				g_hash_table_insert (loop->values, GINT_TO_POINTER (ins->dreg), v1);
+			}
+			break;
+		case OP_X86_LEA:
+			/* &arr [i] */
+			v1 = get_value (loop, ins->sreg1);
+			v2 = get_value (loop, ins->sreg2);
+			if (!v1 || v1->kind != VAL_INV || !v1->var || !v2 || v2->kind != VAL_IV)
+				return FALSE;
+			/* int/float arrays, or byte arrays receiving compare results */
+			if ((ins->backend.shift_amount != 2 && ins->backend.shift_amount != 0) || ins->inst_imm != MONO_STRUCT_OFFSET (MonoArray, vector))
+				return FALSE;
+			value = new_value (loop, ins->dreg, VAL_ADDR);
+			value->var = v1->var;
+			value->elem_size = 1 << ins->backend.shift_amount;
+			add_array (loop, v1->var, &failed);
+			break;
+		case OP_BOUNDS_CHECK:
+			v1 = get_value (loop, ins->sreg1);
+			v2 = get_value (loop, ins->sreg2);
+			if (!v1 || v1->kind != VAL_INV || !v1->var || !v2 || v2->kind != VAL_IV || ins->inst_imm != MONO_STRUCT_OFFSET (MonoArray, max_length))
+				return FALSE;
+			add_array (loop, v1->var, &failed);
+			break;
+#ifdef TARGET_AMD64
+		case OP_AMD64_ICOMPARE_MEMBASE_REG:
+#else
+		case OP_X86_COMPARE_MEMBASE_REG:
+#endif
+			/* The bounds check emitted by MONO_ARCH_EMIT_BOUNDS_CHECK */
+			v1 = get_value (loop, ins->inst_basereg);
+			v2 = get_value (loop, ins->sreg2);
+			if (!v1 || v1->kind != VAL_INV || !v1->var || !v2 || v2->kind != VAL_IV || ins->inst_offset != MONO_STRUCT_OFFSET (MonoArray, max_length))
+				return FALSE;
+			if (!ins->next || ins->next->opcode != OP_COND_EXC_LE_UN)
+				return FALSE;
+			add_array (loop, v1->var, &failed);
+			ins = ins->next;
+			break;
+		case OP_COMPARE_IMM:
+			/* Explicit null check */
+			v1 = get_value (loop, ins->sreg1);
+			if (!v1 || v1->kind != VAL_INV || !v1->var || ins->inst_imm != 0)
+				return FALSE;
+			if (!ins->next || ins->next->opcode != OP_COND_EXC_EQ)
+				return FALSE;
+			add_array (loop, v1->var, &failed);
+			ins = ins->next;
+			break;
+		case OP_LOADI4_MEMBASE:
+		case OP_LOADU4_MEMBASE:
+		case OP_LOADR4_MEMBASE:
+			if (!is_element_address (loop, ins->inst_basereg, ins->inst_offset, 4))
+				return FALSE;
+			value = new_value (loop, ins->dreg, VAL_VECTOR);
+			value->is_float = ins->opcode == OP_LOADR4_MEMBASE;
+			value->is_leaf = TRUE;
+			break;
+		case OP_STOREI4_MEMBASE_REG:
+		case OP_STORER4_MEMBASE_REG:
+			if (!is_element_address (loop, ins->inst_destbasereg, ins->inst_offset, 4))
+				return FALSE;
+			if (!is_vector_operand (loop, get_value (loop, ins->sreg1), ins->opcode == OP_STORER4_MEMBASE_REG))
+				return FALSE;
+			break;
+		case OP_STOREI4_MEMBASE_IMM:
+			if (!is_element_address (loop, ins->inst_destbasereg, ins->inst_offset, 4))
+				return FALSE;
+			break;
+		case OP_STOREI1_MEMBASE_REG:
+			/* The lanes are narrowed with saturating packs, so only 0/1 values can be stored */
+			if (!is_element_address (loop, ins->inst_destbasereg, ins->inst_offset, 1))
+				return FALSE;
+			v1 = get_value (loop, ins->sreg1);
+			if (!v1 || v1->kind != VAL_VECTOR || !v1->is_bool)
+				return FALSE;
+			break;
+		case OP_ICOMPARE:
+		case OP_ICOMPARE_IMM:
+			/* a [i] > b [i] */
+			if (!ins->next || int_compare_to_simd (ins->next->opcode) == -1 || get_vreg_to_inst (cfg, ins->next->dreg))
+				return FALSE;
+			v1 = get_value (loop, ins->sreg1);
+			if (ins->opcode == OP_ICOMPARE) {
+				v2 = get_value (loop, ins->sreg2);
+				if (!is_vector_operand (loop, v2, FALSE))
+					return FALSE;
+			} else {
+				v2 = NULL;
+			}
+			if (!is_vector_operand (loop, v1, FALSE) || (v1->kind == VAL_INV && (!v2 || v2->kind == VAL_INV)))
+				return FALSE;
+			ins = ins->next;
+			value = new_value (loop, ins->dreg, VAL_VECTOR);
+			value->is_bool = TRUE;
+			break;
+		case OP_IADD_IMM:
+		case OP_ISUB_IMM:
+		case OP_IAND_IMM:
+		case OP_IOR_IMM:
+		case OP_IXOR_IMM:
+			v1 = get_value (loop, ins->sreg1);
+			if (v1 && v1->kind == VAL_IV && ins->opcode == OP_IADD_IMM && ins->inst_imm == 1 && ins->sreg1 == loop->iv) {
+				if (ins->dreg == loop->iv) {
+					increments ++;
+					loop->iv_updated = TRUE;
+				} else {
+					new_value (loop, ins->dreg, VAL_IV_NEXT);
+				}
+				break;
+			}
+			if (ins->dreg == loop->iv || ins->dreg == loop->sum || !is_vector_operand (loop, v1, FALSE))
+				return FALSE;
+			value = new_value (loop, ins->dreg, VAL_VECTOR);
+			break;
+		case OP_IADD:
+		case OP_ISUB:
+		case OP_IAND:
+		case OP_IOR:
+		case OP_IXOR:
+			if (ins->dreg == loop->iv || ins->dreg == loop->sum)
+				return FALSE;
+			v1 = get_value (loop, ins->sreg1);
+			v2 = get_value (loop, ins->sreg2);
+			if (!is_vector_operand (loop, v1, FALSE) || !is_vector_operand (loop, v2, FALSE))
+				return FALSE;
+			if (v1->kind == VAL_INV && v2->kind == VAL_INV)
+				return FALSE;
+			value = new_value (loop, ins->dreg, VAL_VECTOR);
+			break;
+		default:
+			if (is_float_compare (cfg, ins->opcode)) {
+				/* The preceding compare was nullified, these compare their sregs */
+				v1 = get_value (loop, ins->sreg1);
+				v2 = get_value (loop, ins->sreg2);
+				if (!is_vector_operand (loop, v1, TRUE) || !is_vector_operand (loop, v2, TRUE))
+					return FALSE;
+				if (v1->kind == VAL_INV && v2->kind == VAL_INV)
+					return FALSE;
+				value = new_value (loop, ins->dreg, VAL_VECTOR);
+				value->is_bool = TRUE;
+				break;
+			}
+			if (float_op_to_simd (cfg, ins->opcode) != -1) {
+				v1 = get_value (loop, ins->sreg1);
+				v2 = get_value (loop, ins->sreg2);
+				if (!is_vector_operand (loop, v1, TRUE) || !is_vector_operand (loop, v2, TRUE))
+					return FALSE;
+				if (v1->kind == VAL_INV && v2->kind == VAL_INV)
+					return FALSE;
+				value = new_value (loop, ins->dreg, VAL_VECTOR);
+				value->is_float = TRUE;
+				break;
+			}
+			if (cfg->verbose_level > 2) {
+				printf ("VECTORIZE: can't vectorize: ");
+				mono_print_ins (ins);
+			}
+			return FALSE;
+		}
+		if (failed)
+			return FALSE;
+	}
+
+	if (loop->body->last_ins && MONO_IS_BRANCH_OP (loop->body->last_ins) && loop->body->last_ins->opcode != OP_BR)
+		return FALSE;
+
+	return increments == 1 && (loop->sum == -1 || sums == 1) && loop->num_arrays > 0;
+}
+
+/*
+ * Whenever VREG is a float or double variable, which holds a double precision value
+ * unless r4fp is set.
+ */
+static gboolean
+is_r8_var (MonoCompile *cfg, int vreg)
+{
+	MonoInst *var = get_vreg_to_inst (cfg, vreg);
+
+	return is_loop_var (cfg, vreg) && !cfg->r4fp && var->type == STACK_R8 && !var->inst_vtype->byref;
+}
+
+/*
+ * Return the integer or float variable summed up by the loop body, or -1.
+ */
+static int
+find_sum_var (VectorLoop *loop)
+{
+	MonoCompile *cfg = loop->cfg;
+	MonoInst *ins;
+	int sum = -1;
+
+	MONO_BB_FOR_EACH_INS (loop->body, ins) {
+		const char *spec = INS_INFO (ins->opcode);
+
+		if (spec [MONO_INST_DEST] == ' ' || MONO_IS_STORE_MEMBASE (ins) || ins->dreg == loop->iv || !get_vreg_to_inst (cfg, ins->dreg))
+			continue;
+		if (sum != -1 || (!is_i4_var (cfg, ins->dreg) && !is_r8_var (cfg, ins->dreg)))
+			return -1;
+		sum = ins->dreg;
+	}
+	if (sum != -1)
+		loop->sum_is_float = is_r8_var (cfg, sum);
+	return sum;
+}
+
+static gboolean
+analyze_loop (MonoCompile *cfg, MonoBasicBlock *header, VectorLoop *loop)
+{
+	MonoBasicBlock *preheader = header->idom, *body;
+	MonoInst *ins, *compare, *branch;
+	gboolean true_in_loop;
+	int rel;
+
+	memset (loop, 0, sizeof (VectorLoop));
+	loop->cfg = cfg;
+	loop->limit_array = -1;
+	loop->sum = -1;
+
+	if (g_list_length (header->loop_blocks) != 2 || header->in_count != 2 || header->region != -1)
+		return FALSE;
+	body = (MonoBasicBlock *)(header->loop_blocks->data == header ? header->loop_blocks->next->data : header->loop_blocks->data);
+	if (body->region != -1 || body->out_count != 1 || body->out_bb [0] != header || body->in_count != 1)
+		return FALSE;
+	if (!preheader || !preheader->last_ins || preheader->last_ins->opcode != OP_BR || preheader->last_ins->inst_target_bb != header || preheader->region != -1)
+		return FALSE;
+
+	/* The loop condition */
+	branch = header->last_ins;
+	if (!branch || !MONO_IS_COND_BRANCH_OP (branch) || branch == header->code || !branch->inst_false_bb)
+		return FALSE;
+	compare = branch->prev;
+	true_in_loop = branch->inst_true_bb == body;
+	if (!true_in_loop && branch->inst_false_bb != body)
+		return FALSE;
+	switch (branch->opcode) {
+	case OP_IBLT:
+		rel = true_in_loop ? CMP_LT : CMP_GE;
+		break;
+	case OP_IBLE:
+		rel = true_in_loop ? CMP_LE : CMP_GT;
+		break;
+	case OP_IBGE:
+		rel = true_in_loop ? CMP_GE : CMP_LT;
+		break;
+	case OP_IBGT:
+		rel = true_in_loop ? CMP_GT : CMP_LE;
+		break;
+	default:
+		return FALSE;
+	}
+	if (rel != CMP_LT && rel != CMP_LE)
+		return FALSE;
+	loop->inclusive = rel == CMP_LE;
+
+	loop->header = header;
+	loop->body = body;
+	loop->preheader = preheader;
+	loop->iv = compare->sreg1;
+	if (!is_i4_var (cfg, loop->iv))
+		return FALSE;
+
+	/* The header can only contain the loop condition */
+	for (ins = header->code; ins != compare; ins = ins->next) {
+		if (ins->opcode == OP_NOP || ins->opcode == OP_IL_SEQ_POINT)
+			continue;
+		if (ins->opcode == OP_LDLEN && compare->opcode == OP_ICOMPARE && ins->dreg == compare->sreg2 && !get_vreg_to_inst (cfg, ins->dreg) && loop->limit_array == -1) {
+			loop->limit_array = ins->sreg1;
+			continue;
+		}
+		return FALSE;
+	}
+
+	if (compare->opcode == OP_ICOMPARE) {
+		loop->limit = compare->sreg2;
+		if (loop->limit_array != -1) {
+			if (!is_invariant_var (loop, loop->limit_array))
+				return FALSE;
+		} else if (!is_i4_var (cfg, loop->limit) || !is_invariant_var (loop, loop->limit)) {
+			return FALSE;
+		}
+	} else if (compare->opcode == OP_ICOMPARE_IMM) {
+		loop->limit_is_imm = TRUE;
+		loop->limit_imm = compare->inst_imm;
+		/* Too short to be worth it */
+		if (loop->limit_imm < VECTOR_LENGTH * 2)
+			return FALSE;
+	} else {
+		return FALSE;
+	}
+
+	loop->sum = find_sum_var (loop);
+	if (count_defs (loop, loop->iv) != 1 || (loop->sum != -1 && count_defs (loop, loop->sum) != 1))
+		return FALSE;
+
+	loop->values = g_hash_table_new (NULL, NULL);
+	if (!analyze_body (loop)) {
+		g_hash_table_destroy (loop->values);
+		loop->values = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static MonoBasicBlock*
+new_bblock (MonoCompile *cfg, MonoBasicBlock *template_bb)
+{
+	MonoBasicBlock *bb = (MonoBasicBlock *)mono_mempool_alloc0 (cfg->mempool, sizeof (MonoBasicBlock));
+
+	bb->block_num = cfg->max_block_num ++;
+	bb->cil_code = template_bb->cil_code;
+	bb->real_offset = template_bb->real_offset;
+	bb->region = template_bb->region;
+	return bb;
+}
+
+static void
+emit_br (MonoCompile *cfg, MonoBasicBlock *bb, MonoBasicBlock *target)
+{
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, OP_BR);
+	ins->inst_target_bb = target;
+	MONO_ADD_INS (bb, ins);
+	mono_link_bblock (cfg, bb, target);
+}
+
+static MonoInst*
+emit_ins (MonoCompile *cfg, MonoBasicBlock *bb, int opcode, int dreg, int sreg1, int sreg2)
+{
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, opcode);
+	ins->dreg = dreg;
+	ins->sreg1 = sreg1;
+	ins->sreg2 = sreg2;
+	MONO_ADD_INS (bb, ins);
+	return ins;
+}
+
+/*
+ * Emit a conditional branch to FAIL_BB, returning the bblock executed otherwise.
+ */
+static MonoBasicBlock*
+emit_guard_branch (MonoCompile *cfg, MonoBasicBlock *bb, int opcode, MonoBasicBlock *fail_bb)
+{
+	MonoBasicBlock *next_bb = new_bblock (cfg, bb);
+	MonoInst *ins;
+
+	MONO_INST_NEW (cfg, ins, opcode);
+	ins->inst_true_bb = fail_bb;
+	ins->inst_false_bb = next_bb;
+	MONO_ADD_INS (bb, ins);
+	mono_link_bblock (cfg, bb, fail_bb);
+	mono_link_bblock (cfg, bb, next_bb);
+	bb->next_bb = next_bb;
+	return next_bb;
+}
+
+static MonoBasicBlock*
+emit_array_length (MonoCompile *cfg, MonoBasicBlock *bb, int array, MonoBasicBlock *fail_bb, int dreg)
+{
+	MonoInst *ins;
+
+	ins = emit_ins (cfg, bb, OP_COMPARE_IMM, -1, array, -1);
+	ins->inst_imm = 0;
+	bb = emit_guard_branch (cfg, bb, OP_PBEQ, fail_bb);
+
+	ins = emit_ins (cfg, bb, OP_LDLEN, dreg, array, -1);
+	ins->type = STACK_I4;
+	ins->flags |= MONO_INST_FAULT;
+	cfg->flags |= MONO_CFG_HAS_ARRAY_ACCESS;
+	bb->has_array_access = TRUE;
+	return bb;
+}
+
+#ifdef TARGET_X86
+/* Shared with simd-intrinsics.c */
+static MonoInst*
+get_double_spill_area (MonoCompile *cfg)
+{
+	if (!cfg->fconv_to_r8_x_var) {
+		cfg->fconv_to_r8_x_var = mono_compile_create_var (cfg, &mono_defaults.double_class->byval_arg, OP_LOCAL);
+		cfg->fconv_to_r8_x_var->flags |= MONO_INST_VOLATILE;
+	}
+	return cfg->fconv_to_r8_x_var;
+}
+#endif
+
+static int
+expand_r4 (MonoCompile *cfg, MonoBasicBlock *bb, int freg)
+{
+	MonoInst *ins;
+
+	ins = emit_ins (cfg, bb, OP_EXPAND_R4, alloc_xreg (cfg), freg, -1);
+#ifdef TARGET_X86
+	/* The x86 backend moves the value through memory */
+	ins->backend.spill_var = mini_get_int_to_float_spill_area (cfg);
+#endif
+	return ins->dreg;
+}
+
+/*
+ * Return the vectorized version of the scalar vreg VREG, expanding invariants.
+ */
+static int
+get_vector (VectorLoop *loop, MonoBasicBlock *bb, int vreg)
+{
+	MonoCompile *cfg = loop->cfg;
+	VectorValue *value = (VectorValue *)g_hash_table_lookup (loop->values, GINT_TO_POINTER (vreg));
+	int xreg;
+
+	xreg = GPOINTER_TO_INT (g_hash_table_lookup (loop->vregs, GINT_TO_POINTER (vreg)));
+	if (xreg)
+		return xreg;
+
+	g_assert (value && value->kind == VAL_INV);
+	if (value->is_float)
+		xreg = expand_r4 (cfg, bb, vreg);
+	else
+		xreg = emit_ins (cfg, bb, OP_EXPAND_I4, alloc_xreg (cfg), vreg, -1)->dreg;
+	g_hash_table_insert (loop->vregs, GINT_TO_POINTER (vreg), GINT_TO_POINTER (xreg));
+	return xreg;
+}
+
+static int
+expand_imm (MonoCompile *cfg, MonoBasicBlock *bb, int imm)
+{
+	MonoInst *ins;
+
+	ins = emit_ins (cfg, bb, OP_ICONST, alloc_ireg (cfg), -1, -1);
+	ins->inst_c0 = imm;
+	ins = emit_ins (cfg, bb, OP_EXPAND_I4, alloc_xreg (cfg), ins->dreg, -1);
+	return ins->dreg;
+}
+
+static int
+emit_swap_halves (MonoCompile *cfg, MonoBasicBlock *bb, int xreg)
+{
+	MonoInst *ins;
+
+	ins = emit_ins (cfg, bb, OP_PSHUFLED, alloc_xreg (cfg), xreg, -1);
+	ins->inst_c0 = mono_simd_shuffle_mask (2, 3, 0, 1);
+	return ins->dreg;
+}
+
+/*
+ * Add the horizontal sum of the vectorized value of OTHER to the sum variable.
+ */
+static void
+emit_sum_update (VectorLoop *loop, MonoBasicBlock *bb, int other)
+{
+	MonoCompile *cfg = loop->cfg;
+	MonoInst *ins;
+	int xreg, lo, hi, sreg;
+
+	xreg = get_vector (loop, bb, other);
+	if (loop->sum_is_float) {
+		/* sum += ((a0 + a2) + (a1 + a3)), computed in double precision */
+		lo = emit_ins (cfg, bb, OP_CVTPS2PD, alloc_xreg (cfg), xreg, -1)->dreg;
+		hi = emit_ins (cfg, bb, OP_CVTPS2PD, alloc_xreg (cfg), emit_swap_halves (cfg, bb, xreg), -1)->dreg;
+		xreg = emit_ins (cfg, bb, OP_ADDPD, alloc_xreg (cfg), lo, hi)->dreg;
+		xreg = emit_ins (cfg, bb, OP_ADDPD, alloc_xreg (cfg), xreg, emit_swap_halves (cfg, bb, xreg))->dreg;
+		ins = emit_ins (cfg, bb, OP_EXTRACT_R8, alloc_freg (cfg), xreg, -1);
+		ins->inst_c0 = 0;
+#ifdef TARGET_X86
+		ins->backend.spill_var = get_double_spill_area (cfg);
+#endif
+		emit_ins (cfg, bb, OP_FADD, loop->sum, loop->sum, ins->dreg);
+	} else {
+		xreg = emit_ins (cfg, bb, OP_PADDD, alloc_xreg (cfg), xreg, emit_swap_halves (cfg, bb, xreg))->dreg;
+		ins = emit_ins (cfg, bb, OP_PSHUFLED, alloc_xreg (cfg), xreg, -1);
+		ins->inst_c0 = mono_simd_shuffle_mask (1, 0, 3, 2);
+		xreg = emit_ins (cfg, bb, OP_PADDD, alloc_xreg (cfg), xreg, ins->dreg)->dreg;
+		sreg = emit_ins (cfg, bb, OP_EXTRACT_I4, alloc_ireg (cfg), xreg, -1)->dreg;
+		emit_ins (cfg, bb, OP_IADD, loop->sum, loop->sum, sreg);
+	}
+}
+
+/*
+ * Emit the vector compare of X1 and X2 computing OPCODE, as a vector of 0/1 integers.
+ */
+static int
+emit_compare (MonoCompile *cfg, MonoBasicBlock *bb, int opcode, int x1, int x2)
+{
+	MonoInst *ins;
+	int mask;
+
+	switch (opcode) {
+	case OP_ICEQ:
+	case OP_ICGT:
+		mask = emit_ins (cfg, bb, int_compare_to_simd (opcode), alloc_xreg (cfg), x1, x2)->dreg;
+		break;
+	case OP_ICLT:
+		mask = emit_ins (cfg, bb, OP_PCMPGTD, alloc_xreg (cfg), x2, x1)->dreg;
+		break;
+	case OP_FCEQ:
+	case OP_RCEQ:
+		ins = emit_ins (cfg, bb, OP_COMPPS, alloc_xreg (cfg), x1, x2);
+		ins->inst_c0 = SIMD_COMP_EQ;
+		mask = ins->dreg;
+		break;
+	case OP_FCGT:
+	case OP_RCGT:
+		/* Ordered like cgt, false if either operand is a NaN */
+		ins = emit_ins (cfg, bb, OP_COMPPS, alloc_xreg (cfg), x2, x1);
+		ins->inst_c0 = SIMD_COMP_LT;
+		mask = ins->dreg;
+		break;
+	case OP_FCLT:
+	case OP_RCLT:
+		ins = emit_ins (cfg, bb, OP_COMPPS, alloc_xreg (cfg), x1, x2);
+		ins->inst_c0 = SIMD_COMP_LT;
+		mask = ins->dreg;
+		break;
+	default:
+		g_assert_not_reached ();
+		return -1;
+	}
+	/* The lanes of the mask are 0 or -1 */
+	return emit_ins (cfg, bb, OP_PAND, alloc_xreg (cfg), mask, expand_imm (cfg, bb, 1))->dreg;
+}
+
+/*
+ * Emit the vector loop body into BB, by translating the instructions of the scalar body.
+ */
+static void
+emit_vector_body (VectorLoop *loop, MonoBasicBlock *bb)
+{
+	MonoCompile *cfg = loop->cfg;
+	MonoInst *ins, *new_ins;
+	VectorValue *value;
+	int index_reg, xreg, xreg2, other;
+
+	loop->vregs = g_hash_table_new (NULL, NULL);
+
+#if SIZEOF_REGISTER == 8
+	index_reg = emit_ins (cfg, bb, OP_SEXT_I4, alloc_preg (cfg), loop->iv, -1)->dreg;
+#else
+	index_reg = loop->iv;
+#endif
+
+	MONO_BB_FOR_EACH_INS (loop->body, ins) {
+		if (is_sum_add (loop, ins, &other)) {
+			emit_sum_update (loop, bb, other);
+			continue;
+		}
+
+		switch (ins->opcode) {
+		case OP_ICONST:
+		case OP_R4CONST:
+			/* Constants are only used as vector operands */
+			new_ins = emit_ins (cfg, bb, ins->opcode, ins->opcode == OP_ICONST ? alloc_ireg (cfg) : alloc_freg (cfg), -1, -1);
+			if (ins->opcode == OP_ICONST)
+				new_ins->inst_c0 = ins->inst_c0;
+			else
+				new_ins->inst_p0 = ins->inst_p0;
+			new_ins->type = ins->type;
+			if (ins->opcode == OP_ICONST)
+				xreg = emit_ins (cfg, bb, OP_EXPAND_I4, alloc_xreg (cfg), new_ins->dreg, -1)->dreg;
+			else
+				xreg = expand_r4 (cfg, bb, new_ins->dreg);
+			g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (xreg));
+			break;
+		case OP_SEXT_I4:
+		case OP_MOVE:
+		case OP_FMOVE:
+		case OP_RMOVE:
+			value = (VectorValue *)g_hash_table_lookup (loop->values, GINT_TO_POINTER (ins->dreg));
+			/* Copies of the induction variable/array references and the update of the sum are not needed */
+			if (ins->dreg == loop->iv || ins->dreg == loop->sum || !value || (value->kind != VAL_VECTOR && value->kind != VAL_INV) || value->var)
+				break;
+			g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (get_vector (loop, bb, ins->sreg1)));
+			break;
+		case OP_X86_LEA:
+			value = (VectorValue *)g_hash_table_lookup (loop->values, GINT_TO_POINTER (ins->dreg));
+			new_ins = emit_ins (cfg, bb, OP_X86_LEA, alloc_ireg_mp (cfg), value->var, index_reg);
+			new_ins->inst_imm = ins->inst_imm;
+			new_ins->backend.shift_amount = ins->backend.shift_amount;
+			g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (new_ins->dreg));
+			break;
+		case OP_LOADI4_MEMBASE:
+		case OP_LOADU4_MEMBASE:
+		case OP_LOADR4_MEMBASE:
+			new_ins = emit_ins (cfg, bb, OP_LOADX_MEMBASE, alloc_xreg (cfg), GPOINTER_TO_INT (g_hash_table_lookup (loop->vregs, GINT_TO_POINTER (ins->inst_basereg))), -1);
+			new_ins->inst_offset = 0;
+			g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (new_ins->dreg));
+			break;
+		case OP_STOREI4_MEMBASE_REG:
+		case OP_STORER4_MEMBASE_REG:
+		case OP_STOREI4_MEMBASE_IMM:
+			if (ins->opcode == OP_STOREI4_MEMBASE_IMM)
+				xreg = expand_imm (cfg, bb, ins->inst_imm);
+			else
+				xreg = get_vector (loop, bb, ins->sreg1);
+			new_ins = emit_ins (cfg, bb, OP_STOREX_MEMBASE, GPOINTER_TO_INT (g_hash_table_lookup (loop->vregs, GINT_TO_POINTER (ins->inst_destbasereg))), xreg, -1);
+			new_ins->inst_offset = 0;
+			break;
+		case OP_STOREI1_MEMBASE_REG:
+			/* Narrow the 0/1 lanes to bytes and store the four of them at once */
+			xreg = get_vector (loop, bb, ins->sreg1);
+			xreg = emit_ins (cfg, bb, OP_PACKD, alloc_xreg (cfg), xreg, xreg)->dreg;
+			xreg = emit_ins (cfg, bb, OP_PACKW_UN, alloc_xreg (cfg), xreg, xreg)->dreg;
+			xreg2 = emit_ins (cfg, bb, OP_EXTRACT_I4, alloc_ireg (cfg), xreg, -1)->dreg;
+			new_ins = emit_ins (cfg, bb, OP_STOREI4_MEMBASE_REG, GPOINTER_TO_INT (g_hash_table_lookup (loop->vregs, GINT_TO_POINTER (ins->inst_destbasereg))), xreg2, -1);
+			new_ins->inst_offset = 0;
+			break;
+		case OP_ICOMPARE:
+		case OP_ICOMPARE_IMM:
+			xreg = get_vector (loop, bb, ins->sreg1);
+			if (ins->opcode == OP_ICOMPARE)
+				xreg2 = get_vector (loop, bb, ins->sreg2);
+			else
+				xreg2 = expand_imm (cfg, bb, ins->inst_imm);
+			ins = ins->next;
+			g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (emit_compare (cfg, bb, ins->opcode, xreg, xreg2)));
+			break;
+		case OP_IADD_IMM:
+		case OP_ISUB_IMM:
+		case OP_IAND_IMM:
+		case OP_IOR_IMM:
+		case OP_IXOR_IMM:
+			value = (VectorValue *)g_hash_table_lookup (loop->values, GINT_TO_POINTER (ins->dreg));
+			if (ins->sreg1 == loop->iv || !value || value->kind != VAL_VECTOR)
+				/* The increment of the induction variable */
+				break;
+			xreg = get_vector (loop, bb, ins->sreg1);
+			xreg2 = expand_imm (cfg, bb, ins->inst_imm);
+			new_ins = emit_ins (cfg, bb, int_op_to_simd (ins->opcode), alloc_xreg (cfg), xreg, xreg2);
+			g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (new_ins->dreg));
+			break;
+		default:
+			if (is_float_compare (cfg, ins->opcode)) {
+				xreg = emit_compare (cfg, bb, ins->opcode, get_vector (loop, bb, ins->sreg1), get_vector (loop, bb, ins->sreg2));
+				g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (xreg));
+				break;
+			}
+			if (int_op_to_simd (ins->opcode) != -1 || float_op_to_simd (cfg, ins->opcode) != -1) {
+				int opcode = int_op_to_simd (ins->opcode) != -1 ? int_op_to_simd (ins->opcode) : float_op_to_simd (cfg, ins->opcode);
+
+				xreg = get_vector (loop, bb, ins->sreg1);
+				xreg2 = get_vector (loop, bb, ins->sreg2);
+				new_ins = emit_ins (cfg, bb, opcode, alloc_xreg (cfg), xreg, xreg2);
+				g_hash_table_insert (loop->vregs, GINT_TO_POINTER (ins->dreg), GINT_TO_POINTER (new_ins->dreg));
+			}
+			/* Everything else are bounds/null checks and branches */
+			break;
+		}
+	}
+
+	new_ins = emit_ins (cfg, bb, OP_IADD_IMM, loop->iv, loop->iv, -1);
+	new_ins->inst_imm = VECTOR_LENGTH;
+
+	g_hash_table_destroy (loop->vregs);
+}
+
+static void
+vectorize_loop (VectorLoop *loop)
+{
+	MonoCompile *cfg = loop->cfg;
+	MonoBasicBlock *header = loop->header, *preheader = loop->preheader;
+	MonoBasicBlock *guard_bb, *next_bb, *vheader_bb, *vbody_bb, *last_bb;
+	MonoInst *ins, *vlimit_var;
+	int i, limit, length_reg;
+
+	guard_bb = new_bblock (cfg, preheader);
+	vheader_bb = new_bblock (cfg, header);
+	vbody_bb = new_bblock (cfg, loop->body);
+	vbody_bb->has_array_access = TRUE;
+
+	mono_unlink_bblock (cfg, preheader, header);
+	preheader->last_ins->inst_target_bb = guard_bb;
+	mono_link_bblock (cfg, preheader, guard_bb);
+
+	/* iv >= 0 */
+	next_bb = guard_bb;
+	ins = emit_ins (cfg, next_bb, OP_ICOMPARE_IMM, -1, loop->iv, -1);
+	ins->inst_imm = 0;
+	next_bb = emit_guard_branch (cfg, next_bb, OP_IBLT, header);
+
+	/* The limit is used by the following bblocks, so it needs to be a variable */
+	if (loop->limit_array != -1 || loop->limit_is_imm) {
+		limit = mono_compile_create_var (cfg, &mono_defaults.int32_class->byval_arg, OP_LOCAL)->dreg;
+		if (loop->limit_array != -1) {
+			next_bb = emit_array_length (cfg, next_bb, loop->limit_array, header, limit);
+		} else {
+			ins = emit_ins (cfg, next_bb, OP_ICONST, limit, -1, -1);
+			ins->inst_c0 = loop->limit_imm;
+		}
+	} else {
+		limit = loop->limit;
+	}
+
+	/* limit <= a.Length or limit < a.Length */
+	for (i = 0; i < loop->num_arrays; ++i) {
+		length_reg = alloc_ireg (cfg);
+		next_bb = emit_array_length (cfg, next_bb, loop->arrays [i], header, length_reg);
+		emit_ins (cfg, next_bb, OP_ICOMPARE, -1, limit, length_reg);
+		next_bb = emit_guard_branch (cfg, next_bb, loop->inclusive ? OP_IBGE : OP_IBGT, header);
+	}
+
+	/*
+	 * The vector loop runs while iv + 3 < limit (iv + 3 <= limit if inclusive). The limit is
+	 * at most an array length, so the subtraction can only underflow if it is negative.
+	 */
+	ins = emit_ins (cfg, next_bb, OP_ICOMPARE_IMM, -1, limit, -1);
+	ins->inst_imm = VECTOR_LENGTH;
+	next_bb = emit_guard_branch (cfg, next_bb, OP_IBLT, header);
+	vlimit_var = mono_compile_create_var (cfg, &mono_defaults.int32_class->byval_arg, OP_LOCAL);
+	ins = emit_ins (cfg, next_bb, OP_ISUB_IMM, vlimit_var->dreg, limit, -1);
+	ins->inst_imm = loop->inclusive ? VECTOR_LENGTH - 2 : VECTOR_LENGTH - 1;
+	emit_br (cfg, next_bb, vheader_bb);
+	last_bb = next_bb;
+
+	/* The vector loop */
+	emit_ins (cfg, vheader_bb, OP_ICOMPARE, -1, loop->iv, vlimit_var->dreg);
+	MONO_INST_NEW (cfg, ins, OP_IBGE);
+	ins->inst_true_bb = header;
+	ins->inst_false_bb = vbody_bb;
+	MONO_ADD_INS (vheader_bb, ins);
+	mono_link_bblock (cfg, vheader_bb, header);
+	mono_link_bblock (cfg, vheader_bb, vbody_bb);
+
+	emit_vector_body (loop, vbody_bb);
+	emit_br (cfg, vbody_bb, vheader_bb);
+
+	/* Lay out the new bblocks after the preheader */
+	next_bb = preheader->next_bb;
+	preheader->next_bb = guard_bb;
+	last_bb->next_bb = vheader_bb;
+	vheader_bb->next_bb = vbody_bb;
+	vbody_bb->next_bb = next_bb;
+
+	g_hash_table_destroy (loop->values);
+}
+
+/**
+ * mono_simd_vectorize_loops:
+ * \param cfg Control Flow Graph
+ *
+ * Vectorize the innermost loops which consist of a header and a body, see the comment
+ * at the beginning of this file. Returns whenever the CFG was changed.
+ */
+gboolean
+mono_simd_vectorize_loops (MonoCompile *cfg)
+{
+	VectorLoop *loops = NULL;
+	VectorLoop loop;
+	MonoBasicBlock *bb;
+	int i, nloops = 0;
+
+	if (!(cfg->comp_done & MONO_COMP_LOOPS))
+		return FALSE;
+#ifdef TARGET_X86
+	if (!(cfg->opt & MONO_OPT_SSE2))
+		return FALSE;
+#endif
+
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		if (!is_loop_header (bb) || !analyze_loop (cfg, bb, &loop))
+			continue;
+		loops = (VectorLoop *)g_realloc (loops, sizeof (VectorLoop) * (nloops + 1));
+		loops [nloops ++] = loop;
+	}
+
+	for (i = 0; i < nloops; ++i) {
+		if (cfg->verbose_level > 1)
+			printf ("VECTORIZE: vectorized loop BB%d (%d arrays%s) in %s\n", loops [i].header->block_num, loops [i].num_arrays, loops [i].sum != -1 ? ", sum" : "", mono_method_full_name (cfg->method, TRUE));
+		vectorize_loop (&loops [i]);
+		mono_jit_stats.loops_vectorized ++;
+	}
+
+	g_free (loops);
+	return nloops > 0;
+}
+
+#else
+
+gboolean
+mono_simd_vectorize_loops (MonoCompile *cfg)
+{
+	return FALSE;
+}
+
+#endif /* MONO_ARCH_SIMD_INTRINSICS && !DISABLE_JIT */
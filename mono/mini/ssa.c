@@ -1380,43 +1380,6 @@ mono_ssa_deadce (MonoCompile *cfg)
 	}
 }
 
-#if 0
-void
-mono_ssa_strength_reduction (MonoCompile *cfg)
-{
-	MonoBasicBlock *bb;
-	int i;
-
-	g_assert (cfg->comp_done & MONO_COMP_SSA);
-	g_assert (cfg->comp_done & MONO_COMP_LOOPS);
-	g_assert (cfg->comp_done & MONO_COMP_SSA_DEF_USE);
-
-	for (bb = cfg->bb_entry->next_bb; bb; bb = bb->next_bb) {
-		GList *lp = bb->loop_blocks;
-
-		if (lp) {
-			MonoBasicBlock *h = (MonoBasicBlock *)lp->data;
-
-			/* we only consider loops with 2 in bblocks */
-			if (!h->in_count == 2)
-				continue;
-
-			for (i = 0; i < cfg->num_varinfo; i++) {
-				MonoMethodVar *info = MONO_VARINFO (cfg, i);
-			
-				if (info->def && info->def->ssa_op == MONO_SSA_STORE &&
-				    info->def->inst_i0->opcode == OP_LOCAL && g_list_find (lp, info->def_bb)) {
-					MonoInst *v = info->def->inst_i1;
-
-
-					printf ("FOUND %d in %s\n", info->idx, mono_method_full_name (cfg->method, TRUE));
-				}
-			}
-		}
-	}
-}
-#endif
-
 void
 mono_ssa_loop_invariant_code_motion (MonoCompile *cfg)
 {
@@ -1521,6 +1484,523 @@ mono_ssa_loop_invariant_code_motion (MonoCompile *cfg)
 	}
 }
 
+/*
+ * Return whenever INS computes its result from its sregs only, without faulting or
+ * having any other side effects, so it can be executed speculatively.
+ */
+static gboolean
+licm_is_pure_op (MonoInst *ins)
+{
+	switch (ins->opcode) {
+	case OP_ICONST:
+	case OP_I8CONST:
+	case OP_R4CONST:
+	case OP_R8CONST:
+	case OP_AOTCONST:
+	case OP_MOVE:
+	case OP_FMOVE:
+	case OP_RMOVE:
+	case OP_IADD:
+	case OP_ISUB:
+	case OP_IMUL:
+	case OP_IAND:
+	case OP_IOR:
+	case OP_IXOR:
+	case OP_ISHL:
+	case OP_ISHR:
+	case OP_ISHR_UN:
+	case OP_INEG:
+	case OP_INOT:
+	case OP_IADD_IMM:
+	case OP_ISUB_IMM:
+	case OP_IMUL_IMM:
+	case OP_IAND_IMM:
+	case OP_IOR_IMM:
+	case OP_IXOR_IMM:
+	case OP_ISHL_IMM:
+	case OP_ISHR_IMM:
+	case OP_ISHR_UN_IMM:
+	case OP_ICONV_TO_I1:
+	case OP_ICONV_TO_U1:
+	case OP_ICONV_TO_I2:
+	case OP_ICONV_TO_U2:
+#if SIZEOF_REGISTER == 8
+	case OP_LADD:
+	case OP_LSUB:
+	case OP_LMUL:
+	case OP_LAND:
+	case OP_LOR:
+	case OP_LXOR:
+	case OP_LSHL:
+	case OP_LSHR:
+	case OP_LSHR_UN:
+	case OP_LNEG:
+	case OP_LNOT:
+	case OP_LADD_IMM:
+	case OP_LSUB_IMM:
+	case OP_LMUL_IMM:
+	case OP_LAND_IMM:
+	case OP_LOR_IMM:
+	case OP_LXOR_IMM:
+	case OP_LSHL_IMM:
+	case OP_LSHR_IMM:
+	case OP_LSHR_UN_IMM:
+	case OP_SEXT_I4:
+	case OP_ZEXT_I4:
+#endif
+#if defined(TARGET_X86) || defined(TARGET_AMD64)
+	case OP_X86_LEA:
+#endif
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static gboolean
+licm_is_load (MonoInst *ins)
+{
+	return ins->opcode >= OP_LOAD_MEMBASE && ins->opcode <= OP_LOADI8_MEMBASE;
+}
+
+/*
+ * Return whenever INS might modify memory visible to loads, or act as a barrier for
+ * them. This is conservative, everything not known to be harmless is treated as a write.
+ */
+static gboolean
+licm_writes_memory (MonoInst *ins)
+{
+	if (licm_is_pure_op (ins) || MONO_INS_HAS_NO_SIDE_EFFECT (ins) || licm_is_load (ins))
+		return FALSE;
+	if (MONO_IS_BRANCH_OP (ins) || MONO_IS_COND_EXC (ins))
+		return FALSE;
+
+	switch (ins->opcode) {
+	case OP_COMPARE:
+	case OP_COMPARE_IMM:
+	case OP_ICOMPARE:
+	case OP_ICOMPARE_IMM:
+	case OP_LCOMPARE:
+	case OP_LCOMPARE_IMM:
+	case OP_FCOMPARE:
+	case OP_RCOMPARE:
+	case OP_LOADR4_MEMBASE:
+	case OP_LOADR8_MEMBASE:
+	case OP_BOUNDS_CHECK:
+	case OP_CHECK_THIS:
+	case OP_LDLEN:
+	case OP_STRLEN:
+	case OP_DUMMY_USE:
+		return FALSE;
+	default:
+		return TRUE;
+	}
+}
+
+/*
+ * Return the preceeding bblock of the loop headed by H, i.e. the immediate dominator
+ * of H if it unconditionally branches to H, or NULL.
+ */
+static MonoBasicBlock*
+loop_preheader (MonoBasicBlock *h)
+{
+	MonoBasicBlock *idom = h->idom;
+
+	if (!(idom && idom->last_ins && idom->last_ins->opcode == OP_BR && idom->last_ins->inst_target_bb == h))
+		return NULL;
+	if (idom->region != h->region)
+		return NULL;
+	return idom;
+}
+
+static gboolean
+licm_vreg_is_tracked (MonoCompile *cfg, int vreg)
+{
+	MonoInst *var;
+
+	if (vreg < MONO_MAX_IREGS || vreg >= cfg->next_vreg)
+		return FALSE;
+	var = get_vreg_to_inst (cfg, vreg);
+	if (var && (var->flags & (MONO_INST_VOLATILE|MONO_INST_INDIRECT)))
+		return FALSE;
+	return TRUE;
+}
+
+typedef struct {
+	MonoCompile *cfg;
+	MonoBasicBlock *h, *preheader;
+	/* Number of definitions of each vreg inside the loop, saturated at 2 */
+	guint8 *ndefs;
+	/* Vregs which are known to be non-null in the preheader */
+	gboolean *deref;
+	gboolean writes_memory;
+} LicmLoop;
+
+static gboolean
+licm_can_hoist (LicmLoop *loop, MonoBasicBlock *bb, MonoInst *ins, gboolean header_clean)
+{
+	MonoCompile *cfg = loop->cfg;
+	const char *spec = INS_INFO (ins->opcode);
+	int i, num_sregs;
+	int sregs [MONO_MAX_SRC_REGS];
+
+	if (bb->region != loop->h->region)
+		return FALSE;
+
+	num_sregs = mono_inst_get_src_registers (ins, sregs);
+	for (i = 0; i < num_sregs; ++i) {
+		if (!licm_vreg_is_tracked (cfg, sregs [i]) || loop->ndefs [sregs [i]])
+			return FALSE;
+	}
+
+	if (spec [MONO_INST_DEST] != ' ') {
+		if (!licm_vreg_is_tracked (cfg, ins->dreg) || loop->ndefs [ins->dreg] != 1)
+			return FALSE;
+	}
+
+	if (licm_is_pure_op (ins))
+		return TRUE;
+
+	if (ins->opcode == OP_LDLEN || ins->opcode == OP_STRLEN || ins->opcode == OP_CHECK_THIS || ins->opcode == OP_GENERIC_CLASS_INIT) {
+		/* These can fault or have side effects, so they are only moved out of the loop header */
+		return header_clean;
+	}
+
+	if (licm_is_load (ins)) {
+		if (!(ins->flags & MONO_INST_INVARIANT_LOAD) && loop->writes_memory)
+			return FALSE;
+		/* Loads outside the header can only be moved if the address is known to be valid */
+		return header_clean || loop->deref [ins->sreg1];
+	}
+
+	return FALSE;
+}
+
+static void
+licm_loop (MonoCompile *cfg, MonoBasicBlock *h, MonoBasicBlock *preheader, guint8 *ndefs, gboolean *deref)
+{
+	LicmLoop loop;
+	GList *l;
+	MonoInst *ins, *n;
+	gboolean changed;
+
+	memset (ndefs, 0, cfg->next_vreg);
+	memset (deref, 0, cfg->next_vreg * sizeof (gboolean));
+
+	loop.cfg = cfg;
+	loop.h = h;
+	loop.preheader = preheader;
+	loop.ndefs = ndefs;
+	loop.deref = deref;
+	loop.writes_memory = FALSE;
+
+	for (l = h->loop_blocks; l; l = l->next) {
+		MonoBasicBlock *bb = (MonoBasicBlock *)l->data;
+
+		/* Unreachable blocks are not numbered, see mono_compute_natural_loops () */
+		if (!bb->dfn)
+			return;
+
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			const char *spec = INS_INFO (ins->opcode);
+
+			if (spec [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && ins->dreg < cfg->next_vreg && ndefs [ins->dreg] < 2)
+				ndefs [ins->dreg] ++;
+			if (licm_writes_memory (ins))
+				loop.writes_memory = TRUE;
+		}
+	}
+
+	do {
+		changed = FALSE;
+		for (l = h->loop_blocks; l; l = l->next) {
+			MonoBasicBlock *bb = (MonoBasicBlock *)l->data;
+			gboolean header_clean = bb == h;
+
+			MONO_BB_FOR_EACH_INS_SAFE (bb, n, ins) {
+				if (!licm_can_hoist (&loop, bb, ins, header_clean)) {
+					if (!MONO_INS_HAS_NO_SIDE_EFFECT (ins) && !licm_is_pure_op (ins))
+						header_clean = FALSE;
+					continue;
+				}
+
+				if (cfg->verbose_level > 1) {
+					printf ("licm in BB%d on ", bb->block_num);
+					mono_print_ins (ins);
+				}
+
+				MONO_REMOVE_INS (bb, ins);
+				mono_add_ins_to_end (preheader, ins);
+				if (ins->opcode == OP_LDLEN || ins->opcode == OP_STRLEN)
+					preheader->has_array_access = TRUE;
+				if (ins->opcode == OP_LDLEN || ins->opcode == OP_STRLEN || ins->opcode == OP_CHECK_THIS || licm_is_load (ins))
+					deref [ins->sreg1] = TRUE;
+				if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ')
+					ndefs [ins->dreg] = 0;
+				mono_jit_stats.licm_hoisted ++;
+				changed = TRUE;
+			}
+		}
+	} while (changed);
+}
+
+static int
+compare_loop_nesting (gconstpointer a, gconstpointer b)
+{
+	MonoBasicBlock *bb1 = *(MonoBasicBlock**)a;
+	MonoBasicBlock *bb2 = *(MonoBasicBlock**)b;
+
+	return bb2->nesting - bb1->nesting;
+}
+
+/*
+ * Return the loop headers of the method, innermost loops first, so code hoisted out
+ * of an inner loop can be hoisted out of the enclosing loops too.
+ */
+static GPtrArray*
+get_loop_headers (MonoCompile *cfg)
+{
+	GPtrArray *headers = g_ptr_array_new ();
+	MonoBasicBlock *bb;
+
+	for (bb = cfg->bb_entry->next_bb; bb; bb = bb->next_bb) {
+		if (bb->loop_blocks && bb->loop_blocks->data == bb)
+			g_ptr_array_add (headers, bb);
+	}
+	g_ptr_array_sort (headers, compare_loop_nesting);
+	return headers;
+}
+
+/*
+ * mono_ssa_licm:
+ *
+ *   Move loop invariant computations out of loops into the preceeding bblock. Unlike
+ * mono_ssa_loop_invariant_code_motion (), this looks at every bblock of the loop, and
+ * handles instructions which depend on other invariant instructions.
+ * Pure instructions are moved from anywhere in the loop. Instructions which can fault
+ * are only moved out of the loop header if no instruction with side effects precedes
+ * them. Loads are only moved if the loop doesn't write memory, or the load is invariant.
+ */
+void
+mono_ssa_licm (MonoCompile *cfg)
+{
+	GPtrArray *headers;
+	guint8 *ndefs;
+	gboolean *deref;
+	int i;
+
+	g_assert (cfg->comp_done & MONO_COMP_SSA);
+	if (!(cfg->comp_done & MONO_COMP_LOOPS) || !(cfg->comp_done & MONO_COMP_IDOM))
+		return;
+
+	headers = get_loop_headers (cfg);
+	if (!headers->len) {
+		g_ptr_array_free (headers, TRUE);
+		return;
+	}
+
+	ndefs = (guint8 *)g_malloc (cfg->next_vreg);
+	deref = g_new (gboolean, cfg->next_vreg);
+
+	for (i = 0; i < headers->len; ++i) {
+		MonoBasicBlock *h = (MonoBasicBlock *)g_ptr_array_index (headers, i);
+		MonoBasicBlock *preheader = loop_preheader (h);
+
+		if (preheader)
+			licm_loop (cfg, h, preheader, ndefs, deref);
+	}
+
+	g_free (ndefs);
+	g_free (deref);
+	g_ptr_array_free (headers, TRUE);
+}
+
+typedef struct {
+	int iv, factor;
+	MonoInst *var;
+} ReducedIV;
+
+#define MAX_REDUCED_IVS 16
+
+/*
+ * mono_ssa_strength_reduction:
+ *
+ *   Replace multiplications of basic induction variables by a constant with new
+ * induction variables which are incremented by the scaled step on each iteration.
+ * A basic induction variable is a phi in the loop header whose value on the back edge
+ * is the phi plus/minus a constant. The new variables are initialized in the preceeding
+ * bblock and incremented at the end of the latch. Since integer multiplication
+ * distributes over addition modulo 2^n, this is exact even when the values overflow.
+ */
+void
+mono_ssa_strength_reduction (MonoCompile *cfg)
+{
+	GPtrArray *headers;
+	MonoInst **defs;
+	MonoBasicBlock *bb;
+	MonoInst *ins;
+	int i, num_vregs;
+
+	g_assert (cfg->comp_done & MONO_COMP_SSA);
+	if (!(cfg->comp_done & MONO_COMP_LOOPS) || !(cfg->comp_done & MONO_COMP_IDOM))
+		return;
+
+	headers = get_loop_headers (cfg);
+	if (!headers->len) {
+		g_ptr_array_free (headers, TRUE);
+		return;
+	}
+
+	/* New variables are created below, only vregs below num_vregs are in defs */
+	num_vregs = cfg->next_vreg;
+
+	/* vreg -> defining instruction, only valid for vregs with a single definition */
+	defs = g_new0 (MonoInst*, num_vregs);
+	for (bb = cfg->bb_entry; bb; bb = bb->next_bb) {
+		MONO_BB_FOR_EACH_INS (bb, ins) {
+			if (INS_INFO (ins->opcode) [MONO_INST_DEST] != ' ' && !MONO_IS_STORE_MEMBASE (ins) && ins->dreg < num_vregs)
+				defs [ins->dreg] = ins;
+		}
+	}
+
+	for (i = 0; i < headers->len; ++i) {
+		MonoBasicBlock *h = (MonoBasicBlock *)g_ptr_array_index (headers, i);
+		MonoBasicBlock *preheader = loop_preheader (h);
+		MonoBasicBlock *latch;
+		ReducedIV reduced [MAX_REDUCED_IVS];
+		int num_reduced = 0;
+		int pre_index, latch_index;
+		MonoInst *phi;
+		GList *l;
+
+		if (!preheader || h->in_count != 2)
+			continue;
+		pre_index = h->in_bb [0] == preheader ? 0 : 1;
+		latch_index = 1 - pre_index;
+		latch = h->in_bb [latch_index];
+		if (h->in_bb [pre_index] != preheader || !g_list_find (h->loop_blocks, latch) || latch->region != h->region)
+			continue;
+
+		for (phi = h->code; phi && MONO_IS_PHI (phi); phi = phi->next) {
+			MonoInst *def;
+			int init, next, steps, add_opcode, mul_opcode;
+			gint64 step;
+
+			if (phi->opcode != OP_PHI || phi->dreg >= num_vregs || !licm_vreg_is_tracked (cfg, phi->dreg))
+				continue;
+			init = phi->inst_phi_args [pre_index + 1];
+			next = phi->inst_phi_args [latch_index + 1];
+
+			def = next < num_vregs ? defs [next] : NULL;
+			for (steps = 0; def && def->opcode == OP_MOVE && steps < 4; ++steps)
+				def = def->sreg1 < num_vregs ? defs [def->sreg1] : NULL;
+			if (!def || def->sreg1 != phi->dreg)
+				continue;
+
+			switch (def->opcode) {
+			case OP_IADD_IMM:
+			case OP_ISUB_IMM:
+				add_opcode = OP_IADD_IMM;
+				mul_opcode = OP_IMUL_IMM;
+				break;
+#if SIZEOF_REGISTER == 8
+			case OP_LADD_IMM:
+			case OP_LSUB_IMM:
+				add_opcode = OP_LADD_IMM;
+				mul_opcode = OP_LMUL_IMM;
+				break;
+#endif
+			default:
+				continue;
+			}
+			if (def->inst_imm != (gint32)def->inst_imm)
+				continue;
+			step = (def->opcode == OP_ISUB_IMM || def->opcode == OP_LSUB_IMM) ? - (gint64)def->inst_imm : (gint64)def->inst_imm;
+
+			for (l = h->loop_blocks; l; l = l->next) {
+				MonoBasicBlock *loop_bb = (MonoBasicBlock *)l->data;
+
+				if (loop_bb->region != h->region)
+					continue;
+
+				MONO_BB_FOR_EACH_INS (loop_bb, ins) {
+					MonoInst *var, *tins, *new_phi;
+					MonoClass *klass;
+					gint64 stride;
+					int j;
+
+					if (ins->opcode != mul_opcode || ins->sreg1 != phi->dreg || ins->inst_imm != (gint32)ins->inst_imm)
+						continue;
+					stride = step * (gint64)ins->inst_imm;
+					if (stride != (gint32)stride)
+						continue;
+
+					var = NULL;
+					for (j = 0; j < num_reduced; ++j) {
+						if (reduced [j].iv == phi->dreg && reduced [j].factor == ins->inst_imm)
+							var = reduced [j].var;
+					}
+
+					if (!var) {
+						MonoInst *init_var, *next_var;
+
+						if (num_reduced == MAX_REDUCED_IVS)
+							continue;
+
+						klass = mul_opcode == OP_IMUL_IMM ? mono_defaults.int32_class : mono_defaults.int64_class;
+						var = mono_compile_create_var (cfg, &klass->byval_arg, OP_LOCAL);
+						init_var = mono_compile_create_var (cfg, &klass->byval_arg, OP_LOCAL);
+						next_var = mono_compile_create_var (cfg, &klass->byval_arg, OP_LOCAL);
+
+						/* init_var = init * factor in the preheader */
+						MONO_INST_NEW (cfg, tins, mul_opcode);
+						tins->dreg = init_var->dreg;
+						tins->sreg1 = init;
+						tins->inst_imm = ins->inst_imm;
+						mono_add_ins_to_end (preheader, tins);
+
+						/* var = phi (init_var, next_var) in the header */
+						MONO_INST_NEW (cfg, new_phi, OP_PHI);
+						new_phi->inst_c0 = var->inst_c0;
+						new_phi->dreg = var->dreg;
+						new_phi->klass = klass;
+						new_phi->inst_phi_args = (int *)mono_mempool_alloc0 (cfg->mempool, sizeof (int) * (h->in_count + 1));
+						new_phi->inst_phi_args [0] = h->in_count;
+						new_phi->inst_phi_args [pre_index + 1] = init_var->dreg;
+						new_phi->inst_phi_args [latch_index + 1] = next_var->dreg;
+						mono_bblock_insert_before_ins (h, h->code, new_phi);
+
+						/* next_var = var + step * factor in the latch */
+						MONO_INST_NEW (cfg, tins, add_opcode);
+						tins->dreg = next_var->dreg;
+						tins->sreg1 = var->dreg;
+						tins->inst_imm = stride;
+						mono_add_ins_to_end (latch, tins);
+
+						reduced [num_reduced].iv = phi->dreg;
+						reduced [num_reduced].factor = ins->inst_imm;
+						reduced [num_reduced].var = var;
+						num_reduced ++;
+					}
+
+					if (cfg->verbose_level > 1) {
+						printf ("strength reduction in BB%d of R%d on ", loop_bb->block_num, phi->dreg);
+						mono_print_ins (ins);
+					}
+
+					ins->opcode = OP_MOVE;
+					ins->sreg1 = var->dreg;
+					ins->inst_imm = 0;
+					mono_jit_stats.ivs_strength_reduced ++;
+				}
+			}
+		}
+	}
+
+	g_free (defs);
+	g_ptr_array_free (headers, TRUE);
+}
+
 #else /* !DISABLE_JIT */
 
 MONO_EMPTY_SOURCE_FILE (ssa);
@@ -7,8 +7,10 @@
  * This profiler collects profiling information usable by the Mono AOT compiler
  * to generate better code. It saves the information into files under ~/.mono. 
  * The AOT compiler can load these files during compilation.
- * Currently, only the order in which methods were compiled is saved, 
- * allowing more efficient function ordering in the AOT files.
+ * The order in which methods were compiled is saved, allowing more efficient
+ * function ordering in the AOT files. With the 'counts' option, the number of
+ * calls and the execution counts of each IL offset are saved too, allowing the
+ * AOT compiler to order methods by hotness and to move cold code out of line.
  * Licensed under the MIT license. See LICENSE file in the project root for full license information.
  */
 
@@ -16,6 +18,7 @@
 
 #include "aot.h"
 
+#include <mono/mini/aot-profile.h>
 #include <mono/metadata/profiler.h>
 #include <mono/metadata/tokentype.h>
 #include <mono/metadata/tabledefs.h>
@@ -34,16 +37,17 @@
 #endif
 
 struct _MonoProfiler {
-	GHashTable *classes;
-	GHashTable *images;
 	GPtrArray *methods;
-	FILE *outfile;
-	int id;
+	MonoAotProfileWriter writer;
 	char *outfile_name;
+	MonoProfilerHandle handle;
+	/* IL offset/count pairs of the method being saved */
+	GArray *counts;
 };
 
 static mono_mutex_t mutex;
 static gboolean verbose;
+static gboolean record_counts;
 
 static void
 prof_jit_leave (MonoProfiler *prof, MonoMethod *method, MonoJitInfo *jinfo)
@@ -58,6 +62,14 @@ prof_jit_leave (MonoProfiler *prof, MonoMethod *method, MonoJitInfo *jinfo)
 	mono_os_mutex_unlock (&mutex);
 }
 
+static mono_bool
+prof_coverage_filter (MonoProfiler *prof, MonoMethod *method)
+{
+	MonoImage *image = mono_class_get_image (mono_method_get_class (method));
+
+	return image->assembly && !method->wrapper_type;
+}
+
 static void
 prof_shutdown (MonoProfiler *prof);
 
@@ -69,6 +81,7 @@ usage (int do_exit)
 	printf ("Options:\n");
 	printf ("\thelp                 show this usage info\n");
 	printf ("\toutput=FILENAME      write the data to file FILENAME (required)\n");
+	printf ("\tcounts               record call and IL offset execution counts (slow)\n");
 	printf ("\tverbose              print diagnostic info\n");
 	if (do_exit)
 		exit (1);
@@ -146,6 +159,10 @@ mono_profiler_init (const char *desc)
 			verbose = TRUE;
 			continue;
 		}
+		if ((opt = match_option (p, "counts", NULL)) != p) {
+			record_counts = TRUE;
+			continue;
+		}
 		if ((opt = match_option (p, "output", &val)) != p) {
 			outfile_name = val;
 			continue;
@@ -160,198 +177,58 @@ mono_profiler_init (const char *desc)
 	}
 
 	prof = g_new0 (MonoProfiler, 1);
-	prof->images = g_hash_table_new (NULL, NULL);
-	prof->classes = g_hash_table_new (NULL, NULL);
 	prof->methods = g_ptr_array_new ();
 	prof->outfile_name = outfile_name;
 
 	mono_os_mutex_init (&mutex);
 
 	MonoProfilerHandle handle = mono_profiler_install (prof);
+	prof->handle = handle;
 	mono_profiler_set_runtime_shutdown_end_callback (handle, prof_shutdown);
 	mono_profiler_set_jit_done_callback (handle, prof_jit_leave);
+	if (record_counts) {
+		/* The counts are collected using the code coverage instrumentation */
+		prof->counts = g_array_new (FALSE, FALSE, sizeof (guint32));
+		mono_profiler_set_coverage_filter_callback (handle, prof_coverage_filter);
+	}
 }
 
 static void
-emit_byte (MonoProfiler *prof, guint8 value)
-{
-	fwrite (&value, 1, 1, prof->outfile);
-}
-
-static void
-emit_int32 (MonoProfiler *prof, int value)
-{
-	// FIXME: Endianness
-	fwrite (&value, 4, 1, prof->outfile);
-}
-
-static void
-emit_string (MonoProfiler *prof, const char *str)
+add_coverage_entry (MonoProfiler *prof, const MonoProfilerCoverageData *data)
 {
-	int len = strlen (str);
+	guint32 entry [2];
 
-	emit_int32 (prof, len);
-	fwrite (str, len, 1, prof->outfile);
+	if (!data->counter)
+		return;
+	entry [0] = data->il_offset;
+	entry [1] = data->counter;
+	g_array_append_vals (prof->counts, entry, 2);
 }
 
 static void
-emit_record (MonoProfiler *prof, AotProfRecordType type, int id)
-{
-	emit_byte (prof, type);
-	emit_int32 (prof, id);
-}
-
-static int
-add_image (MonoProfiler *prof, MonoImage *image)
-{
-	int id = GPOINTER_TO_INT (g_hash_table_lookup (prof->images, image));
-	if (id)
-		return id - 1;
-
-	id = prof->id ++;
-	emit_record (prof, AOTPROF_RECORD_IMAGE, id);
-	emit_string (prof, image->assembly->aname.name);
-	emit_string (prof, image->guid);
-	g_hash_table_insert (prof->images, image, GINT_TO_POINTER (id + 1));
-	return id;
-}
-
-static int
-add_class (MonoProfiler *prof, MonoClass *klass);
-
-static int
-add_type (MonoProfiler *prof, MonoType *type)
-{
-	switch (type->type) {
-#if 0
-	case MONO_TYPE_SZARRAY: {
-		int eid = add_type (prof, &type->data.klass->byval_arg);
-		if (eid == -1)
-			return -1;
-		int id = prof->id ++;
-		emit_record (prof, AOTPROF_RECORD_TYPE, id);
-		emit_byte (prof, MONO_TYPE_SZARRAY);
-		emit_int32 (prof, id);
-		return id;
-	}
-#endif
-	case MONO_TYPE_BOOLEAN:
-	case MONO_TYPE_CHAR:
-	case MONO_TYPE_I1:
-	case MONO_TYPE_U1:
-	case MONO_TYPE_I2:
-	case MONO_TYPE_U2:
-	case MONO_TYPE_I4:
-	case MONO_TYPE_U4:
-	case MONO_TYPE_I8:
-	case MONO_TYPE_U8:
-	case MONO_TYPE_R4:
-	case MONO_TYPE_R8:
-	case MONO_TYPE_I:
-	case MONO_TYPE_U:
-	case MONO_TYPE_OBJECT:
-	case MONO_TYPE_STRING:
-	case MONO_TYPE_CLASS:
-	case MONO_TYPE_VALUETYPE:
-	case MONO_TYPE_GENERICINST:
-		return add_class (prof, mono_class_from_mono_type (type));
-	default:
-		return -1;
-	}
-}
-
-static int
-add_ginst (MonoProfiler *prof, MonoGenericInst *inst)
-{
-	int i, id;
-	int *ids;
-
-	// FIXME: Cache
-	ids = g_malloc0 (inst->type_argc * sizeof (int));
-	for (i = 0; i < inst->type_argc; ++i) {
-		MonoType *t = inst->type_argv [i];
-		ids [i] = add_type (prof, t);
-		if (ids [i] == -1) {
-			g_free (ids);
-			return -1;
-		}
-	}
-	id = prof->id ++;
-	emit_record (prof, AOTPROF_RECORD_GINST, id);
-	emit_int32 (prof, inst->type_argc);
-	for (i = 0; i < inst->type_argc; ++i)
-		emit_int32 (prof, ids [i]);
-	g_free (ids);
-
-	return id;
-}
-
-static int
-add_class (MonoProfiler *prof, MonoClass *klass)
+add_method_counts (MonoProfiler *prof, MonoMethod *m, int id)
 {
-	int id, inst_id = -1, image_id;
-	char *name;
-
-	id = GPOINTER_TO_INT (g_hash_table_lookup (prof->classes, klass));
-	if (id)
-		return id - 1;
-
-	image_id = add_image (prof, klass->image);
-
-	if (mono_class_is_ginst (klass)) {
-		MonoGenericContext *ctx = mono_class_get_context (klass);
-		inst_id = add_ginst (prof, ctx->class_inst);
-		if (inst_id == -1)
-			return -1;
+	guint32 *entries;
+	int i, n, calls = 0;
+
+	g_array_set_size (prof->counts, 0);
+	mono_profiler_get_coverage_data (prof->handle, m, add_coverage_entry);
+
+	entries = (guint32*)prof->counts->data;
+	n = prof->counts->len / 2;
+	/* The number of calls is approximated by the execution count of the first IL instruction */
+	for (i = 0; i < n; ++i) {
+		if (entries [i * 2] == 0)
+			calls = entries [i * 2 + 1];
 	}
 
-	if (klass->nested_in)
-		name = g_strdup_printf ("%s.%s/%s", klass->nested_in->name_space, klass->nested_in->name, klass->name);
-	else
-		name = g_strdup_printf ("%s.%s", klass->name_space, klass->name);
-
-	id = prof->id ++;
-	emit_record (prof, AOTPROF_RECORD_TYPE, id);
-	emit_byte (prof, MONO_TYPE_CLASS);
-	emit_int32 (prof, image_id);
-	emit_int32 (prof, inst_id);
-	emit_string (prof, name);
-	g_free (name);
-	g_hash_table_insert (prof->classes, klass, GINT_TO_POINTER (id + 1));
-	return id;
-}
-
-static void
-add_method (MonoProfiler *prof, MonoMethod *m)
-{
-	MonoError error;
-	MonoMethodSignature *sig;
-	char *s;
-
-	sig = mono_method_signature_checked (m, &error);
-	g_assert (mono_error_ok (&error));
-
-	int class_id = add_class (prof, m->klass);
-	if (class_id == -1)
-		return;
-	int inst_id = -1;
-
-	if (m->is_inflated) {
-		MonoGenericContext *ctx = mono_method_get_context (m);
-		if (ctx->method_inst)
-			inst_id = add_ginst (prof, ctx->method_inst);
+	mono_aot_profile_writer_emit_record (&prof->writer, AOTPROF_RECORD_METHOD_COUNTS, id);
+	mono_aot_profile_writer_emit_int32 (&prof->writer, calls);
+	mono_aot_profile_writer_emit_int32 (&prof->writer, n);
+	for (i = 0; i < n; ++i) {
+		mono_aot_profile_writer_emit_int32 (&prof->writer, entries [i * 2]);
+		mono_aot_profile_writer_emit_int32 (&prof->writer, entries [i * 2 + 1]);
 	}
-	int id = prof->id ++;
-	emit_record (prof, AOTPROF_RECORD_METHOD, id);
-	emit_int32 (prof, class_id);
-	emit_int32 (prof, inst_id);
-	emit_int32 (prof, sig->param_count);
-	emit_string (prof, m->name);
-	s = mono_signature_full_name (sig);
-	emit_string (prof, s);
-	g_free (s);
-	if (verbose)
-		printf ("%s %d\n", mono_method_full_name (m, 1), id);
 }
 
 /* called at the end of the program */
@@ -360,7 +237,6 @@ prof_shutdown (MonoProfiler *prof)
 {
 	FILE *outfile;
 	int mindex;
-	char magic [32];
 
 	printf ("Creating output file: %s\n", prof->outfile_name);
 
@@ -374,12 +250,8 @@ prof_shutdown (MonoProfiler *prof)
 		fprintf (stderr, "Unable to create output file '%s': %s.\n", prof->outfile_name, strerror (errno));
 		return;
 	}
-	prof->outfile = outfile;
-
-	gint32 version = (AOT_PROFILER_MAJOR_VERSION << 16) | AOT_PROFILER_MINOR_VERSION;
-	sprintf (magic, AOT_PROFILER_MAGIC);
-	fwrite (magic, strlen (magic), 1, outfile);
-	emit_int32 (prof, version);
+	mono_aot_profile_writer_init (&prof->writer, outfile, 0);
+	mono_aot_profile_writer_emit_header (&prof->writer);
 
 	GHashTable *all_methods = g_hash_table_new (NULL, NULL);
 	for (mindex = 0; mindex < prof->methods->len; ++mindex) {
@@ -392,15 +264,19 @@ prof_shutdown (MonoProfiler *prof)
 			continue;
 		g_hash_table_insert (all_methods, m, m);
 
-		add_method (prof, m);
+		int id = mono_aot_profile_writer_add_method (&prof->writer, m);
+		if (id != -1 && verbose)
+			printf ("%s %d\n", mono_method_full_name (m, 1), id);
+		if (id != -1 && record_counts)
+			add_method_counts (prof, m, id);
 	}
-	emit_record (prof, AOTPROF_RECORD_NONE, 0);
+	mono_aot_profile_writer_finish (&prof->writer);
 
 	fclose (outfile);
 
 	g_hash_table_destroy (all_methods);
-	g_hash_table_destroy (prof->classes);
-	g_hash_table_destroy (prof->images);
 	g_ptr_array_free (prof->methods, TRUE);
+	if (prof->counts)
+		g_array_free (prof->counts, TRUE);
 	g_free (prof->outfile_name);
 }
@@ -15,6 +15,10 @@
  * Encoding rules:
  * - int - 4 bytes little endian
  * - string - int length followed by data
+ * Method counts records (since 1.1) follow the method record they refer to, their id
+ * is the id of the method record. The data is the number of calls, followed by the number
+ * of IL offsets which were executed, followed by IL offset/execution count pairs.
+ * Readers should accept files with the same major version and a lower minor version.
  */
 
 typedef enum {
@@ -22,12 +26,13 @@ typedef enum {
 	AOTPROF_RECORD_IMAGE,
 	AOTPROF_RECORD_TYPE,
 	AOTPROF_RECORD_GINST,
-	AOTPROF_RECORD_METHOD
+	AOTPROF_RECORD_METHOD,
+	AOTPROF_RECORD_METHOD_COUNTS
 } AotProfRecordType;
 
 #define AOT_PROFILER_MAGIC "AOTPROFILE"
 
 #define AOT_PROFILER_MAJOR_VERSION 1
-#define AOT_PROFILER_MINOR_VERSION 0
+#define AOT_PROFILER_MINOR_VERSION 1
 
 #endif /* __MONO_PROFILER_AOT_H__ */
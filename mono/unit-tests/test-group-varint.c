@@ -0,0 +1,155 @@
+/*
+ * test-group-varint.c: Unit test and decode benchmark for the group varint
+ * encoding used by the AOT file format.
+ *
+ * Licensed under the MIT license. See LICENSE file in the project root for full license information.
+ */
+
+#include "config.h"
+
+#include "utils/mono-group-varint.h"
+#include "utils/mono-time.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define NVALUES		(64 * 1024)
+#define ITERATIONS	200
+
+/* The metadata style encoding the AOT tables used before, see encode_value () in aot-compiler.c */
+static void
+encode_value (gint32 value, guint8 *buf, guint8 **endbuf)
+{
+	guint8 *p = buf;
+
+	if ((value >= 0) && (value <= 127))
+		*p++ = value;
+	else if ((value >= 0) && (value <= 16383)) {
+		p [0] = 0x80 | (value >> 8);
+		p [1] = value & 0xff;
+		p += 2;
+	} else if ((value >= 0) && (value <= 0x1fffffff)) {
+		p [0] = (value >> 24) | 0xc0;
+		p [1] = (value >> 16) & 0xff;
+		p [2] = (value >> 8) & 0xff;
+		p [3] = value & 0xff;
+		p += 4;
+	} else {
+		p [0] = 0xff;
+		p [1] = (value >> 24) & 0xff;
+		p [2] = (value >> 16) & 0xff;
+		p [3] = (value >> 8) & 0xff;
+		p [4] = value & 0xff;
+		p += 5;
+	}
+	*endbuf = p;
+}
+
+static gint32
+decode_value (guint8 *ptr, guint8 **rptr)
+{
+	guint8 b = *ptr;
+	gint32 len;
+
+	if ((b & 0x80) == 0) {
+		len = b;
+		++ptr;
+	} else if ((b & 0x40) == 0) {
+		len = ((b & 0x3f) << 8 | ptr [1]);
+		ptr += 2;
+	} else if (b != 0xff) {
+		len = ((b & 0x1f) << 24) | (ptr [1] << 16) | (ptr [2] << 8) | ptr [3];
+		ptr += 4;
+	} else {
+		len = (ptr [1] << 24) | (ptr [2] << 16) | (ptr [3] << 8) | ptr [4];
+		ptr += 5;
+	}
+	*rptr = ptr;
+	return len;
+}
+
+/* Mostly small differences, some negative, like the offset tables and line numbers */
+static gint32
+random_delta (void)
+{
+	int r = random () % 100;
+
+	if (r < 70)
+		return random () % 128;
+	if (r < 85)
+		return -(random () % 64);
+	if (r < 98)
+		return random () % 16384;
+	return random ();
+}
+
+int
+main (void)
+{
+	gint32 *deltas = (gint32 *)malloc (NVALUES * sizeof (gint32));
+	guint32 *values = (guint32 *)malloc (NVALUES * sizeof (guint32));
+	guint32 *decoded = (guint32 *)malloc (NVALUES * sizeof (guint32));
+	guint8 *group_buf = (guint8 *)malloc (NVALUES * 5);
+	guint8 *varint_buf = (guint8 *)malloc (NVALUES * 5);
+	guint8 *p, *end;
+	gint64 start, group_time, varint_time;
+	gint64 sum = 0;
+	int i, n, iter;
+
+	srandom (time (NULL));
+
+	for (i = 0; i < NVALUES; ++i) {
+		deltas [i] = random_delta ();
+		values [i] = mono_zigzag_encode (deltas [i]);
+	}
+
+	/* Round trip, including prefixes which end inside a group */
+	for (n = 0; n <= 9; ++n) {
+		mono_group_varint_encode (values, n, group_buf, &end);
+		p = mono_group_varint_decode (group_buf, n, decoded);
+		assert (p == end);
+		assert (!memcmp (values, decoded, n * sizeof (guint32)));
+	}
+	mono_group_varint_encode (values, NVALUES, group_buf, &end);
+	p = mono_group_varint_decode (group_buf, NVALUES, decoded);
+	assert (p == end);
+	for (i = 0; i < NVALUES; ++i)
+		assert (mono_zigzag_decode (decoded [i]) == deltas [i]);
+	printf ("group varint: %d bytes\n", (int)(end - group_buf));
+
+	p = varint_buf;
+	for (i = 0; i < NVALUES; ++i)
+		encode_value (deltas [i], p, &p);
+	printf ("encode_value: %d bytes\n", (int)(p - varint_buf));
+
+	/* Decode benchmark */
+	start = mono_100ns_ticks ();
+	for (iter = 0; iter < ITERATIONS; ++iter) {
+		mono_group_varint_decode (group_buf, NVALUES, decoded);
+		for (i = 0; i < NVALUES; ++i)
+			sum += mono_zigzag_decode (decoded [i]);
+	}
+	group_time = mono_100ns_ticks () - start;
+
+	start = mono_100ns_ticks ();
+	for (iter = 0; iter < ITERATIONS; ++iter) {
+		p = varint_buf;
+		for (i = 0; i < NVALUES; ++i)
+			sum -= decode_value (p, &p);
+	}
+	varint_time = mono_100ns_ticks () - start;
+
+	assert (sum == 0);
+	printf ("decode %d values x %d: group varint %.2f ms, encode_value %.2f ms\n", NVALUES, ITERATIONS,
+			group_time / 10000.0, varint_time / 10000.0);
+
+	free (deltas);
+	free (values);
+	free (decoded);
+	free (group_buf);
+	free (varint_buf);
+	return 0;
+}
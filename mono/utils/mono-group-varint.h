@@ -0,0 +1,107 @@
+/**
+ * \file
+ * Group varint encoding of runs of integers, used by the AOT file format.
+ *
+ * The values are encoded in groups of four. Each group starts with a control
+ * byte holding the length - 1 of each value in two bits, followed by the low
+ * order bytes of the values. Unlike with the metadata style encoding, the
+ * lengths of four values are known after reading one byte, so the decoder
+ * doesn't have to test every byte, and the format can be decoded using a byte
+ * shuffle on SIMD hardware.
+ */
+
+#ifndef __MONO_GROUP_VARINT_H__
+#define __MONO_GROUP_VARINT_H__
+
+#include <glib.h>
+
+/*
+ * mono_group_varint_encode:
+ *
+ *   Encode the N values in VALUES into BUF, setting ENDBUF to the position after them.
+ * BUF needs room for N * 4 + (N + 3) / 4 bytes.
+ */
+static inline void
+mono_group_varint_encode (const guint32 *values, int n, guint8 *buf, guint8 **endbuf)
+{
+	guint8 *p = buf;
+	int i, j, k;
+
+	for (i = 0; i < n; i += 4) {
+		guint8 *ctrl = p ++;
+
+		*ctrl = 0;
+		for (j = 0; j < 4 && i + j < n; ++j) {
+			guint32 value = values [i + j];
+			int len;
+
+			if (value <= 0xff)
+				len = 1;
+			else if (value <= 0xffff)
+				len = 2;
+			else if (value <= 0xffffff)
+				len = 3;
+			else
+				len = 4;
+			*ctrl |= (len - 1) << (j * 2);
+			for (k = 0; k < len; ++k)
+				*p++ = (value >> (k * 8)) & 0xff;
+		}
+	}
+	*endbuf = p;
+}
+
+/*
+ * mono_group_varint_decode:
+ *
+ *   Decode N values encoded by mono_group_varint_encode () into VALUES.
+ * Return the position after the values.
+ */
+static inline guint8*
+mono_group_varint_decode (guint8 *ptr, int n, guint32 *values)
+{
+	guint8 *p = ptr;
+	int i, j;
+
+	for (i = 0; i < n; i += 4) {
+		guint32 ctrl = *p++;
+
+		for (j = 0; j < 4 && i + j < n; ++j) {
+			guint32 value = 0;
+			int len = ((ctrl >> (j * 2)) & 3) + 1;
+
+			switch (len) {
+			case 4:
+				value |= (guint32)p [3] << 24;
+				/* fall through */
+			case 3:
+				value |= (guint32)p [2] << 16;
+				/* fall through */
+			case 2:
+				value |= (guint32)p [1] << 8;
+				/* fall through */
+			case 1:
+				value |= p [0];
+				break;
+			}
+			values [i + j] = value;
+			p += len;
+		}
+	}
+	return p;
+}
+
+/* Map small negative values to small unsigned values, so differences stay short */
+static inline guint32
+mono_zigzag_encode (gint32 value)
+{
+	return ((guint32)value << 1) ^ (guint32)(value >> 31);
+}
+
+static inline gint32
+mono_zigzag_decode (guint32 value)
+{
+	return (gint32)(value >> 1) ^ -(gint32)(value & 1);
+}
+
+#endif /* __MONO_GROUP_VARINT_H__ */